@@ -44,11 +44,42 @@
 
 #define COAP_CLIENT_HOST_BUF_LEN  128                                           /**< Buffer length for host addresses */
 #define COAP_CLIENT_PORT_BUF_LEN  8                                             /**< Buffer length for port numbers */
+#define COAP_CLIENT_DEF_NSTART    8                                             /**< Default maximum number of concurrent asynchronous exchanges */
 
 /**
- *  @brief Client structure
+ *  @brief Asynchronous exchange state enumeration
+ */
+typedef enum
+{
+    COAP_CLIENT_ASYNC_IDLE = 0,                                                 /**< No asynchronous exchange in progress */
+    COAP_CLIENT_ASYNC_ACK = 1,                                                  /**< Waiting for an acknowledgement to a confirmable request */
+    COAP_CLIENT_ASYNC_SEP = 2,                                                  /**< Waiting for a separate response to a confirmable request */
+    COAP_CLIENT_ASYNC_RESP = 3                                                  /**< Waiting for a response to a non-confirmable request */
+}
+coap_client_async_t;
+
+struct coap_client;
+
+/**
+ *  @brief Asynchronous exchange structure
  */
 typedef struct
+{
+    coap_client_async_t state;                                                  /**< State of the exchange */
+    coap_msg_t req;                                                             /**< Request message of the exchange */
+    struct timespec timeout;                                                    /**< Current timeout interval */
+    struct timespec expiry;                                                     /**< Absolute time that the timeout expires */
+    struct timespec start;                                                      /**< Time that the request was first transmitted */
+    unsigned num_retrans;                                                       /**< Current number of retransmissions */
+    void (* done)(struct coap_client *, coap_msg_t *, int, void *);             /**< Call-back function to deliver the result of the exchange */
+    void *data;                                                                 /**< Pointer passed unmodified to the call-back function */
+}
+coap_client_exch_t;
+
+/**
+ *  @brief Client structure
+ */
+typedef struct coap_client
 {
     int sd;                                                                     /**< Socket descriptor */
     int timer_fd;                                                               /**< Timer file descriptor */
@@ -58,6 +89,16 @@ typedef struct
     socklen_t server_sin_len;                                                   /**< IPv6 socket structure length */
     char server_host[COAP_CLIENT_HOST_BUF_LEN];                                 /**< String to hold the server host address */
     char server_port[COAP_CLIENT_PORT_BUF_LEN];                                 /**< String to hold the server port number */
+    coap_client_exch_t *exch;                                                   /**< Hash table of asynchronous exchange structures indexed by token */
+    unsigned nstart;                                                            /**< Maximum number of concurrent asynchronous exchanges */
+    coap_mem_acct_t mem;                                                        /**< Byte counters and optional budget for the client's allocations */
+    int adaptive_rto;                                                           /**< Flag to indicate that the retransmission timeout is estimated from round trip time measurements */
+    unsigned rto_msec;                                                          /**< Overall retransmission timeout estimate (msec) */
+    unsigned srtt_strong_msec;                                                  /**< Strong smoothed round trip time estimate (msec) */
+    unsigned rttvar_strong_msec;                                                /**< Strong round trip time variation estimate (msec) */
+    unsigned srtt_weak_msec;                                                    /**< Weak smoothed round trip time estimate (msec) */
+    unsigned rttvar_weak_msec;                                                  /**< Weak round trip time variation estimate (msec) */
+    struct timespec req_start;                                                  /**< Time that the current blocking request was first transmitted */
 #ifdef COAP_DTLS_EN
     gnutls_session_t session;                                                   /**< DTLS session */
     gnutls_certificate_credentials_t cred;                                      /**< DTLS credentials */
@@ -91,6 +132,43 @@ int coap_client_create(coap_client_t *client,
                        const char *trust_file_name,
                        const char *crl_file_name);
 
+/**
+ *  @brief Save the DTLS session data to a file
+ *
+ *  The session data of the most recently established DTLS
+ *  session is retained by the library and reused to attempt
+ *  an abbreviated handshake when a new client connects to
+ *  the same server. This function writes the retained
+ *  session data to a file so that it survives a restart;
+ *  coap_client_load_sess reads it back before the client
+ *  is created.
+ *
+ *  @param[in] file_name String containing the file name
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -EAGAIN No session data available
+ *  @retval <0 Error
+ */
+int coap_client_save_sess(const char *file_name);
+
+/**
+ *  @brief Load the DTLS session data from a file
+ *
+ *  Read session data previously written by
+ *  coap_client_save_sess so that the next client created
+ *  for the same server attempts an abbreviated handshake.
+ *  If the server declines resumption, a full handshake is
+ *  performed as normal.
+ *
+ *  @param[in] file_name String containing the file name
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_client_load_sess(const char *file_name);
+
 #else  /* !COAP_DTLS_EN */
 
 /**
@@ -134,4 +212,196 @@ void coap_client_destroy(coap_client_t *client);
  **/
 int coap_client_exchange(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp);
 
+/**
+ *  @brief Observe a resource on the server
+ *
+ *  Add an observe registration option to the request message,
+ *  exchange it with the server and pass the response and each
+ *  subsequent notification to the notify call-back function.
+ *  This function returns when the call-back function returns
+ *  a non-zero value or an error occurs. A deregistration
+ *  request is exchanged with the server before this function
+ *  returns if the call-back function returned a positive value.
+ *
+ *  The request message should contain the URI path of the
+ *  resource but no observe option. This function sets the
+ *  message ID and token fields of the request message and
+ *  adds an observe option to it, overriding any values set
+ *  by the calling function.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *  @param[in] notify Call-back function to handle the response and notifications
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ **/
+int coap_client_observe(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, int (* notify)(coap_client_t *, coap_msg_t *));
+
+/**
+ *  @brief Exchange a request and response with the server using blockwise transfers
+ *
+ *  Send the first send_len bytes of the body buffer to the
+ *  server as the body of the request, block1_size bytes at a
+ *  time, and assemble the body of the response into the body
+ *  buffer, up to block2_size bytes at a time. The request
+ *  message should contain the type, code and options of the
+ *  request but no payload or block options. The response
+ *  message contains the first response received from the
+ *  server for the final request block.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *  @param[in] block1_size Block size used to send the request body
+ *  @param[in] block2_size Maximum block size accepted in the response body
+ *  @param[in,out] body Pointer to a buffer containing the request body and to contain the response body
+ *  @param[in] body_len Length of the buffer
+ *  @param[in] send_len Length of the request body, zero if the request has no body
+ *
+ *  @returns Length of the response body or error code
+ *  @retval >=0 Length of the response body
+ *  @retval <0 Error
+ **/
+ssize_t coap_client_exchange_blockwise(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, unsigned block1_size, unsigned block2_size, char *body, size_t body_len, size_t send_len);
+
+/**
+ *  @brief Send a batch of non-confirmable requests without waiting for responses
+ *
+ *  Format the messages and flush them to the server with a
+ *  single sendmmsg call, skipping the acknowledgement and
+ *  response machinery entirely, so that a telemetry batch
+ *  costs one system call instead of several per message.
+ *  Any responses sent by the server are not collected. This
+ *  function sets the message ID field of each request
+ *  message overriding any values set by the calling
+ *  function.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] msgs Array of request messages
+ *  @param[in] num Number of request messages
+ *
+ *  @returns Number of messages sent or error code
+ *  @retval >0 Number of messages sent
+ *  @retval <0 Error
+ **/
+int coap_client_send_non_batch(coap_client_t *client, coap_msg_t msgs[], unsigned num);
+
+/**
+ *  @brief Submit a request to the server without waiting for the response
+ *
+ *  Send the request and return immediately. Retransmissions,
+ *  timeouts and the response are handled by subsequent calls
+ *  to coap_client_process. The calling function should poll
+ *  the sd and timer_fd members of the client structure for
+ *  reading and call coap_client_process whenever either is
+ *  readable, so that a single event loop thread can drive
+ *  many clients. When the exchange completes, the call-back
+ *  function is invoked with the response message, a status
+ *  value of zero or a negative error code, and the data
+ *  pointer. The response message is only valid for the
+ *  duration of the call-back.
+ *
+ *  Up to nstart asynchronous exchanges per client can be in
+ *  progress at a time, so that a batch of requests can be
+ *  pipelined over one session and pay the round trip time
+ *  once. Responses are matched to requests by token. This
+ *  function sets the message ID and token fields of the
+ *  request message overriding any values set by the calling
+ *  function.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to the request message
+ *  @param[in] done Call-back function to deliver the result of the exchange
+ *  @param[in] data Pointer passed unmodified to the call-back function
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -EBUSY The maximum number of asynchronous exchanges are already in progress
+ *  @retval <0 Error
+ **/
+int coap_client_submit(coap_client_t *client, coap_msg_t *req, void (* done)(coap_client_t *, coap_msg_t *, int, void *), void *data);
+
+/**
+ *  @brief Set the maximum number of concurrent asynchronous exchanges
+ *
+ *  Replace the table of asynchronous exchange structures
+ *  with a table of the given size. The table can only be
+ *  resized while no asynchronous exchange is in progress.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] nstart Maximum number of concurrent asynchronous exchanges
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -EBUSY An asynchronous exchange is in progress
+ *  @retval <0 Error
+ **/
+int coap_client_set_nstart(coap_client_t *client, unsigned nstart);
+
+/**
+ *  @brief Set the memory budget for a client
+ *
+ *  Limit the total number of bytes the client may have
+ *  allocated at any one time for asynchronous exchange
+ *  state and messages. An allocation that would exceed
+ *  the budget fails gracefully. A budget of zero means
+ *  unlimited.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] budget Maximum number of bytes, zero means unlimited
+ */
+void coap_client_set_mem_budget(coap_client_t *client, size_t budget);
+
+/**
+ *  @brief Get a copy of the memory accounting counters from a client
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[out] acct Pointer to a memory accounting structure
+ */
+void coap_client_get_mem_acct(coap_client_t *client, coap_mem_acct_t *acct);
+
+/**
+ *  @brief Enable or disable the adaptive retransmission timeout
+ *
+ *  When the adaptive retransmission timeout is enabled, the
+ *  round trip time to the server is measured and the initial
+ *  retransmission timeout tracks the measured round trip
+ *  time instead of the constant ACK_TIMEOUT value from
+ *  RFC 7252, so that a lost datagram on a fast path is
+ *  recovered quickly. Enabling or disabling the adaptive
+ *  retransmission timeout discards any previous round trip
+ *  time measurements. The adaptive retransmission timeout
+ *  is enabled by default.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] enable Non-zero to enable the adaptive retransmission timeout
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ **/
+int coap_client_set_adaptive_rto(coap_client_t *client, int enable);
+
+/**
+ *  @brief Advance the asynchronous exchanges in progress
+ *
+ *  Handle a timer expiry or received messages without
+ *  blocking. Called by the event loop whenever the sd or
+ *  timer_fd member of the client structure is readable.
+ *  Completion of an exchange is reported via the call-back
+ *  function passed to coap_client_submit. Calling this
+ *  function when no asynchronous exchange is in progress
+ *  has no effect.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ **/
+int coap_client_process(coap_client_t *client);
+
 #endif
@@ -36,6 +36,10 @@
 
 #define COAP_LOG_DEF_LEVEL  COAP_LOG_ERROR                                      /**< Default log level */
 
+#ifndef COAP_LOG_MAX_LEVEL
+#define COAP_LOG_MAX_LEVEL  4                                                   /**< Compile-time maximum log level, log calls above this level compile to nothing, 0: error, 1: warning, 2: notice, 3: info, 4: debug */
+#endif
+
 /**
  *  @brief Log level
  */
@@ -66,6 +70,32 @@ void coap_log_set_level(coap_log_level_t level);
  */
 coap_log_level_t coap_log_get_level(void);
 
+/**
+ *  @brief Enable or disable asynchronous mode
+ *
+ *  In asynchronous mode, log messages are formatted into a
+ *  lock-free ring buffer and written to the output by a
+ *  background writer thread so that the calling thread does
+ *  not block on terminal or file I/O. Messages are dropped
+ *  when the ring buffer is full. When asynchronous mode is
+ *  disabled, any messages left in the ring buffer are written
+ *  to the output before this function returns.
+ *
+ *  @param[in] enable Flag to enable or disable asynchronous mode
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_log_set_async(int enable);
+
+/**
+ *  @brief Get the number of log messages dropped in asynchronous mode
+ *
+ *  @returns Number of dropped log messages
+ */
+unsigned long coap_log_get_num_dropped(void);
+
 /**
  *  @brief Log an error message
  *
@@ -106,4 +136,66 @@ void coap_log_info(const char *msg, ...);
  */
 void coap_log_debug(const char *msg, ...);
 
+/*  each log call is guarded by a macro so that the arguments
+ *  are only evaluated if the message would actually be logged,
+ *  calls above the compile-time maximum level are removed
+ *  entirely, error messages cannot be filtered
+ */
+
+#if COAP_LOG_MAX_LEVEL >= 1
+#define coap_log_warn(...)                                                      \
+do                                                                              \
+{                                                                               \
+    if (COAP_LOG_WARN <= coap_log_get_level())                                  \
+    {                                                                           \
+        (coap_log_warn)(__VA_ARGS__);                                           \
+    }                                                                           \
+}                                                                               \
+while (0)
+#else
+#define coap_log_warn(...)  ((void)0)
+#endif
+
+#if COAP_LOG_MAX_LEVEL >= 2
+#define coap_log_notice(...)                                                    \
+do                                                                              \
+{                                                                               \
+    if (COAP_LOG_NOTICE <= coap_log_get_level())                                \
+    {                                                                           \
+        (coap_log_notice)(__VA_ARGS__);                                         \
+    }                                                                           \
+}                                                                               \
+while (0)
+#else
+#define coap_log_notice(...)  ((void)0)
+#endif
+
+#if COAP_LOG_MAX_LEVEL >= 3
+#define coap_log_info(...)                                                      \
+do                                                                              \
+{                                                                               \
+    if (COAP_LOG_INFO <= coap_log_get_level())                                  \
+    {                                                                           \
+        (coap_log_info)(__VA_ARGS__);                                           \
+    }                                                                           \
+}                                                                               \
+while (0)
+#else
+#define coap_log_info(...)  ((void)0)
+#endif
+
+#if COAP_LOG_MAX_LEVEL >= 4
+#define coap_log_debug(...)                                                     \
+do                                                                              \
+{                                                                               \
+    if (COAP_LOG_DEBUG <= coap_log_get_level())                                 \
+    {                                                                           \
+        (coap_log_debug)(__VA_ARGS__);                                          \
+    }                                                                           \
+}                                                                               \
+while (0)
+#else
+#define coap_log_debug(...)  ((void)0)
+#endif
+
 #endif
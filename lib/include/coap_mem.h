@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file coap_mem.h
+ *
+ *  @brief Include file for the FreeCoAP memory accounting module
+ *
+ *  All dynamic allocations in the library pass through this module.
+ *  The underlying allocator is pluggable and defaults to malloc/free.
+ *  An allocation can be charged to an accounting structure which
+ *  maintains current and peak byte counters and an optional hard
+ *  budget; an allocation that would exceed the budget fails
+ *  gracefully by returning NULL.
+ */
+
+#ifndef COAP_MEM_H
+#define COAP_MEM_H
+
+#include <stddef.h>
+
+#define coap_mem_get_cur(acct)     ((acct)->cur)                                /**< Get the number of bytes currently allocated */
+#define coap_mem_get_peak(acct)    ((acct)->peak)                               /**< Get the peak number of bytes allocated */
+#define coap_mem_get_budget(acct)  ((acct)->budget)                             /**< Get the budget in bytes, zero means unlimited */
+#define coap_mem_get_fails(acct)   ((acct)->num_fails)                          /**< Get the number of allocations refused by the budget */
+
+/**
+ *  @brief Memory accounting structure
+ */
+typedef struct
+{
+    size_t cur;                                                                 /**< Number of bytes currently allocated */
+    size_t peak;                                                                /**< Peak number of bytes allocated */
+    size_t budget;                                                              /**< Maximum number of bytes that may be allocated, zero means unlimited */
+    unsigned long num_fails;                                                    /**< Number of allocations refused by the budget */
+}
+coap_mem_acct_t;
+
+/**
+ *  @brief Set the underlying allocator functions
+ *
+ *  Passing NULL for either function restores the default
+ *  malloc/free allocator. Must be called before any memory
+ *  is allocated and must not be changed while allocations
+ *  are outstanding.
+ *
+ *  @param[in] alloc_func Allocation function
+ *  @param[in] free_func Deallocation function
+ */
+void coap_mem_set_hooks(void *(*alloc_func)(size_t), void (*free_func)(void *));
+
+/**
+ *  @brief Initialise a memory accounting structure
+ *
+ *  @param[out] acct Pointer to a memory accounting structure
+ *  @param[in] budget Maximum number of bytes that may be allocated, zero means unlimited
+ */
+void coap_mem_acct_init(coap_mem_acct_t *acct, size_t budget);
+
+/**
+ *  @brief Allocate memory charged to an accounting structure
+ *
+ *  @param[in,out] acct Pointer to a memory accounting structure or NULL for unaccounted memory
+ *  @param[in] len Number of bytes to allocate
+ *
+ *  @returns Pointer to the allocated memory or NULL
+ */
+void *coap_mem_alloc(coap_mem_acct_t *acct, size_t len);
+
+/**
+ *  @brief Resize memory previously allocated by coap_mem_alloc
+ *
+ *  @param[in,out] acct Pointer to a memory accounting structure or NULL for unaccounted memory
+ *  @param[in] ptr Pointer to the memory to resize or NULL
+ *  @param[in] len New number of bytes
+ *
+ *  @returns Pointer to the resized memory or NULL
+ */
+void *coap_mem_realloc(coap_mem_acct_t *acct, void *ptr, size_t len);
+
+/**
+ *  @brief Duplicate a string charged to an accounting structure
+ *
+ *  @param[in,out] acct Pointer to a memory accounting structure or NULL for unaccounted memory
+ *  @param[in] str String to duplicate
+ *
+ *  @returns Pointer to the duplicated string or NULL
+ */
+char *coap_mem_strdup(coap_mem_acct_t *acct, const char *str);
+
+/**
+ *  @brief Free memory previously allocated by this module
+ *
+ *  The bytes are credited back to the accounting structure
+ *  that the allocation was charged to. Accepts NULL.
+ *
+ *  @param[in] ptr Pointer to the memory to free
+ */
+void coap_mem_free(void *ptr);
+
+#endif
@@ -36,6 +36,8 @@
 
 #include <stddef.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include "coap_mem.h"
 
 #define COAP_MSG_VER                           0x01                             /**< CoAP version */
 #define COAP_MSG_MAX_TOKEN_LEN                 8                                /**< Maximum token length */
@@ -48,6 +50,11 @@
 
 #define COAP_MSG_MAX_BUF_LEN                   1152                             /**< Maximum buffer length for header and payload */
 
+#define COAP_MSG_ARENA_BLOCK_LEN               512                              /**< Default allocation block length for a message arena */
+
+#define COAP_MSG_NUM_INLINE_OPS                8                                /**< Number of option structures stored directly in a message */
+#define COAP_MSG_OP_INLINE_VAL_LEN             16                               /**< Maximum length of an option value stored directly in an option structure */
+
 #define coap_msg_op_num_is_critical(num)       ((num) & 1)                      /**< Indicate if an option is critical */
 #define coap_msg_op_num_is_unsafe(num)         ((num) & 2)                      /**< Indicate if an option is unsafe to forward */
 #define coap_msg_op_num_no_cache_key(num)      ((num & 0x1e) == 0x1c)           /**< Indicate if an option is not part of the cache key */
@@ -71,8 +78,11 @@
 #define coap_msg_get_first_op(msg)             ((msg)->op_list.first)           /**< Get the first option from a message */
 #define coap_msg_get_payload(msg)              ((msg)->payload)                 /**< Get the payload from a message */
 #define coap_msg_get_payload_len(msg)          ((msg)->payload_len)             /**< Get the payload length from a message */
+#define coap_msg_set_mem_acct(msg, acct)       ((msg)->arena.mem = (acct))      /**< Charge the message's option allocations to an accounting structure */
+#define coap_msg_get_mem_acct(msg)             ((msg)->arena.mem)               /**< Get the accounting structure the message's allocations are charged to */
 #define coap_msg_is_empty(msg)                 (((msg)->code_class == 0) && ((msg)->code_detail == 0))
                                                                                 /**< Indicate if a message is empty */
+#define coap_msg_is_borrowed(msg)              ((msg)->borrowed)                /**< Indicate if a message borrows option values and payload from a caller-owned buffer */
 
 /**
  *  @brief Message type enumeration
@@ -119,7 +129,8 @@ typedef enum
     COAP_MSG_DELETED = 2,                                                       /**< Deleted success response */
     COAP_MSG_VALID = 3,                                                         /**< Valid success response */
     COAP_MSG_CHANGED = 4,                                                       /**< Changed success response */
-    COAP_MSG_CONTENT = 5                                                        /**< Content success response */
+    COAP_MSG_CONTENT = 5,                                                       /**< Content success response */
+    COAP_MSG_CONTINUE = 31                                                      /**< Continue success response */
 }
 coap_msg_success_t;
 
@@ -135,6 +146,7 @@ typedef enum
     COAP_MSG_NOT_FOUND = 4,                                                     /**< Not found client error */
     COAP_MSG_METHOD_NOT_ALLOWED = 5,                                            /**< Method not allowed client error */
     COAP_MSG_NOT_ACCEPTABLE = 6,                                                /**< Not acceptable client error */
+    COAP_MSG_REQ_ENT_INCOMPLETE = 8,                                            /**< Request entity incomplete client error */
     COAP_MSG_PRECOND_FAILED = 12,                                               /**< Precondition failed client error */
     COAP_MSG_REQ_ENT_TOO_LARGE = 13,                                            /**< Request entity too large client error */
     COAP_MSG_UNSUP_CONT_FMT = 15                                                /**< Unsupported content-format client error */
@@ -164,6 +176,7 @@ typedef enum
     COAP_MSG_URI_HOST = 3,                                                      /**< URI-Host option number */
     COAP_MSG_ETAG = 4,                                                          /**< Entity-Tag option number */
     COAP_MSG_IF_NONE_MATCH = 5,                                                 /**< If-None-Match option number */
+    COAP_MSG_OBSERVE = 6,                                                       /**< Observe option number */
     COAP_MSG_URI_PORT = 7,                                                      /**< URI-Port option number */
     COAP_MSG_LOCATION_PATH = 8,                                                 /**< Location-Path option number */
     COAP_MSG_URI_PATH = 11,                                                     /**< URI-Path option number */
@@ -172,12 +185,45 @@ typedef enum
     COAP_MSG_URI_QUERY = 15,                                                    /**< URI-Query option number */
     COAP_MSG_ACCEPT = 17,                                                       /**< Accept option number */
     COAP_MSG_LOCATION_QUERY = 20,                                               /**< Location-Query option number */
+    COAP_MSG_BLOCK2 = 23,                                                       /**< Block2 option number */
+    COAP_MSG_BLOCK1 = 27,                                                       /**< Block1 option number */
+    COAP_MSG_SIZE2 = 28,                                                        /**< Size2 option number */
     COAP_MSG_PROXY_URI = 35,                                                    /**< Proxy-URI option number */
     COAP_MSG_PROXY_SCHEME = 39,                                                 /**< Proxy-Scheme option number */
     COAP_MSG_SIZE1 = 60                                                         /**< Size1 option number */
 }
 coap_msg_op_num_t;
 
+/**
+ *  @brief Arena block structure
+ *
+ *  A single allocation that backs one or more options
+ *  belonging to the same message.
+ */
+typedef struct coap_msg_arena_block
+{
+    struct coap_msg_arena_block *next;                                          /**< Pointer to the next arena block structure in the chain */
+    size_t len;                                                                 /**< Length of the data buffer */
+    size_t used;                                                                /**< Number of bytes of the data buffer in use */
+    char *data;                                                                 /**< Pointer to the data buffer */
+}
+coap_msg_arena_block_t;
+
+/**
+ *  @brief Arena structure
+ *
+ *  Backs all of the options in a message from a chain of
+ *  reusable blocks so that the options can be released
+ *  together without walking a free list.
+ */
+typedef struct
+{
+    coap_msg_arena_block_t *first;                                              /**< Pointer to the first arena block structure in the chain */
+    coap_msg_arena_block_t *block;                                              /**< Pointer to the arena block structure currently used for allocations */
+    coap_mem_acct_t *mem;                                                       /**< Accounting structure that the message's allocations are charged to */
+}
+coap_msg_arena_t;
+
 /**
  *  @brief Option structure
  */
@@ -185,18 +231,29 @@ typedef struct coap_msg_op
 {
     unsigned num;                                                               /**< Option number */
     unsigned len;                                                               /**< Option length */
+    unsigned inline_val;                                                        /**< Indicates whether or not the value is stored in the in-struct buffer */
     char *val;                                                                  /**< Pointer to a buffer containing the option value */
+    char val_buf[COAP_MSG_OP_INLINE_VAL_LEN];                                   /**< In-struct buffer for small option values */
     struct coap_msg_op *next;                                                   /**< Pointer to the next option structure in the list */
 }
 coap_msg_op_t;
 
 /**
- *  @brief Option linked-list structure
+ *  @brief Option list structure
+ *
+ *  The options are stored in a contiguous, sorted array
+ *  so that iteration is a linear scan over memory. The
+ *  first and last pointers and the next pointers in the
+ *  option structures are maintained for iteration.
  */
 typedef struct
 {
     coap_msg_op_t *first;                                                       /**< Pointer to the first option structure in the list */
     coap_msg_op_t *last;                                                        /**< Pointer to the last option structure in the list */
+    coap_msg_op_t *ops;                                                         /**< Pointer to the array of option structures */
+    unsigned num;                                                               /**< Number of option structures in the array */
+    unsigned cap;                                                               /**< Number of option structures the array can hold */
+    coap_msg_op_t inline_ops[COAP_MSG_NUM_INLINE_OPS];                          /**< In-struct array for typical numbers of options */
 }
 coap_msg_op_list_t;
 
@@ -212,12 +269,171 @@ typedef struct
     unsigned code_detail;                                                       /**< Code detail */
     unsigned msg_id;                                                            /**< Message ID */
     char token[COAP_MSG_MAX_TOKEN_LEN];                                         /**< Token value */
+    coap_msg_arena_t arena;                                                     /**< Arena that backs the option list */
     coap_msg_op_list_t op_list;                                                 /**< Option list */
     char *payload;                                                              /**< Pointer to a buffer containing the payload */
     size_t payload_len;                                                         /**< Length of the payload */
+    unsigned borrowed;                                                          /**< Indicates whether or not option values and payload point into a caller-owned buffer */
+    unsigned payload_borrowed;                                                  /**< Indicates whether or not just the payload points into a caller-owned buffer */
+    unsigned strict;                                                            /**< Indicates whether or not options are validated against the descriptor table while parsing */
 }
 coap_msg_t;
 
+/**
+ *  @brief Option descriptor structure
+ *
+ *  Precomputed properties of a recognized option number.
+ */
+typedef struct
+{
+    unsigned recognized;                                                        /**< Indicates whether or not the option number is recognized */
+    unsigned critical;                                                          /**< Indicates whether or not the option is critical */
+    unsigned unsafe;                                                            /**< Indicates whether or not the option is unsafe to forward */
+    unsigned no_cache_key;                                                      /**< Indicates whether or not the option is excluded from the cache key */
+    unsigned repeatable;                                                        /**< Indicates whether or not the option may occur more than once in a message */
+    unsigned min_len;                                                           /**< Minimum length of the option value */
+    unsigned max_len;                                                           /**< Maximum length of the option value */
+}
+coap_msg_op_desc_t;
+
+/**
+ *  @brief Look up the descriptor for an option number
+ *
+ *  @param[in] num Option number
+ *
+ *  @returns Pointer to a descriptor structure
+ *
+ *  A descriptor with the recognized field set to zero is
+ *  returned for unrecognized option numbers.
+ */
+const coap_msg_op_desc_t *coap_msg_op_num_get_desc(unsigned num);
+
+/**
+ *  @brief Check an option number and length against the option descriptor table
+ *
+ *  Unrecognized option numbers pass the check so that
+ *  elective options can be ignored by the caller.
+ *
+ *  @param[in] num Option number
+ *  @param[in] len Option length
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_msg_op_num_check_len(unsigned num, unsigned len);
+
+/**
+ *  @brief Calculate the block size exponent for a block size
+ *
+ *  @param[in] size Block size in bytes
+ *
+ *  @returns Block size exponent or error code
+ *  @retval >=0 Block size exponent
+ *  @retval -EINVAL Invalid block size
+ */
+int coap_msg_op_calc_block_szx(unsigned size);
+
+/**
+ *  @brief Parse the value of a block1 or block2 option
+ *
+ *  @param[out] num Pointer to an unsigned to contain the block number
+ *  @param[out] more Pointer to an unsigned to contain the more flag
+ *  @param[out] size Pointer to an unsigned to contain the block size in bytes
+ *  @param[in] val Pointer to a buffer containing the option value
+ *  @param[in] len Length of the option value
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_msg_op_parse_block_val(unsigned *num, unsigned *more, unsigned *size, const char *val, unsigned len);
+
+/**
+ *  @brief Format the value of a block1 or block2 option
+ *
+ *  The block number, more flag and block size are encoded
+ *  in the smallest number of bytes that can represent them.
+ *
+ *  @param[out] val Pointer to a buffer to contain the option value
+ *  @param[in] len Length of the buffer
+ *  @param[in] num Block number
+ *  @param[in] more More flag
+ *  @param[in] size Block size in bytes
+ *
+ *  @returns Length of the option value or error code
+ *  @retval >=0 Length of the option value
+ *  @retval <0 Error
+ */
+ssize_t coap_msg_op_format_block_val(char *val, unsigned len, unsigned num, unsigned more, unsigned size);
+
+/**
+ *  @brief Parser state enumeration
+ */
+typedef enum
+{
+    COAP_MSG_PARSER_HDR = 0,                                                    /**< Parsing the fixed header */
+    COAP_MSG_PARSER_TOKEN,                                                      /**< Parsing the token */
+    COAP_MSG_PARSER_OPS,                                                        /**< Parsing the options */
+    COAP_MSG_PARSER_PAYLOAD,                                                    /**< Parsing the payload */
+    COAP_MSG_PARSER_DONE                                                        /**< Parsing complete */
+}
+coap_msg_parser_state_t;
+
+/**
+ *  @brief Resumable parser structure
+ *
+ *  Allows a message to be parsed from a sequence of
+ *  buffer fragments without assembling them into one
+ *  contiguous copy of the datagram. Only the element
+ *  that straddles a fragment boundary is staged.
+ */
+typedef struct
+{
+    coap_msg_t *msg;                                                            /**< Pointer to the message structure being populated */
+    coap_msg_parser_state_t state;                                              /**< Current parser state */
+    size_t total_len;                                                           /**< Total length of the message */
+    size_t consumed;                                                            /**< Number of bytes consumed so far */
+    size_t stage_len;                                                           /**< Number of bytes held in the staging buffer */
+    size_t payload_off;                                                         /**< Number of payload bytes received so far */
+    char stage[COAP_MSG_MAX_BUF_LEN];                                           /**< Staging buffer for elements that straddle fragments */
+}
+coap_msg_parser_t;
+
+#define coap_msg_parser_is_done(parser)        ((parser)->state == COAP_MSG_PARSER_DONE)
+                                                                                /**< Indicate if a parser has consumed a complete message */
+
+/**
+ *  @brief Initialise a resumable parser structure
+ *
+ *  The message structure is reset and populated as
+ *  fragments are fed to the parser. The total length of
+ *  the message must be known up front, e.g. from the
+ *  record layer that delivers the fragments.
+ *
+ *  @param[out] parser Pointer to a parser structure
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] total_len Total length of the message
+ */
+void coap_msg_parser_create(coap_msg_parser_t *parser, coap_msg_t *msg, size_t total_len);
+
+/**
+ *  @brief Feed a buffer fragment to a resumable parser
+ *
+ *  May be called repeatedly until the parser reports
+ *  completion. The message check is performed when the
+ *  final fragment is consumed.
+ *
+ *  @param[in,out] parser Pointer to a parser structure
+ *  @param[in] buf Pointer to a buffer containing part of the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Number of bytes consumed or error code
+ *  @retval >=0 Number of bytes consumed
+ *  @retval <0 Error
+ */
+ssize_t coap_msg_parser_feed(coap_msg_parser_t *parser, const char *buf, size_t len);
+
 /**
  *  @brief Check if option is recognized
  *
@@ -311,6 +527,43 @@ int coap_msg_parse_type_msg_id(char *buf, size_t len, unsigned *type, unsigned *
  */
 ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len);
 
+/**
+ *  @brief Parse a message without copying option values or payload
+ *
+ *  The option values and payload in the message structure
+ *  point into the buffer passed by the caller. The caller
+ *  must keep the buffer intact and unmodified until the
+ *  message structure is destroyed or reset.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+ssize_t coap_msg_parse_borrowed(coap_msg_t *msg, char *buf, size_t len);
+
+/**
+ *  @brief Parse a message, validating options against the descriptor table
+ *
+ *  In addition to the usual format checks, the length and
+ *  repeatability of every recognized option are checked
+ *  against the option descriptor table while parsing, so
+ *  malformed messages are rejected without a second walk
+ *  over the option list.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+ssize_t coap_msg_parse_strict(coap_msg_t *msg, char *buf, size_t len);
+
 /**
  *  @brief Set the type in a message
  *
@@ -393,6 +646,39 @@ int coap_msg_add_op(coap_msg_t *msg, unsigned num, unsigned len, const char *val
  */
 int coap_msg_set_payload(coap_msg_t *msg, char *buf, size_t len);
 
+/**
+ *  @brief Set the payload in a message without copying
+ *
+ *  The payload in the message structure points into the
+ *  buffer passed by the caller. The caller must keep the
+ *  buffer intact and unmodified until the message structure
+ *  is destroyed or reset. The buffer is not freed when the
+ *  message structure is destroyed or reset.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the payload
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_msg_borrow_payload(coap_msg_t *msg, char *buf, size_t len);
+
+/**
+ *  @brief Remove the payload from a message and pass ownership to the caller
+ *
+ *  The returned buffer was allocated by the message and must
+ *  be freed by the caller. NULL is returned if the message
+ *  has no payload or does not own its payload.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[out] len Length of the payload
+ *
+ *  @returns Pointer to the payload buffer or NULL
+ */
+char *coap_msg_detach_payload(coap_msg_t *msg, size_t *len);
+
 /**
  *  @brief Format a message
  *
@@ -406,6 +692,29 @@ int coap_msg_set_payload(coap_msg_t *msg, char *buf, size_t len);
  */
 ssize_t coap_msg_format(coap_msg_t *msg, char *buf, size_t len);
 
+/**
+ *  @brief Format a message as an iovec array
+ *
+ *  The iovec entries for option values and payload point
+ *  at the storage already held by the message structure,
+ *  so the caller can pass the array to sendmsg() without
+ *  assembling a flat copy of the message. The buffer
+ *  argument receives the fixed header, token, per-option
+ *  headers and payload marker and must remain intact
+ *  while the iovec array is in use.
+ *
+ *  @param[in] msg Pointer to a message structure
+ *  @param[out] iov Pointer to an array of iovec structures
+ *  @param[in] num_iov Number of iovec structures in the array
+ *  @param[out] buf Pointer to a buffer to contain the header bytes
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Number of iovec structures used or error code
+ *  @retval >0 Number of iovec structures used
+ *  @retval <0 Error
+ */
+ssize_t coap_msg_format_iov(coap_msg_t *msg, struct iovec *iov, unsigned num_iov, char *buf, size_t len);
+
 /**
  *  @brief Copy a message
  *
@@ -42,9 +42,13 @@
 #endif
 #include "coap_msg.h"
 
-#define COAP_SERVER_NUM_TRANS         8                                         /**< Maximum number of active transactions per server */
+#define COAP_SERVER_DEF_MAX_TRANS     8                                         /**< Default maximum number of active transactions per server */
+#define COAP_SERVER_NUM_ROUTE_BUCKETS 64                                        /**< Number of buckets in the route hash table */
+#define COAP_SERVER_NUM_WHEEL_SLOTS   64                                        /**< Number of slots in the retransmission timer wheel */
 #define COAP_SERVER_ADDR_BUF_LEN      128                                       /**< Buffer length for host addresses */
+#define COAP_SERVER_PORT_BUF_LEN      8                                         /**< Buffer length for port numbers */
 #define COAP_SERVER_DIAG_PAYLOAD_LEN  128                                       /**< Buffer length for diagnostic payloads */
+#define COAP_SERVER_NUM_LAT_BUCKETS   16                                        /**< Number of buckets in the request latency histogram */
 
 /**
  *  @brief Response type enumeration
@@ -78,24 +82,123 @@ coap_server_path_list_t;
 
 struct coap_server;
 
+/**
+ *  @brief Route structure
+ */
+typedef struct coap_server_route
+{
+    char *str;                                                                  /**< String containing the URI path of the resource */
+    int (* handle)(struct coap_server *, coap_msg_t *, coap_msg_t *);           /**< Call-back function to handle requests for the resource */
+    coap_server_resp_t resp_type;                                               /**< Response type required by the resource */
+    struct coap_server_route *next;                                             /**< Pointer to the next route structure in the same hash bucket */
+}
+coap_server_route_t;
+
+#ifdef COAP_DTLS_EN
+
+/**
+ *  @brief DTLS session cache entry structure
+ */
+typedef struct
+{
+    time_t last_use;                                                            /**< The time that this session cache entry was last used */
+    gnutls_datum_t key;                                                         /**< Session ID */
+    gnutls_datum_t data;                                                        /**< Serialised session data */
+}
+coap_server_sess_t;
+
+#endif
+
+/**
+ *  @brief Outgoing datagram structure
+ */
+typedef struct
+{
+    struct sockaddr_in6 client_sin;                                             /**< IPv6 socket structure of the destination client */
+    socklen_t client_sin_len;                                                   /**< IPv6 socket structure length */
+    size_t len;                                                                 /**< Length of the datagram */
+    char buf[COAP_MSG_MAX_BUF_LEN];                                             /**< Buffer containing the datagram */
+}
+coap_server_dgram_t;
+
+/**
+ *  @brief Response deduplication cache entry structure
+ */
+typedef struct
+{
+    time_t expiry;                                                              /**< The time that this entry expires */
+    struct sockaddr_in6 client_sin;                                             /**< IPv6 socket structure of the client */
+    socklen_t client_sin_len;                                                   /**< IPv6 socket structure length */
+    unsigned msg_id;                                                            /**< Message ID of the request */
+    size_t len;                                                                 /**< Length of the stored response, zero if the entry is empty */
+    char buf[COAP_MSG_MAX_BUF_LEN];                                             /**< Buffer containing the formatted response */
+}
+coap_server_dedup_t;
+
+/**
+ *  @brief Observer structure
+ */
+typedef struct
+{
+    int active;                                                                 /**< Flag to indicate that this observer entry is in use */
+    struct sockaddr_in6 client_sin;                                             /**< IPv6 socket structure of the observing client */
+    socklen_t client_sin_len;                                                   /**< IPv6 socket structure length */
+    char token[COAP_MSG_MAX_TOKEN_LEN];                                         /**< Token supplied by the client at registration */
+    size_t token_len;                                                           /**< Length of the token */
+    char uri_path[COAP_MSG_OP_URI_PATH_MAX_LEN];                                /**< URI path of the observed resource */
+    unsigned seq;                                                               /**< Sequence number carried in the last notification */
+}
+coap_server_obs_t;
+
+/**
+ *  @brief Runtime statistics structure
+ */
+typedef struct
+{
+    unsigned long long rx_dgrams;                                               /**< Number of datagrams received */
+    unsigned long long tx_dgrams;                                               /**< Number of datagrams sent or queued for sending */
+    unsigned long long retrans;                                                 /**< Number of response retransmissions */
+    unsigned long long dedup_hits;                                              /**< Number of duplicate requests answered without invoking the handler */
+    unsigned long long handshakes;                                              /**< Number of completed DTLS handshakes, always zero without DTLS */
+    unsigned long long num_reqs;                                                /**< Number of requests that produced a response */
+    unsigned num_trans;                                                         /**< Current number of active transactions */
+    unsigned max_trans;                                                         /**< Maximum number of active transactions */
+    unsigned long long lat_hist[COAP_SERVER_NUM_LAT_BUCKETS];                   /**< Request latency histogram, bucket i counts requests serviced in [2^i, 2^(i+1)) usec */
+}
+coap_server_stats_t;
+
 /**
  *  @brief Transaction structure
  */
 typedef struct coap_server_trans
 {
-    int active;                                                                 /**< Flag to indicate if this transaction structure contains valid data */
     time_t last_use;                                                            /**< The time that this transaction structure was last used */
-    int timer_fd;                                                               /**< Timer file descriptor */
     struct timespec timeout;                                                    /**< Timeout value */
     unsigned num_retrans;                                                       /**< Current number of retransmissions */
+    struct coap_server_trans *timer_next;                                       /**< Pointer to the next transaction in the same timer wheel slot */
+    struct coap_server_trans *timer_prev;                                       /**< Pointer to the previous transaction in the same timer wheel slot */
+    unsigned timer_slot;                                                        /**< Timer wheel slot that the timer is linked into */
+    unsigned timer_rounds;                                                      /**< Remaining timer wheel revolutions before the timer expires */
+    int timer_armed;                                                            /**< Flag to indicate that the timer is linked into the timer wheel */
     struct sockaddr_in6 client_sin;                                             /**< IPv6 socket structure */
     socklen_t client_sin_len;                                                   /**< IPv6 socket structure length */
     char client_addr[COAP_SERVER_ADDR_BUF_LEN];                                 /**< String to hold the client address */
+    char recv_buf[COAP_MSG_MAX_BUF_LEN];                                        /**< Buffer to hold a datagram read from the shared socket for this transaction */
+    size_t recv_buf_len;                                                        /**< Length of the datagram in the receive buffer, zero if the buffer is empty */
+    char *body;                                                                 /**< Buffer used to assemble or serve the body of a blockwise transfer */
+    size_t body_alloc;                                                          /**< Allocated length of the blockwise body buffer */
+    size_t body_len;                                                            /**< Number of bytes of body assembled or cached */
+    int body_resp;                                                              /**< Flag to indicate that the body buffer holds a cached response */
+    unsigned body_code_class;                                                   /**< Code class of the cached blockwise response */
+    unsigned body_code_detail;                                                  /**< Code detail of the cached blockwise response */
+    char body_uri_path[COAP_MSG_OP_URI_PATH_MAX_LEN];                           /**< URI path of the resource involved in the blockwise transfer */
     coap_msg_t req;                                                             /**< Last request message received for this transaction */
     coap_msg_t resp;                                                            /**< Last response message sent for this transaction */
     struct coap_server *server;                                                 /**< Pointer to the containing server structure */
+    struct coap_server_trans *next;                                             /**< Pointer to the next transaction structure in the same hash bucket */
 #ifdef COAP_DTLS_EN
     gnutls_session_t session;                                                   /**< DTLS session */
+    int handshaking;                                                            /**< Flag to indicate that the DTLS handshake is still in progress */
 #endif
 }
 coap_server_trans_t;
@@ -106,14 +209,39 @@ coap_server_trans_t;
 typedef struct coap_server
 {
     int sd;                                                                     /**< Socket descriptor */
+    int epfd;                                                                   /**< epoll instance descriptor */
     unsigned msg_id;                                                            /**< Last message ID value used in a response message */
     coap_server_path_list_t sep_list;                                           /**< List of URI paths that require separate responses */
-    coap_server_trans_t trans[COAP_SERVER_NUM_TRANS];                           /**< Array of transaction structures */
+    coap_server_route_t *routes[COAP_SERVER_NUM_ROUTE_BUCKETS];                 /**< Hash table of route structures indexed by URI path */
+    coap_server_trans_t **trans;                                                /**< Hash table of transaction structures indexed by client address and port */
+    unsigned num_buckets;                                                       /**< Number of buckets in the transaction hash table */
+    unsigned num_trans;                                                         /**< Current number of active transactions */
+    unsigned max_trans;                                                         /**< Maximum number of active transactions */
+    coap_server_dedup_t *dedup;                                                 /**< Ring buffer of responses kept to answer retransmitted requests */
+    unsigned dedup_len;                                                         /**< Number of entries in the deduplication ring buffer */
+    unsigned dedup_next;                                                        /**< Index of the next deduplication ring buffer entry to overwrite */
+    coap_server_obs_t *obs;                                                     /**< Array of observer structures */
+    unsigned obs_len;                                                           /**< Number of entries in the observer array */
+    coap_server_dgram_t *send_queue;                                            /**< Queue of response datagrams awaiting a batched send */
+    unsigned num_queued;                                                        /**< Number of response datagrams in the send queue */
+    int batching;                                                               /**< Flag to indicate that a batch of messages is being processed */
+    coap_server_stats_t stats;                                                  /**< Runtime statistics */
+    coap_mem_acct_t mem;                                                        /**< Byte counters and optional budget for the server's allocations */
+    coap_server_trans_t *wheel[COAP_SERVER_NUM_WHEEL_SLOTS];                    /**< Timer wheel slots, each a list of transactions with armed timers */
+    unsigned wheel_slot;                                                        /**< Timer wheel slot that will expire next */
+    unsigned num_armed;                                                         /**< Number of armed timers in the timer wheel */
+    int wheel_fd;                                                               /**< Timer descriptor that drives the timer wheel */
     int (* handle)(struct coap_server *, coap_msg_t *, coap_msg_t *);           /**< Call-back function to handle requests and generate responses */
+    char host[COAP_SERVER_ADDR_BUF_LEN];                                        /**< String containing the host address the server is bound to */
+    char port[COAP_SERVER_PORT_BUF_LEN];                                        /**< String containing the port number the server is bound to */
 #ifdef COAP_DTLS_EN
     gnutls_certificate_credentials_t cred;                                      /**< DTLS credentials */
     gnutls_priority_t priority;                                                 /**< DTLS priorities */
     gnutls_dh_params_t dh_params;                                               /**< Diffie-Hellman parameters */
+    gnutls_datum_t ticket_key;                                                  /**< Key used to protect DTLS session tickets */
+    coap_server_sess_t *sess_cache;                                             /**< Cache of DTLS sessions available for resumption, indexed by session ID */
+    unsigned sess_cache_len;                                                    /**< Number of entries in the DTLS session cache */
+    int shared_cred;                                                            /**< Flag to indicate that the DTLS credentials are shared with another worker */
 #endif
 }
 coap_server_t;
@@ -173,6 +301,96 @@ int coap_server_create(coap_server_t *server,
  */
 void coap_server_destroy(coap_server_t *server);
 
+/**
+ *  @brief Set the maximum number of active transactions
+ *
+ *  Resize the transaction hash table. If the new maximum is
+ *  less than the current number of active transactions then
+ *  the least recently used transactions are destroyed until
+ *  the new maximum is satisfied.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] max_trans Maximum number of active transactions
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_set_max_trans(coap_server_t *server, unsigned max_trans);
+
+/**
+ *  @brief Read the runtime statistics
+ *
+ *  Copy the current statistics into the structure supplied
+ *  by the caller. The counters continue to accumulate; they
+ *  are not reset by a read.
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[out] stats Pointer to a statistics structure
+ */
+void coap_server_get_stats(coap_server_t *server, coap_server_stats_t *stats);
+
+/**
+ *  @brief Set the memory budget for a server
+ *
+ *  Limit the total number of bytes the server may have
+ *  allocated at any one time for transactions, messages
+ *  and caches. An allocation that would exceed the budget
+ *  fails gracefully. A budget of zero means unlimited.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] budget Maximum number of bytes, zero means unlimited
+ */
+void coap_server_set_mem_budget(coap_server_t *server, size_t budget);
+
+/**
+ *  @brief Get a copy of the memory accounting counters from a server
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[out] acct Pointer to a memory accounting structure
+ */
+void coap_server_get_mem_acct(coap_server_t *server, coap_mem_acct_t *acct);
+
+#ifdef COAP_DTLS_EN
+
+/**
+ *  @brief Set the number of entries in the DTLS session cache
+ *
+ *  Resize the DTLS session cache. Cached sessions are dropped
+ *  by the resize. A length of zero disables the cache; session
+ *  tickets remain available for resumption.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] sess_cache_len Number of entries in the DTLS session cache
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_set_sess_cache_len(coap_server_t *server, unsigned sess_cache_len);
+
+/**
+ *  @brief Load Diffie-Hellman parameters from a PEM file
+ *
+ *  Import PKCS#3 encoded Diffie-Hellman parameters, generated
+ *  once at install time, e.g. with certtool --generate-dh-params,
+ *  and use them for every server created by this process.
+ *  Generating parameters at startup costs several seconds;
+ *  loading them costs milliseconds. This function must be
+ *  called before the first call to coap_server_create. If it
+ *  is not called then parameters are generated by the first
+ *  call to coap_server_create and reused by subsequent calls.
+ *
+ *  @param[in] file_name String containing the Diffie-Hellman parameters file name
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_load_dh_params(const char *file_name);
+
+#endif
+
 /**
  *  @brief Get a new message ID value
  *
@@ -194,6 +412,50 @@ unsigned coap_server_get_next_msg_id(coap_server_t *server);
  */ 
 int coap_server_add_sep_resp_uri_path(coap_server_t *server, const char *str);
 
+/**
+ *  @brief Register a handler for a URI path
+ *
+ *  Add a route to the route hash table. Requests for the
+ *  URI path are dispatched to the given call-back function
+ *  in constant time instead of the server-wide handle
+ *  call-back function, and the response type of the route
+ *  is used instead of consulting the separate response
+ *  URI path list.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] str String representation of a URI path
+ *  @param[in] handle Call-back function to handle requests for the resource
+ *  @param[in] resp_type Response type required by the resource
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_add_resource(coap_server_t *server,
+                             const char *str,
+                             int (* handle)(coap_server_t *, coap_msg_t *, coap_msg_t *),
+                             coap_server_resp_t resp_type);
+
+/**
+ *  @brief Notify the observers of a resource
+ *
+ *  Invoke the handler registered for the URI path once to
+ *  generate the current representation of the resource and
+ *  send it to every observer of the resource in a
+ *  non-confirmable notification message. The notifications
+ *  are batched into a single sendmmsg call. Clients register
+ *  as observers by including an observe option with value 0
+ *  in a GET request for the URI path.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] str String representation of a URI path
+ *
+ *  @returns Number of notifications sent or error code
+ *  @retval >=0 Number of notifications sent
+ *  @retval <0 Error
+ */
+int coap_server_notify(coap_server_t *server, const char *str);
+
 /**
  *  @brief Run the server
  *
@@ -209,4 +471,21 @@ int coap_server_add_sep_resp_uri_path(coap_server_t *server, const char *str);
  */
 int coap_server_run(coap_server_t *server);
 
+/**
+ *  @brief Run the server with a pool of worker threads
+ *
+ *  Each worker opens its own socket bound to the same address
+ *  and port with SO_REUSEPORT so that the kernel steers flows
+ *  across the workers, and owns its own transaction table and
+ *  message ID space. The calling thread runs one of the workers.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] num_workers Number of worker threads
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_run_workers(coap_server_t *server, unsigned num_workers);
+
 #endif
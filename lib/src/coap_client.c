@@ -31,6 +31,8 @@
  *  @brief Source file for the FreeCoAP client library
  */
 
+#define _GNU_SOURCE  /* for sendmmsg */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -39,6 +41,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
 #include <sys/select.h>
@@ -50,6 +53,13 @@
 #define COAP_CLIENT_MAX_RETRANSMIT    4                                         /**< Maximum number of times a confirmable message can be retransmitted */
 #define COAP_CLIENT_RESP_TIMEOUT_SEC  30                                        /**< Maximum amount of time to wait for a response */
 
+#define COAP_CLIENT_BATCH_SIZE        16                                        /**< Maximum number of datagrams to send per batch */
+
+#define COAP_CLIENT_RTO_INIT_MSEC     2000                                      /**< Initial retransmission timeout estimate */
+#define COAP_CLIENT_RTO_MIN_MSEC      100                                       /**< Lower bound on the retransmission timeout estimate */
+#define COAP_CLIENT_RTO_MAX_MSEC      32000                                     /**< Upper bound on the retransmission timeout estimate */
+#define COAP_CLIENT_WEAK_RTT_RETRANS  2                                         /**< Maximum number of retransmissions for which a weak round trip time measurement is taken */
+
 #ifdef COAP_DTLS_EN
 
 #define COAP_CLIENT_DTLS_MTU              COAP_MSG_MAX_BUF_LEN                  /**< Maximum transmission unit excluding the UDP and IPv6 headers */
@@ -67,6 +77,41 @@ static int rand_init = 0;
  *                                         coap_client_dtls                                         *
  ****************************************************************************************************/
 
+static pthread_mutex_t coap_client_sess_mutex = PTHREAD_MUTEX_INITIALIZER;      /**< Mutex to protect the saved DTLS session data from concurrent access */
+static char coap_client_sess_host[COAP_CLIENT_HOST_BUF_LEN] = {0};              /**< Host address of the server that the saved DTLS session data belongs to */
+static char coap_client_sess_port[COAP_CLIENT_PORT_BUF_LEN] = {0};              /**< Port number of the server that the saved DTLS session data belongs to */
+static gnutls_datum_t coap_client_sess_data = {0};                              /**< Saved DTLS session data used to attempt session resumption */
+
+/**
+ *  @brief Save the DTLS session data for later resumption
+ *
+ *  Export the session data (including any session ticket
+ *  issued by the server) from an established session and
+ *  retain it so that a subsequent connection to the same
+ *  server can attempt an abbreviated handshake.
+ *
+ *  @param[in] client Pointer to a client structure
+ */
+static void coap_client_dtls_save_sess(coap_client_t *client)
+{
+    gnutls_datum_t data = {0};
+    int ret = 0;
+
+    ret = gnutls_session_get_data2(client->session, &data);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_debug("Unable to save DTLS session data for host %s and port %s", client->server_host, client->server_port);
+        return;
+    }
+    pthread_mutex_lock(&coap_client_sess_mutex);
+    gnutls_free(coap_client_sess_data.data);
+    coap_client_sess_data = data;
+    memcpy(coap_client_sess_host, client->server_host, sizeof(coap_client_sess_host));
+    memcpy(coap_client_sess_port, client->server_port, sizeof(coap_client_sess_port));
+    pthread_mutex_unlock(&coap_client_sess_mutex);
+    coap_log_debug("Saved DTLS session data for host %s and port %s", client->server_host, client->server_port);
+}
+
 /**
  *  @brief Listen for a packet from the server with a timeout
  *
@@ -264,6 +309,7 @@ static int coap_client_dtls_create(coap_client_t *client,
                                    const char *trust_file_name,
                                    const char *crl_file_name)
 {
+    gnutls_datum_t sess_data = {0};
     int ret = 0;
 
     ret = gnutls_global_init();
@@ -352,6 +398,30 @@ static int coap_client_dtls_create(coap_client_t *client,
     gnutls_transport_set_push_function(client->session, coap_client_dtls_push_func);
     gnutls_dtls_set_mtu(client->session, COAP_CLIENT_DTLS_MTU);
     gnutls_dtls_set_timeouts(client->session, COAP_CLIENT_DTLS_RETRANS_TIMEOUT, COAP_CLIENT_DTLS_TOTAL_TIMEOUT);
+    /* copy the saved session data out under the lock, it may be */
+    /* freed and overwritten by a handshake in a concurrent thread */
+    pthread_mutex_lock(&coap_client_sess_mutex);
+    if ((coap_client_sess_data.size > 0)
+     && (strcmp(coap_client_sess_host, client->server_host) == 0)
+     && (strcmp(coap_client_sess_port, client->server_port) == 0))
+    {
+        sess_data.data = (unsigned char *)gnutls_malloc(coap_client_sess_data.size);
+        if (sess_data.data != NULL)
+        {
+            memcpy(sess_data.data, coap_client_sess_data.data, coap_client_sess_data.size);
+            sess_data.size = coap_client_sess_data.size;
+        }
+    }
+    pthread_mutex_unlock(&coap_client_sess_mutex);
+    if (sess_data.size > 0)
+    {
+        ret = gnutls_session_set_data(client->session, sess_data.data, sess_data.size);
+        if (ret == GNUTLS_E_SUCCESS)
+        {
+            coap_log_info("Attempting DTLS session resumption with host %s and port %s", client->server_host, client->server_port);
+        }
+        gnutls_free(sess_data.data);
+    }
     ret = coap_client_dtls_handshake(client);
     if (ret < 0)
     {
@@ -362,6 +432,11 @@ static int coap_client_dtls_create(coap_client_t *client,
         coap_log_warn("Failed to complete DTLS handshake");
         return ret;
     }
+    if (gnutls_session_is_resumed(client->session))
+    {
+        coap_log_info("Resumed DTLS session with host %s and port %s", client->server_host, client->server_port);
+    }
+    coap_client_dtls_save_sess(client);
     return 0;
 }
 
@@ -379,6 +454,98 @@ static void coap_client_dtls_destroy(coap_client_t *client)
     gnutls_global_deinit();
 }
 
+int coap_client_save_sess(const char *file_name)
+{
+    uint32_t size = 0;
+    FILE *file = NULL;
+    size_t num = 0;
+
+    if ((file_name == NULL) || (strlen(file_name) == 0))
+    {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&coap_client_sess_mutex);
+    if (coap_client_sess_data.size == 0)
+    {
+        pthread_mutex_unlock(&coap_client_sess_mutex);
+        return -EAGAIN;
+    }
+    file = fopen(file_name, "wb");
+    if (file == NULL)
+    {
+        pthread_mutex_unlock(&coap_client_sess_mutex);
+        return -errno;
+    }
+    size = coap_client_sess_data.size;
+    num = fwrite(coap_client_sess_host, sizeof(coap_client_sess_host), 1, file);
+    num += fwrite(coap_client_sess_port, sizeof(coap_client_sess_port), 1, file);
+    num += fwrite(&size, sizeof(size), 1, file);
+    num += fwrite(coap_client_sess_data.data, coap_client_sess_data.size, 1, file);
+    pthread_mutex_unlock(&coap_client_sess_mutex);
+    fclose(file);
+    if (num != 4)
+    {
+        return -EIO;
+    }
+    coap_log_notice("Saved DTLS session data to file '%s'", file_name);
+    return 0;
+}
+
+int coap_client_load_sess(const char *file_name)
+{
+    unsigned char *data = NULL;
+    uint32_t size = 0;
+    FILE *file = NULL;
+    size_t num = 0;
+
+    if ((file_name == NULL) || (strlen(file_name) == 0))
+    {
+        return -EINVAL;
+    }
+    file = fopen(file_name, "rb");
+    if (file == NULL)
+    {
+        return -errno;
+    }
+    pthread_mutex_lock(&coap_client_sess_mutex);
+    num = fread(coap_client_sess_host, sizeof(coap_client_sess_host), 1, file);
+    num += fread(coap_client_sess_port, sizeof(coap_client_sess_port), 1, file);
+    num += fread(&size, sizeof(size), 1, file);
+    if ((num != 3) || (size == 0))
+    {
+        fclose(file);
+        memset(coap_client_sess_host, 0, sizeof(coap_client_sess_host));
+        memset(coap_client_sess_port, 0, sizeof(coap_client_sess_port));
+        pthread_mutex_unlock(&coap_client_sess_mutex);
+        return -EINVAL;
+    }
+    data = (unsigned char *)gnutls_malloc(size);
+    if (data == NULL)
+    {
+        fclose(file);
+        memset(coap_client_sess_host, 0, sizeof(coap_client_sess_host));
+        memset(coap_client_sess_port, 0, sizeof(coap_client_sess_port));
+        pthread_mutex_unlock(&coap_client_sess_mutex);
+        return -ENOMEM;
+    }
+    num = fread(data, size, 1, file);
+    fclose(file);
+    if (num != 1)
+    {
+        gnutls_free(data);
+        memset(coap_client_sess_host, 0, sizeof(coap_client_sess_host));
+        memset(coap_client_sess_port, 0, sizeof(coap_client_sess_port));
+        pthread_mutex_unlock(&coap_client_sess_mutex);
+        return -EINVAL;
+    }
+    gnutls_free(coap_client_sess_data.data);
+    coap_client_sess_data.data = data;
+    coap_client_sess_data.size = size;
+    pthread_mutex_unlock(&coap_client_sess_mutex);
+    coap_log_notice("Loaded DTLS session data from file '%s'", file_name);
+    return 0;
+}
+
 #endif  /* COAP_DTLS_EN */
 
 /****************************************************************************************************
@@ -474,10 +641,23 @@ int coap_client_create(coap_client_t *client,
         memset(client, 0, sizeof(coap_client_t));
         return -errno;
     }
+    client->nstart = COAP_CLIENT_DEF_NSTART;
+    client->exch = (coap_client_exch_t *)coap_mem_alloc(&client->mem, client->nstart * sizeof(coap_client_exch_t));
+    if (client->exch == NULL)
+    {
+        close(client->timer_fd);
+        close(client->sd);
+        memset(client, 0, sizeof(coap_client_t));
+        return -ENOMEM;
+    }
+    memset(client->exch, 0, client->nstart * sizeof(coap_client_exch_t));
+    client->adaptive_rto = 1;
+    client->rto_msec = COAP_CLIENT_RTO_INIT_MSEC;
 #ifdef COAP_DTLS_EN
     ret = coap_client_dtls_create(client, key_file_name, cert_file_name, trust_file_name, crl_file_name);
     if (ret < 0)
     {
+        coap_mem_free(client->exch);
         close(client->timer_fd);
         close(client->sd);
         memset(client, 0, sizeof(coap_client_t));
@@ -490,6 +670,16 @@ int coap_client_create(coap_client_t *client,
 
 void coap_client_destroy(coap_client_t *client)
 {
+    unsigned i = 0;
+
+    for (i = 0; i < client->nstart; i++)
+    {
+        if (client->exch[i].state != COAP_CLIENT_ASYNC_IDLE)
+        {
+            coap_msg_destroy(&client->exch[i].req);
+        }
+    }
+    coap_mem_free(client->exch);
 #ifdef COAP_DTLS_EN
     coap_client_dtls_destroy(client);
 #endif
@@ -498,6 +688,100 @@ void coap_client_destroy(coap_client_t *client)
     memset(client, 0, sizeof(coap_client_t));
 }
 
+/**
+ *  @brief Calculate the time elapsed since a start time
+ *
+ *  @param[in] start Pointer to the start time
+ *
+ *  @returns Elapsed time (msec)
+ */
+static unsigned coap_client_elapsed_msec(struct timespec *start)
+{
+    struct timespec now = {0};
+    int ret = 0;
+
+    ret = clock_gettime(CLOCK_MONOTONIC, &now);
+    if (ret < 0)
+    {
+        return 0;
+    }
+    return ((now.tv_sec - start->tv_sec) * 1000)
+         + ((now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+/**
+ *  @brief Update the retransmission timeout estimate with a round trip time measurement
+ *
+ *  Apply a CoCoA-style estimator. A measurement taken from an
+ *  exchange that completed without retransmission updates the
+ *  strong estimate; a measurement taken from an exchange that
+ *  was retransmitted a small number of times is ambiguous and
+ *  updates the weak estimate with a lower weight. The overall
+ *  retransmission timeout estimate is a weighted average of
+ *  the previous estimate and the estimate that was updated.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] start Pointer to the time that the request was first transmitted
+ *  @param[in] num_retrans Number of times the request was retransmitted
+ */
+static void coap_client_sample_rtt(coap_client_t *client, struct timespec *start, unsigned num_retrans)
+{
+    unsigned rtt_msec = 0;
+    unsigned rto_est = 0;
+
+    if (!client->adaptive_rto)
+    {
+        return;
+    }
+    rtt_msec = coap_client_elapsed_msec(start);
+    if (num_retrans == 0)
+    {
+        if (client->srtt_strong_msec == 0)
+        {
+            client->srtt_strong_msec = rtt_msec;
+            client->rttvar_strong_msec = rtt_msec / 2;
+        }
+        else
+        {
+            client->rttvar_strong_msec = ((3 * client->rttvar_strong_msec)
+                                       + (unsigned)abs((int)client->srtt_strong_msec - (int)rtt_msec)) / 4;
+            client->srtt_strong_msec = ((7 * client->srtt_strong_msec) + rtt_msec) / 8;
+        }
+        rto_est = client->srtt_strong_msec + (4 * client->rttvar_strong_msec);
+        client->rto_msec = (rto_est + client->rto_msec) / 2;
+    }
+    else if (num_retrans <= COAP_CLIENT_WEAK_RTT_RETRANS)
+    {
+        if (client->srtt_weak_msec == 0)
+        {
+            client->srtt_weak_msec = rtt_msec;
+            client->rttvar_weak_msec = rtt_msec / 2;
+        }
+        else
+        {
+            client->rttvar_weak_msec = ((3 * client->rttvar_weak_msec)
+                                     + (unsigned)abs((int)client->srtt_weak_msec - (int)rtt_msec)) / 4;
+            client->srtt_weak_msec = ((7 * client->srtt_weak_msec) + rtt_msec) / 8;
+        }
+        rto_est = client->srtt_weak_msec + client->rttvar_weak_msec;
+        client->rto_msec = (rto_est + (3 * client->rto_msec)) / 4;
+    }
+    else
+    {
+        /* the measurement is too ambiguous to be useful */
+        return;
+    }
+    if (client->rto_msec < COAP_CLIENT_RTO_MIN_MSEC)
+    {
+        client->rto_msec = COAP_CLIENT_RTO_MIN_MSEC;
+    }
+    else if (client->rto_msec > COAP_CLIENT_RTO_MAX_MSEC)
+    {
+        client->rto_msec = COAP_CLIENT_RTO_MAX_MSEC;
+    }
+    coap_log_debug("Round trip time measured as %u msec, retransmission timeout estimate updated to %u msec", rtt_msec, client->rto_msec);
+}
+
 /**
  *  @brief Initialise the acknowledgement timer in a client structure
  *
@@ -508,17 +792,32 @@ void coap_client_destroy(coap_client_t *client)
  *  ACK_TIMEOUT = 2
  *  ACK_RANDOM_FACTOR = 1.5
  *
+ *  When the adaptive retransmission timeout is enabled,
+ *  the retransmission timeout estimate is used in place
+ *  of ACK_TIMEOUT.
+ *
  *  @param[out] client Pointer to a client structure
  */
 static void coap_client_init_ack_timeout(coap_client_t *client)
 {
+    unsigned msec = 0;
+
     if (!rand_init)
     {
         srand(time(NULL));
         rand_init = 1;
     }
-    client->timeout.tv_sec = COAP_CLIENT_ACK_TIMEOUT_SEC;
-    client->timeout.tv_nsec = (rand() % 1000) * 1000000;
+    if (client->adaptive_rto)
+    {
+        msec = client->rto_msec + (rand() % ((client->rto_msec / 2) + 1));
+        client->timeout.tv_sec = msec / 1000;
+        client->timeout.tv_nsec = (msec % 1000) * 1000000;
+    }
+    else
+    {
+        client->timeout.tv_sec = COAP_CLIENT_ACK_TIMEOUT_SEC;
+        client->timeout.tv_nsec = (rand() % 1000) * 1000000;
+    }
     coap_log_debug("Acknowledgement timeout initialised to: %lu sec, %lu nsec", client->timeout.tv_sec, client->timeout.tv_nsec);
 }
 
@@ -537,17 +836,59 @@ static void coap_client_init_resp_timeout(coap_client_t *client)
 }
 
 /**
- *  @brief Double the value of the timer in a client structure
+ *  @brief Apply the retransmission back-off to a timeout value
+ *
+ *  The timeout is doubled or, when the adaptive
+ *  retransmission timeout is enabled, a CoCoA-style variable
+ *  back-off factor is applied so that a small timeout does
+ *  not exhaust the retransmission budget before the
+ *  worst-case timeout is reached and a large timeout does
+ *  not grow excessively.
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in,out] timeout Pointer to the timeout value
+ */
+static void coap_client_backoff_timeout(coap_client_t *client, struct timespec *timeout)
+{
+    unsigned msec = (timeout->tv_sec * 1000)
+                  + (timeout->tv_nsec / 1000000);
+
+    if (client->adaptive_rto)
+    {
+        if (msec < 1000)
+        {
+            msec *= 3;
+        }
+        else if (msec <= 3000)
+        {
+            msec *= 2;
+        }
+        else
+        {
+            msec += msec / 2;
+        }
+        if (msec > COAP_CLIENT_RTO_MAX_MSEC)
+        {
+            msec = COAP_CLIENT_RTO_MAX_MSEC;
+        }
+    }
+    else
+    {
+        msec *= 2;
+    }
+    timeout->tv_sec = msec / 1000;
+    timeout->tv_nsec = (msec % 1000) * 1000000;
+    coap_log_debug("Timeout increased to: %lu sec, %lu nsec", timeout->tv_sec, timeout->tv_nsec);
+}
+
+/**
+ *  @brief Increase the value of the timer in a client structure
  *
  *  @param[in,out] client Pointer to a client structure
  */
 static void coap_client_double_timeout(coap_client_t *client)
 {
-    unsigned msec = 2 * ((client->timeout.tv_sec * 1000)
-                      + (client->timeout.tv_nsec / 1000000));
-    client->timeout.tv_sec = msec / 1000;
-    client->timeout.tv_nsec = (msec % 1000) * 1000000;
-    coap_log_debug("Timeout doubled to: %lu sec, %lu nsec", client->timeout.tv_sec, client->timeout.tv_nsec);
+    coap_client_backoff_timeout(client, &client->timeout);
 }
 
 /**
@@ -634,6 +975,18 @@ static int coap_client_start_resp_timer(coap_client_t *client)
     return coap_client_start_timer(client);
 }
 
+/**
+ *  @brief Stop the timer in a client structure
+ *
+ *  @param[in,out] client Pointer to a client structure
+ */
+static void coap_client_stop_timer(coap_client_t *client)
+{
+    struct itimerspec its = {{0}};
+
+    timerfd_settime(client->timer_fd, 0, &its, NULL);
+}
+
 /**
  *  @brief Send a message to the server
  *
@@ -1066,6 +1419,37 @@ static int coap_client_listen_resp(coap_client_t *client)
     return 0;
 }
 
+/**
+ *  @brief Wait indefinitely for a message to arrive
+ *
+ *  @param[in] client Pointer to a client structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_listen_ntf(coap_client_t *client)
+{
+    fd_set read_fds = {{0}};
+    int ret = 0;
+
+    while (1)
+    {
+        FD_ZERO(&read_fds);
+        FD_SET(client->sd, &read_fds);
+        ret = select(client->sd + 1, &read_fds, NULL, NULL, NULL);
+        if (ret < 0)
+        {
+            return -errno;
+        }
+        if (FD_ISSET(client->sd, &read_fds))
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
 /**
  *  @brief Compare the token values in a request message and a response message
  *
@@ -1267,6 +1651,7 @@ static int coap_client_exchange_con(coap_client_t *client, coap_msg_t *req, coap
      *  or ack message and separate response message
      */
     coap_log_info("Expecting acknowledgement from host %s and port %s", client->server_host, client->server_port);
+    clock_gettime(CLOCK_MONOTONIC, &client->req_start);
     coap_client_start_ack_timer(client);
     while (1)
     {
@@ -1288,10 +1673,12 @@ static int coap_client_exchange_con(coap_client_t *client, coap_msg_t *req, coap
                 {
                     /* received ack message, wait for separate response message */
                     coap_log_info("Received acknowledgement from host %s and port %s", client->server_host, client->server_port);
+                    coap_client_sample_rtt(client, &client->req_start, client->num_retrans);
                     return coap_client_exchange_sep(client, req, resp);
                 }
                 else if (coap_client_match_token(req, resp))
                 {
+                    coap_client_sample_rtt(client, &client->req_start, client->num_retrans);
                     return coap_client_handle_piggybacked_response(client, resp);
                 }
             }
@@ -1311,6 +1698,7 @@ static int coap_client_exchange_con(coap_client_t *client, coap_msg_t *req, coap
              * the purposes of terminating the retransmission sequence, this also
              * serves as an acknowledgement.
              */
+             coap_client_sample_rtt(client, &client->req_start, client->num_retrans);
              return coap_client_handle_sep_response(client, resp);
         }
         /* message deduplication */
@@ -1441,3 +1829,1158 @@ int coap_client_exchange(coap_client_t *client, coap_msg_t *req, coap_msg_t *res
     }
     return -EINVAL;
 }
+
+int coap_client_observe(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, int (* notify)(coap_client_t *, coap_msg_t *))
+{
+    coap_msg_t dereg_resp = {0};
+    coap_msg_t dereg = {0};
+    coap_msg_t ntf = {0};
+    ssize_t num = 0;
+    char obs_val = 1;
+    int ret = 0;
+
+    if ((client == NULL) || (req == NULL) || (resp == NULL) || (notify == NULL))
+    {
+        return -EINVAL;
+    }
+    /* prepare the deregistration request before the */
+    /* observe option is added to the request message */
+    coap_msg_create(&dereg);
+    ret = coap_msg_copy(&dereg, req);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&dereg);
+        return ret;
+    }
+    ret = coap_msg_add_op(&dereg, COAP_MSG_OBSERVE, 1, &obs_val);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&dereg);
+        return ret;
+    }
+    /* register with the server */
+    ret = coap_msg_add_op(req, COAP_MSG_OBSERVE, 0, "");
+    if (ret < 0)
+    {
+        coap_msg_destroy(&dereg);
+        return ret;
+    }
+    ret = coap_client_exchange(client, req, resp);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&dereg);
+        return ret;
+    }
+    /* pass the initial representation to the call-back function */
+    ret = (*notify)(client, resp);
+    while (ret == 0)
+    {
+        /* wait for a notification */
+        ret = coap_client_listen_ntf(client);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&dereg);
+            return ret;
+        }
+        coap_msg_create(&ntf);
+        num = coap_client_recv(client, &ntf);
+        if (num == -EAGAIN)
+        {
+            /* no application data is ready yet */
+            coap_msg_destroy(&ntf);
+            continue;
+        }
+        if (num < 0)
+        {
+            coap_msg_destroy(&ntf);
+            coap_msg_destroy(&dereg);
+            return num;
+        }
+        if (!coap_client_match_token(req, &ntf))
+        {
+            coap_client_reject(client, &ntf);
+            coap_msg_destroy(&ntf);
+            continue;
+        }
+        /* acknowledge a confirmable notification */
+        if (coap_msg_get_type(&ntf) == COAP_MSG_CON)
+        {
+            ret = coap_client_send_ack(client, &ntf);
+            if (ret < 0)
+            {
+                coap_msg_destroy(&ntf);
+                coap_msg_destroy(&dereg);
+                return ret;
+            }
+        }
+        coap_log_info("Received notification from host %s and port %s", client->server_host, client->server_port);
+        ret = (*notify)(client, &ntf);
+        coap_msg_destroy(&ntf);
+    }
+    if (ret < 0)
+    {
+        coap_msg_destroy(&dereg);
+        return ret;
+    }
+    /* deregister with the server */
+    coap_msg_create(&dereg_resp);
+    ret = coap_client_exchange(client, &dereg, &dereg_resp);
+    coap_msg_destroy(&dereg_resp);
+    coap_msg_destroy(&dereg);
+    return ret;
+}
+
+/**
+ *  @brief Parse a block1 or block2 option in a message
+ *
+ *  @param[in] msg Pointer to a message structure
+ *  @param[in] op_num Option number
+ *  @param[out] num Pointer to an unsigned to contain the block number
+ *  @param[out] more Pointer to an unsigned to contain the more flag
+ *  @param[out] size Pointer to an unsigned to contain the block size in bytes
+ *
+ *  @returns Operation status
+ *  @retval 1 Option not present
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_get_block_val(coap_msg_t *msg, unsigned op_num, unsigned *num, unsigned *more, unsigned *size)
+{
+    coap_msg_op_t *op = NULL;
+
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) == op_num)
+        {
+            return coap_msg_op_parse_block_val(num, more, size, coap_msg_op_get_val(op), coap_msg_op_get_len(op));
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    return 1;
+}
+
+/**
+ *  @brief Send the body of a request to the server block by block
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *  @param[in] block1_size Block size used to send the request body
+ *  @param[in] block2_size Preferred block size for the response body
+ *  @param[in] body Pointer to a buffer containing the request body
+ *  @param[in] send_len Length of the request body
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_send_blocks(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, unsigned block1_size, unsigned block2_size, const char *body, size_t send_len)
+{
+    coap_msg_t block_resp = {0};
+    coap_msg_t block_req = {0};
+    size_t offset = 0;
+    size_t chunk = 0;
+    unsigned echo_more = 0;
+    unsigned echo_size = 0;
+    unsigned echo_num = 0;
+    unsigned more = 0;
+    unsigned size = 0;
+    unsigned num = 0;
+    ssize_t val_len = 0;
+    char val[3] = {0};
+    int ret = 0;
+
+    size = block1_size;
+    while (1)
+    {
+        chunk = send_len - offset;
+        more = chunk > size;
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+        coap_msg_create(&block_req);
+        coap_msg_create(&block_resp);
+        ret = coap_msg_copy(&block_req, req);
+        if (ret == 0)
+        {
+            ret = coap_msg_set_payload(&block_req, (char *)body + offset, chunk);
+        }
+        if (ret == 0)
+        {
+            val_len = coap_msg_op_format_block_val(val, sizeof(val), num, more, size);
+            if (val_len < 0)
+            {
+                ret = val_len;
+            }
+            else
+            {
+                ret = coap_msg_add_op(&block_req, COAP_MSG_BLOCK1, val_len, val);
+            }
+        }
+        if ((ret == 0) && (!more))
+        {
+            /* advise the server of the preferred response block size */
+            val_len = coap_msg_op_format_block_val(val, sizeof(val), 0, 0, block2_size);
+            if (val_len < 0)
+            {
+                ret = val_len;
+            }
+            else
+            {
+                ret = coap_msg_add_op(&block_req, COAP_MSG_BLOCK2, val_len, val);
+            }
+        }
+        if (ret < 0)
+        {
+            coap_msg_destroy(&block_resp);
+            coap_msg_destroy(&block_req);
+            return ret;
+        }
+        ret = coap_client_exchange(client, &block_req, &block_resp);
+        coap_msg_destroy(&block_req);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&block_resp);
+            return ret;
+        }
+        if ((!more)
+         || (coap_msg_get_code_class(&block_resp) != COAP_MSG_SUCCESS)
+         || (coap_msg_get_code_detail(&block_resp) != COAP_MSG_CONTINUE))
+        {
+            /* final block acknowledged or the server responded early */
+            ret = coap_msg_copy(resp, &block_resp);
+            coap_msg_destroy(&block_resp);
+            return ret;
+        }
+        /* adopt a smaller block size chosen by the server */
+        ret = coap_client_get_block_val(&block_resp, COAP_MSG_BLOCK1, &echo_num, &echo_more, &echo_size);
+        coap_msg_destroy(&block_resp);
+        if ((ret == 0) && (echo_size < size))
+        {
+            size = echo_size;
+        }
+        offset += chunk;
+        num = offset / size;
+    }
+    return 0;
+}
+
+ssize_t coap_client_exchange_blockwise(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, unsigned block1_size, unsigned block2_size, char *body, size_t body_len, size_t send_len)
+{
+    coap_msg_t block_resp = {0};
+    coap_msg_t block_req = {0};
+    size_t resp_len = 0;
+    unsigned more = 0;
+    unsigned size = 0;
+    unsigned num = 0;
+    ssize_t val_len = 0;
+    char val[3] = {0};
+    int ret = 0;
+
+    if ((client == NULL) || (req == NULL) || (resp == NULL) || (body == NULL)
+     || (send_len > body_len)
+     || (coap_msg_get_payload_len(req) != 0)
+     || (coap_msg_op_calc_block_szx(block1_size) < 0)
+     || (coap_msg_op_calc_block_szx(block2_size) < 0))
+    {
+        return -EINVAL;
+    }
+
+    /* send the request body */
+    if (send_len > block1_size)
+    {
+        ret = coap_client_send_blocks(client, req, resp, block1_size, block2_size, body, send_len);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    else
+    {
+        coap_msg_create(&block_req);
+        ret = coap_msg_copy(&block_req, req);
+        if ((ret == 0) && (send_len > 0))
+        {
+            ret = coap_msg_set_payload(&block_req, body, send_len);
+        }
+        if (ret == 0)
+        {
+            /* advise the server of the preferred response block size */
+            val_len = coap_msg_op_format_block_val(val, sizeof(val), 0, 0, block2_size);
+            if (val_len < 0)
+            {
+                ret = val_len;
+            }
+            else
+            {
+                ret = coap_msg_add_op(&block_req, COAP_MSG_BLOCK2, val_len, val);
+            }
+        }
+        if (ret == 0)
+        {
+            ret = coap_client_exchange(client, &block_req, resp);
+        }
+        coap_msg_destroy(&block_req);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    if (coap_msg_get_code_class(resp) != COAP_MSG_SUCCESS)
+    {
+        return -EBADMSG;
+    }
+
+    /* assemble the response body */
+    if (coap_msg_get_payload_len(resp) > body_len)
+    {
+        return -ENOSPC;
+    }
+    memcpy(body, coap_msg_get_payload(resp), coap_msg_get_payload_len(resp));
+    resp_len = coap_msg_get_payload_len(resp);
+    ret = coap_client_get_block_val(resp, COAP_MSG_BLOCK2, &num, &more, &size);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if ((ret == 1) || (!more))
+    {
+        /* the response body fits in a single message */
+        return resp_len;
+    }
+    while (more)
+    {
+        /* request the next block of the response body */
+        num = resp_len / size;
+        coap_msg_create(&block_req);
+        coap_msg_create(&block_resp);
+        ret = coap_msg_copy(&block_req, req);
+        if (ret == 0)
+        {
+            ret = coap_msg_set_payload(&block_req, NULL, 0);
+        }
+        if (ret == 0)
+        {
+            val_len = coap_msg_op_format_block_val(val, sizeof(val), num, 0, size);
+            if (val_len < 0)
+            {
+                ret = val_len;
+            }
+            else
+            {
+                ret = coap_msg_add_op(&block_req, COAP_MSG_BLOCK2, val_len, val);
+            }
+        }
+        if (ret == 0)
+        {
+            ret = coap_client_exchange(client, &block_req, &block_resp);
+        }
+        coap_msg_destroy(&block_req);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&block_resp);
+            return ret;
+        }
+        if (coap_msg_get_code_class(&block_resp) != COAP_MSG_SUCCESS)
+        {
+            coap_msg_destroy(&block_resp);
+            return -EBADMSG;
+        }
+        if (resp_len + coap_msg_get_payload_len(&block_resp) > body_len)
+        {
+            coap_msg_destroy(&block_resp);
+            return -ENOSPC;
+        }
+        memcpy(body + resp_len, coap_msg_get_payload(&block_resp), coap_msg_get_payload_len(&block_resp));
+        resp_len += coap_msg_get_payload_len(&block_resp);
+        ret = coap_client_get_block_val(&block_resp, COAP_MSG_BLOCK2, &num, &more, &size);
+        coap_msg_destroy(&block_resp);
+        if (ret != 0)
+        {
+            /* the server must include a block2 option in every block */
+            return (ret < 0) ? ret : -EBADMSG;
+        }
+    }
+    return resp_len;
+}
+
+int coap_client_send_non_batch(coap_client_t *client, coap_msg_t msgs[], unsigned num)
+{
+#ifndef COAP_DTLS_EN
+    struct mmsghdr msgvec[COAP_CLIENT_BATCH_SIZE] = {{{0}}};
+    struct iovec iov[COAP_CLIENT_BATCH_SIZE] = {{0}};
+    char buf[COAP_CLIENT_BATCH_SIZE][COAP_MSG_MAX_BUF_LEN] = {{0}};
+    unsigned chunk = 0;
+    unsigned j = 0;
+    int count = 0;
+#endif
+    unsigned char msg_id_buf[2] = {0};
+    unsigned msg_id = 0;
+    unsigned sent = 0;
+    unsigned i = 0;
+    ssize_t len = 0;
+    int ret = 0;
+
+    if ((client == NULL) || (msgs == NULL) || (num == 0))
+    {
+        return -EINVAL;
+    }
+    /* check for valid requests */
+    for (i = 0; i < num; i++)
+    {
+        if ((coap_msg_get_type(&msgs[i]) != COAP_MSG_NON)
+         || (coap_msg_get_code_class(&msgs[i]) != COAP_MSG_REQ))
+        {
+            return -EINVAL;
+        }
+    }
+    /* generate the message IDs */
+    for (i = 0; i < num; i++)
+    {
+        coap_msg_gen_rand_str((char *)msg_id_buf, sizeof(msg_id_buf));
+        msg_id = (((unsigned)msg_id_buf[1]) << 8) | (unsigned)msg_id_buf[0];
+        ret = coap_msg_set_msg_id(&msgs[i], msg_id);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+#ifdef COAP_DTLS_EN
+    /* each record is encrypted individually so the messages are sent one at a time */
+    for (i = 0; i < num; i++)
+    {
+        len = coap_client_send(client, &msgs[i]);
+        if (len < 0)
+        {
+            return (sent > 0) ? (int)sent : (int)len;
+        }
+        sent++;
+    }
+#else
+    while (sent < num)
+    {
+        chunk = num - sent;
+        if (chunk > COAP_CLIENT_BATCH_SIZE)
+        {
+            chunk = COAP_CLIENT_BATCH_SIZE;
+        }
+        for (j = 0; j < chunk; j++)
+        {
+            len = coap_msg_format(&msgs[sent + j], buf[j], COAP_MSG_MAX_BUF_LEN);
+            if (len < 0)
+            {
+                return (sent > 0) ? (int)sent : (int)len;
+            }
+            iov[j].iov_base = buf[j];
+            iov[j].iov_len = len;
+            msgvec[j].msg_hdr.msg_iov = &iov[j];
+            msgvec[j].msg_hdr.msg_iovlen = 1;
+        }
+        for (j = 0; j < chunk; )
+        {
+            count = sendmmsg(client->sd, &msgvec[j], chunk - j, 0);
+            if (count < 0)
+            {
+                return (sent > 0) ? (int)sent : -errno;
+            }
+            j += count;
+            sent += count;
+        }
+    }
+#endif
+    coap_log_info("Sent %u non-confirmable requests to host %s and port %s", sent, client->server_host, client->server_port);
+    return sent;
+}
+
+/**
+ *  @brief Hash a token value
+ *
+ *  Generate an index into the table of asynchronous
+ *  exchange structures from a token value.
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] token Pointer to the token value
+ *  @param[in] len Length of the token value
+ *
+ *  @returns Index into the table of asynchronous exchange structures
+ */
+static unsigned coap_client_exch_hash(coap_client_t *client, const char *token, size_t len)
+{
+    unsigned long hash = 5381;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)token[i];
+    }
+    return hash % client->nstart;
+}
+
+/**
+ *  @brief Find the asynchronous exchange that matches a token
+ *
+ *  Probe the table of asynchronous exchange structures
+ *  starting at the hash of the token in the received message.
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] msg Pointer to the received message
+ *
+ *  @returns Pointer to an asynchronous exchange structure or NULL
+ */
+static coap_client_exch_t *coap_client_find_exch_by_token(coap_client_t *client, coap_msg_t *msg)
+{
+    coap_client_exch_t *exch = NULL;
+    unsigned start = 0;
+    unsigned i = 0;
+
+    start = coap_client_exch_hash(client, coap_msg_get_token(msg), coap_msg_get_token_len(msg));
+    for (i = 0; i < client->nstart; i++)
+    {
+        exch = &client->exch[(start + i) % client->nstart];
+        if ((exch->state != COAP_CLIENT_ASYNC_IDLE)
+         && (coap_client_match_token(&exch->req, msg)))
+        {
+            return exch;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Find the asynchronous exchange that matches a message ID
+ *
+ *  Empty acknowledgement and reset messages carry no token
+ *  and are matched to the request by message ID instead.
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] msg Pointer to the received message
+ *
+ *  @returns Pointer to an asynchronous exchange structure or NULL
+ */
+static coap_client_exch_t *coap_client_find_exch_by_msg_id(coap_client_t *client, coap_msg_t *msg)
+{
+    coap_client_exch_t *exch = NULL;
+    unsigned i = 0;
+
+    for (i = 0; i < client->nstart; i++)
+    {
+        exch = &client->exch[i];
+        if ((exch->state != COAP_CLIENT_ASYNC_IDLE)
+         && (coap_msg_get_msg_id(&exch->req) == coap_msg_get_msg_id(msg)))
+        {
+            return exch;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Find a free asynchronous exchange structure
+ *
+ *  Probe the table of asynchronous exchange structures
+ *  starting at the hash of the token of the new request.
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] token Pointer to the token value
+ *  @param[in] len Length of the token value
+ *
+ *  @returns Pointer to an asynchronous exchange structure or NULL
+ */
+static coap_client_exch_t *coap_client_find_free_exch(coap_client_t *client, const char *token, size_t len)
+{
+    coap_client_exch_t *exch = NULL;
+    unsigned start = 0;
+    unsigned i = 0;
+
+    start = coap_client_exch_hash(client, token, len);
+    for (i = 0; i < client->nstart; i++)
+    {
+        exch = &client->exch[(start + i) % client->nstart];
+        if (exch->state == COAP_CLIENT_ASYNC_IDLE)
+        {
+            return exch;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Set the expiry time of an asynchronous exchange
+ *
+ *  Set the absolute expiry time of the exchange to the
+ *  current time plus the current timeout interval.
+ *
+ *  @param[in,out] exch Pointer to an asynchronous exchange structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_exch_set_expiry(coap_client_exch_t *exch)
+{
+    int ret = 0;
+
+    ret = clock_gettime(CLOCK_MONOTONIC, &exch->expiry);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    exch->expiry.tv_sec += exch->timeout.tv_sec;
+    exch->expiry.tv_nsec += exch->timeout.tv_nsec;
+    if (exch->expiry.tv_nsec >= 1000000000)
+    {
+        exch->expiry.tv_sec++;
+        exch->expiry.tv_nsec -= 1000000000;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Initialise the acknowledgement timeout of an asynchronous exchange
+ *
+ *  The timeout is initialised to a random duration between:
+ *
+ *  ACK_TIMEOUT and (ACK_TIMEOUT * ACK_RANDOM_FACTOR)
+ *  where:
+ *  ACK_TIMEOUT = 2
+ *  ACK_RANDOM_FACTOR = 1.5
+ *
+ *  When the adaptive retransmission timeout is enabled,
+ *  the retransmission timeout estimate is used in place
+ *  of ACK_TIMEOUT.
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in,out] exch Pointer to an asynchronous exchange structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_exch_init_ack_timeout(coap_client_t *client, coap_client_exch_t *exch)
+{
+    unsigned msec = 0;
+
+    if (!rand_init)
+    {
+        srand(time(NULL));
+        rand_init = 1;
+    }
+    if (client->adaptive_rto)
+    {
+        msec = client->rto_msec + (rand() % ((client->rto_msec / 2) + 1));
+        exch->timeout.tv_sec = msec / 1000;
+        exch->timeout.tv_nsec = (msec % 1000) * 1000000;
+    }
+    else
+    {
+        exch->timeout.tv_sec = COAP_CLIENT_ACK_TIMEOUT_SEC;
+        exch->timeout.tv_nsec = (rand() % 1000) * 1000000;
+    }
+    coap_log_debug("Acknowledgement timeout initialised to: %lu sec, %lu nsec", exch->timeout.tv_sec, exch->timeout.tv_nsec);
+    return coap_client_exch_set_expiry(exch);
+}
+
+/**
+ *  @brief Initialise the response timeout of an asynchronous exchange
+ *
+ *  The timeout is initialised to a constant value.
+ *
+ *  @param[in,out] exch Pointer to an asynchronous exchange structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_exch_init_resp_timeout(coap_client_exch_t *exch)
+{
+    exch->timeout.tv_sec = COAP_CLIENT_RESP_TIMEOUT_SEC;
+    exch->timeout.tv_nsec = 0;
+    coap_log_debug("Response timeout initialised to: %lu sec, %lu nsec", exch->timeout.tv_sec, exch->timeout.tv_nsec);
+    return coap_client_exch_set_expiry(exch);
+}
+
+/**
+ *  @brief Increase the timeout of an asynchronous exchange
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in,out] exch Pointer to an asynchronous exchange structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_exch_double_timeout(coap_client_t *client, coap_client_exch_t *exch)
+{
+    coap_client_backoff_timeout(client, &exch->timeout);
+    return coap_client_exch_set_expiry(exch);
+}
+
+/**
+ *  @brief Arm the timer to the earliest expiry time
+ *
+ *  Arm the timer in the client structure to the earliest
+ *  absolute expiry time of the asynchronous exchanges in
+ *  progress or stop the timer if no asynchronous exchange
+ *  is in progress.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_arm_timer(coap_client_t *client)
+{
+    coap_client_exch_t *exch = NULL;
+    struct itimerspec its = {{0}};
+    unsigned found = 0;
+    unsigned i = 0;
+    int ret = 0;
+
+    for (i = 0; i < client->nstart; i++)
+    {
+        exch = &client->exch[i];
+        if (exch->state == COAP_CLIENT_ASYNC_IDLE)
+        {
+            continue;
+        }
+        if ((!found)
+         || (exch->expiry.tv_sec < its.it_value.tv_sec)
+         || ((exch->expiry.tv_sec == its.it_value.tv_sec)
+          && (exch->expiry.tv_nsec < its.it_value.tv_nsec)))
+        {
+            its.it_value = exch->expiry;
+            found = 1;
+        }
+    }
+    if (!found)
+    {
+        coap_client_stop_timer(client);
+        return 0;
+    }
+    ret = timerfd_settime(client->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Complete an asynchronous exchange
+ *
+ *  Return the exchange structure to the idle state, rearm
+ *  the timer and deliver the result of the exchange to the
+ *  call-back function. The exchange structure is returned
+ *  to the idle state before the call-back function is
+ *  invoked so that a new exchange can be submitted from
+ *  within the call-back function.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] exch Pointer to an asynchronous exchange structure
+ *  @param[in] resp Pointer to the response message
+ *  @param[in] status Result of the exchange
+ */
+static void coap_client_exch_complete(coap_client_t *client, coap_client_exch_t *exch, coap_msg_t *resp, int status)
+{
+    void (* done)(coap_client_t *, coap_msg_t *, int, void *) = exch->done;
+    void *data = exch->data;
+
+    coap_msg_destroy(&exch->req);
+    memset(exch, 0, sizeof(coap_client_exch_t));
+    coap_client_async_arm_timer(client);
+    (*done)(client, resp, status, data);
+}
+
+/**
+ *  @brief Handle a timer expiry for an asynchronous exchange
+ *
+ *  Retransmit the request if the exchange is waiting for an
+ *  acknowledgement and the maximum number of retransmits has
+ *  not been reached, otherwise complete the exchange with a
+ *  timeout error.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] exch Pointer to an asynchronous exchange structure
+ */
+static void coap_client_exch_handle_timeout(coap_client_t *client, coap_client_exch_t *exch)
+{
+    coap_msg_t resp = {0};
+    ssize_t num = 0;
+    int ret = 0;
+
+    coap_log_debug("Transaction expired for host %s and port %s", client->server_host, client->server_port);
+    if ((exch->state == COAP_CLIENT_ASYNC_ACK)
+     && (exch->num_retrans < COAP_CLIENT_MAX_RETRANSMIT))
+    {
+        ret = coap_client_exch_double_timeout(client, exch);
+        if (ret < 0)
+        {
+            coap_msg_create(&resp);
+            coap_client_exch_complete(client, exch, &resp, ret);
+            coap_msg_destroy(&resp);
+            return;
+        }
+        exch->num_retrans++;
+        coap_log_debug("Retransmitting to host %s and port %s", client->server_host, client->server_port);
+        num = coap_client_send(client, &exch->req);
+        if (num < 0)
+        {
+            coap_msg_create(&resp);
+            coap_client_exch_complete(client, exch, &resp, num);
+            coap_msg_destroy(&resp);
+        }
+        return;
+    }
+    if (exch->state == COAP_CLIENT_ASYNC_ACK)
+    {
+        coap_log_debug("Stopped retransmitting to host %s and port %s", client->server_host, client->server_port);
+        coap_log_info("No acknowledgement received from host %s and port %s", client->server_host, client->server_port);
+    }
+    coap_msg_create(&resp);
+    coap_client_exch_complete(client, exch, &resp, -ETIMEDOUT);
+    coap_msg_destroy(&resp);
+}
+
+/**
+ *  @brief Handle a message received during asynchronous exchanges
+ *
+ *  Match the message to an exchange in progress by token or,
+ *  for empty acknowledgement and reset messages, by message
+ *  ID, applying the same message matching rules as the
+ *  blocking exchange functions. Messages that complete an
+ *  exchange are delivered to the call-back function;
+ *  duplicate and unexpected messages are ignored or rejected
+ *  and the exchanges continue.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] resp Pointer to the received message
+ */
+static void coap_client_async_handle_msg(coap_client_t *client, coap_msg_t *resp)
+{
+    coap_client_exch_t *exch = NULL;
+    int ret = 0;
+
+    exch = coap_client_find_exch_by_msg_id(client, resp);
+    if (exch != NULL)
+    {
+        if ((exch->state == COAP_CLIENT_ASYNC_ACK)
+         && (coap_msg_get_type(resp) == COAP_MSG_ACK))
+        {
+            if (coap_msg_is_empty(resp))
+            {
+                /* received ack message, wait for separate response message */
+                coap_log_info("Received acknowledgement from host %s and port %s", client->server_host, client->server_port);
+                coap_log_info("Expecting response from host %s and port %s", client->server_host, client->server_port);
+                coap_client_sample_rtt(client, &exch->start, exch->num_retrans);
+                exch->state = COAP_CLIENT_ASYNC_SEP;
+                ret = coap_client_exch_init_resp_timeout(exch);
+                if (ret == 0)
+                {
+                    ret = coap_client_async_arm_timer(client);
+                }
+                if (ret < 0)
+                {
+                    coap_client_exch_complete(client, exch, resp, ret);
+                }
+                return;
+            }
+            else if (coap_client_match_token(&exch->req, resp))
+            {
+                coap_client_sample_rtt(client, &exch->start, exch->num_retrans);
+                ret = coap_client_handle_piggybacked_response(client, resp);
+                coap_client_exch_complete(client, exch, resp, ret);
+                return;
+            }
+        }
+        else if ((exch->state == COAP_CLIENT_ASYNC_SEP)
+              && (coap_msg_get_type(resp) == COAP_MSG_ACK))
+        {
+            /* message deduplication */
+            coap_log_info("Received duplicate acknowledgement from host %s and port %s", client->server_host, client->server_port);
+            return;
+        }
+        else if (coap_msg_get_type(resp) == COAP_MSG_RST)
+        {
+            coap_client_exch_complete(client, exch, resp, -ECONNRESET);
+            return;
+        }
+        coap_client_reject(client, resp);
+        coap_client_exch_complete(client, exch, resp, -EBADMSG);
+        return;
+    }
+    exch = coap_client_find_exch_by_token(client, resp);
+    if (exch != NULL)
+    {
+        /* RFC7252
+         * as the underlying datagram transport may not be sequence-preserving,
+         * the Confirmable message carrying the response may actually arrive
+         * before or after the Acknowledgement message for the request; for
+         * the purposes of terminating the retransmission sequence, this also
+         * serves as an acknowledgement.
+         */
+        if (exch->state == COAP_CLIENT_ASYNC_ACK)
+        {
+            coap_client_sample_rtt(client, &exch->start, exch->num_retrans);
+        }
+        ret = coap_client_handle_sep_response(client, resp);
+        coap_client_exch_complete(client, exch, resp, ret);
+        return;
+    }
+    /* message deduplication */
+    /* we might have received a duplicate message that was already received from the same server */
+    /* reject the message and continue listening */
+    coap_client_reject(client, resp);
+}
+
+/**
+ *  @brief Check if any asynchronous exchange is in progress
+ *
+ *  @param[in] client Pointer to a client structure
+ *
+ *  @returns Indication of whether or not any asynchronous exchange is in progress
+ *  @retval 1 At least one asynchronous exchange is in progress
+ *  @retval 0 No asynchronous exchange is in progress
+ */
+static int coap_client_async_active(coap_client_t *client)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < client->nstart; i++)
+    {
+        if (client->exch[i].state != COAP_CLIENT_ASYNC_IDLE)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int coap_client_submit(coap_client_t *client, coap_msg_t *req, void (* done)(coap_client_t *, coap_msg_t *, int, void *), void *data)
+{
+    coap_client_exch_t *exch = NULL;
+    unsigned char msg_id_buf[2] = {0};
+    unsigned msg_id = 0;
+    ssize_t num = 0;
+    char token[4] = {0};
+    int ret = 0;
+
+    if ((client == NULL) || (req == NULL) || (done == NULL))
+    {
+        return -EINVAL;
+    }
+
+    /* check for a valid request */
+    if ((coap_msg_get_type(req) == COAP_MSG_ACK)
+     || (coap_msg_get_type(req) == COAP_MSG_RST)
+     || (coap_msg_get_code_class(req) != COAP_MSG_REQ))
+    {
+        return -EINVAL;
+    }
+
+    /* generate the message ID */
+    coap_msg_gen_rand_str((char *)msg_id_buf, sizeof(msg_id_buf));
+    msg_id = (((unsigned)msg_id_buf[1]) << 8) | (unsigned)msg_id_buf[0];
+    ret = coap_msg_set_msg_id(req, msg_id);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    /* generate a token that is unique among the exchanges in progress */
+    do
+    {
+        coap_msg_gen_rand_str(token, sizeof(token));
+        ret = coap_msg_set_token(req, token, sizeof(token));
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    while (coap_client_find_exch_by_token(client, req) != NULL);
+
+    exch = coap_client_find_free_exch(client, token, sizeof(token));
+    if (exch == NULL)
+    {
+        return -EBUSY;
+    }
+
+    /* retain a copy of the request for retransmission and matching */
+    coap_msg_create(&exch->req);
+    ret = coap_msg_copy(&exch->req, req);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&exch->req);
+        return ret;
+    }
+
+    if (coap_msg_get_type(req) == COAP_MSG_CON)
+    {
+        coap_log_info("Sending confirmable request to host %s and port %s", client->server_host, client->server_port);
+    }
+    else if (coap_msg_get_type(req) == COAP_MSG_NON)
+    {
+        coap_log_info("Sending non-confirmable request to host %s and port %s", client->server_host, client->server_port);
+    }
+
+    num = coap_client_send(client, &exch->req);
+    if (num < 0)
+    {
+        coap_msg_destroy(&exch->req);
+        return num;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &exch->start);
+
+    if (coap_msg_get_type(req) == COAP_MSG_CON)
+    {
+        coap_log_info("Expecting acknowledgement from host %s and port %s", client->server_host, client->server_port);
+        ret = coap_client_exch_init_ack_timeout(client, exch);
+        exch->state = COAP_CLIENT_ASYNC_ACK;
+    }
+    else
+    {
+        coap_log_info("Expecting response from host %s and port %s", client->server_host, client->server_port);
+        ret = coap_client_exch_init_resp_timeout(exch);
+        exch->state = COAP_CLIENT_ASYNC_RESP;
+    }
+    if (ret == 0)
+    {
+        ret = coap_client_async_arm_timer(client);
+    }
+    if (ret < 0)
+    {
+        coap_msg_destroy(&exch->req);
+        memset(exch, 0, sizeof(coap_client_exch_t));
+        coap_client_async_arm_timer(client);
+        return ret;
+    }
+    exch->done = done;
+    exch->data = data;
+    return 0;
+}
+
+int coap_client_set_adaptive_rto(coap_client_t *client, int enable)
+{
+    if (client == NULL)
+    {
+        return -EINVAL;
+    }
+    client->adaptive_rto = (enable != 0);
+    client->rto_msec = COAP_CLIENT_RTO_INIT_MSEC;
+    client->srtt_strong_msec = 0;
+    client->rttvar_strong_msec = 0;
+    client->srtt_weak_msec = 0;
+    client->rttvar_weak_msec = 0;
+    return 0;
+}
+
+int coap_client_set_nstart(coap_client_t *client, unsigned nstart)
+{
+    coap_client_exch_t *exch = NULL;
+
+    if ((client == NULL) || (nstart == 0))
+    {
+        return -EINVAL;
+    }
+    if (coap_client_async_active(client))
+    {
+        return -EBUSY;
+    }
+    exch = (coap_client_exch_t *)coap_mem_alloc(&client->mem, nstart * sizeof(coap_client_exch_t));
+    if (exch == NULL)
+    {
+        return -ENOMEM;
+    }
+    memset(exch, 0, nstart * sizeof(coap_client_exch_t));
+    coap_mem_free(client->exch);
+    client->exch = exch;
+    client->nstart = nstart;
+    return 0;
+}
+
+void coap_client_set_mem_budget(coap_client_t *client, size_t budget)
+{
+    client->mem.budget = budget;
+    coap_log_debug("Set memory budget to %zu bytes", budget);
+}
+
+void coap_client_get_mem_acct(coap_client_t *client, coap_mem_acct_t *acct)
+{
+    memcpy(acct, &client->mem, sizeof(coap_mem_acct_t));
+}
+
+int coap_client_process(coap_client_t *client)
+{
+    coap_client_exch_t *exch = NULL;
+    struct timespec now = {0};
+    coap_msg_t resp = {0};
+    uint64_t expiry = 0;
+    ssize_t num = 0;
+    unsigned i = 0;
+    int ret = 0;
+
+    if (client == NULL)
+    {
+        return -EINVAL;
+    }
+    if (!coap_client_async_active(client))
+    {
+        return 0;
+    }
+
+    /* handle a timer expiry */
+    num = read(client->timer_fd, &expiry, sizeof(expiry));
+    if (num == (ssize_t)sizeof(expiry))
+    {
+        ret = clock_gettime(CLOCK_MONOTONIC, &now);
+        if (ret < 0)
+        {
+            return -errno;
+        }
+        for (i = 0; i < client->nstart; i++)
+        {
+            exch = &client->exch[i];
+            if ((exch->state != COAP_CLIENT_ASYNC_IDLE)
+             && ((exch->expiry.tv_sec < now.tv_sec)
+              || ((exch->expiry.tv_sec == now.tv_sec)
+               && (exch->expiry.tv_nsec <= now.tv_nsec))))
+            {
+                coap_client_exch_handle_timeout(client, exch);
+            }
+        }
+        ret = coap_client_async_arm_timer(client);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+
+    /* handle received messages */
+    while (coap_client_async_active(client))
+    {
+        coap_msg_create(&resp);
+        num = coap_client_recv(client, &resp);
+        if (num == -EAGAIN)
+        {
+            /* no message is ready yet */
+            coap_msg_destroy(&resp);
+            break;
+        }
+        if (num == -EBADMSG)
+        {
+            /* a reset message has been sent, the message cannot be matched to an exchange */
+            coap_msg_destroy(&resp);
+            continue;
+        }
+        if (num < 0)
+        {
+            coap_msg_destroy(&resp);
+            return num;
+        }
+        coap_client_async_handle_msg(client, &resp);
+        coap_msg_destroy(&resp);
+    }
+    return 0;
+}
@@ -33,9 +33,42 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include "coap_log.h"
 
+/* the log functions defined here must not be expanded
+ * by the guard macros declared in coap_log.h
+ */
+#undef coap_log_warn
+#undef coap_log_notice
+#undef coap_log_info
+#undef coap_log_debug
+
+#define COAP_LOG_RING_SIZE       1024                                           /**< Number of records in the asynchronous log ring buffer, must be a power of 2 */
+#define COAP_LOG_REC_LEN         256                                            /**< Size of a record in the asynchronous log ring buffer */
+#define COAP_LOG_WRITER_IDLE_NS  1000000                                        /**< Time for the writer thread to sleep when the ring buffer is empty (nsec) */
+
+/**
+ *  @brief Asynchronous log record structure
+ */
+typedef struct
+{
+    unsigned long seq;                                                          /**< Sequence number used to synchronise producers and the writer thread */
+    char str[COAP_LOG_REC_LEN];                                                 /**< Formatted log message */
+}
+coap_log_rec_t;
+
 static coap_log_level_t coap_log_level = COAP_LOG_DEF_LEVEL;                    /**< Log level used to filter log messages */
+static coap_log_rec_t coap_log_ring[COAP_LOG_RING_SIZE] = {{0}};                /**< Ring buffer of log records awaiting the writer thread */
+static unsigned long coap_log_ring_head = 0;                                    /**< Index of the next record to be claimed by a producer */
+static unsigned long coap_log_ring_tail = 0;                                    /**< Index of the next record to be consumed by the writer thread */
+static unsigned long coap_log_num_dropped = 0;                                  /**< Number of log messages dropped due to ring buffer overflow */
+static pthread_t coap_log_writer_thread = 0;                                    /**< Writer thread that drains the ring buffer */
+static int coap_log_async_en = 0;                                               /**< Flag to indicate that asynchronous mode is enabled */
+static int coap_log_writer_run = 0;                                             /**< Flag to keep the writer thread running */
 
 void coap_log_set_level(coap_log_level_t level)
 {
@@ -56,6 +89,180 @@ coap_log_level_t coap_log_get_level(void)
     return coap_log_level;
 }
 
+/**
+ *  @brief Append a log message to the ring buffer
+ *
+ *  Claim the record at the head of the ring buffer by atomically
+ *  advancing the head index, format the message into the record
+ *  and publish it to the writer thread by advancing the record's
+ *  sequence number. If the ring buffer is full then the message
+ *  is dropped and the drop counter is incremented.
+ *
+ *  @param[in] prefix String containing the log level prefix
+ *  @param[in] msg String containing format specifiers
+ *  @param[in] arg_list Arguments for the format specifiers
+ */
+static void coap_log_enqueue(const char *prefix, const char *msg, va_list arg_list)
+{
+    coap_log_rec_t *rec = NULL;
+    unsigned long seq = 0;
+    unsigned long pos = 0;
+    int len = 0;
+    int num = 0;
+
+    pos = __atomic_load_n(&coap_log_ring_head, __ATOMIC_RELAXED);
+    while (1)
+    {
+        rec = &coap_log_ring[pos & (COAP_LOG_RING_SIZE - 1)];
+        seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos)
+        {
+            if (__atomic_compare_exchange_n(&coap_log_ring_head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if ((long)(seq - pos) < 0)
+        {
+            /* the record has not been consumed yet, the ring buffer is full */
+            __atomic_fetch_add(&coap_log_num_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            pos = __atomic_load_n(&coap_log_ring_head, __ATOMIC_RELAXED);
+        }
+    }
+    len = snprintf(rec->str, sizeof(rec->str), "%s", prefix);
+    num = vsnprintf(rec->str + len, sizeof(rec->str) - len, msg, arg_list);
+    if (num > 0)
+    {
+        len += num;
+    }
+    if (len > (int)sizeof(rec->str) - 2)
+    {
+        len = sizeof(rec->str) - 2;
+    }
+    rec->str[len] = '\n';
+    rec->str[len + 1] = '\0';
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ *  @brief Write published records from the ring buffer to the output
+ *
+ *  @returns Number of records written
+ */
+static int coap_log_drain(void)
+{
+    coap_log_rec_t *rec = NULL;
+    unsigned long pos = 0;
+    int num = 0;
+
+    pos = coap_log_ring_tail;
+    while (1)
+    {
+        rec = &coap_log_ring[pos & (COAP_LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != pos + 1)
+        {
+            break;
+        }
+        fputs(rec->str, stdout);
+        __atomic_store_n(&rec->seq, pos + COAP_LOG_RING_SIZE, __ATOMIC_RELEASE);
+        pos++;
+        num++;
+    }
+    coap_log_ring_tail = pos;
+    return num;
+}
+
+/**
+ *  @brief Writer thread main function
+ *
+ *  Drain the ring buffer until asynchronous mode is disabled,
+ *  sleeping briefly whenever the ring buffer is empty.
+ *
+ *  @param[in] data Not used
+ *
+ *  @returns Not used
+ */
+static void *coap_log_writer(void *data)
+{
+    struct timespec idle = {0, COAP_LOG_WRITER_IDLE_NS};
+
+    while (__atomic_load_n(&coap_log_writer_run, __ATOMIC_ACQUIRE))
+    {
+        if (coap_log_drain() == 0)
+        {
+            nanosleep(&idle, NULL);
+        }
+        else
+        {
+            fflush(stdout);
+        }
+    }
+    /* write any records left in the ring buffer */
+    coap_log_drain();
+    fflush(stdout);
+    return NULL;
+}
+
+int coap_log_set_async(int enable)
+{
+    unsigned long i = 0;
+    int ret = 0;
+
+    if ((enable) && (!coap_log_async_en))
+    {
+        for (i = 0; i < COAP_LOG_RING_SIZE; i++)
+        {
+            coap_log_ring[i].seq = i;
+        }
+        coap_log_ring_head = 0;
+        coap_log_ring_tail = 0;
+        __atomic_store_n(&coap_log_writer_run, 1, __ATOMIC_RELEASE);
+        ret = pthread_create(&coap_log_writer_thread, NULL, coap_log_writer, NULL);
+        if (ret != 0)
+        {
+            __atomic_store_n(&coap_log_writer_run, 0, __ATOMIC_RELEASE);
+            return -ret;
+        }
+        __atomic_store_n(&coap_log_async_en, 1, __ATOMIC_RELEASE);
+    }
+    else if ((!enable) && (coap_log_async_en))
+    {
+        __atomic_store_n(&coap_log_async_en, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&coap_log_writer_run, 0, __ATOMIC_RELEASE);
+        pthread_join(coap_log_writer_thread, NULL);
+    }
+    return 0;
+}
+
+unsigned long coap_log_get_num_dropped(void)
+{
+    return __atomic_load_n(&coap_log_num_dropped, __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief Log a message synchronously or via the ring buffer
+ *
+ *  @param[in] prefix String containing the log level prefix
+ *  @param[in] msg String containing format specifiers
+ *  @param[in] arg_list Arguments for the format specifiers
+ */
+static void coap_log_msg(const char *prefix, const char *msg, va_list arg_list)
+{
+    if (__atomic_load_n(&coap_log_async_en, __ATOMIC_ACQUIRE))
+    {
+        coap_log_enqueue(prefix, msg, arg_list);
+        return;
+    }
+    printf("%s", prefix);
+    vprintf(msg, arg_list);
+    printf("\n");
+}
+
 void coap_log_error(const char *msg, ...)
 {
     va_list arg_list;
@@ -63,9 +270,7 @@ void coap_log_error(const char *msg, ...)
     va_start(arg_list, msg);
     if (COAP_LOG_ERROR <= coap_log_level)
     {
-        printf("Error  : ");
-        vprintf(msg, arg_list);
-        printf("\n");
+        coap_log_msg("Error  : ", msg, arg_list);
     }
     va_end(arg_list);
 }
@@ -77,9 +282,7 @@ void coap_log_warn(const char *msg, ...)
     va_start(arg_list, msg);
     if (COAP_LOG_WARN <= coap_log_level)
     {
-        printf("Warning: ");
-        vprintf(msg, arg_list);
-        printf("\n");
+        coap_log_msg("Warning: ", msg, arg_list);
     }
     va_end(arg_list);
 }
@@ -91,9 +294,7 @@ void coap_log_notice(const char *msg, ...)
     va_start(arg_list, msg);
     if (COAP_LOG_NOTICE <= coap_log_level)
     {
-        printf("Notice : ");
-        vprintf(msg, arg_list);
-        printf("\n");
+        coap_log_msg("Notice : ", msg, arg_list);
     }
     va_end(arg_list);
 }
@@ -105,9 +306,7 @@ void coap_log_info(const char *msg, ...)
     va_start(arg_list, msg);
     if (COAP_LOG_INFO <= coap_log_level)
     {
-        printf("Info   : ");
-        vprintf(msg, arg_list);
-        printf("\n");
+        coap_log_msg("Info   : ", msg, arg_list);
     }
     va_end(arg_list);
 }
@@ -119,9 +318,7 @@ void coap_log_debug(const char *msg, ...)
     va_start(arg_list, msg);
     if (COAP_LOG_DEBUG <= coap_log_level)
     {
-        printf("Debug  : ");
-        vprintf(msg, arg_list);
-        printf("\n");
+        coap_log_msg("Debug  : ", msg, arg_list);
     }
     va_end(arg_list);
 }
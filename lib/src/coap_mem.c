@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file coap_mem.c
+ *
+ *  @brief Source file for the FreeCoAP memory accounting module
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "coap_mem.h"
+
+/**
+ *  @brief Allocation header structure
+ *
+ *  Prepended to every allocation so that coap_mem_free can
+ *  credit the bytes back to the owning accounting structure
+ *  without the caller passing the length or the owner. The
+ *  structure is two pointers in size which preserves the
+ *  alignment of the memory that follows it.
+ */
+typedef struct
+{
+    coap_mem_acct_t *acct;                                                      /**< Pointer to the accounting structure the allocation is charged to */
+    size_t len;                                                                 /**< Number of bytes requested by the caller */
+}
+coap_mem_hdr_t;
+
+static void *(*coap_mem_alloc_func)(size_t) = malloc;                           /**< Underlying allocation function */
+static void (*coap_mem_free_func)(void *) = free;                               /**< Underlying deallocation function */
+
+void coap_mem_set_hooks(void *(*alloc_func)(size_t), void (*free_func)(void *))
+{
+    coap_mem_alloc_func = (alloc_func != NULL) ? alloc_func : malloc;
+    coap_mem_free_func = (free_func != NULL) ? free_func : free;
+}
+
+void coap_mem_acct_init(coap_mem_acct_t *acct, size_t budget)
+{
+    memset(acct, 0, sizeof(coap_mem_acct_t));
+    acct->budget = budget;
+}
+
+void *coap_mem_alloc(coap_mem_acct_t *acct, size_t len)
+{
+    coap_mem_hdr_t *hdr = NULL;
+
+    if (acct != NULL)
+    {
+        if ((acct->budget > 0) && (acct->cur + len > acct->budget))
+        {
+            acct->num_fails++;
+            return NULL;
+        }
+    }
+    hdr = (coap_mem_hdr_t *)(*coap_mem_alloc_func)(sizeof(coap_mem_hdr_t) + len);
+    if (hdr == NULL)
+    {
+        return NULL;
+    }
+    hdr->acct = acct;
+    hdr->len = len;
+    if (acct != NULL)
+    {
+        acct->cur += len;
+        if (acct->cur > acct->peak)
+        {
+            acct->peak = acct->cur;
+        }
+    }
+    return hdr + 1;
+}
+
+void *coap_mem_realloc(coap_mem_acct_t *acct, void *ptr, size_t len)
+{
+    coap_mem_hdr_t *hdr = NULL;
+    void *mem = NULL;
+
+    if (ptr == NULL)
+    {
+        return coap_mem_alloc(acct, len);
+    }
+    hdr = (coap_mem_hdr_t *)ptr - 1;
+    mem = coap_mem_alloc(acct, len);
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+    memcpy(mem, ptr, (hdr->len < len) ? hdr->len : len);
+    coap_mem_free(ptr);
+    return mem;
+}
+
+char *coap_mem_strdup(coap_mem_acct_t *acct, const char *str)
+{
+    size_t len = 0;
+    char *mem = NULL;
+
+    len = strlen(str) + 1;
+    mem = (char *)coap_mem_alloc(acct, len);
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+    memcpy(mem, str, len);
+    return mem;
+}
+
+void coap_mem_free(void *ptr)
+{
+    coap_mem_hdr_t *hdr = NULL;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+    hdr = (coap_mem_hdr_t *)ptr - 1;
+    if (hdr->acct != NULL)
+    {
+        hdr->acct->cur -= hdr->len;
+    }
+    (*coap_mem_free_func)(hdr);
+}
@@ -60,143 +60,460 @@ void coap_msg_gen_rand_str(char *buf, size_t len)
     }
 }
 
+/**
+ *  Option descriptor table indexed by option number
+ *
+ *  The critical, unsafe and no-cache-key flags and the
+ *  length bounds and repeatability are from RFC 7252.
+ */
+static const coap_msg_op_desc_t coap_msg_op_desc_table[] =
+{
+    [COAP_MSG_IF_MATCH]       = {.recognized = 1, .critical = 1, .unsafe = 0, .no_cache_key = 0, .repeatable = 1, .min_len = 0, .max_len = 8},
+    [COAP_MSG_URI_HOST]       = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 1, .max_len = 255},
+    [COAP_MSG_ETAG]           = {.recognized = 1, .critical = 0, .unsafe = 0, .no_cache_key = 0, .repeatable = 1, .min_len = 1, .max_len = 8},
+    [COAP_MSG_IF_NONE_MATCH]  = {.recognized = 1, .critical = 1, .unsafe = 0, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 0},
+    [COAP_MSG_OBSERVE]        = {.recognized = 1, .critical = 0, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 3},
+    [COAP_MSG_URI_PORT]       = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 2},
+    [COAP_MSG_LOCATION_PATH]  = {.recognized = 1, .critical = 0, .unsafe = 0, .no_cache_key = 0, .repeatable = 1, .min_len = 0, .max_len = 255},
+    [COAP_MSG_URI_PATH]       = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 1, .min_len = 0, .max_len = 255},
+    [COAP_MSG_CONTENT_FORMAT] = {.recognized = 1, .critical = 0, .unsafe = 0, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 2},
+    [COAP_MSG_MAX_AGE]        = {.recognized = 1, .critical = 0, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 4},
+    [COAP_MSG_URI_QUERY]      = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 1, .min_len = 0, .max_len = 255},
+    [COAP_MSG_ACCEPT]         = {.recognized = 1, .critical = 1, .unsafe = 0, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 2},
+    [COAP_MSG_LOCATION_QUERY] = {.recognized = 1, .critical = 0, .unsafe = 0, .no_cache_key = 0, .repeatable = 1, .min_len = 0, .max_len = 255},
+    [COAP_MSG_BLOCK2]         = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 3},
+    [COAP_MSG_BLOCK1]         = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 0, .max_len = 3},
+    [COAP_MSG_SIZE2]          = {.recognized = 1, .critical = 0, .unsafe = 0, .no_cache_key = 1, .repeatable = 0, .min_len = 0, .max_len = 4},
+    [COAP_MSG_PROXY_URI]      = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 1, .max_len = 1034},
+    [COAP_MSG_PROXY_SCHEME]   = {.recognized = 1, .critical = 1, .unsafe = 1, .no_cache_key = 0, .repeatable = 0, .min_len = 1, .max_len = 255},
+    [COAP_MSG_SIZE1]          = {.recognized = 1, .critical = 0, .unsafe = 0, .no_cache_key = 1, .repeatable = 0, .min_len = 0, .max_len = 4}
+};
+
+/**
+ *  Descriptor returned for unrecognized option numbers
+ */
+static const coap_msg_op_desc_t coap_msg_op_desc_unrecognized = {0};
+
+#define COAP_MSG_NUM_OP_DESC  (sizeof(coap_msg_op_desc_table) / sizeof(coap_msg_op_desc_table[0]))
+                                                                                /**< Number of entries in the option descriptor table */
+
+const coap_msg_op_desc_t *coap_msg_op_num_get_desc(unsigned num)
+{
+    if (num >= COAP_MSG_NUM_OP_DESC)
+    {
+        return &coap_msg_op_desc_unrecognized;
+    }
+    return &coap_msg_op_desc_table[num];
+}
+
+int coap_msg_op_num_check_len(unsigned num, unsigned len)
+{
+    const coap_msg_op_desc_t *desc = NULL;
+
+    desc = coap_msg_op_num_get_desc(num);
+    if (!desc->recognized)
+    {
+        return 0;
+    }
+    if ((len < desc->min_len) || (len > desc->max_len))
+    {
+        return -EBADMSG;
+    }
+    return 0;
+}
+
 int coap_msg_op_num_is_recognized(unsigned num)
 {
-    switch (num)
-    {
-    case COAP_MSG_IF_MATCH:
-    case COAP_MSG_URI_HOST:
-    case COAP_MSG_ETAG:
-    case COAP_MSG_IF_NONE_MATCH:
-    case COAP_MSG_URI_PORT:
-    case COAP_MSG_LOCATION_PATH:
-    case COAP_MSG_URI_PATH:
-    case COAP_MSG_CONTENT_FORMAT:
-    case COAP_MSG_MAX_AGE:
-    case COAP_MSG_URI_QUERY:
-    case COAP_MSG_ACCEPT:
-    case COAP_MSG_LOCATION_QUERY:
-    case COAP_MSG_PROXY_URI:
-    case COAP_MSG_PROXY_SCHEME:
-    case COAP_MSG_SIZE1:
-        return 1;
+    return coap_msg_op_num_get_desc(num)->recognized;
+}
+
+int coap_msg_op_calc_block_szx(unsigned size)
+{
+    int szx = 0;
+
+    for (szx = 0; szx <= 6; szx++)
+    {
+        if (size == (16u << szx))
+        {
+            return szx;
+        }
+    }
+    return -EINVAL;
+}
+
+int coap_msg_op_parse_block_val(unsigned *num, unsigned *more, unsigned *size, const char *val, unsigned len)
+{
+    unsigned block_val = 0;
+    unsigned szx = 0;
+    unsigned i = 0;
+
+    if (len > 3)
+    {
+        return -EINVAL;
+    }
+    for (i = 0; i < len; i++)
+    {
+        block_val = (block_val << 8) | (unsigned char)val[i];
+    }
+    szx = block_val & 0x7;
+    if (szx == 7)
+    {
+        /* reserved value */
+        return -EBADMSG;
     }
+    *num = block_val >> 4;
+    *more = (block_val >> 3) & 0x1;
+    *size = 16u << szx;
     return 0;
 }
 
+ssize_t coap_msg_op_format_block_val(char *val, unsigned len, unsigned num, unsigned more, unsigned size)
+{
+    unsigned block_val = 0;
+    unsigned val_len = 0;
+    unsigned i = 0;
+    int szx = 0;
+
+    szx = coap_msg_op_calc_block_szx(size);
+    if (szx < 0)
+    {
+        return szx;
+    }
+    if (num > 0x000fffff)
+    {
+        return -EINVAL;
+    }
+    block_val = (num << 4) | ((more & 0x1) << 3) | (unsigned)szx;
+    if (block_val > 0xffff)
+    {
+        val_len = 3;
+    }
+    else if (block_val > 0xff)
+    {
+        val_len = 2;
+    }
+    else if (block_val > 0)
+    {
+        val_len = 1;
+    }
+    if (val_len > len)
+    {
+        return -EINVAL;
+    }
+    for (i = 0; i < val_len; i++)
+    {
+        val[i] = (block_val >> (8 * (val_len - i - 1))) & 0xff;
+    }
+    return val_len;
+}
+
 /**
- *  @brief Allocate an option structure
+ *  @brief Initialise an arena structure
  *
- *  @param[in] num Option number
- *  @param[in] len Option length
- *  @param[in] val Pointer to the option value
+ *  @param[out] arena Pointer to an arena structure
+ */
+static void coap_msg_arena_create(coap_msg_arena_t *arena)
+{
+    memset(arena, 0, sizeof(coap_msg_arena_t));
+}
+
+/**
+ *  @brief Deinitialise an arena structure
+ *
+ *  All of the blocks in the arena are freed.
+ *
+ *  @param[in,out] arena Pointer to an arena structure
+ */
+static void coap_msg_arena_destroy(coap_msg_arena_t *arena)
+{
+    coap_msg_arena_block_t *prev = NULL;
+    coap_msg_arena_block_t *block = NULL;
+
+    block = arena->first;
+    while (block != NULL)
+    {
+        prev = block;
+        block = block->next;
+        coap_mem_free(prev);
+    }
+    memset(arena, 0, sizeof(coap_msg_arena_t));
+}
+
+/**
+ *  @brief Recycle an arena structure
+ *
+ *  The blocks in the arena are retained and marked unused
+ *  so that they can back the options of the next message
+ *  without going back to the allocator.
+ *
+ *  @param[in,out] arena Pointer to an arena structure
+ */
+static void coap_msg_arena_recycle(coap_msg_arena_t *arena)
+{
+    coap_msg_arena_block_t *block = NULL;
+
+    block = arena->first;
+    while (block != NULL)
+    {
+        block->used = 0;
+        block = block->next;
+    }
+    arena->block = arena->first;
+}
+
+/**
+ *  @brief Allocate memory from an arena structure
+ *
+ *  A new block is chained to the arena if the current
+ *  block does not have sufficient unused space.
  *
- *  @returns Pointer to the option structure
+ *  @param[in,out] arena Pointer to an arena structure
+ *  @param[in] len Number of bytes to allocate
+ *
+ *  @returns Pointer to the allocated memory
  *  @retval NULL Out-of-memory
  */
-static coap_msg_op_t *coap_msg_op_new(unsigned num, unsigned len, const char *val)
+static void *coap_msg_arena_alloc(coap_msg_arena_t *arena, size_t len)
 {
-    coap_msg_op_t *op = NULL;
+    coap_msg_arena_block_t *block = NULL;
+    coap_msg_arena_block_t *last = NULL;
+    size_t block_len = 0;
+    void *mem = NULL;
 
-    op = (coap_msg_op_t *)malloc(sizeof(coap_msg_op_t));
-    if (op == NULL)
+    /* keep allocations aligned for structure types */
+    len = (len + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    block = arena->block;
+    while (block != NULL)
+    {
+        if (block->len - block->used >= len)
+        {
+            mem = block->data + block->used;
+            block->used += len;
+            arena->block = block;
+            return mem;
+        }
+        last = block;
+        block = block->next;
+    }
+    block_len = COAP_MSG_ARENA_BLOCK_LEN;
+    if (len > block_len)
+    {
+        block_len = len;
+    }
+    block = (coap_msg_arena_block_t *)coap_mem_alloc(arena->mem, sizeof(coap_msg_arena_block_t) + block_len);
+    if (block == NULL)
     {
         return NULL;
     }
-    op->num = num;
+    block->next = NULL;
+    block->len = block_len;
+    block->used = len;
+    block->data = (char *)(block + 1);
+    if (arena->first == NULL)
+    {
+        arena->first = block;
+    }
+    else
+    {
+        last->next = block;
+    }
+    arena->block = block;
+    return block->data;
+}
+
+/**
+ *  @brief Initialise the value in an option structure
+ *
+ *  Small values are stored in the in-struct buffer,
+ *  borrowed values point into the caller-owned buffer
+ *  and oversized values are backed by the arena.
+ *
+ *  @param[in,out] op Pointer to an option structure
+ *  @param[in,out] arena Pointer to the arena structure that backs oversized values
+ *  @param[in] len Option length
+ *  @param[in] val Pointer to the option value
+ *  @param[in] borrow Borrow the value instead of copying it
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_msg_op_set_val_buf(coap_msg_op_t *op, coap_msg_arena_t *arena, unsigned len, const char *val, int borrow)
+{
     op->len = len;
-    op->val = (char *)malloc(len);
-    if (op->val == NULL)
+    op->inline_val = 0;
+    if (borrow)
     {
-        free(op);
-        return NULL;
+        op->val = (char *)val;
+    }
+    else if (len <= COAP_MSG_OP_INLINE_VAL_LEN)
+    {
+        memcpy(op->val_buf, val, len);
+        op->val = op->val_buf;
+        op->inline_val = 1;
+    }
+    else
+    {
+        op->val = (char *)coap_msg_arena_alloc(arena, len);
+        if (op->val == NULL)
+        {
+            return -ENOMEM;
+        }
+        memcpy(op->val, val, len);
     }
-    memcpy(op->val, val, len);
-    op->next = NULL;
-    return op;
+    return 0;
 }
 
 /**
- *  @brief Free an option structure that was allocated by coap_msg_op_new
+ *  @brief Restore the pointers in an option list structure
+ *
+ *  The option structures are relocated when the array is
+ *  grown or an option is inserted mid-array, so the next
+ *  pointers and in-struct value pointers are rebuilt.
  *
- *  @param[in,out] op Pointer to the option structure
+ *  @param[in,out] list Pointer to an option list structure
  */
-static void coap_msg_op_delete(coap_msg_op_t *op)
+static void coap_msg_op_list_relink(coap_msg_op_list_t *list)
 {
-    free(op->val);
-    free(op);
+    unsigned i = 0;
+
+    if (list->num == 0)
+    {
+        list->first = NULL;
+        list->last = NULL;
+        return;
+    }
+    for (i = 0; i < list->num; i++)
+    {
+        if (list->ops[i].inline_val)
+        {
+            list->ops[i].val = list->ops[i].val_buf;
+        }
+        if (i + 1 < list->num)
+        {
+            list->ops[i].next = &list->ops[i + 1];
+        }
+        else
+        {
+            list->ops[i].next = NULL;
+        }
+    }
+    list->first = &list->ops[0];
+    list->last = &list->ops[list->num - 1];
 }
 
 /**
- *  @brief Initialise an option linked-list structure
+ *  @brief Initialise an option list structure
  *
- *  @param[out] list Pointer to an option linked-list structure
+ *  @param[out] list Pointer to an option list structure
  */
 static void coap_msg_op_list_create(coap_msg_op_list_t *list)
 {
     memset(list, 0, sizeof(coap_msg_op_list_t));
+    list->ops = list->inline_ops;
+    list->cap = COAP_MSG_NUM_INLINE_OPS;
 }
 
 /**
- *  @brief Deinitialise an option linked-list structure
+ *  @brief Deinitialise an option list structure
+ *
+ *  Oversized option values are backed by the arena in the
+ *  message that owns them and are released with it.
  *
- *  @param[in,out] list Pointer to an option linked-list structure
+ *  @param[in,out] list Pointer to an option list structure
  */
 static void coap_msg_op_list_destroy(coap_msg_op_list_t *list)
 {
-    coap_msg_op_t *prev = NULL;
-    coap_msg_op_t *op = NULL;
-
-    op = list->first;
-    while (op != NULL)
+    if (list->ops != list->inline_ops)
     {
-        prev = op;
-        op = op->next;
-        coap_msg_op_delete(prev);
+        coap_mem_free(list->ops);
     }
     memset(list, 0, sizeof(coap_msg_op_list_t));
 }
 
 /**
- *  @brief Allocate an option structure and add it to the end of an option linked-list structure
+ *  @brief Ensure an option list structure has space for one more option
+ *
+ *  The array is moved to a larger heap buffer when the
+ *  in-struct array is full.
+ *
+ *  @param[in,out] list Pointer to an option list structure
+ *  @param[in,out] mem Pointer to a memory accounting structure or NULL
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_msg_op_list_grow(coap_msg_op_list_t *list, coap_mem_acct_t *mem)
+{
+    coap_msg_op_t *ops = NULL;
+    unsigned cap = 0;
+
+    if (list->num < list->cap)
+    {
+        return 0;
+    }
+    cap = 2 * list->cap;
+    ops = (coap_msg_op_t *)coap_mem_alloc(mem, cap * sizeof(coap_msg_op_t));
+    if (ops == NULL)
+    {
+        return -ENOMEM;
+    }
+    memcpy(ops, list->ops, list->num * sizeof(coap_msg_op_t));
+    if (list->ops != list->inline_ops)
+    {
+        coap_mem_free(list->ops);
+    }
+    list->ops = ops;
+    list->cap = cap;
+    coap_msg_op_list_relink(list);
+    return 0;
+}
+
+/**
+ *  @brief Add an option to the end of an option list structure
  *
- *  @param[in,out] list Pointer to an option linked-list structure
+ *  @param[in,out] list Pointer to an option list structure
+ *  @param[in,out] arena Pointer to the arena structure that backs oversized values
  *  @param[in] num Option number
  *  @param[in] len Option length
  *  @param[in] val Pointer to a buffer containing the option value
+ *  @param[in] borrow Borrow the value instead of copying it
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_msg_op_list_add_last(coap_msg_op_list_t *list, unsigned num, unsigned len, const char *val)
+static int coap_msg_op_list_add_last(coap_msg_op_list_t *list, coap_msg_arena_t *arena, unsigned num, unsigned len, const char *val, int borrow)
 {
     coap_msg_op_t *op = NULL;
+    int ret = 0;
 
-    op = coap_msg_op_new(num, len, val);
-    if (op == NULL)
-    {
-        return -ENOMEM;
-    }
-    if (list->first == NULL)
+    ret = coap_msg_op_list_grow(list, arena->mem);
+    if (ret < 0)
     {
-        list->first = op;
-        list->last = op;
+        return ret;
     }
-    else
+    op = &list->ops[list->num];
+    memset(op, 0, sizeof(coap_msg_op_t));
+    op->num = num;
+    ret = coap_msg_op_set_val_buf(op, arena, len, val, borrow);
+    if (ret < 0)
     {
-        list->last->next = op;
-        list->last = op;
+        return ret;
     }
+    list->num++;
+    coap_msg_op_list_relink(list);
     return 0;
 }
 
 /**
- *  @brief Allocate an option structure and add it to an option linked-list structure
+ *  @brief Add an option to an option list structure
  *
- *  The option is added to the list at a position determined by the option number.
+ *  The option is added to the array at a position determined by the option number.
  *
- *  @param[in,out] list Pointer to an option linked-list structure
+ *  @param[in,out] list Pointer to an option list structure
+ *  @param[in,out] arena Pointer to the arena structure that backs oversized values
  *  @param[in] num Option number
  *  @param[in] len Option length
  *  @param[in] val Pointer to a buffer containing the option value
@@ -205,45 +522,44 @@ static int coap_msg_op_list_add_last(coap_msg_op_list_t *list, unsigned num, uns
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_msg_op_list_add(coap_msg_op_list_t *list, unsigned num, unsigned len, const char *val)
+static int coap_msg_op_list_add(coap_msg_op_list_t *list, coap_msg_arena_t *arena, unsigned num, unsigned len, const char *val)
 {
-    coap_msg_op_t *prev = NULL;
     coap_msg_op_t *op = NULL;
+    unsigned i = 0;
+    int ret = 0;
 
-    op = coap_msg_op_new(num, len, val);
-    if (op == NULL)
+    ret = coap_msg_op_list_grow(list, arena->mem);
+    if (ret < 0)
     {
-        return -ENOMEM;
+        return ret;
     }
-    if (list->first == NULL)
+    while (i < list->num)
     {
-        /* empty list */
-        list->first = op;
-        list->last = op;
-        return 0;
+        if (num < list->ops[i].num)
+        {
+            break;
+        }
+        i++;
     }
-    if (op->num < list->first->num)
+    if (i < list->num)
     {
-        /* start of the list */
-        op->next = list->first;
-        list->first = op;
-        return 0;
+        memmove(&list->ops[i + 1], &list->ops[i], (list->num - i) * sizeof(coap_msg_op_t));
     }
-    prev = list->first;
-    while (prev != list->last)
+    op = &list->ops[i];
+    memset(op, 0, sizeof(coap_msg_op_t));
+    op->num = num;
+    ret = coap_msg_op_set_val_buf(op, arena, len, val, 0);
+    if (ret < 0)
     {
-        /* middle of the list */
-        if ((prev->num <= op->num) && (op->num < prev->next->num))
+        if (i < list->num)
         {
-            op->next = prev->next;
-            prev->next = op;
-            return 0;
+            memmove(&list->ops[i], &list->ops[i + 1], (list->num - i) * sizeof(coap_msg_op_t));
         }
-        prev = prev->next;
+        coap_msg_op_list_relink(list);
+        return ret;
     }
-    /* end of the list */
-    list->last->next = op;
-    list->last = op;
+    list->num++;
+    coap_msg_op_list_relink(list);
     return 0;
 }
 
@@ -251,13 +567,15 @@ void coap_msg_create(coap_msg_t *msg)
 {
     memset(msg, 0, sizeof(coap_msg_t));
     msg->ver = COAP_MSG_VER;
+    coap_msg_arena_create(&msg->arena);
     coap_msg_op_list_create(&msg->op_list);
 }
 
 void coap_msg_destroy(coap_msg_t *msg)
 {
     coap_msg_op_list_destroy(&msg->op_list);
-    if (msg->payload != NULL)
+    coap_msg_arena_destroy(&msg->arena);
+    if ((msg->payload != NULL) && (!msg->borrowed) && (!msg->payload_borrowed))
     {
         free(msg->payload);
     }
@@ -266,8 +584,20 @@ void coap_msg_destroy(coap_msg_t *msg)
 
 void coap_msg_reset(coap_msg_t *msg)
 {
-    coap_msg_destroy(msg);
-    coap_msg_create(msg);
+    coap_msg_arena_t arena = {0};
+
+    /* recycle the arena blocks for the next message */
+    coap_msg_arena_recycle(&msg->arena);
+    arena = msg->arena;
+    coap_msg_op_list_destroy(&msg->op_list);
+    if ((msg->payload != NULL) && (!msg->borrowed) && (!msg->payload_borrowed))
+    {
+        free(msg->payload);
+    }
+    memset(msg, 0, sizeof(coap_msg_t));
+    msg->ver = COAP_MSG_VER;
+    msg->arena = arena;
+    coap_msg_op_list_create(&msg->op_list);
 }
 
 /**
@@ -515,7 +845,23 @@ static ssize_t coap_msg_parse_op(coap_msg_t *msg, char *buf, size_t len)
     {
         op_num = coap_msg_op_get_num(prev) + op_delta;
     }
-    ret = coap_msg_op_list_add_last(&msg->op_list, op_num, op_len, p);
+    if (msg->strict)
+    {
+        /* validate while parsing to avoid a second walk over the option list */
+        ret = coap_msg_op_num_check_len(op_num, op_len);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        if ((prev != NULL)
+         && (op_num == coap_msg_op_get_num(prev))
+         && (!coap_msg_op_num_get_desc(op_num)->repeatable)
+         && (coap_msg_op_num_is_recognized(op_num)))
+        {
+            return -EBADMSG;
+        }
+    }
+    ret = coap_msg_op_list_add_last(&msg->op_list, &msg->arena, op_num, op_len, p, msg->borrowed);
     if (ret < 0)
     {
         return ret;
@@ -586,23 +932,40 @@ static ssize_t coap_msg_parse_payload(coap_msg_t *msg, char *buf, size_t len)
     {
         return -EBADMSG;
     }
-    msg->payload = (char *)malloc(len);
-    if (msg->payload == NULL)
+    if (msg->borrowed)
     {
-        return -ENOMEM;
+        msg->payload = p;
+    }
+    else
+    {
+        msg->payload = (char *)malloc(len);
+        if (msg->payload == NULL)
+        {
+            return -ENOMEM;
+        }
+        memcpy(msg->payload, p, len);
     }
-    memcpy(msg->payload, p, len);
     msg->payload_len = len;
     p += len;
     return p - buf;
 }
 
-ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len)
+/**
+ *  @brief Parse a message that has been reset
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static ssize_t coap_msg_parse_buf(coap_msg_t *msg, char *buf, size_t len)
 {
     ssize_t num = 0;
     char *p = buf;
 
-    coap_msg_reset(msg);
     num = coap_msg_parse_hdr(msg, p, len);
     if (num < 0)
     {
@@ -636,24 +999,315 @@ ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len)
     return coap_msg_check(msg);
 }
 
-int coap_msg_set_type(coap_msg_t *msg, unsigned type)
+ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len)
 {
-    if ((type != COAP_MSG_CON)
-     && (type != COAP_MSG_NON)
-     && (type != COAP_MSG_ACK)
-     && (type != COAP_MSG_RST))
-    {
-        return -EINVAL;
-    }
-    msg->type = type;
-    return 0;
+    coap_msg_reset(msg);
+    return coap_msg_parse_buf(msg, buf, len);
 }
 
-int coap_msg_set_code(coap_msg_t *msg, unsigned code_class, unsigned code_detail)
+/**
+ *  @brief Compute the length of a complete encoded option
+ *
+ *  @param[in] buf Pointer to a buffer containing the start of the option
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Length of the encoded option or status code
+ *  @retval >0 Length of the encoded option
+ *  @retval 0 More bytes are required to compute the length
+ *  @retval <0 Error
+ */
+static ssize_t coap_msg_op_elem_len(const char *buf, size_t len)
 {
-    if (code_class > COAP_MSG_MAX_CODE_CLASS)
+    unsigned op_delta = 0;
+    unsigned op_len = 0;
+    size_t hdr_len = 1;
+    size_t i = 1;
+
+    if (len < 1)
     {
-        return -EINVAL;
+        return 0;
+    }
+    op_delta = (buf[0] >> 4) & 0x0f;
+    op_len = buf[0] & 0x0f;
+    if ((op_delta == 15) || (op_len == 15))
+    {
+        return -EBADMSG;
+    }
+    if (op_delta == 13)
+    {
+        hdr_len += 1;
+        i += 1;
+    }
+    else if (op_delta == 14)
+    {
+        hdr_len += 2;
+        i += 2;
+    }
+    if (op_len == 13)
+    {
+        hdr_len += 1;
+    }
+    else if (op_len == 14)
+    {
+        hdr_len += 2;
+    }
+    if (len < hdr_len)
+    {
+        return 0;
+    }
+    if (op_len == 13)
+    {
+        op_len += buf[i];
+    }
+    else if (op_len == 14)
+    {
+        op_len = 269 + ntohs(*((uint16_t *)(&buf[i])));
+    }
+    return hdr_len + op_len;
+}
+
+/**
+ *  @brief Check whether a parser has consumed a complete message
+ *
+ *  @param[in,out] parser Pointer to a parser structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_msg_parser_finish(coap_msg_parser_t *parser)
+{
+    int ret = 0;
+
+    if (parser->consumed != parser->total_len)
+    {
+        return 0;
+    }
+    if ((parser->stage_len != 0)
+     || ((parser->state != COAP_MSG_PARSER_OPS)
+      && ((parser->state != COAP_MSG_PARSER_PAYLOAD)
+       || (parser->payload_off != parser->msg->payload_len))))
+    {
+        return -EBADMSG;
+    }
+    ret = coap_msg_check(parser->msg);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    parser->state = COAP_MSG_PARSER_DONE;
+    return 0;
+}
+
+void coap_msg_parser_create(coap_msg_parser_t *parser, coap_msg_t *msg, size_t total_len)
+{
+    memset(parser, 0, sizeof(coap_msg_parser_t));
+    coap_msg_reset(msg);
+    parser->msg = msg;
+    parser->total_len = total_len;
+}
+
+ssize_t coap_msg_parser_feed(coap_msg_parser_t *parser, const char *buf, size_t len)
+{
+    coap_msg_t *msg = parser->msg;
+    ssize_t elem = 0;
+    ssize_t num = 0;
+    size_t avail = 0;
+    size_t need = 0;
+    size_t take = 0;
+    size_t pos = 0;
+    int ret = 0;
+
+    while ((pos < len) && (parser->state != COAP_MSG_PARSER_DONE))
+    {
+        avail = len - pos;
+        if (avail > parser->total_len - parser->consumed)
+        {
+            avail = parser->total_len - parser->consumed;
+        }
+        if (avail == 0)
+        {
+            return -EBADMSG;
+        }
+        switch (parser->state)
+        {
+        case COAP_MSG_PARSER_HDR:
+            need = 4 - parser->stage_len;
+            take = need < avail ? need : avail;
+            memcpy(parser->stage + parser->stage_len, buf + pos, take);
+            parser->stage_len += take;
+            parser->consumed += take;
+            pos += take;
+            if (parser->stage_len == 4)
+            {
+                num = coap_msg_parse_hdr(msg, parser->stage, 4);
+                if (num < 0)
+                {
+                    return num;
+                }
+                parser->stage_len = 0;
+                if (msg->token_len > 0)
+                {
+                    parser->state = COAP_MSG_PARSER_TOKEN;
+                }
+                else
+                {
+                    parser->state = COAP_MSG_PARSER_OPS;
+                }
+            }
+            break;
+        case COAP_MSG_PARSER_TOKEN:
+            need = msg->token_len - parser->stage_len;
+            take = need < avail ? need : avail;
+            memcpy(parser->stage + parser->stage_len, buf + pos, take);
+            parser->stage_len += take;
+            parser->consumed += take;
+            pos += take;
+            if (parser->stage_len == msg->token_len)
+            {
+                num = coap_msg_parse_token(msg, parser->stage, parser->stage_len);
+                if (num < 0)
+                {
+                    return num;
+                }
+                parser->stage_len = 0;
+                parser->state = COAP_MSG_PARSER_OPS;
+            }
+            break;
+        case COAP_MSG_PARSER_OPS:
+            if ((parser->stage_len == 0) && ((buf[pos] & 0xff) == 0xff))
+            {
+                /* payload marker */
+                parser->consumed++;
+                pos++;
+                msg->payload_len = parser->total_len - parser->consumed;
+                if (msg->payload_len == 0)
+                {
+                    return -EBADMSG;
+                }
+                msg->payload = (char *)malloc(msg->payload_len);
+                if (msg->payload == NULL)
+                {
+                    return -ENOMEM;
+                }
+                parser->state = COAP_MSG_PARSER_PAYLOAD;
+                break;
+            }
+            if (parser->stage_len == 0)
+            {
+                elem = coap_msg_op_elem_len(buf + pos, avail);
+                if (elem < 0)
+                {
+                    return elem;
+                }
+                if ((elem > 0) && ((size_t)elem <= avail))
+                {
+                    /* the whole option is in this fragment */
+                    num = coap_msg_parse_op(msg, (char *)(buf + pos), elem);
+                    if (num < 0)
+                    {
+                        return num;
+                    }
+                    parser->consumed += num;
+                    pos += num;
+                    break;
+                }
+            }
+            /* stage the option until it is complete */
+            elem = coap_msg_op_elem_len(parser->stage, parser->stage_len);
+            if (elem < 0)
+            {
+                return elem;
+            }
+            if (elem == 0)
+            {
+                /* option header incomplete; stage one byte at a time */
+                need = 1;
+            }
+            else
+            {
+                if ((size_t)elem > sizeof(parser->stage))
+                {
+                    return -ENOSPC;
+                }
+                need = elem - parser->stage_len;
+            }
+            take = need < avail ? need : avail;
+            memcpy(parser->stage + parser->stage_len, buf + pos, take);
+            parser->stage_len += take;
+            parser->consumed += take;
+            pos += take;
+            elem = coap_msg_op_elem_len(parser->stage, parser->stage_len);
+            if (elem < 0)
+            {
+                return elem;
+            }
+            if ((elem > 0) && (parser->stage_len == (size_t)elem))
+            {
+                num = coap_msg_parse_op(msg, parser->stage, parser->stage_len);
+                if (num < 0)
+                {
+                    return num;
+                }
+                parser->stage_len = 0;
+            }
+            break;
+        case COAP_MSG_PARSER_PAYLOAD:
+            need = msg->payload_len - parser->payload_off;
+            take = need < avail ? need : avail;
+            memcpy(msg->payload + parser->payload_off, buf + pos, take);
+            parser->payload_off += take;
+            parser->consumed += take;
+            pos += take;
+            break;
+        default:
+            return -EBADMSG;
+        }
+        ret = coap_msg_parser_finish(parser);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    if ((pos < len) && (parser->state == COAP_MSG_PARSER_DONE))
+    {
+        return -EBADMSG;
+    }
+    return pos;
+}
+
+ssize_t coap_msg_parse_borrowed(coap_msg_t *msg, char *buf, size_t len)
+{
+    coap_msg_reset(msg);
+    msg->borrowed = 1;
+    return coap_msg_parse_buf(msg, buf, len);
+}
+
+ssize_t coap_msg_parse_strict(coap_msg_t *msg, char *buf, size_t len)
+{
+    coap_msg_reset(msg);
+    msg->strict = 1;
+    return coap_msg_parse_buf(msg, buf, len);
+}
+
+int coap_msg_set_type(coap_msg_t *msg, unsigned type)
+{
+    if ((type != COAP_MSG_CON)
+     && (type != COAP_MSG_NON)
+     && (type != COAP_MSG_ACK)
+     && (type != COAP_MSG_RST))
+    {
+        return -EINVAL;
+    }
+    msg->type = type;
+    return 0;
+}
+
+int coap_msg_set_code(coap_msg_t *msg, unsigned code_class, unsigned code_detail)
+{
+    if (code_class > COAP_MSG_MAX_CODE_CLASS)
+    {
+        return -EINVAL;
     }
     if (code_detail > COAP_MSG_MAX_CODE_DETAIL)
     {
@@ -687,16 +1341,28 @@ int coap_msg_set_token(coap_msg_t *msg, char *buf, size_t len)
 
 int coap_msg_add_op(coap_msg_t *msg, unsigned num, unsigned len, const char *val)
 {
-    return coap_msg_op_list_add(&msg->op_list, num, len, val);
+    if (msg->borrowed)
+    {
+        return -EPERM;
+    }
+    return coap_msg_op_list_add(&msg->op_list, &msg->arena, num, len, val);
 }
 
 int coap_msg_set_payload(coap_msg_t *msg, char *buf, size_t len)
 {
+    if (msg->borrowed)
+    {
+        return -EPERM;
+    }
     msg->payload_len = 0;
     if (msg->payload != NULL)
     {
-        free(msg->payload);
+        if (!msg->payload_borrowed)
+        {
+            free(msg->payload);
+        }
         msg->payload = NULL;
+        msg->payload_borrowed = 0;
     }
     if (len > 0)
     {
@@ -711,6 +1377,38 @@ int coap_msg_set_payload(coap_msg_t *msg, char *buf, size_t len)
     return 0;
 }
 
+int coap_msg_borrow_payload(coap_msg_t *msg, char *buf, size_t len)
+{
+    if (msg->borrowed)
+    {
+        return -EPERM;
+    }
+    if ((msg->payload != NULL) && (!msg->payload_borrowed))
+    {
+        free(msg->payload);
+    }
+    msg->payload = buf;
+    msg->payload_len = len;
+    msg->payload_borrowed = 1;
+    return 0;
+}
+
+char *coap_msg_detach_payload(coap_msg_t *msg, size_t *len)
+{
+    char *payload = NULL;
+
+    *len = 0;
+    if ((msg->payload == NULL) || (msg->borrowed) || (msg->payload_borrowed))
+    {
+        return NULL;
+    }
+    payload = msg->payload;
+    *len = msg->payload_len;
+    msg->payload = NULL;
+    msg->payload_len = 0;
+    return payload;
+}
+
 /**
  *  @brief Format the header in a message
  *
@@ -978,6 +1676,197 @@ ssize_t coap_msg_format(coap_msg_t *msg, char *buf, size_t len)
     return p - buf;
 }
 
+/**
+ *  @brief Format the header of an option in a message
+ *
+ *  Only the delta/length byte and any extended delta and
+ *  length bytes are written; the option value is referenced
+ *  separately by the caller.
+ *
+ *  @param[in] op Pointer to an option structure
+ *  @param[in] prev_num option number of the previous option
+ *  @param[out] buf Pointer to a buffer to contain the formatted option header
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Length of the formatted option header or error code
+ *  @retval >0 Length of the formatted option header
+ *  @retval <0 Error
+ */
+static ssize_t coap_msg_format_op_hdr(coap_msg_op_t *op, unsigned prev_num, char *buf, size_t len)
+{
+    unsigned op_delta = 0;
+    unsigned num = 0;
+    uint16_t val = 0;
+    char *p = buf;
+
+    op_delta = op->num - prev_num;
+    num++;
+    if (op_delta >= 269)
+    {
+        num += 2;
+    }
+    else if (op_delta >= 13)
+    {
+        num += 1;
+    }
+    if (op->len >= 269)
+    {
+        num += 2;
+    }
+    else if (op->len >= 13)
+    {
+        num += 1;
+    }
+    if (num > len)
+    {
+        return -ENOSPC;
+    }
+
+    /* option delta */
+    if (op_delta >= 269)
+    {
+        p[0] = 14 << 4;
+    }
+    else if (op_delta >= 13)
+    {
+        p[0] = 13 << 4;
+    }
+    else
+    {
+        p[0] = op_delta << 4;
+    }
+
+    /* option length */
+    if (op->len >= 269)
+    {
+        p[0] |= 14;
+    }
+    else if (op->len >= 13)
+    {
+        p[0] |= 13;
+    }
+    else
+    {
+        p[0] |= op->len;
+    }
+    p++;
+
+    /* option delta extended */
+    if (op_delta >= 269)
+    {
+        val = htons(op_delta - 269);
+        memcpy(p, &val, 2);
+        p += 2;
+    }
+    else if (op_delta >= 13)
+    {
+        p[0] = op_delta - 13;
+        p++;
+    }
+
+    /* option length extended */
+    if (op->len >= 269)
+    {
+        val = htons(op->len - 269);
+        memcpy(p, &val, 2);
+        p += 2;
+    }
+    else if (op->len >= 13)
+    {
+        p[0] = op->len - 13;
+        p++;
+    }
+    return p - buf;
+}
+
+ssize_t coap_msg_format_iov(coap_msg_t *msg, struct iovec *iov, unsigned num_iov, char *buf, size_t len)
+{
+    coap_msg_op_t *op = NULL;
+    unsigned prev_num = 0;
+    unsigned n = 0;
+    ssize_t num = 0;
+    char *p = buf;
+    int ret = 0;
+
+    ret = coap_msg_check(msg);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* fixed header and token */
+    num = coap_msg_format_hdr(msg, p, len);
+    if (num < 0)
+    {
+        return num;
+    }
+    p += num;
+    len -= num;
+    num = coap_msg_format_token(msg, p, len);
+    if (num < 0)
+    {
+        return num;
+    }
+    p += num;
+    len -= num;
+    if (num_iov < 1)
+    {
+        return -ENOSPC;
+    }
+    iov[n].iov_base = buf;
+    iov[n].iov_len = p - buf;
+    n++;
+
+    /* options */
+    op = coap_msg_op_list_get_first(&msg->op_list);
+    while (op != NULL)
+    {
+        num = coap_msg_format_op_hdr(op, prev_num, p, len);
+        if (num < 0)
+        {
+            return num;
+        }
+        if (num_iov - n < 2)
+        {
+            return -ENOSPC;
+        }
+        iov[n].iov_base = p;
+        iov[n].iov_len = num;
+        n++;
+        p += num;
+        len -= num;
+        if (coap_msg_op_get_len(op) > 0)
+        {
+            iov[n].iov_base = coap_msg_op_get_val(op);
+            iov[n].iov_len = coap_msg_op_get_len(op);
+            n++;
+        }
+        prev_num = coap_msg_op_get_num(op);
+        op = coap_msg_op_get_next(op);
+    }
+
+    /* payload marker and payload */
+    if (msg->payload_len > 0)
+    {
+        if (len < 1)
+        {
+            return -ENOSPC;
+        }
+        if (num_iov - n < 2)
+        {
+            return -ENOSPC;
+        }
+        p[0] = 0xff;
+        iov[n].iov_base = p;
+        iov[n].iov_len = 1;
+        n++;
+        iov[n].iov_base = msg->payload;
+        iov[n].iov_len = msg->payload_len;
+        n++;
+    }
+    return n;
+}
+
 int coap_msg_copy(coap_msg_t *dst, coap_msg_t *src)
 {
     coap_msg_op_t *op = NULL;
@@ -31,6 +31,8 @@
  *  @brief Source file for the FreeCoAP server library
  */
 
+#define _GNU_SOURCE  /* for recvmmsg and sendmmsg */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -39,17 +41,27 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <linux/types.h>
 #include "coap_server.h"
 #include "coap_log.h"
 
 #define COAP_SERVER_ACK_TIMEOUT_SEC       2                                     /**< Minimum delay to wait before retransmitting a confirmable message */
 #define COAP_SERVER_MAX_RETRANSMIT        4                                     /**< Maximum number of times a confirmable message can be retransmitted */
+#define COAP_SERVER_NUM_EVENTS            16                                    /**< Maximum number of epoll events to process per wakeup */
+#define COAP_SERVER_BATCH_SIZE            16                                    /**< Maximum number of datagrams to receive or send per batch */
+#define COAP_SERVER_WHEEL_TICK_MSEC       250                                   /**< Granularity of the retransmission timer wheel */
+#define COAP_SERVER_EXCHANGE_LIFETIME     247                                   /**< Time (sec) that a message ID must not be reused (RFC 7252) */
+#define COAP_SERVER_DEDUP_LEN             32                                    /**< Number of entries in the deduplication ring buffer */
+#define COAP_SERVER_NUM_OBS               32                                    /**< Number of entries in the observer array */
+#define COAP_SERVER_BLOCK1_SIZE           1024                                  /**< Maximum block size accepted in a blockwise request */
+#define COAP_SERVER_BLOCK2_SIZE           1024                                  /**< Maximum block size used in a blockwise response */
+#define COAP_SERVER_MAX_BODY_LEN          (1 << 20)                             /**< Maximum length of the body of a blockwise transfer */
 
 #ifdef COAP_DTLS_EN
 
@@ -57,12 +69,22 @@
 #define COAP_SERVER_DTLS_RETRANS_TIMEOUT  100                                   /**< Retransmission timeout (msec) for the DTLS handshake */
 #define COAP_SERVER_DTLS_TOTAL_TIMEOUT    5000                                  /**< Total timeout (msec) for the DTLS handshake */
 #define COAP_SERVER_DTLS_NUM_DH_BITS      1024                                  /**< DTLS Diffie-Hellman key size */
+#define COAP_SERVER_DTLS_SESS_CACHE_LEN   32                                    /**< Default number of entries in the DTLS session cache */
 #define COAP_SERVER_DTLS_PRIORITIES       "PERFORMANCE:-VERS-TLS-ALL:+VERS-DTLS1.0:%SERVER_PRECEDENCE"
                                                                                 /**< DTLS priorities */
 #endif
 
 static int rand_init = 0;                                                       /**< Indicates if the random number generator has been initialised */
 
+static int coap_server_trans_stop_timer(coap_server_trans_t *trans);
+static int coap_server_trans_start_timer(coap_server_trans_t *trans);
+static ssize_t coap_server_queue_send(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len, const char *buf, size_t len);
+#ifdef COAP_DTLS_EN
+static gnutls_datum_t coap_server_sess_retrieve_func(void *data, gnutls_datum_t key);
+static int coap_server_sess_store_func(void *data, gnutls_datum_t key, gnutls_datum_t sess_data);
+static int coap_server_sess_remove_func(void *data, gnutls_datum_t key);
+#endif
+
 /****************************************************************************************************
  *                                         coap_server_path                                         *
  ****************************************************************************************************/
@@ -75,19 +97,19 @@ static int rand_init = 0;
  *  @returns New URI path structure
  *  @retval NULL Out-of-memory
  */
-static coap_server_path_t *coap_server_path_new(const char *str)
+static coap_server_path_t *coap_server_path_new(coap_mem_acct_t *mem, const char *str)
 {
     coap_server_path_t *path = NULL;
 
-    path = (coap_server_path_t *)malloc(sizeof(coap_server_path_t));
+    path = (coap_server_path_t *)coap_mem_alloc(mem, sizeof(coap_server_path_t));
     if (path == NULL)
     {
         return NULL;
     }
-    path->str = strdup(str);
+    path->str = coap_mem_strdup(mem, str);
     if (path->str == NULL)
     {
-        free(path);
+        coap_mem_free(path);
         return NULL;
     }
     path->next = NULL;
@@ -101,8 +123,8 @@ static coap_server_path_t *coap_server_path_new(const char *str)
  */
 static void coap_server_path_delete(coap_server_path_t *path)
 {
-    free(path->str);
-    free(path);
+    coap_mem_free(path->str);
+    coap_mem_free(path);
 }
 
 /**
@@ -139,17 +161,18 @@ static void coap_server_path_list_destroy(coap_server_path_list_t *list)
  *  @brief Add a URI path to a URI path list structure
  *
  *  @param[in,out] list Pointer to a URI path list structure
+ *  @param[in,out] mem Pointer to a memory accounting structure or NULL
  *  @param[in] str String representation of a URI path
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_path_list_add(coap_server_path_list_t *list, const char *str)
+static int coap_server_path_list_add(coap_server_path_list_t *list, coap_mem_acct_t *mem, const char *str)
 {
     coap_server_path_t *path = NULL;
 
-    path = coap_server_path_new(str);
+    path = coap_server_path_new(mem, str);
     if (path == NULL)
     {
         return -ENOMEM;
@@ -195,59 +218,70 @@ static int coap_server_path_list_match(coap_server_path_list_t *list, const char
     return 0;
 }
 
-#ifdef COAP_DTLS_EN
-
 /****************************************************************************************************
- *                                      coap_server_trans_dtls                                      *
+ *                                        coap_server_route                                         *
  ****************************************************************************************************/
 
 /**
- *  @brief Listen for a packet from the client with a timeout
+ *  @brief Compute the route hash table bucket index for a URI path
  *
- *  @param[in] trans Pointer to a transaction structure
- *  @param[in] ms Timeout value in msec
+ *  @param[in] str String representation of a URI path
  *
- *  @returns Operation status
- *  @retval 1 Success
- *  @retval 0 Timeout
- *  @retval <0 Error
+ *  @returns Bucket index
  */
-static int coap_server_trans_dtls_listen_timeout(coap_server_trans_t *trans, unsigned ms)
+static unsigned coap_server_route_hash(const char *str)
 {
-    coap_server_t *server = NULL;
-    struct timeval tv = {0};
-    fd_set read_fds = {{0}};
-    int ret = 0;
+    const unsigned char *p = NULL;
+    unsigned hash = 5381;
 
-    server = trans->server;
-    tv.tv_sec = ms / 1000;
-    tv.tv_usec = (ms % 1000) * 1000;
-    while (1)
+    for (p = (const unsigned char *)str; *p != '\0'; p++)
     {
-        FD_ZERO(&read_fds);
-        FD_SET(server->sd, &read_fds);
-        ret = select(server->sd + 1, &read_fds, NULL, NULL, &tv);
-        if (ret < 0)
-        {
-            return -errno;
-        }
-        if (ret == 0)
-        {
-            return 0;  /* timeout */
-        }
-        if (FD_ISSET(server->sd, &read_fds))
+        hash = (hash * 33) ^ *p;
+    }
+    return hash % COAP_SERVER_NUM_ROUTE_BUCKETS;
+}
+
+/**
+ *  @brief Find a route by URI path
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] str String representation of a URI path
+ *
+ *  @returns Pointer to a route structure or NULL
+ */
+static coap_server_route_t *coap_server_find_route(coap_server_t *server, const char *str)
+{
+    coap_server_route_t *route = NULL;
+
+    route = server->routes[coap_server_route_hash(str)];
+    while (route != NULL)
+    {
+        if (strcmp(route->str, str) == 0)
         {
-            return 1;  /* success */
+            return route;
         }
+        route = route->next;
     }
+    return NULL;
 }
 
+#ifdef COAP_DTLS_EN
+
+/****************************************************************************************************
+ *                                      coap_server_trans_dtls                                      *
+ ****************************************************************************************************/
+
 /**
  *  @brief Receive data from the client
  *
  *  This is a call-back function that the
  *  GnuTLS library uses to receive data.
  *
+ *  Data deposited in the transaction receive buffer by the
+ *  event loop is consumed; the call-back never reads from
+ *  the socket itself and never blocks. If the receive buffer
+ *  is empty then EAGAIN is reported.
+ *
  *  @param[in,out] data Pointer to a transaction structure
  *  @param[out] buf Pointer to a buffer
  *  @param[in] len Length of the buffer
@@ -259,76 +293,46 @@ static int coap_server_trans_dtls_listen_timeout(coap_server_trans_t *trans, uns
 static ssize_t coap_server_trans_dtls_pull_func(gnutls_transport_ptr_t data, void *buf, size_t len)
 {
     coap_server_trans_t *trans = NULL;
-    struct sockaddr_in6 client_sin = {0};
-    coap_server_t *server = NULL;
-    socklen_t client_sin_len = 0;
     ssize_t num = 0;
 
     trans = (coap_server_trans_t *)data;
-    server = trans->server;
-    client_sin_len = sizeof(client_sin);
-    num = recvfrom(server->sd, buf, len, MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);  /* peek data */
-    if (num < 0)
-    {
-        return -1;
-    }
-    if ((client_sin_len != trans->client_sin_len)
-     || (memcmp(&client_sin, &trans->client_sin, trans->client_sin_len) != 0))
+    if (trans->recv_buf_len > 0)
     {
-        errno = EINVAL;
-        return -1;
+        num = trans->recv_buf_len < len ? trans->recv_buf_len : len;
+        memcpy(buf, trans->recv_buf, num);
+        trans->recv_buf_len = 0;
+        return num;
     }
-    return recvfrom(server->sd, buf, num, 0, (struct sockaddr *)&client_sin, &client_sin_len);  /* consume data */
+    errno = EAGAIN;
+    return -1;
 }
 
 /**
- *  @brief Wait for receive data from the client
+ *  @brief Check for receive data from the client
  *
  *  This is a call-back function that the GnuTLS
- *  library uses to wait for receive data.
+ *  library uses to check for receive data.
+ *
+ *  The session is non-blocking so the timeout is not
+ *  observed, only the transaction receive buffer is checked.
  *
  *  @param[in,out] data Pointer to a transaction structure
  *  @param[in] ms Timeout in msec
  *
- *  @returns Number of bytes received or error
- *  @retval >0 Number of bytes received
+ *  @returns Number of bytes available or timeout
+ *  @retval >0 Number of bytes available
  *  @retval 0 Timeout
- *  @retval -1 Error
  */
 static int coap_server_trans_dtls_pull_timeout_func(gnutls_transport_ptr_t data, unsigned ms)
 {
     coap_server_trans_t *trans = NULL;
-    struct sockaddr_in6 client_sin = {0};
-    coap_server_t *server = NULL;
-    socklen_t client_sin_len = 0;
-    ssize_t num = 0;
-    char buf[COAP_SERVER_DTLS_MTU] = {0};
-    int ret = 0;
 
     trans = (coap_server_trans_t *)data;
-    server = trans->server;
-    ret = coap_server_trans_dtls_listen_timeout(trans, ms);
-    if (ret == 0)
-    {
-        return 0;  /* timeout */
-    }
-    if (ret < 0)
-    {
-        return -1;
-    }
-    client_sin_len = sizeof(client_sin);
-    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);  /* peek data */
-    if (num < 0)
-    {
-        return -1;
-    }
-    if ((client_sin_len != trans->client_sin_len)
-     || (memcmp(&client_sin, &trans->client_sin, trans->client_sin_len) != 0))
+    if (trans->recv_buf_len > 0)
     {
-        errno = EINVAL;
-        return -1;
+        return trans->recv_buf_len;  /* success */
     }
-    return num;  /* success */
+    return 0;  /* timeout */
 }
 
 /**
@@ -349,78 +353,95 @@ static ssize_t coap_server_trans_dtls_push_func(gnutls_transport_ptr_t data, con
 {
     coap_server_trans_t *trans = NULL;
     coap_server_t *server = NULL;
+    ssize_t num = 0;
 
     trans = (coap_server_trans_t *)data;
     server = trans->server;
-    return sendto(server->sd, buf, len, 0, (struct sockaddr *)&trans->client_sin, trans->client_sin_len);
+    num = coap_server_queue_send(server, &trans->client_sin, trans->client_sin_len, buf, len);
+    if (num < 0)
+    {
+        errno = -num;
+        return -1;
+    }
+    return num;
 }
 
 /**
- *  @brief Perform a DTLS handshake with the client
+ *  @brief Advance the DTLS handshake with the client
+ *
+ *  Called once for each handshake message deposited in the
+ *  transaction receive buffer and on each retransmission
+ *  timeout. Never blocks; while the handshake is incomplete
+ *  the transaction timer is armed so that the GnuTLS library
+ *  can retransmit the last flight and enforce the total
+ *  handshake timeout.
  *
  *  @param[in,out] trans Pointer to a transaction structure
  *
  *  @returns Operation success
- *  @retval 0 Success
+ *  @retval 0 Success or handshake in progress
  *  @retval <0 Error
  */
-static int coap_server_trans_dtls_handshake(coap_server_trans_t *trans)
+static int coap_server_trans_dtls_handshake_step(coap_server_trans_t *trans)
 {
     gnutls_cipher_algorithm_t cipher = 0;
     gnutls_mac_algorithm_t mac = 0;
     gnutls_kx_algorithm_t kx = 0;
     const char *cipher_suite = NULL;
     int ret = 0;
-    int i = 0;
 
-    for (i = 0; i < COAP_SERVER_DTLS_TOTAL_TIMEOUT / COAP_SERVER_DTLS_RETRANS_TIMEOUT; i++)
+    errno = 0;
+    ret = gnutls_handshake(trans->session);
+    if ((errno != 0) && (errno != EAGAIN))
     {
-        errno = 0;
-        ret = gnutls_handshake(trans->session);
-        if ((errno != 0) && (errno != EAGAIN))
-        {
-            return -errno;
-        }
-        if (ret == GNUTLS_E_SUCCESS)
-        {
+        return -errno;
+    }
+    if (ret == GNUTLS_E_SUCCESS)
+    {
+        trans->handshaking = 0;
+        trans->server->stats.handshakes++;
+        coap_server_trans_stop_timer(trans);
+        if (gnutls_session_is_resumed(trans->session))
+            coap_log_info("Completed abbreviated DTLS handshake for resumed session");
+        else
             coap_log_info("Completed DTLS handshake");
-            /* determine which cipher suite was negotiated */
-            kx = gnutls_kx_get(trans->session);
-            cipher = gnutls_cipher_get(trans->session);
-            mac = gnutls_mac_get(trans->session);
-            cipher_suite = gnutls_cipher_suite_get_name(kx, cipher, mac);
-            if (cipher_suite != NULL)
-                coap_log_info("Cipher suite is TLS_%s", cipher_suite);
-            else
-                coap_log_info("Cipher suite is unknown");
-            return 0;  /* success */
-        }
-        if (ret == GNUTLS_E_TIMEDOUT)
-        {
-            break;
-        }
-        if ((ret == GNUTLS_E_WARNING_ALERT_RECEIVED)
-         || (ret == GNUTLS_E_FATAL_ALERT_RECEIVED))
-        {
-            return -ECONNRESET;
-        }
-        if (ret != GNUTLS_E_AGAIN)
-        {
-            return -1;
-        }
-        ret = coap_server_trans_dtls_listen_timeout(trans, COAP_SERVER_DTLS_RETRANS_TIMEOUT);
-        if (ret < 0)
-        {
-            return ret;
-        }
+        /* determine which cipher suite was negotiated */
+        kx = gnutls_kx_get(trans->session);
+        cipher = gnutls_cipher_get(trans->session);
+        mac = gnutls_mac_get(trans->session);
+        cipher_suite = gnutls_cipher_suite_get_name(kx, cipher, mac);
+        if (cipher_suite != NULL)
+            coap_log_info("Cipher suite is TLS_%s", cipher_suite);
+        else
+            coap_log_info("Cipher suite is unknown");
+        return 0;  /* success */
+    }
+    if (ret == GNUTLS_E_TIMEDOUT)
+    {
+        return -ETIMEDOUT;
+    }
+    if ((ret == GNUTLS_E_WARNING_ALERT_RECEIVED)
+     || (ret == GNUTLS_E_FATAL_ALERT_RECEIVED))
+    {
+        return -ECONNRESET;
+    }
+    if ((ret != GNUTLS_E_AGAIN) && (ret != GNUTLS_E_INTERRUPTED))
+    {
+        return -1;
     }
-    return -ETIMEDOUT;
+    /* wait for the next handshake message or a retransmission timeout */
+    trans->timeout.tv_sec = COAP_SERVER_DTLS_RETRANS_TIMEOUT / 1000;
+    trans->timeout.tv_nsec = (COAP_SERVER_DTLS_RETRANS_TIMEOUT % 1000) * 1000000;
+    return coap_server_trans_start_timer(trans);
 }
 
 /**
  *  @brief Initialise the DTLS members of a transaction structure
  *
- *  Perform a DTLS handshake with the client.
+ *  Start a DTLS handshake with the client. The handshake is
+ *  advanced by the event loop as further handshake messages
+ *  arrive so that established transactions are not blocked
+ *  while a new session is negotiating.
  *
  *  @param[out] trans Pointer to a transaction structure
  *
@@ -454,13 +475,25 @@ static int coap_server_trans_dtls_create(coap_server_trans_t *trans)
         coap_log_error("Failed to assign priorities to DTLS session");
         return -1;
     }
+    ret = gnutls_session_ticket_enable_server(trans->session, &server->ticket_key);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        gnutls_deinit(trans->session);
+        coap_log_error("Failed to enable session tickets for DTLS session");
+        return -1;
+    }
+    gnutls_db_set_ptr(trans->session, server);
+    gnutls_db_set_retrieve_function(trans->session, coap_server_sess_retrieve_func);
+    gnutls_db_set_store_function(trans->session, coap_server_sess_store_func);
+    gnutls_db_set_remove_function(trans->session, coap_server_sess_remove_func);
     gnutls_transport_set_ptr(trans->session, trans);
     gnutls_transport_set_pull_function(trans->session, coap_server_trans_dtls_pull_func);
     gnutls_transport_set_pull_timeout_function(trans->session, coap_server_trans_dtls_pull_timeout_func);
     gnutls_transport_set_push_function(trans->session, coap_server_trans_dtls_push_func);
     gnutls_dtls_set_mtu(trans->session, COAP_SERVER_DTLS_MTU);
     gnutls_dtls_set_timeouts(trans->session, COAP_SERVER_DTLS_RETRANS_TIMEOUT, COAP_SERVER_DTLS_TOTAL_TIMEOUT);
-    ret = coap_server_trans_dtls_handshake(trans);
+    trans->handshaking = 1;
+    ret = coap_server_trans_dtls_handshake_step(trans);
     if (ret < 0)
     {
         gnutls_deinit(trans->session);
@@ -488,20 +521,85 @@ static void coap_server_trans_dtls_destroy(coap_server_trans_t *trans)
  ****************************************************************************************************/
 
 /**
- *  @brief Deinitialise a transaction structure
+ *  @brief Compute the transaction hash table bucket index for an endpoint
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to a struct sockaddr_in6
+ *
+ *  @returns Bucket index
+ */
+static unsigned coap_server_trans_hash(coap_server_t *server, struct sockaddr_in6 *client_sin)
+{
+    const unsigned char *p = NULL;
+    unsigned hash = 5381;
+    unsigned i = 0;
+
+    p = (const unsigned char *)&client_sin->sin6_addr;
+    for (i = 0; i < sizeof(client_sin->sin6_addr); i++)
+    {
+        hash = (hash * 33) ^ p[i];
+    }
+    p = (const unsigned char *)&client_sin->sin6_port;
+    for (i = 0; i < sizeof(client_sin->sin6_port); i++)
+    {
+        hash = (hash * 33) ^ p[i];
+    }
+    return hash % server->num_buckets;
+}
+
+/**
+ *  @brief Link a transaction structure into the transaction hash table
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_link(coap_server_t *server, coap_server_trans_t *trans)
+{
+    unsigned bucket = 0;
+
+    bucket = coap_server_trans_hash(server, &trans->client_sin);
+    trans->next = server->trans[bucket];
+    server->trans[bucket] = trans;
+    server->num_trans++;
+}
+
+/**
+ *  @brief Deinitialise and free a transaction structure
+ *
+ *  Unlink the transaction structure from the transaction
+ *  hash table in the containing server structure.
  *
  *  @param[in,out] trans Pointer to a transaction structure
  */
 static void coap_server_trans_destroy(coap_server_trans_t *trans)
 {
+    coap_server_trans_t **p = NULL;
+    coap_server_t *server = NULL;
+    unsigned bucket = 0;
+
     coap_log_debug("Destroyed transaction for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
 #ifdef COAP_DTLS_EN
     coap_server_trans_dtls_destroy(trans);
 #endif
+    coap_server_trans_stop_timer(trans);
     coap_msg_destroy(&trans->resp);
     coap_msg_destroy(&trans->req);
-    close(trans->timer_fd);
+    coap_mem_free(trans->body);
+    server = trans->server;
+    bucket = coap_server_trans_hash(server, &trans->client_sin);
+    p = &server->trans[bucket];
+    while (*p != NULL)
+    {
+        if (*p == trans)
+        {
+            *p = trans->next;
+            server->num_trans--;
+            break;
+        }
+        p = &(*p)->next;
+    }
     memset(trans, 0, sizeof(coap_server_trans_t));
+    coap_mem_free(trans);
 }
 
 /**
@@ -514,6 +612,29 @@ static void coap_server_trans_touch(coap_server_trans_t *trans)
     trans->last_use = time(NULL);
 }
 
+/**
+ *  @brief Deposit a datagram in the receive buffer of a transaction structure
+ *
+ *  The datagram has already been read from the shared socket
+ *  and is held here until the transaction consumes it. If the
+ *  receive buffer is occupied then the datagram is dropped and
+ *  the client is expected to retransmit.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] buf Pointer to a buffer containing the datagram
+ *  @param[in] len Length of the datagram
+ */
+static void coap_server_trans_deposit(coap_server_trans_t *trans, const char *buf, size_t len)
+{
+    if ((trans->recv_buf_len > 0) || (len > sizeof(trans->recv_buf)))
+    {
+        coap_log_debug("Dropped datagram from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+        return;
+    }
+    memcpy(trans->recv_buf, buf, len);
+    trans->recv_buf_len = len;
+}
+
 /**
  *  @brief Compare a received message with the request part of a transaction structure
  *
@@ -637,46 +758,109 @@ static void coap_server_trans_double_timeout(coap_server_trans_t *trans)
 }
 
 /**
- *  @brief Start the timer in a transaction structure
+ *  @brief Stop the timer in a transaction structure
  *
- *  @param[in,out] trans Pointer to a transaction structure
+ *  Unlink the transaction from the timer wheel. If no armed
+ *  timers remain then the timer descriptor that drives the
+ *  wheel is stopped.
+ *
+ *  @param[out] trans Pointer to a transaction structure
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_trans_start_timer(coap_server_trans_t *trans)
+static int coap_server_trans_stop_timer(coap_server_trans_t *trans)
 {
+    coap_server_t *server = NULL;
     struct itimerspec its = {{0}};
     int ret = 0;
 
-    its.it_value = trans->timeout;
-    ret = timerfd_settime(trans->timer_fd, 0, &its, NULL);
-    if (ret < 0)
+    if (!trans->timer_armed)
     {
-        return -errno;
+        return 0;
+    }
+    server = trans->server;
+    if (trans->timer_prev != NULL)
+    {
+        trans->timer_prev->timer_next = trans->timer_next;
+    }
+    else
+    {
+        server->wheel[trans->timer_slot] = trans->timer_next;
+    }
+    if (trans->timer_next != NULL)
+    {
+        trans->timer_next->timer_prev = trans->timer_prev;
+    }
+    trans->timer_next = NULL;
+    trans->timer_prev = NULL;
+    trans->timer_armed = 0;
+    server->num_armed--;
+    if (server->num_armed == 0)
+    {
+        ret = timerfd_settime(server->wheel_fd, 0, &its, NULL);
+        if (ret < 0)
+        {
+            return -errno;
+        }
     }
     return 0;
 }
 
 /**
- *  @brief Stop the timer in a transaction structure
+ *  @brief Start the timer in a transaction structure
  *
- *  @param[out] trans Pointer to a transaction structure
+ *  Link the transaction into the timer wheel slot that
+ *  corresponds to the timeout value. The timer descriptor
+ *  that drives the wheel is started when the first timer
+ *  is armed.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_trans_stop_timer(coap_server_trans_t *trans)
+static int coap_server_trans_start_timer(coap_server_trans_t *trans)
 {
+    coap_server_t *server = NULL;
     struct itimerspec its = {{0}};
+    unsigned msec = 0;
+    unsigned ticks = 0;
+    unsigned slot = 0;
     int ret = 0;
 
-    ret = timerfd_settime(trans->timer_fd, 0, &its, NULL);
-    if (ret < 0)
+    coap_server_trans_stop_timer(trans);
+    server = trans->server;
+    msec = (trans->timeout.tv_sec * 1000) + (trans->timeout.tv_nsec / 1000000);
+    ticks = (msec + COAP_SERVER_WHEEL_TICK_MSEC - 1) / COAP_SERVER_WHEEL_TICK_MSEC;
+    if (ticks == 0)
     {
-        return -errno;
+        ticks = 1;
+    }
+    slot = (server->wheel_slot + ticks) % COAP_SERVER_NUM_WHEEL_SLOTS;
+    trans->timer_rounds = ticks / COAP_SERVER_NUM_WHEEL_SLOTS;
+    trans->timer_slot = slot;
+    trans->timer_prev = NULL;
+    trans->timer_next = server->wheel[slot];
+    if (server->wheel[slot] != NULL)
+    {
+        server->wheel[slot]->timer_prev = trans;
+    }
+    server->wheel[slot] = trans;
+    trans->timer_armed = 1;
+    server->num_armed++;
+    if (server->num_armed == 1)
+    {
+        its.it_value.tv_nsec = COAP_SERVER_WHEEL_TICK_MSEC * 1000000;
+        its.it_interval.tv_nsec = COAP_SERVER_WHEEL_TICK_MSEC * 1000000;
+        ret = timerfd_settime(server->wheel_fd, 0, &its, NULL);
+        if (ret < 0)
+        {
+            coap_server_trans_stop_timer(trans);
+            return -errno;
+        }
     }
     return 0;
 }
@@ -743,31 +927,26 @@ static int coap_server_trans_update_ack_timer(coap_server_trans_t *trans)
 }
 
 /**
- *  @brief Send a message to the client
+ *  @brief Send a formatted message to the client
  *
  *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the formatted message
+ *  @param[in] len Length of the formatted message
  *
  *  @returns Number of bytes sent or error code
  *  @retval >0 Number of bytes sent
  *  @retval <0 Error
  */
-static ssize_t coap_server_trans_send(coap_server_trans_t *trans, coap_msg_t *msg)
+static ssize_t coap_server_trans_send_buf(coap_server_trans_t *trans, const char *buf, size_t len)
 {
 #ifndef COAP_DTLS_EN
     coap_server_t *server = NULL;
 #endif
     ssize_t num = 0;
-    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
 
-    num = coap_msg_format(msg, buf, sizeof(buf));
-    if (num < 0)
-    {
-        return num;
-    }
 #ifdef COAP_DTLS_EN
     errno = 0;
-    num = gnutls_record_send(trans->session, buf, num);
+    num = gnutls_record_send(trans->session, buf, len);
     if (errno != 0)
     {
         return -errno;
@@ -788,10 +967,10 @@ static ssize_t coap_server_trans_send(coap_server_trans_t *trans, coap_msg_t *ms
     }
 #else
     server = trans->server;
-    num = sendto(server->sd, buf, num, 0, (struct sockaddr *)&trans->client_sin, trans->client_sin_len);
+    num = coap_server_queue_send(server, &trans->client_sin, trans->client_sin_len, buf, len);
     if (num < 0)
     {
-        return -errno;
+        return num;
     }
 #endif
     coap_server_trans_touch(trans);
@@ -799,6 +978,29 @@ static ssize_t coap_server_trans_send(coap_server_trans_t *trans, coap_msg_t *ms
     return num;
 }
 
+/**
+ *  @brief Send a message to the client
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Number of bytes sent or error code
+ *  @retval >0 Number of bytes sent
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_send(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    ssize_t num = 0;
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+
+    num = coap_msg_format(msg, buf, sizeof(buf));
+    if (num < 0)
+    {
+        return num;
+    }
+    return coap_server_trans_send_buf(trans, buf, num);
+}
+
 /**
  *  @brief Handle a format error in a received message
  *
@@ -852,11 +1054,6 @@ static void coap_server_trans_handle_format_error(coap_server_trans_t *trans, ch
  */
 static ssize_t coap_server_trans_recv(coap_server_trans_t *trans, coap_msg_t *msg)
 {
-#ifndef COAP_DTLS_EN
-    struct sockaddr_in6 client_sin = {0};
-    coap_server_t *server = NULL;
-    socklen_t client_sin_len = 0;
-#endif
     ssize_t num = 0;
     ssize_t ret = 0;
     char buf[COAP_MSG_MAX_BUF_LEN] = {0};
@@ -883,23 +1080,13 @@ static ssize_t coap_server_trans_recv(coap_server_trans_t *trans, coap_msg_t *ms
         return -1;
     }
 #else
-    server = trans->server;
-    client_sin_len = sizeof(client_sin);
-    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);
-    if (num < 0)
-    {
-        return -errno;
-    }
-    if ((client_sin_len != trans->client_sin_len)
-     || (memcmp(&client_sin, &trans->client_sin, client_sin_len) != 0))
-    {
-        return -EINVAL;
-    }
-    num = recvfrom(server->sd, buf, num, 0, (struct sockaddr *)&client_sin, &client_sin_len);
-    if (num < 0)
+    if (trans->recv_buf_len == 0)
     {
-        return -errno;
+        return -EAGAIN;
     }
+    num = trans->recv_buf_len;
+    memcpy(buf, trans->recv_buf, num);
+    trans->recv_buf_len = 0;
 #endif
     ret = coap_msg_parse(msg, buf, num);
     if (ret < 0)
@@ -1144,7 +1331,9 @@ static int coap_server_trans_send_ack(coap_server_trans_t *trans, coap_msg_t *ms
  *
  *  Update the acknowledgement timer in the transaction structure
  *  and if the maximum number of retransmits has not been reached
- *  then retransmit the last response to the client.
+ *  then retransmit the last response to the client. If the DTLS
+ *  handshake is still in progress then the timeout belongs to
+ *  the handshake and the handshake is advanced instead.
  *
  *  @param[in,out] trans Pointer to a transaction structure
  *
@@ -1157,11 +1346,24 @@ static int coap_server_trans_handle_ack_timeout(coap_server_trans_t *trans)
     ssize_t num = 0;
     int ret = 0;
 
-    coap_log_debug("Transaction expired for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
-    ret = coap_server_trans_update_ack_timer(trans);
-    if (ret == 0)
+#ifdef COAP_DTLS_EN
+    if (trans->handshaking)
+    {
+        ret = coap_server_trans_dtls_handshake_step(trans);
+        if (ret < 0)
+        {
+            coap_log_warn("Failed to complete DTLS handshake");
+            coap_server_trans_destroy(trans);
+        }
+        return 0;
+    }
+#endif
+    coap_log_debug("Transaction expired for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+    ret = coap_server_trans_update_ack_timer(trans);
+    if (ret == 0)
     {
         coap_log_debug("Retransmitting to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+        trans->server->stats.retrans++;
         num = coap_server_trans_send(trans, &trans->resp);
         if (num < 0)
         {
@@ -1181,50 +1383,56 @@ static int coap_server_trans_handle_ack_timeout(coap_server_trans_t *trans)
 /**
  *  @brief Initialise a transaction structure
  *
+ *  The datagram that prompted the creation of the transaction
+ *  is deposited in the receive buffer. With DTLS enabled it is
+ *  consumed as the first handshake message, otherwise it is
+ *  consumed as the first request.
+ *
  *  @param[out] trans Pointer to a transaction structure
  *  @param[in] server Pointer to a server structure
  *  @param[in] client_sin Pointer to a struct sockaddr_in6
  *  @param[in] client_sin_len Length of the struct sockaddr_in6
+ *  @param[in] buf Pointer to a buffer containing the received datagram
+ *  @param[in] len Length of the received datagram
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_trans_create(coap_server_trans_t *trans, coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len)
+static int coap_server_trans_create(coap_server_trans_t *trans, coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len, const char *buf, size_t len)
 {
     const char *p = NULL;
 #ifdef COAP_DTLS_EN
+    int batching = 0;
     int ret = 0;
 #endif
 
     memset(trans, 0, sizeof(coap_server_trans_t));
-    trans->active = 1;
     coap_server_trans_touch(trans);
-    trans->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (trans->timer_fd < 0)
-    {
-        memset(trans, 0, sizeof(coap_server_trans_t));
-        return -errno;
-    }
     memcpy(&trans->client_sin, client_sin, client_sin_len);
     trans->client_sin_len = client_sin_len;
     p = inet_ntop(AF_INET6, &client_sin->sin6_addr, trans->client_addr, sizeof(trans->client_addr));
     if (p == NULL)
     {
-        close(trans->timer_fd);
         memset(trans, 0, sizeof(coap_server_trans_t));
         return -errno;
     }
     coap_msg_create(&trans->req);
     coap_msg_create(&trans->resp);
+    coap_msg_set_mem_acct(&trans->req, &server->mem);
+    coap_msg_set_mem_acct(&trans->resp, &server->mem);
     trans->server = server;
+    coap_server_trans_deposit(trans, buf, len);
 #ifdef COAP_DTLS_EN
+    /* handshake flights must be sent immediately, not queued for a batched send */
+    batching = server->batching;
+    server->batching = 0;
     ret = coap_server_trans_dtls_create(trans);
+    server->batching = batching;
     if (ret < 0)
     {
         coap_msg_destroy(&trans->resp);
         coap_msg_destroy(&trans->req);
-        close(trans->timer_fd);
         memset(trans, 0, sizeof(coap_server_trans_t));
         return ret;
     }
@@ -1239,6 +1447,288 @@ static int coap_server_trans_create(coap_server_trans_t *trans, coap_server_t *s
  *                                         coap_server_dtls                                         *
  ****************************************************************************************************/
 
+/**
+ *  @brief Clear a DTLS session cache entry
+ *
+ *  @param[in,out] sess Pointer to a session cache entry structure
+ */
+static void coap_server_sess_clear(coap_server_sess_t *sess)
+{
+    coap_mem_free(sess->key.data);
+    coap_mem_free(sess->data.data);
+    memset(sess, 0, sizeof(coap_server_sess_t));
+}
+
+/**
+ *  @brief Find a DTLS session cache entry by session ID
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] key Session ID
+ *
+ *  @returns Pointer to a session cache entry structure or NULL
+ */
+static coap_server_sess_t *coap_server_sess_find(coap_server_t *server, gnutls_datum_t key)
+{
+    coap_server_sess_t *sess = NULL;
+    unsigned i = 0;
+
+    for (i = 0; i < server->sess_cache_len; i++)
+    {
+        sess = &server->sess_cache[i];
+        if ((sess->key.data != NULL)
+         && (sess->key.size == key.size)
+         && (memcmp(sess->key.data, key.data, key.size) == 0))
+        {
+            return sess;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Store a DTLS session in the session cache
+ *
+ *  This is a call-back function that the GnuTLS library
+ *  uses to store a session for later resumption. If the
+ *  cache is full then the least recently used entry is
+ *  evicted.
+ *
+ *  @param[in,out] data Pointer to a server structure
+ *  @param[in] key Session ID
+ *  @param[in] sess_data Serialised session data
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Error
+ */
+static int coap_server_sess_store_func(void *data, gnutls_datum_t key, gnutls_datum_t sess_data)
+{
+    coap_server_sess_t *sess = NULL;
+    coap_server_t *server = NULL;
+    unsigned i = 0;
+
+    server = (coap_server_t *)data;
+    if (server->sess_cache_len == 0)
+    {
+        return -1;
+    }
+    sess = coap_server_sess_find(server, key);
+    if (sess == NULL)
+    {
+        /* use the empty or least recently used entry */
+        sess = &server->sess_cache[0];
+        for (i = 1; i < server->sess_cache_len; i++)
+        {
+            if (server->sess_cache[i].last_use < sess->last_use)
+            {
+                sess = &server->sess_cache[i];
+            }
+        }
+    }
+    coap_server_sess_clear(sess);
+    sess->key.data = (unsigned char *)coap_mem_alloc(&server->mem, key.size);
+    sess->data.data = (unsigned char *)coap_mem_alloc(&server->mem, sess_data.size);
+    if ((sess->key.data == NULL) || (sess->data.data == NULL))
+    {
+        coap_server_sess_clear(sess);
+        return -1;
+    }
+    memcpy(sess->key.data, key.data, key.size);
+    sess->key.size = key.size;
+    memcpy(sess->data.data, sess_data.data, sess_data.size);
+    sess->data.size = sess_data.size;
+    sess->last_use = time(NULL);
+    coap_log_debug("Stored DTLS session in the session cache");
+    return 0;
+}
+
+/**
+ *  @brief Retrieve a DTLS session from the session cache
+ *
+ *  This is a call-back function that the GnuTLS library
+ *  uses to retrieve a stored session so that a client can
+ *  resume it with an abbreviated handshake.
+ *
+ *  @param[in,out] data Pointer to a server structure
+ *  @param[in] key Session ID
+ *
+ *  @returns Serialised session data, empty if not found
+ */
+static gnutls_datum_t coap_server_sess_retrieve_func(void *data, gnutls_datum_t key)
+{
+    coap_server_sess_t *sess = NULL;
+    coap_server_t *server = NULL;
+    gnutls_datum_t ret = {NULL, 0};
+
+    server = (coap_server_t *)data;
+    sess = coap_server_sess_find(server, key);
+    if (sess == NULL)
+    {
+        return ret;
+    }
+    ret.data = gnutls_malloc(sess->data.size);
+    if (ret.data == NULL)
+    {
+        return ret;
+    }
+    memcpy(ret.data, sess->data.data, sess->data.size);
+    ret.size = sess->data.size;
+    sess->last_use = time(NULL);
+    coap_log_debug("Retrieved DTLS session from the session cache");
+    return ret;
+}
+
+/**
+ *  @brief Remove a DTLS session from the session cache
+ *
+ *  This is a call-back function that the GnuTLS library
+ *  uses to remove a stored session that is no longer
+ *  valid for resumption.
+ *
+ *  @param[in,out] data Pointer to a server structure
+ *  @param[in] key Session ID
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Error
+ */
+static int coap_server_sess_remove_func(void *data, gnutls_datum_t key)
+{
+    coap_server_sess_t *sess = NULL;
+    coap_server_t *server = NULL;
+
+    server = (coap_server_t *)data;
+    sess = coap_server_sess_find(server, key);
+    if (sess == NULL)
+    {
+        return -1;
+    }
+    coap_server_sess_clear(sess);
+    coap_log_debug("Removed DTLS session from the session cache");
+    return 0;
+}
+
+static gnutls_dh_params_t coap_server_dh_params;                                /**< Process-wide Diffie-Hellman parameters shared by every server */
+static int coap_server_dh_params_ready;                                         /**< Flag to indicate that the process-wide Diffie-Hellman parameters are available */
+
+/**
+ *  @brief Get the process-wide Diffie-Hellman parameters
+ *
+ *  Generating Diffie-Hellman parameters costs several seconds,
+ *  so they are generated at most once per process and shared
+ *  by every server, unless they have already been loaded from
+ *  a file by coap_server_load_dh_params. The parameters are
+ *  retained for the lifetime of the process because the
+ *  credentials of every server refer to them.
+ *
+ *  @param[out] dh_params Pointer to a Diffie-Hellman parameters handle
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Error
+ */
+static int coap_server_dh_params_get(gnutls_dh_params_t *dh_params)
+{
+    int ret = 0;
+
+    if (!coap_server_dh_params_ready)
+    {
+        /* take an extra reference on the DTLS library so that the */
+        /* parameters outlive the destruction of every server */
+        ret = gnutls_global_init();
+        if (ret != GNUTLS_E_SUCCESS)
+        {
+            return -1;
+        }
+        ret = gnutls_dh_params_init(&coap_server_dh_params);
+        if (ret != GNUTLS_E_SUCCESS)
+        {
+            gnutls_global_deinit();
+            return -1;
+        }
+        coap_log_info("Generating Diffie-Hellman parameters");
+        ret = gnutls_dh_params_generate2(coap_server_dh_params, COAP_SERVER_DTLS_NUM_DH_BITS);
+        if (ret != GNUTLS_E_SUCCESS)
+        {
+            gnutls_dh_params_deinit(coap_server_dh_params);
+            gnutls_global_deinit();
+            return -1;
+        }
+        coap_server_dh_params_ready = 1;
+    }
+    *dh_params = coap_server_dh_params;
+    return 0;
+}
+
+int coap_server_load_dh_params(const char *file_name)
+{
+    gnutls_datum_t datum = {0};
+    FILE *file = NULL;
+    long file_len = 0;
+    int ret = 0;
+
+    if ((file_name == NULL) || (strlen(file_name) == 0))
+    {
+        return -EINVAL;
+    }
+    if (coap_server_dh_params_ready)
+    {
+        /* the credentials of an existing server may refer to the current parameters */
+        return -EBUSY;
+    }
+    file = fopen(file_name, "rb");
+    if (file == NULL)
+    {
+        return -errno;
+    }
+    if ((fseek(file, 0, SEEK_END) < 0)
+     || ((file_len = ftell(file)) < 0)
+     || (fseek(file, 0, SEEK_SET) < 0))
+    {
+        fclose(file);
+        return -errno;
+    }
+    datum.data = (unsigned char *)malloc(file_len);
+    if (datum.data == NULL)
+    {
+        fclose(file);
+        return -ENOMEM;
+    }
+    if (fread(datum.data, 1, file_len, file) != (size_t)file_len)
+    {
+        free(datum.data);
+        fclose(file);
+        return -EIO;
+    }
+    fclose(file);
+    datum.size = file_len;
+    ret = gnutls_global_init();
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        free(datum.data);
+        coap_log_error("Failed to initialise DTLS library");
+        return -1;
+    }
+    ret = gnutls_dh_params_init(&coap_server_dh_params);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        free(datum.data);
+        coap_log_error("Failed to initialise Diffie-Hellman parameters");
+        return -1;
+    }
+    ret = gnutls_dh_params_import_pkcs3(coap_server_dh_params, &datum, GNUTLS_X509_FMT_PEM);
+    free(datum.data);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        gnutls_dh_params_deinit(coap_server_dh_params);
+        coap_log_error("Failed to import Diffie-Hellman parameters from file '%s'", file_name);
+        return -1;
+    }
+    coap_server_dh_params_ready = 1;
+    coap_log_info("Loaded Diffie-Hellman parameters from file '%s'", file_name);
+    return 0;
+}
+
 /**
  *  @brief Initialise the DTLS members of a server structure
  *
@@ -1303,33 +1793,44 @@ static int coap_server_dtls_create(coap_server_t *server,
         coap_log_error("Failed to assign X.509 certificate file and key file to DTLS credentials");
         return -1;
     }
-    ret = gnutls_dh_params_init(&server->dh_params);
-    if (ret != GNUTLS_E_SUCCESS)
+    ret = coap_server_dh_params_get(&server->dh_params);
+    if (ret < 0)
     {
         gnutls_certificate_free_credentials(server->cred);
         gnutls_global_deinit();
-        coap_log_error("Failed to initialise Diffie-Hellman parameters for DTLS credentials");
+        coap_log_error("Failed to obtain Diffie-Hellman parameters for DTLS credentials");
         return -1;
     }
-    ret = gnutls_dh_params_generate2(server->dh_params, COAP_SERVER_DTLS_NUM_DH_BITS);
+    gnutls_certificate_set_dh_params(server->cred, server->dh_params);
+    ret = gnutls_priority_init(&server->priority, COAP_SERVER_DTLS_PRIORITIES, NULL);
     if (ret != GNUTLS_E_SUCCESS)
     {
-        gnutls_dh_params_deinit(server->dh_params);
         gnutls_certificate_free_credentials(server->cred);
         gnutls_global_deinit();
-        coap_log_error("Failed to generate Diffie-Hellman parameters for DTLS credentials");
+        coap_log_error("Failed to initialise priorities for DTLS session");
         return -1;
     }
-    gnutls_certificate_set_dh_params(server->cred, server->dh_params);
-    ret = gnutls_priority_init(&server->priority, COAP_SERVER_DTLS_PRIORITIES, NULL);
+    ret = gnutls_session_ticket_key_generate(&server->ticket_key);
     if (ret != GNUTLS_E_SUCCESS)
     {
-        gnutls_dh_params_deinit(server->dh_params);
+        gnutls_priority_deinit(server->priority);
         gnutls_certificate_free_credentials(server->cred);
         gnutls_global_deinit();
-        coap_log_error("Failed to initialise priorities for DTLS session");
+        coap_log_error("Failed to generate DTLS session ticket key");
+        return -1;
+    }
+    server->sess_cache = (coap_server_sess_t *)coap_mem_alloc(&server->mem, COAP_SERVER_DTLS_SESS_CACHE_LEN * sizeof(coap_server_sess_t));
+    if (server->sess_cache == NULL)
+    {
+        gnutls_free(server->ticket_key.data);
+        gnutls_priority_deinit(server->priority);
+        gnutls_certificate_free_credentials(server->cred);
+        gnutls_global_deinit();
+        coap_log_error("Failed to allocate DTLS session cache");
         return -1;
     }
+    memset(server->sess_cache, 0, COAP_SERVER_DTLS_SESS_CACHE_LEN * sizeof(coap_server_sess_t));
+    server->sess_cache_len = COAP_SERVER_DTLS_SESS_CACHE_LEN;
     return 0;
 }
 
@@ -1340,9 +1841,10 @@ static int coap_server_dtls_create(coap_server_t *server,
  */
 static void coap_server_dtls_destroy(coap_server_t *server)
 {
+    gnutls_free(server->ticket_key.data);
     gnutls_priority_deinit(server->priority);
     gnutls_certificate_free_credentials(server->cred);
-    gnutls_dh_params_deinit(server->dh_params);
+    /* the process-wide Diffie-Hellman parameters are retained for reuse */
     gnutls_global_deinit();
 }
 
@@ -1352,23 +1854,30 @@ static void coap_server_dtls_destroy(coap_server_t *server)
  *                                           coap_server                                            *
  ****************************************************************************************************/
 
-#ifdef COAP_DTLS_EN
-int coap_server_create(coap_server_t *server,
-                       int (* handle)(coap_server_t *, coap_msg_t *, coap_msg_t *),
-                       const char *host,
-                       const char *port,
-                       const char *key_file_name,
-                       const char *cert_file_name,
-                       const char *trust_file_name,
-                       const char *crl_file_name)
-#else
-int coap_server_create(coap_server_t *server,
-                       int (* handle)(coap_server_t *, coap_msg_t *, coap_msg_t *),
-                       const char *host,
-                       const char *port)
-#endif
+/**
+ *  @brief Initialise the transport members of a server structure
+ *
+ *  Open the socket, the epoll instance and the timer wheel
+ *  and allocate the transaction table and the send queue.
+ *  The DTLS members are not initialised here so that worker
+ *  servers can share the credentials of the primary server.
+ *
+ *  @param[out] server Pointer to a server structure
+ *  @param[in] handle Call-back function to handle client requests
+ *  @param[in] host Pointer to a string containing the host address of the server
+ *  @param[in] port Port number of the server
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_init(coap_server_t *server,
+                            int (* handle)(coap_server_t *, coap_msg_t *, coap_msg_t *),
+                            const char *host,
+                            const char *port)
 {
     unsigned char msg_id[2] = {0};
+    struct epoll_event ev = {0};
     struct addrinfo hints = {0};
     struct addrinfo *list = NULL;
     struct addrinfo *node = NULL;
@@ -1413,6 +1922,14 @@ int coap_server_create(coap_server_t *server,
                 freeaddrinfo(list);
                 return -EBUSY;
             }
+            opt_val = 1;
+            ret = setsockopt(server->sd, SOL_SOCKET, SO_REUSEPORT, &opt_val, (socklen_t)sizeof(opt_val));
+            if (ret < 0)
+            {
+                close(server->sd);
+                freeaddrinfo(list);
+                return -EBUSY;
+            }
             ret = bind(server->sd, node->ai_addr, node->ai_addrlen);
             if (ret < 0)
             {
@@ -1442,58 +1959,306 @@ int coap_server_create(coap_server_t *server,
         memset(server, 0, sizeof(coap_server_t));
         return -errno;
     }
-    coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
-    server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
-    coap_server_path_list_create(&server->sep_list);
-    server->handle = handle;
-#ifdef COAP_DTLS_EN
-    ret = coap_server_dtls_create(server, key_file_name, cert_file_name, trust_file_name, crl_file_name);
-    if (ret < 0)
+    server->epfd = epoll_create1(0);
+    if (server->epfd < 0)
     {
-        coap_server_path_list_destroy(&server->sep_list);
         close(server->sd);
         memset(server, 0, sizeof(coap_server_t));
-        return ret;
+        return -errno;
     }
-#endif
-    coap_log_notice("Listening on address %s and port %s", host, port);
-    return 0;
-}
-
-void coap_server_destroy(coap_server_t *server)
-{
-    coap_server_trans_t *trans = NULL;
-    unsigned i = 0;
-
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;  /* NULL identifies the listen socket */
+    ret = epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->sd, &ev);
+    if (ret < 0)
     {
-        trans = &server->trans[i];
-        if (trans->active)
-        {
-            coap_server_trans_destroy(trans);
-        }
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -errno;
     }
-#ifdef COAP_DTLS_EN
-    coap_server_dtls_destroy(server);
-#endif
-    coap_server_path_list_destroy(&server->sep_list);
-    close(server->sd);
-    memset(server, 0, sizeof(coap_server_t));
-}
-
-unsigned coap_server_get_next_msg_id(coap_server_t *server)
-{
-    unsigned char msg_id[2] = {0};
-
-    server->msg_id++;
-    while (server->msg_id > COAP_MSG_MAX_MSG_ID)
+    server->wheel_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (server->wheel_fd < 0)
     {
-        coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
-        server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -errno;
     }
-    return server->msg_id;
-}
-
+    ev.events = EPOLLIN;
+    ev.data.ptr = server;  /* the server pointer identifies the timer wheel */
+    ret = epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->wheel_fd, &ev);
+    if (ret < 0)
+    {
+        close(server->wheel_fd);
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -errno;
+    }
+    server->max_trans = COAP_SERVER_DEF_MAX_TRANS;
+    server->num_buckets = COAP_SERVER_DEF_MAX_TRANS;
+    server->trans = (coap_server_trans_t **)coap_mem_alloc(&server->mem, server->num_buckets * sizeof(coap_server_trans_t *));
+    if (server->trans == NULL)
+    {
+        close(server->wheel_fd);
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -ENOMEM;
+    }
+    memset(server->trans, 0, server->num_buckets * sizeof(coap_server_trans_t *));
+    server->send_queue = (coap_server_dgram_t *)coap_mem_alloc(&server->mem, COAP_SERVER_BATCH_SIZE * sizeof(coap_server_dgram_t));
+    if (server->send_queue == NULL)
+    {
+        coap_mem_free(server->trans);
+        close(server->wheel_fd);
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -ENOMEM;
+    }
+    server->dedup = (coap_server_dedup_t *)coap_mem_alloc(&server->mem, COAP_SERVER_DEDUP_LEN * sizeof(coap_server_dedup_t));
+    if (server->dedup == NULL)
+    {
+        coap_mem_free(server->send_queue);
+        coap_mem_free(server->trans);
+        close(server->wheel_fd);
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -ENOMEM;
+    }
+    memset(server->dedup, 0, COAP_SERVER_DEDUP_LEN * sizeof(coap_server_dedup_t));
+    server->dedup_len = COAP_SERVER_DEDUP_LEN;
+    server->obs = (coap_server_obs_t *)coap_mem_alloc(&server->mem, COAP_SERVER_NUM_OBS * sizeof(coap_server_obs_t));
+    if (server->obs == NULL)
+    {
+        coap_mem_free(server->dedup);
+        coap_mem_free(server->send_queue);
+        coap_mem_free(server->trans);
+        close(server->wheel_fd);
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -ENOMEM;
+    }
+    memset(server->obs, 0, COAP_SERVER_NUM_OBS * sizeof(coap_server_obs_t));
+    server->obs_len = COAP_SERVER_NUM_OBS;
+    coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
+    server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
+    coap_server_path_list_create(&server->sep_list);
+    server->handle = handle;
+    strncpy(server->host, host, sizeof(server->host) - 1);
+    strncpy(server->port, port, sizeof(server->port) - 1);
+    return 0;
+}
+
+#ifdef COAP_DTLS_EN
+int coap_server_create(coap_server_t *server,
+                       int (* handle)(coap_server_t *, coap_msg_t *, coap_msg_t *),
+                       const char *host,
+                       const char *port,
+                       const char *key_file_name,
+                       const char *cert_file_name,
+                       const char *trust_file_name,
+                       const char *crl_file_name)
+{
+    int ret = 0;
+
+    ret = coap_server_init(server, handle, host, port);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_server_dtls_create(server, key_file_name, cert_file_name, trust_file_name, crl_file_name);
+    if (ret < 0)
+    {
+        coap_server_path_list_destroy(&server->sep_list);
+        coap_mem_free(server->obs);
+        coap_mem_free(server->dedup);
+        coap_mem_free(server->send_queue);
+        coap_mem_free(server->trans);
+        close(server->wheel_fd);
+        close(server->epfd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return ret;
+    }
+    coap_log_notice("Listening on address %s and port %s", host, port);
+    return 0;
+}
+#else  /* !COAP_DTLS_EN */
+int coap_server_create(coap_server_t *server,
+                       int (* handle)(coap_server_t *, coap_msg_t *, coap_msg_t *),
+                       const char *host,
+                       const char *port)
+{
+    int ret = 0;
+
+    ret = coap_server_init(server, handle, host, port);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    coap_log_notice("Listening on address %s and port %s", host, port);
+    return 0;
+}
+#endif  /* COAP_DTLS_EN */
+
+void coap_server_destroy(coap_server_t *server)
+{
+    coap_server_route_t *route = NULL;
+    unsigned i = 0;
+
+    for (i = 0; i < server->num_buckets; i++)
+    {
+        while (server->trans[i] != NULL)
+        {
+            coap_server_trans_destroy(server->trans[i]);
+        }
+    }
+    for (i = 0; i < COAP_SERVER_NUM_ROUTE_BUCKETS; i++)
+    {
+        while (server->routes[i] != NULL)
+        {
+            route = server->routes[i];
+            server->routes[i] = route->next;
+            coap_mem_free(route->str);
+            coap_mem_free(route);
+        }
+    }
+#ifdef COAP_DTLS_EN
+    for (i = 0; i < server->sess_cache_len; i++)
+    {
+        coap_server_sess_clear(&server->sess_cache[i]);
+    }
+    coap_mem_free(server->sess_cache);
+    if (!server->shared_cred)
+    {
+        coap_server_dtls_destroy(server);
+    }
+#endif
+    coap_server_path_list_destroy(&server->sep_list);
+    coap_mem_free(server->obs);
+    coap_mem_free(server->dedup);
+    coap_mem_free(server->send_queue);
+    coap_mem_free(server->trans);
+    close(server->wheel_fd);
+    close(server->epfd);
+    close(server->sd);
+    memset(server, 0, sizeof(coap_server_t));
+}
+
+static coap_server_trans_t *coap_server_find_oldest_trans(coap_server_t *server);
+
+int coap_server_set_max_trans(coap_server_t *server, unsigned max_trans)
+{
+    coap_server_trans_t **old_table = NULL;
+    coap_server_trans_t **new_table = NULL;
+    coap_server_trans_t *trans = NULL;
+    coap_server_trans_t *next = NULL;
+    unsigned old_num_buckets = 0;
+    unsigned bucket = 0;
+    unsigned i = 0;
+
+    if (max_trans == 0)
+    {
+        return -EINVAL;
+    }
+    new_table = (coap_server_trans_t **)coap_mem_alloc(&server->mem, max_trans * sizeof(coap_server_trans_t *));
+    if (new_table == NULL)
+    {
+        return -ENOMEM;
+    }
+    memset(new_table, 0, max_trans * sizeof(coap_server_trans_t *));
+    old_table = server->trans;
+    old_num_buckets = server->num_buckets;
+    server->trans = new_table;
+    server->num_buckets = max_trans;
+    server->max_trans = max_trans;
+    /* rehash the existing transactions into the new table */
+    for (i = 0; i < old_num_buckets; i++)
+    {
+        trans = old_table[i];
+        while (trans != NULL)
+        {
+            next = trans->next;
+            bucket = coap_server_trans_hash(server, &trans->client_sin);
+            trans->next = server->trans[bucket];
+            server->trans[bucket] = trans;
+            trans = next;
+        }
+    }
+    coap_mem_free(old_table);
+    /* destroy least recently used transactions in excess of the new maximum */
+    while (server->num_trans > server->max_trans)
+    {
+        coap_server_trans_destroy(coap_server_find_oldest_trans(server));
+    }
+    coap_log_debug("Set maximum number of active transactions to %u", max_trans);
+    return 0;
+}
+
+void coap_server_get_stats(coap_server_t *server, coap_server_stats_t *stats)
+{
+    memcpy(stats, &server->stats, sizeof(coap_server_stats_t));
+    stats->num_trans = server->num_trans;
+    stats->max_trans = server->max_trans;
+}
+
+void coap_server_set_mem_budget(coap_server_t *server, size_t budget)
+{
+    server->mem.budget = budget;
+    coap_log_debug("Set memory budget to %zu bytes", budget);
+}
+
+void coap_server_get_mem_acct(coap_server_t *server, coap_mem_acct_t *acct)
+{
+    memcpy(acct, &server->mem, sizeof(coap_mem_acct_t));
+}
+
+#ifdef COAP_DTLS_EN
+
+int coap_server_set_sess_cache_len(coap_server_t *server, unsigned sess_cache_len)
+{
+    coap_server_sess_t *new_cache = NULL;
+    unsigned i = 0;
+
+    if (sess_cache_len > 0)
+    {
+        new_cache = (coap_server_sess_t *)coap_mem_alloc(&server->mem, sess_cache_len * sizeof(coap_server_sess_t));
+        if (new_cache == NULL)
+        {
+            return -ENOMEM;
+        }
+        memset(new_cache, 0, sess_cache_len * sizeof(coap_server_sess_t));
+    }
+    for (i = 0; i < server->sess_cache_len; i++)
+    {
+        coap_server_sess_clear(&server->sess_cache[i]);
+    }
+    coap_mem_free(server->sess_cache);
+    server->sess_cache = new_cache;
+    server->sess_cache_len = sess_cache_len;
+    coap_log_debug("Set DTLS session cache length to %u", sess_cache_len);
+    return 0;
+}
+
+#endif  /* COAP_DTLS_EN */
+
+unsigned coap_server_get_next_msg_id(coap_server_t *server)
+{
+    unsigned char msg_id[2] = {0};
+
+    server->msg_id++;
+    while (server->msg_id > COAP_MSG_MAX_MSG_ID)
+    {
+        coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
+        server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
+    }
+    return server->msg_id;
+}
+
 /**
  *  @brief Check that all of the options in a message are acceptable
  *
@@ -1528,41 +2293,15 @@ static unsigned coap_server_check_options(coap_msg_t *msg)
 static coap_server_trans_t *coap_server_find_trans(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len)
 {
     coap_server_trans_t *trans = NULL;
-    unsigned i = 0;
+    unsigned bucket = 0;
 
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+    bucket = coap_server_trans_hash(server, client_sin);
+    for (trans = server->trans[bucket]; trans != NULL; trans = trans->next)
     {
-        trans = &server->trans[i];
-        if ((trans->active)
-         && (trans->client_sin_len == client_sin_len)
+        if ((trans->client_sin_len == client_sin_len)
          && (memcmp(&trans->client_sin, client_sin, client_sin_len) == 0))
         {
-            coap_log_debug("Found existing transaction at index %u", i);
-            return trans;
-        }
-    }
-    return NULL;
-}
-
-/**
- *  @brief Search for an empty transaction structure in a server structure
- *
- *  @param[in] server Pointer to a server structure
- *
- *  @returns Pointer to a transaction structure
- *  @retval NULL No empty transaction structures available
- */
-static coap_server_trans_t *coap_server_find_empty_trans(coap_server_t *server)
-{
-    coap_server_trans_t *trans = NULL;
-    unsigned i = 0;
-
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
-    {
-        trans = &server->trans[i];
-        if (!trans->active)
-        {
-            coap_log_debug("Found empty transaction at index %u", i);
+            coap_log_debug("Found existing transaction in bucket %u", bucket);
             return trans;
         }
     }
@@ -1573,246 +2312,1333 @@ static coap_server_trans_t *coap_server_find_empty_trans(coap_server_t *server)
  *  @brief Search for the oldest transaction structure in a server structure
  *
  *  Search for the transaction structure in a server structure that was
- *  used least recently.
+ *  used least recently. This walks every transaction but is only called
+ *  when the maximum number of active transactions has been reached.
  *
  *  @param[in] server Pointer to a server structure
  *
  *  @returns Pointer to a transaction structure
+ *  @retval NULL No active transactions
  */
 static coap_server_trans_t *coap_server_find_oldest_trans(coap_server_t *server)
 {
     coap_server_trans_t *oldest = NULL;
     coap_server_trans_t *trans = NULL;
     unsigned i = 0;
-    unsigned j = 0;
     time_t min_last_use = 0;
 
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+    for (i = 0; i < server->num_buckets; i++)
     {
-        trans = &server->trans[i];
-        if (trans->active)
+        for (trans = server->trans[i]; trans != NULL; trans = trans->next)
         {
             if ((min_last_use == 0) || (trans->last_use < min_last_use))
             {
                 oldest = trans;
                 min_last_use = trans->last_use;
-                j = i;
             }
         }
     }
-    coap_log_debug("Found oldest transaction at index %u", j);
-    return oldest != NULL ? oldest : &server->trans[0];
+    if (oldest != NULL)
+    {
+        coap_log_debug("Found oldest transaction for address %s and port %u", oldest->client_addr, ntohs(oldest->client_sin.sin6_port));
+    }
+    return oldest;
 }
 
 /**
  *  @brief Wait for a message to arrive or an acknowledgement
  *         timer in any of the active transactions to expire
  *
+ *  The listen socket and the timer descriptor that drives the
+ *  timer wheel are registered with an epoll instance so that a
+ *  wakeup costs the same regardless of the number of active
+ *  transactions.
+ *
  *  @param[in,out] server Pointer to a server structure
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_listen(coap_server_t *server)
+/**
+ *  @brief Advance the timer wheel and handle expired timers
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_wheel_tick(coap_server_t *server)
 {
     coap_server_trans_t *trans = NULL;
-    unsigned i = 0;
-    fd_set read_fds = {{0}};
-    int max_fd = 0;
+    coap_server_trans_t *next = NULL;
+    uint64_t num_exp = 0;
+    ssize_t num = 0;
     int ret = 0;
 
-    while (1)
+    num = read(server->wheel_fd, &num_exp, sizeof(num_exp));
+    if (num != sizeof(num_exp))
+    {
+        return 0;  /* spurious wakeup */
+    }
+    while (num_exp-- > 0)
     {
-        FD_ZERO(&read_fds);
-        FD_SET(server->sd, &read_fds);
-        max_fd = server->sd;
-        for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+        server->wheel_slot = (server->wheel_slot + 1) % COAP_SERVER_NUM_WHEEL_SLOTS;
+        trans = server->wheel[server->wheel_slot];
+        while (trans != NULL)
         {
-            trans = &server->trans[i];
-            if (trans->active)
+            /* handling an acknowledgement timeout may destroy the transaction */
+            next = trans->timer_next;
+            if (trans->timer_rounds > 0)
+            {
+                trans->timer_rounds--;
+            }
+            else
             {
-                FD_SET(trans->timer_fd, &read_fds);
-                if (trans->timer_fd > max_fd)
+                coap_server_trans_stop_timer(trans);
+                ret = coap_server_trans_handle_ack_timeout(trans);
+                if (ret < 0)
                 {
-                    max_fd = trans->timer_fd;
+                    return ret;
                 }
             }
+            trans = next;
         }
-        ret = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
-        if (ret < 0)
+        if (server->num_armed == 0)
         {
-            return -errno;
+            break;  /* the timer that drives the wheel has been stopped */
         }
-        if (FD_ISSET(server->sd, &read_fds))
+    }
+    return 0;
+}
+
+static int coap_server_listen(coap_server_t *server)
+{
+    struct epoll_event events[COAP_SERVER_NUM_EVENTS] = {{0}};
+    int msg_ready = 0;
+    int num = 0;
+    int ret = 0;
+    int i = 0;
+
+    while (1)
+    {
+        num = epoll_wait(server->epfd, events, COAP_SERVER_NUM_EVENTS, -1);
+        if (num < 0)
         {
-            return 0;
+            return -errno;
         }
-        for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+        msg_ready = 0;
+        for (i = 0; i < num; i++)
         {
-            trans = &server->trans[i];
-            if ((trans->active) && (FD_ISSET(trans->timer_fd, &read_fds)))
+            /* a NULL data pointer identifies the listen socket, */
+            /* the server pointer identifies the timer wheel */
+            if (events[i].data.ptr == NULL)
             {
-                ret = coap_server_trans_handle_ack_timeout(trans);
+                msg_ready = 1;
+            }
+            else if (events[i].data.ptr == server)
+            {
+                ret = coap_server_wheel_tick(server);
                 if (ret < 0)
                 {
                     return ret;
                 }
             }
         }
+        if (msg_ready)
+        {
+            return 0;
+        }
     }
     return 0;
 }
 
 /**
- *  @brief Accept an incoming connection
+ *  @brief Send a datagram to a client
  *
- *  @param[in] server Pointer to a server structure
- *  @param[out] client_sin Pointer to an IPv6 socket structure
- *  @param[out] client_sin_len Length of the IPv6 socket structure
+ *  While a batch of messages is being processed, datagrams
+ *  are queued and flushed with a single sendmmsg call when
+ *  the batch completes. Otherwise, or when the send queue
+ *  is full, the datagram is sent immediately.
  *
- *  Get the address and port number of the client.
- *  Do not read the received data.
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to an IPv6 socket structure
+ *  @param[in] client_sin_len Length of the IPv6 socket structure
+ *  @param[in] buf Pointer to a buffer containing the datagram
+ *  @param[in] len Length of the datagram
  *
- *  @returns Number of bytes received or error code
- *  @retval 0 Success
+ *  @returns Number of bytes sent or queued or error code
+ *  @retval >=0 Number of bytes sent or queued
  *  @retval <0 Error
  */
-static int coap_server_accept(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t *client_sin_len)
+static ssize_t coap_server_queue_send(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len, const char *buf, size_t len)
 {
+    coap_server_dgram_t *dgram = NULL;
     ssize_t num = 0;
-    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
 
-    *client_sin_len = sizeof(struct sockaddr_in6);
-    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)client_sin, client_sin_len);
+    if ((server->batching)
+     && (server->num_queued < COAP_SERVER_BATCH_SIZE)
+     && (len <= COAP_MSG_MAX_BUF_LEN))
+    {
+        dgram = &server->send_queue[server->num_queued];
+        memcpy(&dgram->client_sin, client_sin, client_sin_len);
+        dgram->client_sin_len = client_sin_len;
+        memcpy(dgram->buf, buf, len);
+        dgram->len = len;
+        server->num_queued++;
+        server->stats.tx_dgrams++;
+        return len;
+    }
+    num = sendto(server->sd, buf, len, 0, (struct sockaddr *)client_sin, client_sin_len);
     if (num < 0)
     {
         return -errno;
     }
+    server->stats.tx_dgrams++;
+    return num;
+}
+
+/**
+ *  @brief Send all queued response datagrams
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_flush_send_queue(coap_server_t *server)
+{
+    struct mmsghdr msgvec[COAP_SERVER_BATCH_SIZE] = {{{0}}};
+    struct iovec iov[COAP_SERVER_BATCH_SIZE] = {{0}};
+    unsigned num_sent = 0;
+    unsigned i = 0;
+    int num = 0;
+
+    for (i = 0; i < server->num_queued; i++)
+    {
+        iov[i].iov_base = server->send_queue[i].buf;
+        iov[i].iov_len = server->send_queue[i].len;
+        msgvec[i].msg_hdr.msg_name = &server->send_queue[i].client_sin;
+        msgvec[i].msg_hdr.msg_namelen = server->send_queue[i].client_sin_len;
+        msgvec[i].msg_hdr.msg_iov = &iov[i];
+        msgvec[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (num_sent < server->num_queued)
+    {
+        num = sendmmsg(server->sd, &msgvec[num_sent], server->num_queued - num_sent, 0);
+        if (num < 0)
+        {
+            server->num_queued = 0;
+            return -errno;
+        }
+        num_sent += num;
+    }
+    server->num_queued = 0;
     return 0;
 }
 
 int coap_server_add_sep_resp_uri_path(coap_server_t *server, const char *str)
 {
-    return coap_server_path_list_add(&server->sep_list, str);
+    return coap_server_path_list_add(&server->sep_list, &server->mem, str);
 }
 
-/**
- *  @brief Determine whether a request warrants a piggy-backed
- *         response or a separate response
- *
- *  This function makes the decision on whether to send a separate
- *  response or a piggy-backed response by searching for the URI
- *  path taken from the request message structure in a user supplied
- *  URI path list. The idea being that some resources will consistently
- *  require time to retrieve and others will not.
+int coap_server_add_resource(coap_server_t *server,
+                             const char *str,
+                             int (* handle)(coap_server_t *, coap_msg_t *, coap_msg_t *),
+                             coap_server_resp_t resp_type)
+{
+    coap_server_route_t *route = NULL;
+    unsigned bucket = 0;
+
+    if ((str == NULL) || (handle == NULL))
+    {
+        return -EINVAL;
+    }
+    route = coap_server_find_route(server, str);
+    if (route != NULL)
+    {
+        route->handle = handle;
+        route->resp_type = resp_type;
+        return 0;
+    }
+    route = (coap_server_route_t *)coap_mem_alloc(&server->mem, sizeof(coap_server_route_t));
+    if (route == NULL)
+    {
+        return -ENOMEM;
+    }
+    route->str = coap_mem_strdup(&server->mem, str);
+    if (route->str == NULL)
+    {
+        coap_mem_free(route);
+        return -ENOMEM;
+    }
+    route->handle = handle;
+    route->resp_type = resp_type;
+    bucket = coap_server_route_hash(str);
+    route->next = server->routes[bucket];
+    server->routes[bucket] = route;
+    coap_log_debug("Added route for URI path: '%s'", str);
+    return 0;
+}
+
+/**
+ *  @brief Reconstruct the URI path from the options in a request message
  *
- *  @param[in] server Pointer to a server structure
  *  @param[in] msg Pointer to a message structure
- *
- *  @returns Response type
- *  @retval COAP_SERVER_PIGGYBACKED Piggy-backed response
- *  @retval COAP_SERVER_SEPARATE Separate response
- */ 
-static int coap_server_get_resp_type(coap_server_t *server, coap_msg_t *msg)
+ *  @param[out] buf Pointer to a buffer to contain the URI path
+ *  @param[in] buf_len Length of the buffer
+ */
+static void coap_server_get_uri_path(coap_msg_t *msg, char *buf, size_t buf_len)
 {
     coap_msg_op_t *op = NULL;
     size_t val_len = 0;
     size_t add = 0;
     size_t len = 0;
     char val_buf[COAP_MSG_OP_URI_PATH_MAX_LEN] = {0};
-    char buf[COAP_MSG_OP_URI_PATH_MAX_LEN] = {0};
     char *val = NULL;
     char *p = NULL;
-    int match = 0;
 
+    memset(buf, 0, buf_len);
     p = buf;
-    len = sizeof(buf) - 1;
+    len = buf_len - 1;
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_OP_URI_PATH_NUM)
+        {
+            strncpy(p, "/", len);
+            add = (1 < len) ? 1 : len;
+            p += add;
+            len -= add;
+
+            val = coap_msg_op_get_val(op);
+            val_len = coap_msg_op_get_len(op);
+            if (val_len > sizeof(val_buf) - 1)
+                val_len = sizeof(val_buf) - 1;
+            memcpy(val_buf, val, val_len);
+            strncpy(p, val_buf, len);
+            add = (val_len < len) ? val_len : len;
+            p += add;
+            len -= add;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if (p == buf)
+    {
+        buf[0] = '/';
+    }
+}
+
+/**
+ *  @brief Determine whether a request warrants a piggy-backed
+ *         response or a separate response
+ *
+ *  This function makes the decision on whether to send a separate
+ *  response or a piggy-backed response by searching for the URI
+ *  path taken from the request message structure in a user supplied
+ *  URI path list. The idea being that some resources will consistently
+ *  require time to retrieve and others will not.
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] uri_path String representation of the request URI path
+ *
+ *  @returns Response type
+ *  @retval COAP_SERVER_PIGGYBACKED Piggy-backed response
+ *  @retval COAP_SERVER_SEPARATE Separate response
+ */
+static int coap_server_get_resp_type(coap_server_t *server, const char *uri_path)
+{
+    int match = 0;
+
+    match = coap_server_path_list_match(&server->sep_list, uri_path);
+    return match ? COAP_SERVER_SEPARATE : COAP_SERVER_PIGGYBACKED;
+}
+
+/**
+ *  @brief Store a response in the deduplication ring buffer
+ *
+ *  Format the response message into the next entry of the
+ *  deduplication ring buffer, keyed by the message ID of the
+ *  request and the client address, so that a retransmitted
+ *  request can be answered from the stored response even
+ *  after the transaction has been recycled. The entry expires
+ *  after EXCHANGE_LIFETIME.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] msg_id Message ID of the request
+ *  @param[in] msg Pointer to the response message structure
+ */
+static void coap_server_dedup_store(coap_server_t *server, coap_server_trans_t *trans, unsigned msg_id, coap_msg_t *msg)
+{
+    coap_server_dedup_t *dedup = NULL;
+    ssize_t num = 0;
+
+    if (server->dedup_len == 0)
+    {
+        return;
+    }
+    dedup = &server->dedup[server->dedup_next];
+    num = coap_msg_format(msg, dedup->buf, sizeof(dedup->buf));
+    if (num < 0)
+    {
+        return;
+    }
+    memcpy(&dedup->client_sin, &trans->client_sin, trans->client_sin_len);
+    dedup->client_sin_len = trans->client_sin_len;
+    dedup->msg_id = msg_id;
+    dedup->len = num;
+    dedup->expiry = time(NULL) + COAP_SERVER_EXCHANGE_LIFETIME;
+    server->dedup_next = (server->dedup_next + 1) % server->dedup_len;
+}
+
+/**
+ *  @brief Find a response in the deduplication ring buffer
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to an IPv6 socket structure
+ *  @param[in] client_sin_len Length of the IPv6 socket structure
+ *  @param[in] msg_id Message ID of the request
+ *
+ *  @returns Pointer to a deduplication cache entry structure or NULL
+ */
+static coap_server_dedup_t *coap_server_dedup_find(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len, unsigned msg_id)
+{
+    coap_server_dedup_t *dedup = NULL;
+    time_t now = 0;
+    unsigned i = 0;
+
+    now = time(NULL);
+    for (i = 0; i < server->dedup_len; i++)
+    {
+        dedup = &server->dedup[i];
+        if ((dedup->len > 0)
+         && (dedup->expiry > now)
+         && (dedup->msg_id == msg_id)
+         && (dedup->client_sin_len == client_sin_len)
+         && (memcmp(&dedup->client_sin, client_sin, client_sin_len) == 0))
+        {
+            return dedup;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Parse the value of the observe option in a message
+ *
+ *  @param[in] msg Pointer to a message structure
+ *  @param[out] val Pointer to an unsigned to contain the option value
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Observe option not present
+ */
+static int coap_server_get_obs_val(coap_msg_t *msg, unsigned *val)
+{
+    coap_msg_op_t *op = NULL;
+    unsigned i = 0;
+
     op = coap_msg_get_first_op(msg);
     while (op != NULL)
     {
-        if (coap_msg_op_get_num(op) == COAP_MSG_OP_URI_PATH_NUM)
-        {
-            strncpy(p, "/", len);
-            add = (1 < len) ? 1 : len;
-            p += add;
-            len -= add;
-
-            val = coap_msg_op_get_val(op);
-            val_len = coap_msg_op_get_len(op);
-            if (val_len > sizeof(val_buf) - 1)
-                val_len = sizeof(val_buf) - 1;
-            memcpy(val_buf, val, val_len);
-            strncpy(p, val_buf, len);
-            add = (val_len < len) ? val_len : len;
-            p += add;
-            len -= add;
-        }
-        op = coap_msg_op_get_next(op);
+        if (coap_msg_op_get_num(op) == COAP_MSG_OBSERVE)
+        {
+            *val = 0;
+            for (i = 0; i < coap_msg_op_get_len(op); i++)
+            {
+                *val = (*val << 8) | (unsigned char)coap_msg_op_get_val(op)[i];
+            }
+            return 0;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    return -1;
+}
+
+/**
+ *  @brief Add an observe option to a message
+ *
+ *  The sequence number is encoded in the smallest
+ *  number of bytes that can represent it.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] seq Sequence number
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_add_obs_op(coap_msg_t *msg, unsigned seq)
+{
+    unsigned len = 0;
+    unsigned i = 0;
+    char val[3] = {0};
+
+    seq &= 0x00ffffff;  /* the sequence number is 24 bits wide */
+    if (seq > 0xffff)
+    {
+        len = 3;
+    }
+    else if (seq > 0xff)
+    {
+        len = 2;
+    }
+    else if (seq > 0)
+    {
+        len = 1;
+    }
+    for (i = 0; i < len; i++)
+    {
+        val[i] = (seq >> (8 * (len - i - 1))) & 0xff;
+    }
+    return coap_msg_add_op(msg, COAP_MSG_OBSERVE, len, val);
+}
+
+/**
+ *  @brief Find the observer entry for a client and URI path
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to an IPv6 socket structure
+ *  @param[in] client_sin_len Length of the IPv6 socket structure
+ *  @param[in] uri_path String representation of a URI path
+ *
+ *  @returns Pointer to an observer structure or NULL
+ */
+static coap_server_obs_t *coap_server_find_obs(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len, const char *uri_path)
+{
+    coap_server_obs_t *obs = NULL;
+    unsigned i = 0;
+
+    for (i = 0; i < server->obs_len; i++)
+    {
+        obs = &server->obs[i];
+        if ((obs->active)
+         && (obs->client_sin_len == client_sin_len)
+         && (memcmp(&obs->client_sin, client_sin, client_sin_len) == 0)
+         && (strcmp(obs->uri_path, uri_path) == 0))
+        {
+            return obs;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Register an observer of a resource
+ *
+ *  An existing entry for the same client and URI path is
+ *  updated in place so that re-registration refreshes the
+ *  token without consuming another entry. The registration
+ *  is refused when the observer array is full.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to the request message structure
+ *  @param[in] uri_path String representation of a URI path
+ *
+ *  @returns Pointer to an observer structure or NULL
+ */
+static coap_server_obs_t *coap_server_register_obs(coap_server_t *server, coap_server_trans_t *trans, coap_msg_t *msg, const char *uri_path)
+{
+    coap_server_obs_t *obs = NULL;
+    unsigned i = 0;
+
+    obs = coap_server_find_obs(server, &trans->client_sin, trans->client_sin_len, uri_path);
+    if (obs == NULL)
+    {
+        for (i = 0; i < server->obs_len; i++)
+        {
+            if (!server->obs[i].active)
+            {
+                obs = &server->obs[i];
+                break;
+            }
+        }
+        if (obs == NULL)
+        {
+            coap_log_warn("Unable to register observer for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+            return NULL;
+        }
+        memset(obs, 0, sizeof(coap_server_obs_t));
+        obs->active = 1;
+        memcpy(&obs->client_sin, &trans->client_sin, trans->client_sin_len);
+        obs->client_sin_len = trans->client_sin_len;
+        strncpy(obs->uri_path, uri_path, sizeof(obs->uri_path) - 1);
+    }
+    memcpy(obs->token, coap_msg_get_token(msg), coap_msg_get_token_len(msg));
+    obs->token_len = coap_msg_get_token_len(msg);
+    coap_log_info("Registered observer of URI path '%s' at address %s and port %u", uri_path, trans->client_addr, ntohs(trans->client_sin.sin6_port));
+    return obs;
+}
+
+/**
+ *  @brief Deregister an observer of a resource
+ *
+ *  The entry is matched by client address and URI path
+ *  rather than by token so that a deregistration request
+ *  carrying a fresh token is honoured.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] uri_path String representation of a URI path
+ */
+static void coap_server_deregister_obs(coap_server_t *server, coap_server_trans_t *trans, const char *uri_path)
+{
+    coap_server_obs_t *obs = NULL;
+
+    obs = coap_server_find_obs(server, &trans->client_sin, trans->client_sin_len, uri_path);
+    if (obs != NULL)
+    {
+        memset(obs, 0, sizeof(coap_server_obs_t));
+        coap_log_info("Deregistered observer of URI path '%s' at address %s and port %u", uri_path, trans->client_addr, ntohs(trans->client_sin.sin6_port));
+    }
+}
+
+/**
+ *  @brief Remove all observer entries for a client
+ *
+ *  Called when a client rejects a notification with a
+ *  reset message.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to an IPv6 socket structure
+ *  @param[in] client_sin_len Length of the IPv6 socket structure
+ *
+ *  @returns Number of observer entries removed
+ */
+static int coap_server_drop_obs(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len)
+{
+    coap_server_obs_t *obs = NULL;
+    unsigned i = 0;
+    int num = 0;
+
+    for (i = 0; i < server->obs_len; i++)
+    {
+        obs = &server->obs[i];
+        if ((obs->active)
+         && (obs->client_sin_len == client_sin_len)
+         && (memcmp(&obs->client_sin, client_sin, client_sin_len) == 0))
+        {
+            memset(obs, 0, sizeof(coap_server_obs_t));
+            num++;
+        }
+    }
+    return num;
+}
+
+/**
+ *  @brief Generate a request message to pass to a resource handler
+ *
+ *  Used by coap_server_notify to invoke the handler for an
+ *  observed resource outside of a request/response exchange.
+ *
+ *  @param[out] req Pointer to a message structure
+ *  @param[in] str String representation of a URI path
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_gen_obs_req(coap_msg_t *req, const char *str)
+{
+    const char *start = NULL;
+    const char *end = NULL;
+    int ret = 0;
+
+    ret = coap_msg_set_type(req, COAP_MSG_NON);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_code(req, COAP_MSG_REQ, COAP_MSG_GET);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    start = str;
+    while (*start != '\0')
+    {
+        while (*start == '/')
+        {
+            start++;
+        }
+        if (*start == '\0')
+        {
+            break;
+        }
+        end = start;
+        while ((*end != '\0') && (*end != '/'))
+        {
+            end++;
+        }
+        ret = coap_msg_add_op(req, COAP_MSG_URI_PATH, end - start, start);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        start = end;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Generate a notification message for an observer
+ *
+ *  Copy the representation generated by the resource handler
+ *  and set the per-observer message ID, token and observe
+ *  sequence number.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in,out] obs Pointer to an observer structure
+ *  @param[in] resp Pointer to the response message structure
+ *  @param[out] ntf Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_gen_ntf(coap_server_t *server, coap_server_obs_t *obs, coap_msg_t *resp, coap_msg_t *ntf)
+{
+    int ret = 0;
+
+    ret = coap_msg_copy(ntf, resp);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_type(ntf, COAP_MSG_NON);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_msg_id(ntf, coap_server_get_next_msg_id(server));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_token(ntf, obs->token, obs->token_len);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    obs->seq++;
+    return coap_server_add_obs_op(ntf, obs->seq);
+}
+
+int coap_server_notify(coap_server_t *server, const char *str)
+{
+    coap_server_route_t *route = NULL;
+    coap_server_trans_t *trans = NULL;
+    coap_server_obs_t *obs = NULL;
+    coap_msg_t req = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t ntf = {0};
+    unsigned i = 0;
+    ssize_t num = 0;
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    int sent = 0;
+    int ret = 0;
+
+    if ((server == NULL) || (str == NULL))
+    {
+        return -EINVAL;
+    }
+    route = coap_server_find_route(server, str);
+    if (route == NULL)
+    {
+        return -EINVAL;
+    }
+    /* invoke the handler once to generate the current representation */
+    coap_msg_create(&req);
+    ret = coap_server_gen_obs_req(&req, str);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&req);
+        return ret;
+    }
+    coap_msg_create(&resp);
+    ret = (*route->handle)(server, &req, &resp);
+    coap_msg_destroy(&req);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&resp);
+        return ret;
+    }
+    /* fan the notifications out in a single batch */
+    server->batching = 1;
+    for (i = 0; i < server->obs_len; i++)
+    {
+        obs = &server->obs[i];
+        if ((!obs->active)
+         || (strcmp(obs->uri_path, str) != 0))
+        {
+            continue;
+        }
+        trans = coap_server_find_trans(server, &obs->client_sin, obs->client_sin_len);
+#ifdef COAP_DTLS_EN
+        if ((trans == NULL) || (trans->handshaking))
+        {
+            /* the DTLS session is gone, the notification cannot be delivered */
+            coap_log_info("Removing observer of URI path '%s'", obs->uri_path);
+            memset(obs, 0, sizeof(coap_server_obs_t));
+            continue;
+        }
+#endif
+        coap_msg_create(&ntf);
+        ret = coap_server_gen_ntf(server, obs, &resp, &ntf);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&ntf);
+            server->batching = 0;
+            coap_msg_destroy(&resp);
+            return ret;
+        }
+        if (trans != NULL)
+        {
+            num = coap_server_trans_send(trans, &ntf);
+        }
+        else
+        {
+            num = coap_msg_format(&ntf, buf, sizeof(buf));
+            if (num >= 0)
+            {
+                num = coap_server_queue_send(server, &obs->client_sin, obs->client_sin_len, buf, num);
+            }
+        }
+        coap_msg_destroy(&ntf);
+        if (num < 0)
+        {
+            server->batching = 0;
+            coap_msg_destroy(&resp);
+            return num;
+        }
+        sent++;
+    }
+    server->batching = 0;
+    coap_msg_destroy(&resp);
+    ret = coap_server_flush_send_queue(server);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if (sent > 0)
+    {
+        coap_log_info("Notified %d observer(s) of URI path '%s'", sent, str);
+    }
+    return sent;
+}
+
+/**
+ *  @brief Parse a block1 or block2 option in a message
+ *
+ *  @param[in] msg Pointer to a message structure
+ *  @param[in] op_num Option number
+ *  @param[out] num Pointer to an unsigned to contain the block number
+ *  @param[out] more Pointer to an unsigned to contain the more flag
+ *  @param[out] size Pointer to an unsigned to contain the block size in bytes
+ *
+ *  @returns Operation status
+ *  @retval 1 Option not present
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_get_block_val(coap_msg_t *msg, unsigned op_num, unsigned *num, unsigned *more, unsigned *size)
+{
+    coap_msg_op_t *op = NULL;
+
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) == op_num)
+        {
+            return coap_msg_op_parse_block_val(num, more, size, coap_msg_op_get_val(op), coap_msg_op_get_len(op));
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    return 1;
+}
+
+/**
+ *  @brief Prepare a blockwise error response
+ *
+ *  @param[out] resp Pointer to the response message structure
+ *  @param[in] code_detail Client error code detail
+ *  @param[in] str String containing the diagnostic payload
+ *
+ *  @returns Operation status
+ *  @retval 1 Response prepared, the handler should not be invoked
+ *  @retval <0 Error
+ */
+static int coap_server_trans_block_error(coap_msg_t *resp, unsigned code_detail, const char *str)
+{
+    int ret = 0;
+
+    ret = coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, code_detail);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_payload(resp, (char *)str, strlen(str));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return 1;
+}
+
+/**
+ *  @brief Grow the blockwise body buffer in a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] len Required length of the body buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_grow_body(coap_server_trans_t *trans, size_t len)
+{
+    size_t new_alloc = 0;
+    char *new_body = NULL;
+
+    if (len <= trans->body_alloc)
+    {
+        return 0;
+    }
+    new_alloc = trans->body_alloc == 0 ? COAP_MSG_MAX_BUF_LEN : trans->body_alloc;
+    while (new_alloc < len)
+    {
+        new_alloc *= 2;
+    }
+    if (new_alloc > COAP_SERVER_MAX_BODY_LEN)
+    {
+        new_alloc = COAP_SERVER_MAX_BODY_LEN;
+    }
+    new_body = (char *)coap_mem_realloc(&trans->server->mem, trans->body, new_alloc);
+    if (new_body == NULL)
+    {
+        return -ENOMEM;
+    }
+    trans->body = new_body;
+    trans->body_alloc = new_alloc;
+    return 0;
+}
+
+/**
+ *  @brief Handle a block1 option in a request message (RFC 7959)
+ *
+ *  Assemble the body of a blockwise request into the body
+ *  buffer in the transaction structure. For an intermediate
+ *  block a continue response is prepared; for an invalid or
+ *  out-of-sequence block an error response is prepared. When
+ *  the final block arrives the assembled body replaces the
+ *  payload of the request message so that the handler is
+ *  invoked once with the complete body.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in,out] req Pointer to the request message structure
+ *  @param[out] resp Pointer to the response message structure
+ *
+ *  @returns Operation status
+ *  @retval 1 Response prepared, the handler should not be invoked
+ *  @retval 0 No block1 option or body complete
+ *  @retval <0 Error
+ */
+static int coap_server_trans_handle_block1(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    size_t offset = 0;
+    unsigned more = 0;
+    unsigned size = 0;
+    unsigned num = 0;
+    ssize_t val_len = 0;
+    char val[3] = {0};
+    int ret = 0;
+
+    ret = coap_server_get_block_val(req, COAP_MSG_BLOCK1, &num, &more, &size);
+    if (ret == 1)
+    {
+        return 0;
+    }
+    if ((ret < 0) || (size > COAP_SERVER_BLOCK1_SIZE))
+    {
+        return coap_server_trans_block_error(resp, COAP_MSG_BAD_REQ, "Invalid block1 option");
+    }
+    if (num == 0)
+    {
+        /* first block, restart the assembly */
+        trans->body_len = 0;
+        trans->body_resp = 0;
+    }
+    offset = (size_t)num * size;
+    if (offset != trans->body_len)
+    {
+        trans->body_len = 0;
+        return coap_server_trans_block_error(resp, COAP_MSG_REQ_ENT_INCOMPLETE, "Request entity incomplete");
+    }
+    if (offset + coap_msg_get_payload_len(req) > COAP_SERVER_MAX_BODY_LEN)
+    {
+        trans->body_len = 0;
+        return coap_server_trans_block_error(resp, COAP_MSG_REQ_ENT_TOO_LARGE, "Request entity too large");
+    }
+    ret = coap_server_trans_grow_body(trans, offset + coap_msg_get_payload_len(req));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    memcpy(trans->body + offset, coap_msg_get_payload(req), coap_msg_get_payload_len(req));
+    trans->body_len = offset + coap_msg_get_payload_len(req);
+    /* echo the block1 option in the response */
+    val_len = coap_msg_op_format_block_val(val, sizeof(val), num, more, size);
+    if (val_len < 0)
+    {
+        return val_len;
+    }
+    ret = coap_msg_add_op(resp, COAP_MSG_BLOCK1, val_len, val);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if (more)
+    {
+        /* ask for the next block */
+        coap_log_debug("Received block %u of blockwise request from address %s and port %u", num, trans->client_addr, ntohs(trans->client_sin.sin6_port));
+        ret = coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CONTINUE);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        return 1;
+    }
+    /* final block, present the complete body to the handler */
+    coap_log_info("Assembled %zu byte blockwise request from address %s and port %u", trans->body_len, trans->client_addr, ntohs(trans->client_sin.sin6_port));
+    ret = coap_msg_set_payload(req, trans->body, trans->body_len);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    trans->body_len = 0;
+    return 0;
+}
+
+/**
+ *  @brief Serve a block of a cached blockwise response (RFC 7959)
+ *
+ *  When a request asks for a subsequent block of a response
+ *  that has already been generated and cached in the
+ *  transaction structure, the block is served from the cache
+ *  without invoking the handler again.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message structure
+ *  @param[out] resp Pointer to the response message structure
+ *  @param[in] uri_path String representation of the URI path of the request
+ *
+ *  @returns Operation status
+ *  @retval 1 Response prepared, the handler should not be invoked
+ *  @retval 0 No cached body for this request
+ *  @retval <0 Error
+ */
+static int coap_server_trans_serve_block2(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp, const char *uri_path)
+{
+    size_t offset = 0;
+    size_t chunk = 0;
+    unsigned more = 0;
+    unsigned size = 0;
+    unsigned num = 0;
+    ssize_t val_len = 0;
+    char val[3] = {0};
+    int ret = 0;
+
+    ret = coap_server_get_block_val(req, COAP_MSG_BLOCK2, &num, &more, &size);
+    if (ret == 1)
+    {
+        return 0;
+    }
+    if ((ret < 0) || (size > COAP_SERVER_BLOCK2_SIZE))
+    {
+        return coap_server_trans_block_error(resp, COAP_MSG_BAD_REQ, "Invalid block2 option");
+    }
+    if ((num == 0)
+     || (!trans->body_resp)
+     || (strcmp(trans->body_uri_path, uri_path) != 0))
+    {
+        /* the first block is generated by the handler */
+        return 0;
+    }
+    offset = (size_t)num * size;
+    if (offset >= trans->body_len)
+    {
+        return coap_server_trans_block_error(resp, COAP_MSG_BAD_REQ, "Invalid block number");
+    }
+    chunk = trans->body_len - offset;
+    more = chunk > size;
+    if (chunk > size)
+    {
+        chunk = size;
+    }
+    ret = coap_msg_set_code(resp, trans->body_code_class, trans->body_code_detail);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_payload(resp, trans->body + offset, chunk);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    val_len = coap_msg_op_format_block_val(val, sizeof(val), num, more, size);
+    if (val_len < 0)
+    {
+        return val_len;
+    }
+    ret = coap_msg_add_op(resp, COAP_MSG_BLOCK2, val_len, val);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    coap_log_debug("Served block %u of blockwise response to address %s and port %u", num, trans->client_addr, ntohs(trans->client_sin.sin6_port));
+    return 1;
+}
+
+/**
+ *  @brief Slice a response into blocks if necessary (RFC 7959)
+ *
+ *  Invoked after the handler has generated a response. If
+ *  the request contained a block2 option or the response
+ *  payload is larger than the maximum block size, cache the
+ *  body in the transaction structure and replace the payload
+ *  with the first requested block. Subsequent blocks are
+ *  served from the cache.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message structure
+ *  @param[in,out] resp Pointer to the response message structure
+ *  @param[in] uri_path String representation of the URI path of the request
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_slice_block2(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp, const char *uri_path)
+{
+    size_t chunk = 0;
+    unsigned more = 0;
+    unsigned size = 0;
+    unsigned num = 0;
+    ssize_t val_len = 0;
+    char size2[4] = {0};
+    char val[3] = {0};
+    int found = 0;
+    int ret = 0;
+    int i = 0;
+
+    ret = coap_server_get_block_val(req, COAP_MSG_BLOCK2, &num, &more, &size);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    found = (ret == 0);
+    if ((!found) || (size > COAP_SERVER_BLOCK2_SIZE))
+    {
+        size = COAP_SERVER_BLOCK2_SIZE;
+        num = 0;
+    }
+    if ((!found) && (coap_msg_get_payload_len(resp) <= size))
+    {
+        /* the response fits in a single message */
+        return 0;
+    }
+    /* cache the body in the transaction structure */
+    ret = coap_server_trans_grow_body(trans, coap_msg_get_payload_len(resp));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    memcpy(trans->body, coap_msg_get_payload(resp), coap_msg_get_payload_len(resp));
+    trans->body_len = coap_msg_get_payload_len(resp);
+    trans->body_resp = 1;
+    trans->body_code_class = coap_msg_get_code_class(resp);
+    trans->body_code_detail = coap_msg_get_code_detail(resp);
+    memset(trans->body_uri_path, 0, sizeof(trans->body_uri_path));
+    strncpy(trans->body_uri_path, uri_path, sizeof(trans->body_uri_path) - 1);
+    /* replace the payload with the requested block */
+    if ((size_t)num * size > trans->body_len)
+    {
+        return coap_server_trans_block_error(resp, COAP_MSG_BAD_REQ, "Invalid block number");
+    }
+    chunk = trans->body_len - (size_t)num * size;
+    more = chunk > size;
+    if (chunk > size)
+    {
+        chunk = size;
+    }
+    ret = coap_msg_set_payload(resp, trans->body + (size_t)num * size, chunk);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    val_len = coap_msg_op_format_block_val(val, sizeof(val), num, more, size);
+    if (val_len < 0)
+    {
+        return val_len;
+    }
+    ret = coap_msg_add_op(resp, COAP_MSG_BLOCK2, val_len, val);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    /* indicate the total size of the body */
+    val_len = 0;
+    while ((trans->body_len >> (8 * val_len)) != 0)
+    {
+        val_len++;
+    }
+    for (i = 0; i < val_len; i++)
+    {
+        size2[i] = (trans->body_len >> (8 * (val_len - i - 1))) & 0xff;
+    }
+    ret = coap_msg_add_op(resp, COAP_MSG_SIZE2, val_len, size2);
+    if (ret < 0)
+    {
+        return ret;
     }
-    if (p == buf)
+    coap_log_info("Serving %zu byte response to address %s and port %u blockwise", trans->body_len, trans->client_addr, ntohs(trans->client_sin.sin6_port));
+    return 0;
+}
+
+/**
+ *  @brief Record the latency of a serviced request
+ *
+ *  Add the time elapsed since the given start time to the
+ *  request latency histogram. Bucket i counts requests that
+ *  were serviced in [2^i, 2^(i+1)) microseconds; the last
+ *  bucket also counts everything beyond its lower bound.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] start Pointer to the time that processing of the request started
+ */
+static void coap_server_stats_record_lat(coap_server_t *server, struct timespec *start)
+{
+    struct timespec end = {0};
+    unsigned long long usec = 0;
+    unsigned bucket = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    usec = (unsigned long long)(end.tv_sec - start->tv_sec) * 1000000
+         + (end.tv_nsec - start->tv_nsec) / 1000;
+    while (((usec >> (bucket + 1)) != 0)
+        && (bucket < COAP_SERVER_NUM_LAT_BUCKETS - 1))
     {
-        buf[0] = '/';
+        bucket++;
     }
-    match = coap_server_path_list_match(&server->sep_list, buf);
-    return match ? COAP_SERVER_SEPARATE : COAP_SERVER_PIGGYBACKED;
+    server->stats.lat_hist[bucket]++;
+    server->stats.num_reqs++;
 }
 
 /**
- *  @brief Receive a request from the client and send the response
+ *  @brief Process a received datagram and send the response
  *
- *  @param[in,out] server Pointer to a client structure
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to an IPv6 socket structure
+ *  @param[in] client_sin_len Length of the IPv6 socket structure
+ *  @param[in] buf Pointer to a buffer containing the datagram
+ *  @param[in] len Length of the datagram
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_exchange(coap_server_t *server)
+static int coap_server_exchange(coap_server_t *server, struct sockaddr_in6 *client_sin, socklen_t client_sin_len, const char *buf, size_t len)
 {
-    struct sockaddr_in6 client_sin = {0};
+    coap_server_route_t *route = NULL;
     coap_server_trans_t *trans = NULL;
+    coap_server_dedup_t *dedup = NULL;
+    coap_server_obs_t *obs = NULL;
     coap_msg_t recv_msg = {0};
     coap_msg_t send_msg = {0};
-    socklen_t client_sin_len = 0;
+    struct timespec start = {0};
+    unsigned obs_val = 0;
     unsigned op_num = 0;
     unsigned msg_id = 0;
     ssize_t num = 0;
+    char uri_path[COAP_MSG_OP_URI_PATH_MAX_LEN] = {0};
+#ifdef COAP_DTLS_EN
+    int batching = 0;
+#endif
     int resp_type = 0;
+    int obs_reg = 0;
     int ret = 0;
 
-    /* accept incoming connection */
-    ret = coap_server_accept(server, &client_sin, &client_sin_len);
-    if (ret < 0)
-    {
-        return ret;
-    }
-
     /* find or create transaction */
-    trans = coap_server_find_trans(server, &client_sin, client_sin_len);
+    trans = coap_server_find_trans(server, client_sin, client_sin_len);
     if (trans == NULL)
     {
-        trans = coap_server_find_empty_trans(server);
-        if (trans == NULL)
+        if (server->num_trans >= server->max_trans)
         {
             trans = coap_server_find_oldest_trans(server);
-            coap_server_trans_destroy(trans);
+            if (trans != NULL)
+            {
+                coap_server_trans_destroy(trans);
+            }
+        }
+        trans = (coap_server_trans_t *)coap_mem_alloc(&server->mem, sizeof(coap_server_trans_t));
+        if (trans == NULL)
+        {
+            return -ENOMEM;
         }
-        ret = coap_server_trans_create(trans, server, &client_sin, client_sin_len);
+        ret = coap_server_trans_create(trans, server, client_sin, client_sin_len, buf, len);
         if (ret < 0)
         {
+            coap_mem_free(trans);
             return ret;
         }
+        coap_server_trans_link(server, trans);
 #ifdef COAP_DTLS_EN
         /* if DTLS is enabled then coap_server_trans_create has consumed */
-        /* the received data as part of the handshake, we need to wait for */
-        /* more data to arrive and identify the sender */
+        /* the received data as the start of the handshake, the event loop */
+        /* will advance the handshake as further messages arrive */
         return 0;
 #endif
     }
+    else
+    {
+        coap_server_trans_deposit(trans, buf, len);
+#ifdef COAP_DTLS_EN
+        if (trans->handshaking)
+        {
+            /* handshake flights must be sent immediately, not queued for a batched send */
+            batching = server->batching;
+            server->batching = 0;
+            ret = coap_server_trans_dtls_handshake_step(trans);
+            server->batching = batching;
+            if (ret < 0)
+            {
+                coap_log_warn("Failed to complete DTLS handshake");
+                coap_server_trans_destroy(trans);
+                return ret;
+            }
+            if (trans->handshaking)
+            {
+                /* wait for more handshake messages to arrive */
+                return 0;
+            }
+        }
+#endif
+    }
 
     /* receive message */
     coap_msg_create(&recv_msg);
+    coap_msg_set_mem_acct(&recv_msg, &server->mem);
     num = coap_server_trans_recv(trans, &recv_msg);
+    if (num == -EAGAIN)
+    {
+        /* no application data is ready for this transaction yet */
+        coap_msg_destroy(&recv_msg);
+        return 0;
+    }
     if (num < 0)
     {
         coap_msg_destroy(&recv_msg);
@@ -1829,6 +3655,7 @@ static int coap_server_exchange(coap_server_t *server)
             /* acknowledge the (confirmable) request again */
             /* do not send the response again */
             coap_log_info("Received duplicate confirmable request from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+            server->stats.dedup_hits++;
             ret = coap_server_trans_send_ack(trans, &recv_msg);
             coap_msg_destroy(&recv_msg);
             if (ret < 0)
@@ -1844,6 +3671,7 @@ static int coap_server_exchange(coap_server_t *server)
             /* do not acknowledge the (non-confirmable) request again */
             /* do not send the response again */
             coap_log_info("Received duplicate non-confirmable request from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+            server->stats.dedup_hits++;
             coap_msg_destroy(&recv_msg);
             return 0;
         }
@@ -1882,9 +3710,50 @@ static int coap_server_exchange(coap_server_t *server)
         }
     }
 
+    /* check for a retransmitted request whose transaction has been recycled */
+    if (((coap_msg_get_type(&recv_msg) == COAP_MSG_CON)
+      || (coap_msg_get_type(&recv_msg) == COAP_MSG_NON))
+     && (coap_msg_get_code_class(&recv_msg) == COAP_MSG_REQ))
+    {
+        dedup = coap_server_dedup_find(server, client_sin, client_sin_len, coap_msg_get_msg_id(&recv_msg));
+        if (dedup != NULL)
+        {
+            /* message deduplication */
+            /* replay the stored response without invoking the handler */
+            coap_log_info("Received duplicate request from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+            server->stats.dedup_hits++;
+            num = coap_server_trans_send_buf(trans, dedup->buf, dedup->len);
+            coap_msg_destroy(&recv_msg);
+            if (num < 0)
+            {
+                coap_server_trans_destroy(trans);
+                return num;
+            }
+            return 0;
+        }
+    }
+
+    /* check for a reset rejecting a notification */
+    if ((coap_msg_get_type(&recv_msg) == COAP_MSG_RST)
+     && (coap_server_drop_obs(server, client_sin, client_sin_len) > 0))
+    {
+        coap_log_info("Received reset from address %s and port %u, observer removed", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+        coap_msg_destroy(&recv_msg);
+        return 0;
+    }
+
+    /* a client with concurrent exchanges in flight may acknowledge */
+    /* a response that this transaction is no longer retransmitting; */
+    /* RFC 7252 requires an unexpected acknowledgement to be ignored */
+    if (coap_msg_get_type(&recv_msg) == COAP_MSG_ACK)
+    {
+        coap_log_info("Ignoring unexpected acknowledgement from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+        coap_msg_destroy(&recv_msg);
+        return 0;
+    }
+
     /* check for a valid request */
-    if ((coap_msg_get_type(&recv_msg) == COAP_MSG_ACK)
-     || (coap_msg_get_type(&recv_msg) == COAP_MSG_RST)
+    if ((coap_msg_get_type(&recv_msg) == COAP_MSG_RST)
      || (coap_msg_get_code_class(&recv_msg) != COAP_MSG_REQ))
     {
         coap_server_trans_reject(trans, &recv_msg);
@@ -1913,13 +3782,42 @@ static int coap_server_exchange(coap_server_t *server)
     }
 
     /* clear details of the previous request/response */
+    /* a new exchange reuses the response buffer so any outstanding */
+    /* retransmission of the previous response must be abandoned */
+    coap_server_trans_stop_ack_timer(trans);
     coap_server_trans_clear_req(trans);
     coap_server_trans_clear_resp(trans);
 
+    /* resolve the route for the request */
+    coap_server_get_uri_path(&recv_msg, uri_path, sizeof(uri_path));
+    route = coap_server_find_route(server, uri_path);
+
+    /* check for an observe registration or deregistration */
+    if ((coap_msg_get_code_detail(&recv_msg) == COAP_MSG_GET)
+     && (coap_server_get_obs_val(&recv_msg, &obs_val) == 0))
+    {
+        if ((obs_val == 0) && (route != NULL))
+        {
+            /* register the observer after the handler has generated a response */
+            obs_reg = 1;
+        }
+        else if (obs_val == 1)
+        {
+            coap_server_deregister_obs(server, trans, uri_path);
+        }
+    }
+
     /* determine response type */
     if (coap_msg_get_type(&recv_msg) == COAP_MSG_CON)
     {
-        resp_type = coap_server_get_resp_type(server, &recv_msg);
+        if (route != NULL)
+        {
+            resp_type = route->resp_type;
+        }
+        else
+        {
+            resp_type = coap_server_get_resp_type(server, uri_path);
+        }
         if (resp_type == COAP_SERVER_SEPARATE)
         {
             coap_log_info("Request URI path requires a separate response to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
@@ -1945,8 +3843,14 @@ static int coap_server_exchange(coap_server_t *server)
 
     /* generate response */
     coap_log_info("Responding to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.sin6_port));
+    clock_gettime(CLOCK_MONOTONIC, &start);
     coap_msg_create(&send_msg);
-    ret = (*server->handle)(server, &recv_msg, &send_msg);
+    /* handle blockwise transfer options */
+    ret = coap_server_trans_serve_block2(trans, &recv_msg, &send_msg, uri_path);
+    if (ret == 0)
+    {
+        ret = coap_server_trans_handle_block1(trans, &recv_msg, &send_msg);
+    }
     if (ret < 0)
     {
         coap_msg_destroy(&send_msg);
@@ -1954,6 +3858,33 @@ static int coap_server_exchange(coap_server_t *server)
         coap_msg_destroy(&recv_msg);
         return ret;
     }
+    if (ret == 0)
+    {
+        if (route != NULL)
+        {
+            ret = (*route->handle)(server, &recv_msg, &send_msg);
+        }
+        else
+        {
+            ret = (*server->handle)(server, &recv_msg, &send_msg);
+        }
+        if (ret < 0)
+        {
+            coap_msg_destroy(&send_msg);
+            coap_server_trans_destroy(trans);
+            coap_msg_destroy(&recv_msg);
+            return ret;
+        }
+        /* slice the response into blocks if necessary */
+        ret = coap_server_trans_slice_block2(trans, &recv_msg, &send_msg, uri_path);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&send_msg);
+            coap_server_trans_destroy(trans);
+            coap_msg_destroy(&recv_msg);
+            return ret;
+        }
+    }
     if ((coap_msg_get_type(&recv_msg) == COAP_MSG_CON)
      && (resp_type == COAP_SERVER_PIGGYBACKED))
     {
@@ -1982,6 +3913,22 @@ static int coap_server_exchange(coap_server_t *server)
         coap_msg_destroy(&recv_msg);
         return ret;
     }
+    /* register the observer and add an observe option to the response */
+    if (obs_reg && (coap_msg_get_code_class(&send_msg) == COAP_MSG_SUCCESS))
+    {
+        obs = coap_server_register_obs(server, trans, &recv_msg, uri_path);
+        if (obs != NULL)
+        {
+            ret = coap_server_add_obs_op(&send_msg, obs->seq);
+            if (ret < 0)
+            {
+                coap_msg_destroy(&send_msg);
+                coap_server_trans_destroy(trans);
+                coap_msg_destroy(&recv_msg);
+                return ret;
+            }
+        }
+    }
     /* set the response type */
     /* we have already verified that the received message */
     /* is either a confirmable or a non-confirmable request */
@@ -2014,6 +3961,12 @@ static int coap_server_exchange(coap_server_t *server)
         return num;
     }
 
+    /* record the request latency */
+    coap_server_stats_record_lat(server, &start);
+
+    /* record the response in the deduplication ring buffer */
+    coap_server_dedup_store(server, trans, coap_msg_get_msg_id(&recv_msg), &send_msg);
+
     /* record the request in the transaction structure */
     ret = coap_server_trans_set_req(trans, &recv_msg);
     if (ret < 0)
@@ -2053,10 +4006,79 @@ static int coap_server_exchange(coap_server_t *server)
     return 0;
 }
 
+/**
+ *  @brief Receive and process a batch of datagrams
+ *
+ *  Drain the socket with a single recvmmsg call, process each
+ *  datagram in turn and flush the queued responses with a single
+ *  sendmmsg call, amortizing the syscall cost over the batch.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_exchange_batch(coap_server_t *server)
+{
+    struct sockaddr_in6 client_sin[COAP_SERVER_BATCH_SIZE] = {{0}};
+    struct mmsghdr msgvec[COAP_SERVER_BATCH_SIZE] = {{{0}}};
+    struct iovec iov[COAP_SERVER_BATCH_SIZE] = {{0}};
+    int err = 0;
+    int num = 0;
+    int ret = 0;
+    int i = 0;
+    char buf[COAP_SERVER_BATCH_SIZE][COAP_MSG_MAX_BUF_LEN];
+
+    for (i = 0; i < COAP_SERVER_BATCH_SIZE; i++)
+    {
+        iov[i].iov_base = buf[i];
+        iov[i].iov_len = sizeof(buf[i]);
+        msgvec[i].msg_hdr.msg_name = &client_sin[i];
+        msgvec[i].msg_hdr.msg_namelen = sizeof(client_sin[i]);
+        msgvec[i].msg_hdr.msg_iov = &iov[i];
+        msgvec[i].msg_hdr.msg_iovlen = 1;
+    }
+    num = recvmmsg(server->sd, msgvec, COAP_SERVER_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (num < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        return -errno;
+    }
+    server->stats.rx_dgrams += num;
+    server->batching = 1;
+    for (i = 0; i < num; i++)
+    {
+        ret = coap_server_exchange(server, &client_sin[i], msgvec[i].msg_hdr.msg_namelen, buf[i], msgvec[i].msg_len);
+        if (ret < 0)
+        {
+            if ((ret == -ETIMEDOUT) || (ret == -ECONNRESET))
+            {
+                coap_log_notice("%s", strerror(-ret));
+            }
+            else
+            {
+                err = ret;
+                break;
+            }
+        }
+    }
+    server->batching = 0;
+    ret = coap_server_flush_send_queue(server);
+    if (err < 0)
+    {
+        return err;
+    }
+    return ret;
+}
+
 int coap_server_run(coap_server_t *server)
 {
     int ret = 0;
- 
+
     while (1)
     {
         ret = coap_server_listen(server);
@@ -2065,19 +4087,151 @@ int coap_server_run(coap_server_t *server)
             coap_log_error("server listen: %s", strerror(-ret));
             return ret;
         }
-        ret = coap_server_exchange(server);
+        ret = coap_server_exchange_batch(server);
         if (ret < 0)
         {
-            if ((ret == -ETIMEDOUT) || (ret == -ECONNRESET))
-            {
-                coap_log_notice("%s", strerror(-ret));
-            }
-            else
+            coap_log_error("%s", strerror(-ret));
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  @brief Initialise a worker server structure from an existing server structure
+ *
+ *  The worker opens its own socket bound to the same address
+ *  and port with SO_REUSEPORT and owns its own transaction
+ *  table, message ID space and separate-response URI path
+ *  list. With DTLS enabled the worker shares the credentials
+ *  of the source server.
+ *
+ *  @param[out] dst Pointer to a worker server structure
+ *  @param[in] src Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_clone(coap_server_t *dst, coap_server_t *src)
+{
+    coap_server_route_t *route = NULL;
+    coap_server_path_t *path = NULL;
+    unsigned i = 0;
+    int ret = 0;
+
+    ret = coap_server_init(dst, src->handle, src->host, src->port);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    for (path = src->sep_list.first; path != NULL; path = path->next)
+    {
+        ret = coap_server_path_list_add(&dst->sep_list, &dst->mem, path->str);
+        if (ret < 0)
+        {
+            coap_server_destroy(dst);
+            return ret;
+        }
+    }
+    for (i = 0; i < COAP_SERVER_NUM_ROUTE_BUCKETS; i++)
+    {
+        for (route = src->routes[i]; route != NULL; route = route->next)
+        {
+            ret = coap_server_add_resource(dst, route->str, route->handle, route->resp_type);
+            if (ret < 0)
             {
-                coap_log_error("%s", strerror(-ret));
+                coap_server_destroy(dst);
                 return ret;
             }
         }
     }
+    ret = coap_server_set_max_trans(dst, src->max_trans);
+    if (ret < 0)
+    {
+        coap_server_destroy(dst);
+        return ret;
+    }
+#ifdef COAP_DTLS_EN
+    dst->cred = src->cred;
+    dst->priority = src->priority;
+    dst->dh_params = src->dh_params;
+    dst->ticket_key = src->ticket_key;
+    dst->shared_cred = 1;
+    /* each worker owns its own session cache, session tickets */
+    /* allow resumption across workers via the shared ticket key */
+    ret = coap_server_set_sess_cache_len(dst, src->sess_cache_len);
+    if (ret < 0)
+    {
+        coap_server_destroy(dst);
+        return ret;
+    }
+#endif
     return 0;
 }
+
+/**
+ *  @brief Entry point for a worker thread
+ *
+ *  @param[in,out] data Pointer to a worker server structure
+ *
+ *  @returns Always NULL
+ */
+static void *coap_server_worker_func(void *data)
+{
+    coap_server_run((coap_server_t *)data);
+    return NULL;
+}
+
+int coap_server_run_workers(coap_server_t *server, unsigned num_workers)
+{
+    coap_server_t *workers = NULL;
+    pthread_t *threads = NULL;
+    unsigned num_created = 0;
+    unsigned i = 0;
+    int ret = 0;
+
+    if (num_workers <= 1)
+    {
+        return coap_server_run(server);
+    }
+    workers = (coap_server_t *)malloc((num_workers - 1) * sizeof(coap_server_t));
+    threads = (pthread_t *)malloc((num_workers - 1) * sizeof(pthread_t));
+    if ((workers == NULL) || (threads == NULL))
+    {
+        free(threads);
+        free(workers);
+        return -ENOMEM;
+    }
+    for (i = 0; i < num_workers - 1; i++)
+    {
+        ret = coap_server_clone(&workers[i], server);
+        if (ret < 0)
+        {
+            break;
+        }
+        ret = pthread_create(&threads[i], NULL, coap_server_worker_func, &workers[i]);
+        if (ret != 0)
+        {
+            coap_server_destroy(&workers[i]);
+            ret = -ret;
+            break;
+        }
+        num_created++;
+    }
+    if (num_created == num_workers - 1)
+    {
+        coap_log_notice("Running %u workers", num_workers);
+        /* the calling thread runs one of the workers */
+        ret = coap_server_run(server);
+    }
+    for (i = 0; i < num_created; i++)
+    {
+        pthread_cancel(threads[i]);
+        pthread_join(threads[i], NULL);
+        coap_server_destroy(&workers[i]);
+    }
+    free(threads);
+    free(workers);
+    return ret;
+}
@@ -34,6 +34,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#define CONFIG_NUM_BUCKETS  16                                                  /**< Number of hash buckets, must be a power of 2 */
+
 #define config_get_first_entry(config)  ((config)->first)
 #define config_get_last_entry(config)   ((config)->last)
 
@@ -56,16 +58,21 @@ typedef struct config_entry_t
 {
     char *name;
     char *value;
+    unsigned hash;
     struct config_entry_t *next;
+    struct config_entry_t *bucket_next;
 }
 config_entry_t;
 
 typedef struct config_section_t
 {
     char *name;
+    unsigned hash;
     config_entry_t *first;
     config_entry_t *last;
+    config_entry_t *bucket[CONFIG_NUM_BUCKETS];
     struct config_section_t *next;
+    struct config_section_t *bucket_next;
 }
 config_section_t;
 
@@ -73,6 +80,7 @@ typedef struct
 {
     config_section_t *first;
     config_section_t *last;
+    config_section_t *bucket[CONFIG_NUM_BUCKETS];
 }
 config_t;
 
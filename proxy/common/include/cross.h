@@ -88,6 +88,24 @@ int cross_uri_coap_to_http(char *buf, size_t len, coap_msg_t *coap_msg);
  */
 int cross_req_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned *code);
 
+/**
+ *  @brief Convert a HTTP request message to a CoAP request message without copying the body
+ *
+ *  The payload of the CoAP message references the body of
+ *  the HTTP message instead of copying it. The HTTP message
+ *  must remain intact until the CoAP message is destroyed
+ *  or reset.
+ *
+ *  @param[out] coap_msg Pointer to a CoAP message structure
+ *  @param[in] http_msg Pointer to a HTTP message structure
+ *  @param[out] code HTTP response code
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int cross_req_http_to_coap_nocopy(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned *code);
+
 /**
  *  @brief Convert a CoAP response message to a HTTP response message
  *
@@ -101,4 +119,23 @@ int cross_req_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned
  */
 int cross_resp_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned *code);
 
+/**
+ *  @brief Convert a CoAP response message to a HTTP response message without copying the body
+ *
+ *  Ownership of the payload of the CoAP message is
+ *  transferred to the HTTP message instead of copying it,
+ *  so the CoAP message may be destroyed before the HTTP
+ *  message is sent. The payload is copied if the CoAP
+ *  message does not own it.
+ *
+ *  @param[out] http_msg Pointer to a HTTP message structure
+ *  @param[in,out] coap_msg Pointer to a CoAP message structure
+ *  @param[out] code HTTP response code
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int cross_resp_coap_to_http_nocopy(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned *code);
+
 #endif
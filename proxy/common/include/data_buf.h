@@ -34,13 +34,18 @@
 #ifndef DATA_BUF_H
 #define DATA_BUF_H
 
-/*   0                      count     size
- *   |                        |         |
- *   +------------------------+---------+
- *   |XXXXXXXXXXXXXXXXXXXXXXXX|         |
- *   +------------------------+---------+
- *   |<         used         >|< space >|
- *  data                    next
+/*   0        start        start+count     size
+ *   |          |                |           |
+ *   +----------+----------------+-----------+
+ *   |          |XXXXXXXXXXXXXXXX|           |
+ *   +----------+----------------+-----------+
+ *   |<consumed>|<     used     >|<  space  >|
+ *  data                       next
+ *
+ * consuming bytes advances start instead of moving the remaining
+ * contents to the front of the buffer; the consumed region is
+ * reclaimed in one move when the buffer drains or start passes
+ * the half-way point
  */
 
 #define DATA_BUF_INIT_SIZE       1024
@@ -49,12 +54,13 @@
 #define data_buf_get_count(buf)     ((buf)->count)
 #define data_buf_get_size(buf)      ((buf)->size)
 #define data_buf_get_max_size(buf)  ((buf)->max_size)
-#define data_buf_get_data(buf)      ((buf)->data)
-#define data_buf_get_space(buf)     (((buf)->size) - ((buf)->count))  /* number of free byte positions beginning at count */
-#define data_buf_get_next(buf)      ((buf)->data + (buf)->count)
+#define data_buf_get_data(buf)      ((buf)->data + (buf)->start)
+#define data_buf_get_space(buf)     (((buf)->size) - ((buf)->start) - ((buf)->count))  /* number of free byte positions beginning at start + count */
+#define data_buf_get_next(buf)      ((buf)->data + (buf)->start + (buf)->count)
 
 typedef struct
 {
+    size_t start;     /* offset of the first stored byte in the buffer */
     size_t count;     /* number of bytes stored in the buffer */
     size_t size;      /* current size of buffer */
     size_t max_size;  /* max allowed size of buffer */
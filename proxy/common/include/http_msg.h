@@ -37,7 +37,8 @@
 #include <stddef.h>
 #include <sys/types.h>
 
-#define HTTP_MSG_NUM_START  3                                                   /**< Number of fields in the start line */
+#define HTTP_MSG_NUM_START    3                                                 /**< Number of fields in the start line */
+#define HTTP_MSG_NUM_BUCKETS  16                                                /**< Number of buckets in the message header hash table, must be a power of 2 */
 
 #define http_msg_header_get_name(header)   ((header)->name)                     /**< Get the name of a message header */
 #define http_msg_header_get_value(header)  ((header)->value)                    /**< Get the value of a message header */
@@ -56,9 +57,13 @@ typedef struct http_msg_header_t
     char *name;                                                                 /**< Name of a message header */
     char *value;                                                                /**< Value of a message header */
     struct http_msg_header_t *next;                                             /**< Next message header */
+    struct http_msg_header_t *bucket_next;                                      /**< Next message header in the same hash bucket */
+    unsigned hash;                                                              /**< Hash of the lower-case message header name */
 }
 http_msg_header_t;
 
+struct http_msg_arena_block;
+
 /**
  *  @brief Message header linked-list structure
  */
@@ -76,6 +81,8 @@ typedef struct
 {
     char *start[HTTP_MSG_NUM_START];                                            /**< Array of start line fields */
     http_msg_list_t header;                                                     /**< Linked-list of message headers */
+    http_msg_header_t *bucket[HTTP_MSG_NUM_BUCKETS];                            /**< Hash table of message headers indexed by name */
+    struct http_msg_arena_block *arena;                                         /**< Chain of arena blocks that back the message headers */
     char *body;                                                                 /**< Message body */
     size_t body_len;                                                            /**< Length of the message body */
 }
@@ -147,6 +154,37 @@ int http_msg_set_start(http_msg_t *msg, const char *start1, const char *start2,
  */
 int http_msg_set_header(http_msg_t *msg, const char *name, const char *value);
 
+/**
+ *  @brief Find a header in a message by name
+ *
+ *  The name comparison is case-insensitive. The name is
+ *  hashed once and compared against the hash precomputed
+ *  for each header so that lookup cost does not depend on
+ *  the number of headers in the message. If the message
+ *  contains duplicate headers with the same name then the
+ *  first one is returned.
+ *
+ *  @param[in] msg Pointer to a message structure
+ *  @param[in] name String containing the header name
+ *
+ *  @returns Pointer to a message header structure or NULL
+ */
+http_msg_header_t *http_msg_get_header(http_msg_t *msg, const char *name);
+
+/**
+ *  @brief Replace the value of an existing message header
+ *
+ *  The new value is allocated from the arena belonging to
+ *  the message that contains the header.
+ *
+ *  @param[in,out] msg Pointer to the message structure that contains the header
+ *  @param[in,out] header Pointer to a message header structure
+ *  @param[in] value String containing the new header value
+ *
+ *  @returns Error code
+ */
+int http_msg_header_set_value(http_msg_t *msg, http_msg_header_t *header, const char *value);
+
 /**
  *  @brief Set the body in a message
  *
@@ -158,6 +196,20 @@ int http_msg_set_header(http_msg_t *msg, const char *name, const char *value);
  */
 int http_msg_set_body(http_msg_t *msg, const char *buf, size_t len);
 
+/**
+ *  @brief Set the body of a message, taking ownership of the buffer
+ *
+ *  The message references the buffer passed by the caller
+ *  instead of copying it. The buffer must have been
+ *  dynamically allocated and is freed when the message
+ *  is destroyed.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the body
+ *  @param[in] len Length of the buffer
+ */
+void http_msg_adopt_body(http_msg_t *msg, char *buf, size_t len);
+
 /**
  *  @brief Write a message to a buffer
  *
@@ -174,6 +226,26 @@ int http_msg_set_body(http_msg_t *msg, const char *buf, size_t len);
  */
 size_t http_msg_generate(http_msg_t *msg, char *buf, size_t len);
 
+/**
+ *  @brief Write the start line and headers of a message to a buffer
+ *
+ *  The body of the message is not written, allowing the
+ *  headers and the body to be transmitted from separate
+ *  buffers in a single scatter-gather operation.
+ *
+ *  Always writes a terminating null character if
+ *  the length of the buffer is greater than zero.
+ *
+ *  @param[in] msg Pointer to a message structure
+ *  @param[out] buf Buffer to hold the start line and headers
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Number of bytes or error code
+ *  @retval >0 Number of bytes that would have been written if the buffer was large enough
+ *  @retval <0 Error code
+ */
+size_t http_msg_generate_headers(http_msg_t *msg, char *buf, size_t len);
+
 /**
  *  @brief Write a message body chunk to a buffer
  *
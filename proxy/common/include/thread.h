@@ -57,6 +57,23 @@ typedef struct
 }
 thread_t;
 
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    thread_ctx_t ctx;
+    thread_t *worker;
+    unsigned num_worker;
+    void **queue;
+    unsigned queue_size;
+    unsigned count;
+    unsigned head;
+    void *(*func)(void *);
+    int stop;
+}
+thread_pool_t;
+
 int thread_joinable_ctx_create(thread_ctx_t *ctx);
 int thread_detached_ctx_create(thread_ctx_t *ctx);
 void thread_ctx_destroy(thread_ctx_t *ctx);
@@ -65,4 +82,8 @@ int thread_init(thread_t *thread, thread_ctx_t *ctx, void *(start_func)(void *),
 int thread_join(thread_t *thread, void **result);
 void thread_block_signals(void);
 
+int thread_pool_create(thread_pool_t *pool, unsigned num_worker, unsigned queue_size, void *(*func)(void *));
+void thread_pool_destroy(thread_pool_t *pool);
+int thread_pool_dispatch(thread_pool_t *pool, void *data);
+
 #endif
@@ -35,6 +35,7 @@
 #define TLS_H
 
 #include <stddef.h>         /* size_t */
+#include <time.h>           /* time_t */
 #include <gnutls/gnutls.h>
 #include "sock.h"           /* error codes */
 #include "lock.h"           /* lock_t */
@@ -46,10 +47,13 @@
 #define TLS_SERVER_MAX_SESSION_ID_SIZE      32
 #define TLS_SERVER_MAX_SESSION_DATA_SIZE  2048
 #define TLS_SERVER_CACHE_SIZE               50
+#define TLS_SERVER_DEF_SESSION_LIFETIME   3600
 #define TLS_SERVER_NUM_DH_BITS            1024
 
-#define tls_client_get_cred(client)  ((client)->cred)
-#define tls_server_get_cred(server)  ((server)->cred)
+#define tls_client_get_cred(client)              ((client)->cred)
+#define tls_server_get_cred(server)              ((server)->cred)
+#define tls_server_get_ticket_key(server)        (&(server)->ticket_key)
+#define tls_server_get_session_lifetime(server)  ((server)->session_lifetime)
 
 typedef struct
 {
@@ -84,6 +88,7 @@ typedef struct
     unsigned char session_data[TLS_SERVER_MAX_SESSION_DATA_SIZE];
     size_t session_id_size;
     size_t session_data_size;
+    time_t expire;  /* absolute expiry time, 0 if the element is unused */
 }
 tls_server_cache_element_t;
 
@@ -99,6 +104,8 @@ typedef struct
 {
     gnutls_certificate_credentials_t cred;
     gnutls_dh_params_t dh_params;
+    gnutls_datum_t ticket_key;
+    unsigned session_lifetime;
     tls_server_cache_t cache;
     lock_t lock;
 }
@@ -113,6 +120,7 @@ void tls_client_destroy(tls_client_t *client);
 int tls_client_set(tls_client_t *client, char *addr, gnutls_datum_t data);
 gnutls_datum_t tls_client_get(tls_client_t *client, char *addr);
 
+void tls_server_set_cache_params(size_t cache_size, unsigned session_lifetime);
 int tls_server_create(tls_server_t *server, const char *trust_file_name, const char *cert_file_name, const char *key_file_name);
 void tls_server_destroy(tls_server_t *server);
 int tls_server_set(void *buf, gnutls_datum_t key, gnutls_datum_t data);
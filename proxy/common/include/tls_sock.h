@@ -36,6 +36,7 @@
 
 #include <string.h>         /* size_t */
 #include <unistd.h>         /* ssize_t */
+#include <sys/uio.h>        /* struct iovec */
 #include <gnutls/gnutls.h>  /* gnutls_session_t */
 #include "sock.h"           /* error codes */
 #include "tls.h"            /* tls_init() */
@@ -93,8 +94,10 @@ ssize_t tls_sock_read(tls_sock_t *s, void *buf, size_t len);
 ssize_t tls_sock_read_full(tls_sock_t *s, void *buf, size_t len);
 ssize_t tls_sock_write(tls_sock_t *s, void *buf, size_t len);
 ssize_t tls_sock_write_full(tls_sock_t *s, void *buf, size_t len);
+ssize_t tls_sock_writev(tls_sock_t *s, const struct iovec *iov, int iovcnt);
 
 int tls_ssock_open(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog);
+int tls_ssock_open_shared(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog);  /* sets SO_REUSEPORT so that several server sockets can share the port */
 void tls_ssock_close(tls_ssock_t *ss);
 int tls_ssock_accept(tls_ssock_t *ss, tls_sock_t *s);
 
@@ -34,6 +34,8 @@
 #ifndef URI_H
 #define URI_H
 
+#include <stddef.h>
+
 #define uri_get_scheme(uri)    ((uri)->scheme)                                  /**< Get the scheme from a URI */
 #define uri_get_userinfo(uri)  ((uri)->userinfo)                                /**< Get the userinfo from a URI */
 #define uri_get_host(uri)      ((uri)->host)                                    /**< Get the host from a URI */
@@ -54,6 +56,49 @@ typedef struct
 }
 uri_t;
 
+#define uri_view_get_scheme(view)        ((view)->scheme)                       /**< Get the scheme view from a URI view */
+#define uri_view_get_scheme_len(view)    ((view)->scheme_len)                   /**< Get the scheme view length from a URI view */
+#define uri_view_get_userinfo(view)      ((view)->userinfo)                     /**< Get the userinfo view from a URI view */
+#define uri_view_get_userinfo_len(view)  ((view)->userinfo_len)                 /**< Get the userinfo view length from a URI view */
+#define uri_view_get_host(view)          ((view)->host)                         /**< Get the host view from a URI view */
+#define uri_view_get_host_len(view)      ((view)->host_len)                     /**< Get the host view length from a URI view */
+#define uri_view_get_port(view)          ((view)->port)                         /**< Get the port view from a URI view */
+#define uri_view_get_port_len(view)      ((view)->port_len)                     /**< Get the port view length from a URI view */
+#define uri_view_get_path(view)          ((view)->path)                         /**< Get the path view from a URI view */
+#define uri_view_get_path_len(view)      ((view)->path_len)                     /**< Get the path view length from a URI view */
+#define uri_view_get_query(view)         ((view)->query)                        /**< Get the query view from a URI view */
+#define uri_view_get_query_len(view)     ((view)->query_len)                    /**< Get the query view length from a URI view */
+#define uri_view_get_fragment(view)      ((view)->fragment)                     /**< Get the fragment view from a URI view */
+#define uri_view_get_fragment_len(view)  ((view)->fragment_len)                 /**< Get the fragment view length from a URI view */
+
+/**
+ *  @brief URI view structure
+ *
+ *  Each component is a pointer into the caller's buffer and
+ *  a length, no memory is allocated and no percent-decoding
+ *  is performed. The caller's buffer must remain valid and
+ *  unmodified for as long as the view is in use. An absent
+ *  component has a NULL pointer and a length of zero.
+ */
+typedef struct
+{
+    const char *scheme;                                                         /**< Scheme */
+    size_t scheme_len;                                                          /**< Length of the scheme */
+    const char *userinfo;                                                       /**< User-Info */
+    size_t userinfo_len;                                                        /**< Length of the user-info */
+    const char *host;                                                           /**< Host */
+    size_t host_len;                                                            /**< Length of the host */
+    const char *port;                                                           /**< Port */
+    size_t port_len;                                                            /**< Length of the port */
+    const char *path;                                                           /**< Path */
+    size_t path_len;                                                            /**< Length of the path */
+    const char *query;                                                          /**< Query */
+    size_t query_len;                                                           /**< Length of the query */
+    const char *fragment;                                                       /**< Fragment */
+    size_t fragment_len;                                                        /**< Length of the fragment */
+}
+uri_view_t;
+
 /**
  *  @brief Initialise a URI structure
  *
@@ -80,6 +125,40 @@ void uri_destroy(uri_t *uri);
  */
 int uri_parse(uri_t *uri, const char *str);
 
+/**
+ *  @brief Parse a URI into a view
+ *
+ *  Single pass over the string with no memory allocation,
+ *  the components of the view point into the string passed
+ *  by the caller. Percent-encoded characters are left as-is,
+ *  use uri_view_materialize to produce a URI structure with
+ *  decoded, owned components.
+ *
+ *  @param[out] view Pointer to a URI view structure
+ *  @param[in] str String representation of the URI
+ *
+ *  @retval Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int uri_parse_view(uri_view_t *view, const char *str);
+
+/**
+ *  @brief Produce a URI structure from a URI view
+ *
+ *  Allocate and percent-decode the components of the view
+ *  so that the result owns its memory and is equivalent to
+ *  the result of calling uri_parse on the original string.
+ *
+ *  @param[in,out] uri Pointer to a URI structure
+ *  @param[in] view Pointer to a URI view structure
+ *
+ *  @retval Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int uri_view_materialize(uri_t *uri, const uri_view_t *view);
+
 /**
  *  @brief Copy a URI
  *
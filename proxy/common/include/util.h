@@ -42,5 +42,9 @@
 size_t util_strncpy(char *dst, const char *src, size_t n);
 size_t util_strncat(char *dst, const char *src, size_t dst_str_len, size_t dst_len);
 long util_load_txt_file(const char *file_name, char **buf);
+long util_load_file_mmap(const char *file_name, char **buf);                    /* map a file read-only, the buffer is not null-terminated */
+void util_unload_file_mmap(char *buf, long len);
+long util_load_cred_file(const char *file_name, const char **buf);             /* map a credential file once and reuse the mapping on subsequent loads */
+void util_unload_cred_files(void);
 
 #endif
@@ -222,46 +222,49 @@ static void config_parser_str_destroy(config_parser_str_t *s)
     s->len = 0;
 }
 
-static int config_parser_str_append(config_parser_str_t *s, char c)
+/* clear the string but retain the buffer for reuse */
+static void config_parser_str_reset(config_parser_str_t *s)
+{
+    s->idx = 0;
+    if (s->buf != NULL)
+    {
+        s->buf[0] = '\0';
+    }
+}
+
+/* append a block of num characters in a single operation */
+static int config_parser_str_append_block(config_parser_str_t *s, const char *str, unsigned num)
 {
     unsigned new_len = 0;
     char *new_buf = NULL;
 
-    if (s->idx >= s->len)
+    if (s->idx + num > s->len)
     {
         new_len = 2 * s->len;
+        while (s->idx + num > new_len)
+        {
+            new_len *= 2;
+        }
         new_buf = calloc(new_len + 1, 1);
         if (new_buf == NULL)
         {
             return CONFIG_ENOMEM;
         }
-        memcpy(new_buf, s->buf, s->len);
+        memcpy(new_buf, s->buf, s->idx);
         free(s->buf);
         s->buf = new_buf;
         s->len = new_len;
     }
-    s->buf[s->idx++] = c;
+    memcpy(s->buf + s->idx, str, num);
+    s->idx += num;
+    s->buf[s->idx] = '\0';
     return CONFIG_OK;
 }
 
 static int config_parser_str_copy(config_parser_str_t *s, const char *str)
 {
-    unsigned len = 0;
-    unsigned i = 0;
-    int ret = 0;
-
-    memset(s->buf, 0, s->len + 1);
-    s->idx = 0;
-    len = strlen(str);
-    for (i = 0; i < len; i++)
-    {
-        ret = config_parser_str_append(s, str[i]);
-        if (ret != CONFIG_OK)
-        {
-            return ret;
-        }
-    }
-    return CONFIG_OK;
+    config_parser_str_reset(s);
+    return config_parser_str_append_block(s, str, strlen(str));
 }
 
 static int config_parser_next(config_parser_t *p)
@@ -340,12 +343,13 @@ static void config_parser_set_token_pos(config_parser_t *p, int c)
 
 static int config_parser_lex(config_parser_t *p)
 {
+    unsigned start = 0;
     int ret = 0;
     int pc = 0;
     int c = 0;
 
     p->token = CONFIG_PARSER_NONE;
-    config_parser_str_destroy(&p->token_str);
+    config_parser_str_reset(&p->token_str);
     c = config_parser_next_skip_ws(p);
     config_parser_set_token_pos(p, c);
     if (c == '\0')
@@ -393,51 +397,39 @@ static int config_parser_lex(config_parser_t *p)
     else if (isalpha(c))
     {
         p->token = CONFIG_PARSER_ID;
-        ret = config_parser_str_create(&p->token_str);
-        if (ret != CONFIG_OK)
-        {
-            return ret;
-        }
+        start = p->in_idx - 1;
         while (isalpha(c) || isdigit(c) || (c == '_'))
         {
-            ret = config_parser_str_append(&p->token_str, c);
-            if (ret != CONFIG_OK)
-            {
-                return ret;
-            }
             c = config_parser_next(p);
         }
         config_parser_put_back(p);
+        ret = config_parser_str_append_block(&p->token_str, p->in + start, p->in_idx - start);
+        if (ret != CONFIG_OK)
+        {
+            return ret;
+        }
         return CONFIG_OK;
     }
     else if (isdigit(c))
     {
         p->token = CONFIG_PARSER_NUM;
-        ret = config_parser_str_create(&p->token_str);
-        if (ret != CONFIG_OK)
-        {
-            return ret;
-        }
+        start = p->in_idx - 1;
         while (isdigit(c))
         {
-            ret = config_parser_str_append(&p->token_str, c);
-            if (ret != CONFIG_OK)
-            {
-                return ret;
-            }
             c = config_parser_next(p);
         }
         config_parser_put_back(p);
+        ret = config_parser_str_append_block(&p->token_str, p->in + start, p->in_idx - start);
+        if (ret != CONFIG_OK)
+        {
+            return ret;
+        }
         return CONFIG_OK;
     }
     else if (c == '\"')
     {
         p->token = CONFIG_PARSER_QUOTE;
-        ret = config_parser_str_create(&p->token_str);
-        if (ret != CONFIG_OK)
-        {
-            return ret;
-        }
+        start = p->in_idx;
         pc = 0;
         c = config_parser_next(p);
         while (1)
@@ -450,14 +442,14 @@ static int config_parser_lex(config_parser_t *p)
             {
                 return CONFIG_ELEXICAL;
             }
-            ret = config_parser_str_append(&p->token_str, c);
-            if (ret != CONFIG_OK)
-            {
-                return ret;
-            }
             pc = c;
             c = config_parser_next(p);
         }
+        ret = config_parser_str_append_block(&p->token_str, p->in + start, p->in_idx - 1 - start);
+        if (ret != CONFIG_OK)
+        {
+            return ret;
+        }
         return CONFIG_OK;
     }
     return CONFIG_ELEXICAL;
@@ -712,6 +704,12 @@ static int config_parser_create(config_parser_t *p, config_parser_cb_func_t cb_f
     {
         return ret;
     }
+    ret = config_parser_str_create(&p->token_str);
+    if (ret != CONFIG_OK)
+    {
+        config_parser_str_destroy(&p->section);
+        return ret;
+    }
     p->tab_width = CONFIG_PARSER_DEF_TAB_WIDTH;
     config_parser_stack_create(&p->id_stack);
     p->cb_func = cb_func;
@@ -731,6 +729,19 @@ static void config_parser_destroy(config_parser_t *p)
     memset(p, 0, sizeof(config_parser_t));
 }
 
+/* djb2 hash used to index sections and entries by name */
+static unsigned config_hash(const char *str)
+{
+    unsigned hash = 5381;
+
+    while (*str != '\0')
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)*str;
+        str++;
+    }
+    return hash;
+}
+
 static void config_entry_delete(config_entry_t *entry)
 {
     if (entry->name != NULL)
@@ -803,15 +814,17 @@ static config_section_t *config_section_new(const char *section_name)
 
 static config_entry_t *config_section_find_entry(config_section_t *section, const char *entry_name)
 {
-    config_entry_t *entry = section->first;
+    config_entry_t *entry = NULL;
+    unsigned hash = config_hash(entry_name);
 
+    entry = section->bucket[hash & (CONFIG_NUM_BUCKETS - 1)];
     while (entry != NULL)
     {
-        if (strcmp(entry->name, entry_name) == 0)
+        if ((entry->hash == hash) && (strcmp(entry->name, entry_name) == 0))
         {
             return entry;
         }
-        entry = entry->next;
+        entry = entry->bucket_next;
     }
     return NULL;
 }
@@ -834,6 +847,9 @@ static int config_section_add_entry(config_section_t *section, const char *entry
         section->last->next = entry;
     }
     section->last = entry;
+    entry->hash = config_hash(entry_name);
+    entry->bucket_next = section->bucket[entry->hash & (CONFIG_NUM_BUCKETS - 1)];
+    section->bucket[entry->hash & (CONFIG_NUM_BUCKETS - 1)] = entry;
     return CONFIG_OK;
 }
 
@@ -858,15 +874,17 @@ void config_destroy(config_t *config)
 
 static config_section_t *config_find_section(config_t *config, const char *section_name)
 {
-    config_section_t *section = config->first;
+    config_section_t *section = NULL;
+    unsigned hash = config_hash(section_name);
 
+    section = config->bucket[hash & (CONFIG_NUM_BUCKETS - 1)];
     while (section != NULL)
     {
-        if (strcmp(section->name, section_name) == 0)
+        if ((section->hash == hash) && (strcmp(section->name, section_name) == 0))
         {
             return section;
         }
-        section = section->next;
+        section = section->bucket_next;
     }
     return NULL;
 }
@@ -889,6 +907,9 @@ static config_section_t *config_add_section(config_t *config, const char *sectio
         config->last->next = section;
     }
     config->last = section;
+    section->hash = config_hash(section_name);
+    section->bucket_next = config->bucket[section->hash & (CONFIG_NUM_BUCKETS - 1)];
+    config->bucket[section->hash & (CONFIG_NUM_BUCKETS - 1)] = section;
     return section;
 }
 
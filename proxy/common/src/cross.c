@@ -32,14 +32,35 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "cross.h"
 #include "uri.h"
 
-#define CROSS_NUM_HTTP_RESP  5                                                  /**< Number of HTTP response codes */
-#define CROSS_COAP_SCHEME    "coaps"                                            /**< CoAP scheme */
-#define CROSS_TMP_BUF_LEN    256                                                /**< Length of temporary buffer */
+#define CROSS_NUM_HTTP_RESP       5                                             /**< Number of HTTP response codes */
+#define CROSS_COAP_SCHEME         "coaps"                                       /**< CoAP scheme */
+#define CROSS_TMP_BUF_LEN         256                                           /**< Length of temporary buffer */
+#define CROSS_URI_CACHE_NUM_ENTRY 64                                            /**< Maximum number of entries in the URI translation cache */
+
+/**
+ *  @brief URI translation cache entry structure
+ */
+typedef struct cross_uri_cache_entry
+{
+    struct cross_uri_cache_entry *prev;                                         /**< Previous entry in least-recently-used order */
+    struct cross_uri_cache_entry *next;                                         /**< Next entry in least-recently-used order */
+    char *uri;                                                                  /**< Raw request target used as the cache key */
+    unsigned hash;                                                              /**< Hash of the raw request target */
+    coap_msg_t msg;                                                             /**< Message holding the pre-built URI options */
+}
+cross_uri_cache_entry_t;
+
+static pthread_mutex_t cross_uri_cache_mutex = PTHREAD_MUTEX_INITIALIZER;       /**< Mutex to protect the URI translation cache */
+static cross_uri_cache_entry_t *cross_uri_cache_first = NULL;                   /**< Most-recently-used entry in the URI translation cache */
+static cross_uri_cache_entry_t *cross_uri_cache_last = NULL;                    /**< Least-recently-used entry in the URI translation cache */
+static unsigned cross_uri_cache_num = 0;                                        /**< Number of entries in the URI translation cache */
 
 /**
  *  @brief Array of HTTP response strings
@@ -192,7 +213,126 @@ static int cross_status_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg)
     return -EBADMSG;
 }
 
-int cross_uri_http_to_coap(coap_msg_t *coap_msg, const char *http_uri)
+/**
+ *  @brief Calculate the hash of a raw request target
+ *
+ *  @param[in] str String containing the raw request target
+ *
+ *  @returns Hash of the raw request target
+ */
+static unsigned cross_uri_cache_hash(const char *str)
+{
+    unsigned hash = 5381;
+
+    while (*str != '\0')
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)*str;
+        str++;
+    }
+    return hash;
+}
+
+/**
+ *  @brief Remove an entry from the least-recently-used list
+ *
+ *  @param[in,out] entry Pointer to a URI translation cache entry
+ */
+static void cross_uri_cache_unlink(cross_uri_cache_entry_t *entry)
+{
+    if (entry->prev != NULL)
+        entry->prev->next = entry->next;
+    else
+        cross_uri_cache_first = entry->next;
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+    else
+        cross_uri_cache_last = entry->prev;
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+/**
+ *  @brief Insert an entry at the front of the least-recently-used list
+ *
+ *  @param[in,out] entry Pointer to a URI translation cache entry
+ */
+static void cross_uri_cache_push(cross_uri_cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = cross_uri_cache_first;
+    if (cross_uri_cache_first != NULL)
+        cross_uri_cache_first->prev = entry;
+    cross_uri_cache_first = entry;
+    if (cross_uri_cache_last == NULL)
+        cross_uri_cache_last = entry;
+}
+
+/**
+ *  @brief Find an entry in the URI translation cache
+ *
+ *  @param[in] hash Hash of the raw request target
+ *  @param[in] http_uri String containing the raw request target
+ *
+ *  @returns Pointer to a URI translation cache entry or NULL
+ */
+static cross_uri_cache_entry_t *cross_uri_cache_find(unsigned hash, const char *http_uri)
+{
+    cross_uri_cache_entry_t *entry = cross_uri_cache_first;
+
+    while (entry != NULL)
+    {
+        if ((entry->hash == hash)
+         && (strcmp(entry->uri, http_uri) == 0))
+        {
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Copy the options from one CoAP message to another
+ *
+ *  @param[out] dest Pointer to the destination CoAP message structure
+ *  @param[in] src Pointer to the source CoAP message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int cross_uri_clone_ops(coap_msg_t *dest, coap_msg_t *src)
+{
+    coap_msg_op_t *op = NULL;
+    int ret = 0;
+
+    op = coap_msg_get_first_op(src);
+    while (op != NULL)
+    {
+        ret = coap_msg_add_op(dest, coap_msg_op_get_num(op), coap_msg_op_get_len(op), coap_msg_op_get_val(op));
+        if (ret < 0)
+        {
+            return ret;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    return 0;
+}
+
+/**
+ *  @brief Convert a HTTP URI to CoAP options
+ *
+ *  Uncached translation, parses the URI and builds the
+ *  Uri-Host, Uri-Port, Uri-Path and Uri-Query options.
+ *
+ *  @param[out] coap_msg Pointer to a CoAP message structure
+ *  @param[in] http_uri String containing the HTTP URI
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int cross_uri_http_to_coap_uncached(coap_msg_t *coap_msg, const char *http_uri)
 {
     const char *str = NULL;
     const char *end = NULL;
@@ -357,6 +497,89 @@ int cross_uri_http_to_coap(coap_msg_t *coap_msg, const char *http_uri)
     return 0;
 }
 
+int cross_uri_http_to_coap(coap_msg_t *coap_msg, const char *http_uri)
+{
+    cross_uri_cache_entry_t *entry = NULL;
+    cross_uri_cache_entry_t *old = NULL;
+    unsigned hash = 0;
+    int ret = 0;
+
+    hash = cross_uri_cache_hash(http_uri);
+    pthread_mutex_lock(&cross_uri_cache_mutex);
+    entry = cross_uri_cache_find(hash, http_uri);
+    if (entry != NULL)
+    {
+        /* repeat request target, clone the pre-built options */
+        ret = cross_uri_clone_ops(coap_msg, &entry->msg);
+        if (ret == 0)
+        {
+            cross_uri_cache_unlink(entry);
+            cross_uri_cache_push(entry);
+        }
+        pthread_mutex_unlock(&cross_uri_cache_mutex);
+        return ret;
+    }
+    pthread_mutex_unlock(&cross_uri_cache_mutex);
+
+    /* translate into a new cache entry so that the */
+    /* pre-built options can be cloned on later requests */
+    entry = (cross_uri_cache_entry_t *)malloc(sizeof(cross_uri_cache_entry_t));
+    if (entry == NULL)
+    {
+        /* the cache is an optimisation, translate directly */
+        return cross_uri_http_to_coap_uncached(coap_msg, http_uri);
+    }
+    memset(entry, 0, sizeof(cross_uri_cache_entry_t));
+    entry->uri = strdup(http_uri);
+    if (entry->uri == NULL)
+    {
+        free(entry);
+        return cross_uri_http_to_coap_uncached(coap_msg, http_uri);
+    }
+    entry->hash = hash;
+    coap_msg_create(&entry->msg);
+    ret = cross_uri_http_to_coap_uncached(&entry->msg, http_uri);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&entry->msg);
+        free(entry->uri);
+        free(entry);
+        return ret;
+    }
+    ret = cross_uri_clone_ops(coap_msg, &entry->msg);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&entry->msg);
+        free(entry->uri);
+        free(entry);
+        return ret;
+    }
+    pthread_mutex_lock(&cross_uri_cache_mutex);
+    if (cross_uri_cache_find(hash, http_uri) != NULL)
+    {
+        /* another thread cached the same request target in the meantime */
+        pthread_mutex_unlock(&cross_uri_cache_mutex);
+        coap_msg_destroy(&entry->msg);
+        free(entry->uri);
+        free(entry);
+        return 0;
+    }
+    if (cross_uri_cache_num >= CROSS_URI_CACHE_NUM_ENTRY)
+    {
+        /* evict the least-recently-used entry */
+        old = cross_uri_cache_last;
+        cross_uri_cache_unlink(old);
+        cross_uri_cache_num--;
+        coap_msg_destroy(&old->msg);
+        free(old->uri);
+        free(old);
+    }
+    cross_uri_cache_push(entry);
+    cross_uri_cache_num++;
+    pthread_mutex_unlock(&cross_uri_cache_mutex);
+    return 0;
+}
+
 int cross_uri_coap_to_http(char *buf, size_t len, coap_msg_t *coap_msg)
 {
     coap_msg_op_t *op = NULL;
@@ -533,67 +756,65 @@ static int cross_headers_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg
      *  COAP_MSG_SIZE1                  not done
      */
 
-    http_header = http_msg_get_first_header(http_msg);
-    while (http_header != NULL)
+    http_header = http_msg_get_header(http_msg, "Etag");
+    if (http_header != NULL)
     {
-        if (strcasecmp(http_msg_header_get_name(http_header), "Etag") == 0)
+        str = http_msg_header_get_value(http_header);
+        ret = coap_msg_add_op(coap_msg, COAP_MSG_ETAG, strlen(str), str);
+        if (ret < 0)
         {
-            str = http_msg_header_get_value(http_header);
-            ret = coap_msg_add_op(coap_msg, COAP_MSG_ETAG, strlen(str), str);
-            if (ret < 0)
-            {
-                coap_msg_destroy(coap_msg);
-                *code = 502;
-                return ret;
-            }
+            coap_msg_destroy(coap_msg);
+            *code = 502;
+            return ret;
         }
-        else if (strcasecmp(http_msg_header_get_name(http_header), "Cache-Control") == 0)
+    }
+    http_header = http_msg_get_header(http_msg, "Cache-Control");
+    if (http_header != NULL)
+    {
+        str = http_msg_header_get_value(http_header);
+        str = strstr(str, "max-age=");
+        if (str != NULL)
         {
-            str = http_msg_header_get_value(http_header);
-            str = strstr(str, "max-age=");
-            if (str != NULL)
+            ret = sscanf(str, "max-age=%u", &val);
+            if (ret == 1)
             {
-                ret = sscanf(str, "max-age=%u", &val);
-                if (ret == 1)
+                ret = snprintf(tmp, sizeof(tmp), "%u", val);
+                if (ret >= sizeof(tmp))
                 {
-                    ret = snprintf(tmp, sizeof(tmp), "%u", val);
-                    if (ret >= sizeof(tmp))
-                    {
-                        *code = 502;
-                        return -ENOSPC;
-                    }
-                    ret = coap_msg_add_op(coap_msg, COAP_MSG_MAX_AGE, strlen(tmp), tmp);
-                    if (ret < 0)
-                    {
-                        coap_msg_destroy(coap_msg);
-                        *code = 502;
-                        return ret;
-                    }
+                    *code = 502;
+                    return -ENOSPC;
+                }
+                ret = coap_msg_add_op(coap_msg, COAP_MSG_MAX_AGE, strlen(tmp), tmp);
+                if (ret < 0)
+                {
+                    coap_msg_destroy(coap_msg);
+                    *code = 502;
+                    return ret;
                 }
             }
         }
-        else if (strcasecmp(http_msg_header_get_name(http_header), "Accept") == 0)
+    }
+    http_header = http_msg_get_header(http_msg, "Accept");
+    if (http_header != NULL)
+    {
+        str = http_msg_header_get_value(http_header);
+        if (strncasecmp(str, "text/plain", 10) == 0)
         {
-            str = http_msg_header_get_value(http_header);
-            if (strncasecmp(str, "text/plain", 10) == 0)
-            {
-                tmp[0] = '0';
-                tmp[1] = '\0';
-            }
-            else
-            {
-                *code = 406;
-                return -EBADMSG;
-            }
-            ret = coap_msg_add_op(coap_msg, COAP_MSG_ACCEPT, strlen(tmp), tmp);
-            if (ret < 0)
-            {
-                coap_msg_destroy(coap_msg);
-                *code = 502;
-                return ret;
-            }
+            tmp[0] = '0';
+            tmp[1] = '\0';
+        }
+        else
+        {
+            *code = 406;
+            return -EBADMSG;
+        }
+        ret = coap_msg_add_op(coap_msg, COAP_MSG_ACCEPT, strlen(tmp), tmp);
+        if (ret < 0)
+        {
+            coap_msg_destroy(coap_msg);
+            *code = 502;
+            return ret;
         }
-        http_header = http_msg_header_get_next(http_header);
     }
     return 0;
 }
@@ -693,18 +914,26 @@ static int cross_headers_coap_to_http(coap_msg_t *coap_msg, http_msg_t *http_msg
  *
  *  @param[out] coap_msg Pointer to a CoAP message structure
  *  @param[in] http_msg Pointer to a HTTP message structure
+ *  @param[in] borrow Reference the HTTP body instead of copying it
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-int cross_body_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg)
+static int cross_body_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg, int borrow)
 {
     int ret = 0;
 
     if (http_msg_get_body_len(http_msg))
     {
-        ret = coap_msg_set_payload(coap_msg, http_msg_get_body(http_msg), http_msg_get_body_len(http_msg));
+        if (borrow)
+        {
+            ret = coap_msg_borrow_payload(coap_msg, http_msg_get_body(http_msg), http_msg_get_body_len(http_msg));
+        }
+        else
+        {
+            ret = coap_msg_set_payload(coap_msg, http_msg_get_body(http_msg), http_msg_get_body_len(http_msg));
+        }
         if (ret < 0)
         {
             return ret;
@@ -717,25 +946,39 @@ int cross_body_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg)
  *  @brief Convert a CoAP payload to a HTTP body
  *
  *  @param[out] http_msg Pointer to a HTTP message structure
- *  @param[in] coap_msg Pointer to a CoAP message structure
+ *  @param[in,out] coap_msg Pointer to a CoAP message structure
+ *  @param[in] take Transfer ownership of the payload instead of copying it
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int cross_body_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg)
+static int cross_body_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg, int take)
 {
     char tmp[CROSS_TMP_BUF_LEN] = {0};
+    char *payload = NULL;
+    size_t payload_len = 0;
     int ret = 0;
 
     if (coap_msg_get_payload_len(coap_msg) > 0)
     {
-        ret = http_msg_set_body(http_msg, coap_msg_get_payload(coap_msg), coap_msg_get_payload_len(coap_msg));
-        if (ret < 0)
+        if (take)
         {
-            return ret;
+            payload = coap_msg_detach_payload(coap_msg, &payload_len);
         }
-        ret = snprintf(tmp, sizeof(tmp), "%zu", coap_msg_get_payload_len(coap_msg));
+        if (payload != NULL)
+        {
+            http_msg_adopt_body(http_msg, payload, payload_len);
+        }
+        else
+        {
+            ret = http_msg_set_body(http_msg, coap_msg_get_payload(coap_msg), coap_msg_get_payload_len(coap_msg));
+            if (ret < 0)
+            {
+                return ret;
+            }
+        }
+        ret = snprintf(tmp, sizeof(tmp), "%zu", http_msg_get_body_len(http_msg));
         if (ret >= sizeof(tmp))
         {
             return -ENOSPC;
@@ -749,7 +992,7 @@ static int cross_body_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg)
     return 0;
 }
 
-int cross_req_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned *code)
+static int cross_req_http_to_coap_(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned *code, int borrow)
 {
     int ret = 0;
 
@@ -775,7 +1018,7 @@ int cross_req_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned
         return ret;
     }
 
-    ret = cross_body_http_to_coap(coap_msg, http_msg);
+    ret = cross_body_http_to_coap(coap_msg, http_msg, borrow);
     if (ret < 0)
     {
         *code = 502;
@@ -786,7 +1029,17 @@ int cross_req_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned
     return 0;
 }
 
-int cross_resp_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned *code)
+int cross_req_http_to_coap(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned *code)
+{
+    return cross_req_http_to_coap_(coap_msg, http_msg, code, 0);
+}
+
+int cross_req_http_to_coap_nocopy(coap_msg_t *coap_msg, http_msg_t *http_msg, unsigned *code)
+{
+    return cross_req_http_to_coap_(coap_msg, http_msg, code, 1);
+}
+
+static int cross_resp_coap_to_http_(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned *code, int take)
 {
     int ret = 0;
 
@@ -806,7 +1059,7 @@ int cross_resp_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned
         return ret;
     }
 
-    ret = cross_body_coap_to_http(http_msg, coap_msg);
+    ret = cross_body_coap_to_http(http_msg, coap_msg, take);
     if (ret < 0)
     {
         *code = 502;
@@ -816,3 +1069,13 @@ int cross_resp_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned
     *code = 0;
     return 0;
 }
+
+int cross_resp_coap_to_http(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned *code)
+{
+    return cross_resp_coap_to_http_(http_msg, coap_msg, code, 0);
+}
+
+int cross_resp_coap_to_http_nocopy(http_msg_t *http_msg, coap_msg_t *coap_msg, unsigned *code)
+{
+    return cross_resp_coap_to_http_(http_msg, coap_msg, code, 1);
+}
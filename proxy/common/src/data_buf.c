@@ -34,8 +34,89 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "data_buf.h"
 
+#define DATA_BUF_POOL_MIN_SIZE    1024                                          /* smallest pooled storage size */
+#define DATA_BUF_POOL_NUM_CLASS   6                                             /* power-of-2 sizes 1024..32768 */
+#define DATA_BUF_POOL_MAX_FREE    64                                            /* max retained blocks per size class */
+
+typedef struct data_buf_pool_block
+{
+    struct data_buf_pool_block *next;
+}
+data_buf_pool_block_t;
+
+static pthread_mutex_t data_buf_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static data_buf_pool_block_t *data_buf_pool_free[DATA_BUF_POOL_NUM_CLASS] = {0};
+static unsigned data_buf_pool_num_free[DATA_BUF_POOL_NUM_CLASS] = {0};
+
+/* map a storage size to its pool size class or -1 if the size is not pooled */
+static int data_buf_pool_class(size_t size)
+{
+    size_t class_size = DATA_BUF_POOL_MIN_SIZE;
+    int i = 0;
+
+    for (i = 0; i < DATA_BUF_POOL_NUM_CLASS; i++)
+    {
+        if (size == class_size)
+        {
+            return i;
+        }
+        class_size *= 2;
+    }
+    return -1;
+}
+
+/* acquire zeroed storage for size + 1 bytes, from the pool where possible */
+static char *data_buf_pool_alloc(size_t size)
+{
+    data_buf_pool_block_t *block = NULL;
+    int class = 0;
+
+    class = data_buf_pool_class(size);
+    if (class >= 0)
+    {
+        pthread_mutex_lock(&data_buf_pool_mutex);
+        block = data_buf_pool_free[class];
+        if (block != NULL)
+        {
+            data_buf_pool_free[class] = block->next;
+            data_buf_pool_num_free[class]--;
+        }
+        pthread_mutex_unlock(&data_buf_pool_mutex);
+        if (block != NULL)
+        {
+            memset(block, 0, size + 1);
+            return (char *)block;
+        }
+    }
+    return (char *)calloc(size + 1, 1);
+}
+
+/* return storage to the pool or free it if the pool is full */
+static void data_buf_pool_dealloc(char *data, size_t size)
+{
+    data_buf_pool_block_t *block = NULL;
+    int class = 0;
+
+    class = data_buf_pool_class(size);
+    if (class >= 0)
+    {
+        pthread_mutex_lock(&data_buf_pool_mutex);
+        if (data_buf_pool_num_free[class] < DATA_BUF_POOL_MAX_FREE)
+        {
+            block = (data_buf_pool_block_t *)data;
+            block->next = data_buf_pool_free[class];
+            data_buf_pool_free[class] = block;
+            data_buf_pool_num_free[class]++;
+            data = NULL;
+        }
+        pthread_mutex_unlock(&data_buf_pool_mutex);
+    }
+    free(data);
+}
+
 int data_buf_create(data_buf_t *buf, size_t size, size_t max_size)
 {
     memset(buf, 0, sizeof(data_buf_t));
@@ -43,7 +124,7 @@ int data_buf_create(data_buf_t *buf, size_t size, size_t max_size)
     {
         return -EINVAL;
     }
-    buf->data = (char *)calloc(size + 1, 1);
+    buf->data = data_buf_pool_alloc(size);
     if (buf->data == NULL)
     {
         return -ENOMEM;
@@ -55,7 +136,7 @@ int data_buf_create(data_buf_t *buf, size_t size, size_t max_size)
 
 void data_buf_destroy(data_buf_t *buf)
 {
-    free(buf->data);
+    data_buf_pool_dealloc(buf->data, buf->size);
     memset(buf, 0, sizeof(data_buf_t));
 }
 
@@ -69,16 +150,16 @@ int data_buf_expand(data_buf_t *buf)
     {
         return -EINVAL;
     }
-    new_data = (char *)malloc(new_size + 1);
+    new_data = data_buf_pool_alloc(new_size);
     if (new_data == NULL)
     {
         return -ENOMEM;
     }
-    memcpy(new_data, buf->data, buf->count);
-    memset(new_data + buf->count, 0, new_size - buf->count);
-    free(buf->data);
+    memcpy(new_data, buf->data + buf->start, buf->count);
+    data_buf_pool_dealloc(buf->data, buf->size);
     buf->data = new_data;
     buf->size = new_size;
+    buf->start = 0;
     return 0;
 }
 
@@ -97,8 +178,20 @@ size_t data_buf_consume(data_buf_t *buf, size_t num)
 {
     if (num > buf->count)
         num = buf->count;
-    memmove(buf->data, buf->data + num, buf->size - num);
-    memset(buf->data + buf->size - num, 0, num);
+    buf->start += num;
     buf->count -= num;
+    if (buf->count == 0)
+    {
+        /* reclaim the whole buffer without copying */
+        memset(buf->data, 0, buf->start);
+        buf->start = 0;
+    }
+    else if (buf->start >= buf->size / 2)
+    {
+        /* reclaim the consumed region in one move */
+        memmove(buf->data, buf->data + buf->start, buf->count);
+        memset(buf->data + buf->count, 0, buf->start);
+        buf->start = 0;
+    }
     return num;
 }
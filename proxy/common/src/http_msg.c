@@ -34,12 +34,37 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <errno.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined __SSE2__
+#include <emmintrin.h>
+#endif
 #include "http_msg.h"
 #include "util.h"
 
-#define HTTP_MSG_NUM_ERROR_STR  4                                               /**< Number of error strings */
+#define HTTP_MSG_NUM_ERROR_STR     4                                            /**< Number of error strings */
+#define HTTP_MSG_ARENA_BLOCK_SIZE  1024                                         /**< Default size of an arena block */
+
+/**
+ *  @brief Arena block structure
+ *
+ *  Headers and their name and value strings are carved from
+ *  a chain of arena blocks owned by the message so that each
+ *  header costs no individual memory allocations and the
+ *  whole lot can be released at once when the message is
+ *  destroyed. The allocation data follows the block structure
+ *  in the same memory allocation.
+ */
+typedef struct http_msg_arena_block
+{
+    struct http_msg_arena_block *next;                                          /**< Next arena block in the chain */
+    size_t size;                                                                /**< Size of the allocation data that follows the block structure */
+    size_t used;                                                                /**< Number of bytes of the allocation data in use */
+}
+http_msg_arena_block_t;
 
 /**
  *  @brief Array of string representations of error codes
@@ -68,102 +93,291 @@ const char *http_msg_strerror(int error)
     return http_msg_error_str[HTTP_MSG_NUM_ERROR_STR];
 }
 
+#ifdef __AVX2__
+
 /**
- *  @brief Allocate memory and initialise a message header
+ *  @brief Find the first occurrence of a character or the terminating null character
  *
- *  @parain[in] name String containing the message header name
- *  @parain[in] value String containing the message header value
+ *  Scan 32 bytes at a time using AVX2 instructions. Loads are
+ *  aligned to 32 bytes so that they cannot cross a page boundary
+ *  and fault on bytes beyond the terminating null character.
  *
- *  @returns Pointer to a message header structure or NULL
- *  @retval Pointer to a message header structure, Success
- *  @retval NULL, Out-of-memory
+ *  @param[in] str String to scan
+ *  @param[in] c Character to scan for
+ *
+ *  @returns Pointer to the first occurrence of the character or the terminating null character
  */
-static http_msg_header_t *http_msg_header_new(const char *name, const char *value)
+static const char *http_msg_scan(const char *str, char c)
 {
-    http_msg_header_t *header = NULL;
+    const __m256i set = _mm256_set1_epi8(c);
+    const __m256i zero = _mm256_setzero_si256();
+    const char *base = (const char *)((uintptr_t)str & ~(uintptr_t)31);
+    __m256i chunk = {0};
+    unsigned mask = 0;
+
+    chunk = _mm256_load_si256((const __m256i *)base);
+    mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, set),
+                                                          _mm256_cmpeq_epi8(chunk, zero)));
+    mask &= 0xffffffffu << (str - base);
+    while (mask == 0)
+    {
+        base += 32;
+        chunk = _mm256_load_si256((const __m256i *)base);
+        mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, set),
+                                                              _mm256_cmpeq_epi8(chunk, zero)));
+    }
+    return base + __builtin_ctz(mask);
+}
 
-    header = (http_msg_header_t *)malloc(sizeof(http_msg_header_t));
-    if (header == NULL)
+#elif defined __SSE2__
+
+/**
+ *  @brief Find the first occurrence of a character or the terminating null character
+ *
+ *  Scan 16 bytes at a time using SSE2 instructions. Loads are
+ *  aligned to 16 bytes so that they cannot cross a page boundary
+ *  and fault on bytes beyond the terminating null character.
+ *
+ *  @param[in] str String to scan
+ *  @param[in] c Character to scan for
+ *
+ *  @returns Pointer to the first occurrence of the character or the terminating null character
+ */
+static const char *http_msg_scan(const char *str, char c)
+{
+    const __m128i set = _mm_set1_epi8(c);
+    const __m128i zero = _mm_setzero_si128();
+    const char *base = (const char *)((uintptr_t)str & ~(uintptr_t)15);
+    __m128i chunk = {0};
+    unsigned mask = 0;
+
+    chunk = _mm_load_si128((const __m128i *)base);
+    mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, set),
+                                                    _mm_cmpeq_epi8(chunk, zero)));
+    mask &= 0xffffu << (str - base);
+    while (mask == 0)
     {
-        return NULL;
+        base += 16;
+        chunk = _mm_load_si128((const __m128i *)base);
+        mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, set),
+                                                        _mm_cmpeq_epi8(chunk, zero)));
     }
-    header->name = strdup(name);
-    if (header->name == NULL)
+    return base + __builtin_ctz(mask);
+}
+
+#else  /* !__AVX2__ && !__SSE2__ */
+
+/**
+ *  @brief Find the first occurrence of a character or the terminating null character
+ *
+ *  Portable fallback for targets without vector instructions.
+ *
+ *  @param[in] str String to scan
+ *  @param[in] c Character to scan for
+ *
+ *  @returns Pointer to the first occurrence of the character or the terminating null character
+ */
+static const char *http_msg_scan(const char *str, char c)
+{
+    while ((*str != c) && (*str != '\0'))
     {
-        free(header);
-        return NULL;
+        str++;
     }
-    header->value = strdup(value);
-    if (header->value == NULL)
+    return str;
+}
+
+#endif  /* __AVX2__ */
+
+/**
+ *  @brief Find the first occurrence of a character in a string
+ *
+ *  @param[in] str String to scan
+ *  @param[in] c Character to scan for
+ *
+ *  @returns Pointer to the first occurrence of the character or NULL
+ */
+static char *http_msg_find_char(const char *str, char c)
+{
+    const char *p = http_msg_scan(str, c);
+
+    return (*p == c) ? (char *)p : NULL;
+}
+
+/**
+ *  @brief Find the first carriage-return line-feed sequence in a string
+ *
+ *  @param[in] str String to scan
+ *
+ *  @returns Pointer to the first carriage-return line-feed sequence or NULL
+ */
+static char *http_msg_find_crlf(const char *str)
+{
+    const char *p = str;
+
+    while (1)
     {
-        free(header->name);
-        free(header);
-        return NULL;
+        p = http_msg_scan(p, '\r');
+        if (*p == '\0')
+        {
+            return NULL;
+        }
+        if (*(p + 1) == '\n')
+        {
+            return (char *)p;
+        }
+        p++;
     }
-    header->next = NULL;
-    return header;
 }
 
 /**
- *  @brief Free the memory that holds a message header structure
+ *  @brief Allocate memory from the arena owned by a message
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] len Number of bytes to allocate
+ *
+ *  @returns Pointer to the allocated memory or NULL
+ *  @retval Pointer to the allocated memory, Success
+ *  @retval NULL, Out-of-memory
  */
-static void http_msg_header_delete(http_msg_header_t *header)
+static void *http_msg_arena_alloc(http_msg_t *msg, size_t len)
 {
-    free(header->name);
-    free(header->value);
-    free(header);
+    http_msg_arena_block_t *block = msg->arena;
+    size_t size = 0;
+    char *data = NULL;
+
+    /* keep allocations aligned for the header structures */
+    len = (len + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if ((block == NULL) || (block->used + len > block->size))
+    {
+        size = (len > HTTP_MSG_ARENA_BLOCK_SIZE) ? len : HTTP_MSG_ARENA_BLOCK_SIZE;
+        block = (http_msg_arena_block_t *)malloc(sizeof(http_msg_arena_block_t) + size);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->next = msg->arena;
+        block->size = size;
+        block->used = 0;
+        msg->arena = block;
+    }
+    data = (char *)(block + 1) + block->used;
+    block->used += len;
+    return data;
 }
 
 /**
- *  @brief Initialise a message header linked-list structure
+ *  @brief Copy a string into the arena owned by a message
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] str String to copy
  *
- *  @param[out] list Pointer to a message header linked-list structure
+ *  @returns Pointer to the copied string or NULL
+ *  @retval Pointer to the copied string, Success
+ *  @retval NULL, Out-of-memory
  */
-static void http_msg_list_create(http_msg_list_t *list)
+static char *http_msg_arena_strdup(http_msg_t *msg, const char *str)
 {
-    memset(list, 0, sizeof(http_msg_list_t));
+    size_t len = strlen(str) + 1;
+    char *dup = NULL;
+
+    dup = (char *)http_msg_arena_alloc(msg, len);
+    if (dup == NULL)
+    {
+        return NULL;
+    }
+    memcpy(dup, str, len);
+    return dup;
 }
 
 /**
- *  @brief Deinitialise a message header linked-list structure
+ *  @brief Free the arena owned by a message
  *
- *  @param[out] list Pointer to a message header linked-list structure
+ *  @param[in,out] msg Pointer to a message structure
  */
-static void http_msg_list_destroy(http_msg_list_t *list)
+static void http_msg_arena_destroy(http_msg_t *msg)
 {
-    http_msg_header_t *header = list->first;
-    http_msg_header_t *prev = NULL;
+    http_msg_arena_block_t *block = msg->arena;
+    http_msg_arena_block_t *prev = NULL;
 
-    while (header != NULL)
+    while (block != NULL)
     {
-        prev = header;
-        header = header->next;
-        http_msg_header_delete(prev);
+        prev = block;
+        block = block->next;
+        free(prev);
     }
-    memset(list, 0, sizeof(http_msg_list_t));
+    msg->arena = NULL;
 }
 
 /**
- *  @brief Add a message header to a message header linked-list structure
+ *  @brief Calculate the hash of a message header name
+ *
+ *  The name is hashed in lower-case so that header
+ *  name lookups are case-insensitive.
  *
- *  @param[in,out] list Pointer to a message header linked-list structure
+ *  @param[in] name String containing the message header name
+ *
+ *  @returns Hash of the message header name
+ */
+static unsigned http_msg_header_hash(const char *name)
+{
+    unsigned hash = 5381;
+
+    while (*name != '\0')
+    {
+        hash = ((hash << 5) + hash) + tolower((unsigned char)*name);
+        name++;
+    }
+    return hash;
+}
+
+/**
+ *  @brief Add a message header to a message
+ *
+ *  The header is appended to the linked-list of headers and
+ *  inserted into the hash table used for lookup by name.
+ *
+ *  @param[in,out] msg Pointer to a message structure
  *  @param[in] name String containing the message header name
  *  @param[in] value String containing the message header value
  *
  *  @returns Error code
  */
-static int http_msg_list_add(http_msg_list_t *list, const char *name, const char *value)
+static int http_msg_list_add(http_msg_t *msg, const char *name, const char *value)
 {
+    http_msg_header_t **bucket = NULL;
     http_msg_header_t *header = NULL;
 
-    header = http_msg_header_new(name, value);
+    header = (http_msg_header_t *)http_msg_arena_alloc(msg, sizeof(http_msg_header_t));
     if (header == NULL)
+    {
         return -ENOMEM;
-    if (list->first == NULL)
-        list->first = header;
+    }
+    memset(header, 0, sizeof(http_msg_header_t));
+    header->name = http_msg_arena_strdup(msg, name);
+    if (header->name == NULL)
+    {
+        return -ENOMEM;
+    }
+    header->value = http_msg_arena_strdup(msg, value);
+    if (header->value == NULL)
+    {
+        return -ENOMEM;
+    }
+    header->hash = http_msg_header_hash(name);
+    if (msg->header.first == NULL)
+        msg->header.first = header;
     else
-        list->last->next = header;
-    list->last = header;
+        msg->header.last->next = header;
+    msg->header.last = header;
+
+    /* append to the bucket chain so that a lookup finds */
+    /* the first of any headers with a duplicate name */
+    bucket = &msg->bucket[header->hash & (HTTP_MSG_NUM_BUCKETS - 1)];
+    while (*bucket != NULL)
+    {
+        bucket = &(*bucket)->bucket_next;
+    }
+    *bucket = header;
     return 0;
 }
 
@@ -216,7 +430,6 @@ static char *http_msg_trim_ws(char *str)
 void http_msg_create(http_msg_t *msg)
 {
     memset(msg, 0, sizeof(http_msg_t));
-    http_msg_list_create(&msg->header);
 }
 
 void http_msg_destroy(http_msg_t *msg)
@@ -227,7 +440,7 @@ void http_msg_destroy(http_msg_t *msg)
     {
         free(msg->body);
     }
-    http_msg_list_destroy(&msg->header);
+    http_msg_arena_destroy(msg);
     for (i = 0; i < HTTP_MSG_NUM_START; i++)
     {
         if (msg->start[i] != NULL)
@@ -262,7 +475,7 @@ static ssize_t http_msg_parse_start(http_msg_t *msg, char *str)
     char *end = NULL;
     int i = 0;
 
-    end = strstr(str, "\r\n");
+    end = http_msg_find_crlf(str);
     if (end == NULL)
     {
         return -EAGAIN;
@@ -275,7 +488,7 @@ static ssize_t http_msg_parse_start(http_msg_t *msg, char *str)
         start = next;
         if (i < HTTP_MSG_NUM_START - 1)
         {
-            next = strchr(start, ' ');
+            next = http_msg_find_char(start, ' ');
             if (next == NULL)
             {
                 return -EBADMSG;
@@ -320,7 +533,7 @@ static ssize_t http_msg_parse_headers(http_msg_t *msg, char *str)
         name = next;
         while (1)
         {
-            next = strstr(next, "\r\n");
+            next = http_msg_find_crlf(next);
             if (next == NULL)
             {
                 return -EAGAIN;
@@ -341,13 +554,13 @@ static ssize_t http_msg_parse_headers(http_msg_t *msg, char *str)
                 break;
             }
         }
-        value = strchr(name, ':');
+        value = http_msg_find_char(name, ':');
         if (value == NULL)
         {
             return -EBADMSG;
         }
         *value++ = '\0';
-        ret = http_msg_list_add(&msg->header, http_msg_trim_ws(name), http_msg_trim_ws(value));
+        ret = http_msg_list_add(msg, http_msg_trim_ws(name), http_msg_trim_ws(value));
         if (ret < 0)
         {
             return ret;
@@ -385,19 +598,16 @@ static ssize_t http_msg_parse_body(http_msg_t *msg, char *str)
 
     str_len = strlen(str);
 
-    header = http_msg_get_first_header(msg);
-    while (header != NULL)
+    header = http_msg_get_header(msg, "Transfer-Encoding");
+    if ((header != NULL)
+     && (strcasecmp(header->value, "chunked") == 0))
     {
-        if ((strcasecmp(header->name, "Transfer-Encoding") == 0)
-         && (strcasecmp(header->value, "chunked") == 0))
-        {
-            chunked = 1;
-        }
-        if (strcasecmp(header->name, "Content-Length") == 0)
-        {
-            content_len = atoi(header->value);
-        }
-        header = header->next;
+        chunked = 1;
+    }
+    header = http_msg_get_header(msg, "Content-Length");
+    if (header != NULL)
+    {
+        content_len = atoi(header->value);
     }
     if (chunked)
     {
@@ -416,7 +626,7 @@ static ssize_t http_msg_parse_body(http_msg_t *msg, char *str)
                 chunk_size = next;
 
                 /* find the end of the chunk-size field */
-                next = strstr(next, "\r\n");
+                next = http_msg_find_crlf(next);
                 if (next == NULL)
                 {
                     return -EAGAIN;
@@ -424,7 +634,7 @@ static ssize_t http_msg_parse_body(http_msg_t *msg, char *str)
                 next += 2;
 
                 /* ignore unrecognised parameters in the chunk-size field */
-                param = strchr(chunk_size, ';');
+                param = http_msg_find_char(chunk_size, ';');
                 if ((param != NULL) && (param < next))
                 {
                     *param = ' ';
@@ -594,7 +804,41 @@ int http_msg_set_start(http_msg_t *msg, const char *start1, const char *start2,
 
 int http_msg_set_header(http_msg_t *msg, const char *name, const char *value)
 {
-    return http_msg_list_add(&msg->header, name, value);
+    return http_msg_list_add(msg, name, value);
+}
+
+http_msg_header_t *http_msg_get_header(http_msg_t *msg, const char *name)
+{
+    http_msg_header_t *header = NULL;
+    unsigned hash = 0;
+
+    hash = http_msg_header_hash(name);
+    header = msg->bucket[hash & (HTTP_MSG_NUM_BUCKETS - 1)];
+    while (header != NULL)
+    {
+        if ((header->hash == hash)
+         && (strcasecmp(header->name, name) == 0))
+        {
+            return header;
+        }
+        header = header->bucket_next;
+    }
+    return NULL;
+}
+
+int http_msg_header_set_value(http_msg_t *msg, http_msg_header_t *header, const char *value)
+{
+    char *str = NULL;
+
+    /* the old value is abandoned in the arena and reclaimed */
+    /* when the message is destroyed */
+    str = http_msg_arena_strdup(msg, value);
+    if (str == NULL)
+    {
+        return -ENOMEM;
+    }
+    header->value = str;
+    return 0;
 }
 
 int http_msg_set_body(http_msg_t *msg, const char *buf, size_t len)
@@ -609,6 +853,16 @@ int http_msg_set_body(http_msg_t *msg, const char *buf, size_t len)
     return 0;
 }
 
+void http_msg_adopt_body(http_msg_t *msg, char *buf, size_t len)
+{
+    if (msg->body != NULL)
+    {
+        free(msg->body);
+    }
+    msg->body = buf;
+    msg->body_len = len;
+}
+
 size_t http_msg_generate(http_msg_t *msg, char *buf, size_t len)
 {
     http_msg_header_t *header = NULL;
@@ -650,6 +904,32 @@ size_t http_msg_generate(http_msg_t *msg, char *buf, size_t len)
     return str_len;
 }
 
+size_t http_msg_generate_headers(http_msg_t *msg, char *buf, size_t len)
+{
+    http_msg_header_t *header = NULL;
+    size_t str_len = 0;
+
+    memset(buf, 0, len);
+    str_len = util_strncat(buf, msg->start[0], str_len, len);
+    str_len = util_strncat(buf, " ", str_len, len);
+    str_len = util_strncat(buf, msg->start[1], str_len, len);
+    str_len = util_strncat(buf, " ", str_len, len);
+    str_len = util_strncat(buf, msg->start[2], str_len, len);
+    str_len = util_strncat(buf, "\r\n", str_len, len);
+
+    header = msg->header.first;
+    while (header != NULL)
+    {
+        str_len = util_strncat(buf, header->name, str_len, len);
+        str_len = util_strncat(buf, ": ", str_len, len);
+        str_len = util_strncat(buf, header->value, str_len, len);
+        str_len = util_strncat(buf, "\r\n", str_len, len);
+        header = header->next;
+    }
+    str_len = util_strncat(buf, "\r\n", str_len, len);
+    return str_len;
+}
+
 size_t http_msg_generate_chunk(char *out, size_t out_len, const char *in, size_t in_len)
 {
     size_t target = 0;
@@ -31,6 +31,8 @@
  *  @brief Source file for the FreeCoAP thread module
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include "thread.h"
 
@@ -112,3 +114,163 @@ void thread_block_signals(void)
     sigfillset(&signal_set);
     pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
 }
+
+/* main function for a worker thread in a thread pool,
+ * takes work items from the handoff queue and passes
+ * them to the work function, exits when the pool is
+ * stopped and the queue is empty
+ */
+static void *thread_pool_worker_func(void *data)
+{
+    thread_pool_t *pool = (thread_pool_t *)data;
+    void *item = NULL;
+
+    thread_block_signals();
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while ((pool->count == 0) && (!pool->stop))
+        {
+            pthread_cond_wait(&pool->not_empty, &pool->mutex);
+        }
+        if (pool->count == 0)  /* stopped and drained */
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        item = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->queue_size;
+        pool->count--;
+        pthread_cond_signal(&pool->not_full);
+        pthread_mutex_unlock(&pool->mutex);
+        (*pool->func)(item);
+    }
+    return NULL;
+}
+
+int thread_pool_create(thread_pool_t *pool, unsigned num_worker, unsigned queue_size, void *(*func)(void *))
+{
+    unsigned i = 0;
+    void *result = NULL;
+    int ret = 0;
+
+    memset(pool, 0, sizeof(thread_pool_t));
+    pool->num_worker = num_worker;
+    pool->queue_size = queue_size;
+    pool->func = func;
+    pool->queue = (void **)calloc(queue_size, sizeof(void *));
+    if (pool->queue == NULL)
+    {
+        return -1;
+    }
+    pool->worker = (thread_t *)calloc(num_worker, sizeof(thread_t));
+    if (pool->worker == NULL)
+    {
+        free(pool->queue);
+        return -1;
+    }
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+    {
+        free(pool->worker);
+        free(pool->queue);
+        return -1;
+    }
+    if (pthread_cond_init(&pool->not_empty, NULL) != 0)
+    {
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->worker);
+        free(pool->queue);
+        return -1;
+    }
+    if (pthread_cond_init(&pool->not_full, NULL) != 0)
+    {
+        pthread_cond_destroy(&pool->not_empty);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->worker);
+        free(pool->queue);
+        return -1;
+    }
+    ret = thread_joinable_ctx_create(&pool->ctx);
+    if (ret < 0)
+    {
+        pthread_cond_destroy(&pool->not_full);
+        pthread_cond_destroy(&pool->not_empty);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->worker);
+        free(pool->queue);
+        return -1;
+    }
+    for (i = 0; i < num_worker; i++)
+    {
+        ret = thread_init(&pool->worker[i], &pool->ctx, thread_pool_worker_func, pool);
+        if (ret < 0)
+        {
+            pthread_mutex_lock(&pool->mutex);
+            pool->stop = 1;
+            pthread_cond_broadcast(&pool->not_empty);
+            pthread_mutex_unlock(&pool->mutex);
+            while (i > 0)
+            {
+                thread_join(&pool->worker[--i], &result);
+            }
+            thread_ctx_destroy(&pool->ctx);
+            pthread_cond_destroy(&pool->not_full);
+            pthread_cond_destroy(&pool->not_empty);
+            pthread_mutex_destroy(&pool->mutex);
+            free(pool->worker);
+            free(pool->queue);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* any work items still queued when the pool is destroyed
+ * are processed by the workers before they exit
+ */
+void thread_pool_destroy(thread_pool_t *pool)
+{
+    unsigned i = 0;
+    void *result = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_cond_broadcast(&pool->not_full);
+    pthread_mutex_unlock(&pool->mutex);
+    for (i = 0; i < pool->num_worker; i++)
+    {
+        thread_join(&pool->worker[i], &result);
+    }
+    thread_ctx_destroy(&pool->ctx);
+    pthread_cond_destroy(&pool->not_full);
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->worker);
+    free(pool->queue);
+    memset(pool, 0, sizeof(thread_pool_t));
+}
+
+/* blocks while the handoff queue is full so that the
+ * caller is held back rather than queueing unbounded
+ * amounts of work
+ */
+int thread_pool_dispatch(thread_pool_t *pool, void *data)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while ((pool->count == pool->queue_size) && (!pool->stop))
+    {
+        pthread_cond_wait(&pool->not_full, &pool->mutex);
+    }
+    if (pool->stop)
+    {
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+    pool->queue[(pool->head + pool->count) % pool->queue_size] = data;
+    pool->count++;
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
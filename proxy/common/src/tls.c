@@ -33,11 +33,14 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "tls.h"
 #include "util.h"
 
 static int _tls_init = 0;
 static gnutls_priority_t _tls_priority_cache = NULL;
+static size_t _tls_server_cache_size = TLS_SERVER_CACHE_SIZE;
+static unsigned _tls_server_session_lifetime = TLS_SERVER_DEF_SESSION_LIFETIME;
 
 int tls_init(void)
 {
@@ -152,6 +155,14 @@ static gnutls_datum_t tls_client_cache_get(tls_client_cache_t *cache, char *addr
 
 int tls_client_create(tls_client_t *client, const char *trust_file_name, const char *cert_file_name, const char *key_file_name)
 {
+#ifdef TLS_CLIENT_AUTH
+    gnutls_datum_t cert_datum = {0};
+    gnutls_datum_t key_datum = {0};
+    long cert_len = 0;
+    long key_len = 0;
+#endif
+    gnutls_datum_t trust_datum = {0};
+    long trust_len = 0;
     int ret = 0;
 
     memset(client, 0, sizeof(tls_client_t));
@@ -163,7 +174,17 @@ int tls_client_create(tls_client_t *client, const char *trust_file_name, const c
         return SOCK_TLS_INIT_ERROR;
     }
 
-    ret = gnutls_certificate_set_x509_trust_file(client->cred, trust_file_name, GNUTLS_X509_FMT_PEM);
+    /* credential files are read once into a process-wide cache of */
+    /* read-only mappings and shared by every client and server */
+    trust_len = util_load_cred_file(trust_file_name, (const char **)&trust_datum.data);
+    if (trust_len <= 0)
+    {
+        gnutls_certificate_free_credentials(client->cred);
+        memset(client, 0, sizeof(tls_client_t));
+        return SOCK_TLS_TRUST_ERROR;
+    }
+    trust_datum.size = trust_len;
+    ret = gnutls_certificate_set_x509_trust_mem(client->cred, &trust_datum, GNUTLS_X509_FMT_PEM);
     if (ret < 0)
     {
         gnutls_certificate_free_credentials(client->cred);
@@ -174,7 +195,17 @@ int tls_client_create(tls_client_t *client, const char *trust_file_name, const c
 #ifdef TLS_CLIENT_AUTH
     if ((cert_file_name != NULL) && (key_file_name != NULL))
     {
-        ret = gnutls_certificate_set_x509_key_file(client->cred, cert_file_name, key_file_name, GNUTLS_X509_FMT_PEM);
+        cert_len = util_load_cred_file(cert_file_name, (const char **)&cert_datum.data);
+        key_len = util_load_cred_file(key_file_name, (const char **)&key_datum.data);
+        if ((cert_len <= 0) || (key_len <= 0))
+        {
+            gnutls_certificate_free_credentials(client->cred);
+            memset(client, 0, sizeof(tls_client_t));
+            return SOCK_TLS_CRED_ERROR;
+        }
+        cert_datum.size = cert_len;
+        key_datum.size = key_len;
+        ret = gnutls_certificate_set_x509_key_mem(client->cred, &cert_datum, &key_datum, GNUTLS_X509_FMT_PEM);
         if (ret != GNUTLS_E_SUCCESS)
         {
             gnutls_certificate_free_credentials(client->cred);
@@ -287,6 +318,20 @@ gnutls_datum_t tls_client_get(tls_client_t *client, char *addr)
     return res;
 }
 
+/* override the session cache size and lifetime used by */
+/* tls_server_create, must be called before tls_server_create */
+void tls_server_set_cache_params(size_t cache_size, unsigned session_lifetime)
+{
+    if (cache_size > 0)
+    {
+        _tls_server_cache_size = cache_size;
+    }
+    if (session_lifetime > 0)
+    {
+        _tls_server_session_lifetime = session_lifetime;
+    }
+}
+
 static int tls_server_cache_create(tls_server_cache_t *cache, size_t size)
 {
     memset(cache, 0, sizeof(tls_server_cache_t));
@@ -310,7 +355,7 @@ static void tls_server_cache_destroy(tls_server_cache_t *cache)
     memset(cache, 0, sizeof(tls_server_cache_t));
 }
 
-static int tls_server_cache_set(tls_server_cache_t *cache, gnutls_datum_t key, gnutls_datum_t data)
+static int tls_server_cache_set(tls_server_cache_t *cache, gnutls_datum_t key, gnutls_datum_t data, unsigned lifetime)
 {
     if ((key.size > TLS_SERVER_MAX_SESSION_ID_SIZE) || (data.size > TLS_SERVER_MAX_SESSION_DATA_SIZE))
     {
@@ -323,6 +368,8 @@ static int tls_server_cache_set(tls_server_cache_t *cache, gnutls_datum_t key, g
     memcpy(cache->element[cache->index].session_data, data.data, data.size);
     cache->element[cache->index].session_data_size = data.size;
 
+    cache->element[cache->index].expire = time(NULL) + lifetime;
+
     cache->index++;
     cache->index %= cache->size;
 
@@ -342,6 +389,12 @@ static gnutls_datum_t tls_server_cache_get(tls_server_cache_t *cache, gnutls_dat
         if ((key.size == cache->element[i].session_id_size)
          && (memcmp(key.data, cache->element[i].session_id, key.size) == 0))
         {
+            if ((cache->element[i].expire != 0) && (time(NULL) > cache->element[i].expire))
+            {
+                /* expired element, treat as a miss */
+                memset(&cache->element[i], 0, sizeof(tls_server_cache_element_t));
+                break;
+            }
             res.size = cache->element[i].session_data_size;
             res.data = (unsigned char *)gnutls_malloc(res.size);
             if (res.data != NULL)
@@ -372,6 +425,14 @@ static int tls_server_cache_delete(tls_server_cache_t *cache, gnutls_datum_t key
 
 int tls_server_create(tls_server_t *server, const char *trust_file_name, const char *cert_file_name, const char *key_file_name)
 {
+#ifdef TLS_CLIENT_AUTH
+    gnutls_datum_t trust_datum = {0};
+    long trust_len = 0;
+#endif
+    gnutls_datum_t cert_datum = {0};
+    gnutls_datum_t key_datum = {0};
+    long cert_len = 0;
+    long key_len = 0;
     int ret = 0;
 
     memset(server, 0, sizeof(tls_server_t));
@@ -383,10 +444,20 @@ int tls_server_create(tls_server_t *server, const char *trust_file_name, const c
         return SOCK_TLS_INIT_ERROR;
     }
 
+    /* credential files are read once into a process-wide cache of */
+    /* read-only mappings and shared by every client and server */
 #ifdef TLS_CLIENT_AUTH
     if (trust_file_name != NULL)
     {
-        ret = gnutls_certificate_set_x509_trust_file(server->cred, trust_file_name, GNUTLS_X509_FMT_PEM);
+        trust_len = util_load_cred_file(trust_file_name, (const char **)&trust_datum.data);
+        if (trust_len <= 0)
+        {
+            gnutls_certificate_free_credentials(server->cred);
+            memset(server, 0, sizeof(tls_server_t));
+            return SOCK_TLS_TRUST_ERROR;
+        }
+        trust_datum.size = trust_len;
+        ret = gnutls_certificate_set_x509_trust_mem(server->cred, &trust_datum, GNUTLS_X509_FMT_PEM);
         if (ret < 0)
         {
             gnutls_certificate_free_credentials(server->cred);
@@ -407,7 +478,17 @@ int tls_server_create(tls_server_t *server, const char *trust_file_name, const c
     }
 #endif
 
-    ret = gnutls_certificate_set_x509_key_file(server->cred, cert_file_name, key_file_name, GNUTLS_X509_FMT_PEM);
+    cert_len = util_load_cred_file(cert_file_name, (const char **)&cert_datum.data);
+    key_len = util_load_cred_file(key_file_name, (const char **)&key_datum.data);
+    if ((cert_len <= 0) || (key_len <= 0))
+    {
+        gnutls_certificate_free_credentials(server->cred);
+        memset(server, 0, sizeof(tls_server_t));
+        return SOCK_TLS_CRED_ERROR;
+    }
+    cert_datum.size = cert_len;
+    key_datum.size = key_len;
+    ret = gnutls_certificate_set_x509_key_mem(server->cred, &cert_datum, &key_datum, GNUTLS_X509_FMT_PEM);
     if (ret != GNUTLS_E_SUCCESS)
     {
         gnutls_certificate_free_credentials(server->cred);
@@ -434,7 +515,7 @@ int tls_server_create(tls_server_t *server, const char *trust_file_name, const c
 
     gnutls_certificate_set_dh_params(server->cred, server->dh_params);
 
-    ret = tls_server_cache_create(&server->cache, TLS_SERVER_CACHE_SIZE);
+    ret = tls_server_cache_create(&server->cache, _tls_server_cache_size);
     if (ret != SOCK_OK)
     {
         gnutls_dh_params_deinit(server->dh_params);
@@ -443,9 +524,23 @@ int tls_server_create(tls_server_t *server, const char *trust_file_name, const c
         return ret;
     }
 
+    server->session_lifetime = _tls_server_session_lifetime;
+
+    /* generate the key used to protect session tickets */
+    ret = gnutls_session_ticket_key_generate(&server->ticket_key);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        tls_server_cache_destroy(&server->cache);
+        gnutls_dh_params_deinit(server->dh_params);
+        gnutls_certificate_free_credentials(server->cred);
+        memset(server, 0, sizeof(tls_server_t));
+        return SOCK_TLS_INIT_ERROR;
+    }
+
     ret = lock_create(&server->lock);
     if (ret < 0)
     {
+        gnutls_free(server->ticket_key.data);
         tls_server_cache_destroy(&server->cache);
         gnutls_dh_params_deinit(server->dh_params);
         gnutls_certificate_free_credentials(server->cred);
@@ -459,6 +554,7 @@ int tls_server_create(tls_server_t *server, const char *trust_file_name, const c
 void tls_server_destroy(tls_server_t *server)
 {
     lock_destroy(&server->lock);
+    gnutls_free(server->ticket_key.data);
     gnutls_dh_params_deinit(server->dh_params);
     gnutls_certificate_free_credentials(server->cred);
     tls_server_cache_destroy(&server->cache);
@@ -476,7 +572,7 @@ int tls_server_set(void *buf, gnutls_datum_t key, gnutls_datum_t data)
     {
         return SOCK_LOCK_ERROR;
     }
-    status = tls_server_cache_set(&server->cache, key, data);
+    status = tls_server_cache_set(&server->cache, key, data, server->session_lifetime);
     ret = lock_put(&server->lock);
     if (ret < 0)
     {
@@ -213,6 +213,16 @@ int tls_sock_open_(tls_sock_t *s, const char *common_name, int timeout)
         gnutls_db_set_store_function(s->session, tls_server_set);
         gnutls_db_set_retrieve_function(s->session, tls_server_get);
         gnutls_db_set_remove_function(s->session, tls_server_delete);
+        gnutls_db_set_cache_expiration(s->session, tls_server_get_session_lifetime(s->u.server));
+
+        /* allow stateless resumption via session tickets */
+        ret = gnutls_session_ticket_enable_server(s->session, tls_server_get_ticket_key(s->u.server));
+        if (ret != GNUTLS_E_SUCCESS)
+        {
+            gnutls_deinit(s->session);
+            close(s->sd);
+            return SOCK_TLS_CONFIG_ERROR;
+        }
 
 #ifdef TLS_CLIENT_AUTH
         /* request client authentication */
@@ -662,7 +672,77 @@ ssize_t tls_sock_write_full(tls_sock_t *s, void *buf, size_t len)
     return total_bytes;
 }
 
-int tls_ssock_open(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog)
+/*  write a vector of fragments as coalesced TLS records
+ *
+ *  the session is corked while the fragments are queued and
+ *  uncorked to transmit them, so adjacent fragments share TLS
+ *  records instead of each fragment becoming its own record
+ *
+ *  return { > 0, number of bytes written
+ *         {   0, nothing to write
+ *         { < 0, error
+ */
+ssize_t tls_sock_writev(tls_sock_t *s, const struct iovec *iov, int iovcnt)
+{
+    struct timeval tv = {0};
+    fd_set writefds = {{0}};
+    ssize_t total = 0;
+    ssize_t num = 0;
+    int ret = 0;
+    int i = 0;
+
+    gnutls_record_cork(s->session);
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].iov_len == 0)
+        {
+            continue;
+        }
+        /* while the session is corked the data is only queued */
+        num = gnutls_record_send(s->session, iov[i].iov_base, iov[i].iov_len);
+        if (num < 0)
+        {
+            gnutls_record_discard_queued(s->session);
+            return SOCK_WRITE_ERROR;
+        }
+        total += num;
+    }
+    tv.tv_sec = s->timeout;
+    tv.tv_usec = 0;
+    while (1)
+    {
+        num = gnutls_record_uncork(s->session, 0);
+        if (num == GNUTLS_E_INTERRUPTED)
+        {
+            return SOCK_INTR;
+        }
+        if ((num < 0) && (num != GNUTLS_E_AGAIN))
+        {
+            return SOCK_WRITE_ERROR;
+        }
+        if (gnutls_record_check_corked(s->session) == 0)
+        {
+            return total;
+        }
+        FD_ZERO(&writefds);
+        FD_SET(s->sd, &writefds);
+        ret = select(s->sd + 1, NULL, &writefds, &writefds, &tv);
+        if (ret == 0)
+        {
+            return SOCK_TIMEOUT;
+        }
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+            {
+                return SOCK_INTR;
+            }
+            return SOCK_WRITE_ERROR;
+        }
+    }
+}
+
+static int tls_ssock_open_(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog, int shared)
 {
     int opt_val = 0;
     int ret = 0;
@@ -692,6 +772,19 @@ int tls_ssock_open(tls_ssock_t *ss, tls_server_t *server, const char *port, int
         return SOCK_CONFIG_ERROR;
     }
 
+    if (shared)
+    {
+        /* allow several server sockets to bind to the same port, */
+        /* the kernel distributes incoming connections between them */
+        opt_val = 1;
+        ret = setsockopt(ss->sd, SOL_SOCKET, SO_REUSEPORT, &opt_val, (socklen_t)sizeof(opt_val));
+        if (ret < 0)
+        {
+            close(ss->sd);
+            return SOCK_CONFIG_ERROR;
+        }
+    }
+
     /* initialise the sin structure */
     memset(&ss->sin, 0, sizeof(ss->sin));
     ss->sin.SOCK_SIN_FAMILY = SOCK_AF_INET;
@@ -728,6 +821,16 @@ int tls_ssock_open(tls_ssock_t *ss, tls_server_t *server, const char *port, int
     return SOCK_OK;
 }
 
+int tls_ssock_open(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog)
+{
+    return tls_ssock_open_(ss, server, port, timeout, backlog, 0);
+}
+
+int tls_ssock_open_shared(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog)
+{
+    return tls_ssock_open_(ss, server, port, timeout, backlog, 1);
+}
+
 void tls_ssock_close(tls_ssock_t *ss)
 {
     close(ss->sd);
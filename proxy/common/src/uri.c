@@ -718,6 +718,293 @@ int uri_parse(uri_t *uri, const char *str)
     return 0;
 }
 
+/**
+ *  @brief Find a character in a bounded string
+ *
+ *  @param[in] start Start of the string
+ *  @param[in] end End of the string (one past the last character)
+ *  @param[in] c Character to find
+ *
+ *  @returns Pointer to the location of the character or NULL
+ */
+static const char *uri_view_find(const char *start, const char *end, char c)
+{
+    while (start < end)
+    {
+        if (*start == c)
+        {
+            return start;
+        }
+        start++;
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Locate the port field in a bounded string
+ *
+ *  Bounded equivalent of uri_find_port, the ':' character
+ *  that marks the start of the port field is the first one
+ *  not enclosed within '[' and ']'.
+ *
+ *  @param[in] start Start of the string
+ *  @param[in] end End of the string (one past the last character)
+ *
+ *  @returns Pointer to the location of the port field or NULL
+ */
+static const char *uri_view_find_port(const char *start, const char *end)
+{
+    int in = 0;
+
+    while (start < end)
+    {
+        if (!in)
+        {
+            if (*start == '[')
+            {
+                in = 1;
+            }
+        }
+        else
+        {
+            if (*start == ']')
+            {
+                in = 0;
+            }
+        }
+        if ((!in) && (*start == ':'))
+        {
+            return start;
+        }
+        start++;
+    }
+    return NULL;
+}
+
+int uri_parse_view(uri_view_t *view, const char *str)
+{
+    const char *end = NULL;
+    const char *p = NULL;
+    const char *q = NULL;
+    const char *r = NULL;
+
+    if ((view == NULL) || (str == NULL))
+    {
+        return -EINVAL;
+    }
+    memset(view, 0, sizeof(uri_view_t));
+    p = str;
+
+    /* scheme */
+    if (*p != '/')
+    {
+        q = strchr(p, ':');
+        if (q != NULL)
+        {
+            if (q > p)
+            {
+                view->scheme = p;
+                view->scheme_len = q - p;
+            }
+            p = q + 1;
+        }
+    }
+
+    /* the hierarchy part ends at the first '?' or '#' */
+    end = p + strcspn(p, "?#");
+    if ((end - p >= 2) && (p[0] == '/') && (p[1] == '/'))
+    {
+        /* authority and path */
+        p += 2;
+        q = uri_view_find(p, end, '@');
+        if (q != NULL)
+        {
+            view->userinfo = p;
+            view->userinfo_len = q - p;
+            p = q + 1;
+        }
+        q = uri_view_find_port(p, end);
+        r = uri_view_find((q != NULL) ? q + 1 : p, end, '/');
+        if (r != NULL)
+        {
+            /* the path view includes the leading forward slash */
+            view->path = r;
+            view->path_len = end - r;
+        }
+        if (q != NULL)
+        {
+            view->port = q + 1;
+            view->port_len = ((r != NULL) ? r : end) - (q + 1);
+        }
+        else
+        {
+            q = (r != NULL) ? r : end;
+        }
+
+        /* host */
+        if ((q - p >= 2) && (*p == '[') && (*(q - 1) == ']'))
+        {
+            /* strip enclosing '[' and ']' from IPv6 address */
+            p++;
+            q--;
+        }
+        if (q > p)
+        {
+            view->host = p;
+            view->host_len = q - p;
+        }
+    }
+    else if (end > p)
+    {
+        /* path only */
+        view->path = p;
+        view->path_len = end - p;
+    }
+    p = end;
+
+    /* query */
+    if (*p == '?')
+    {
+        p++;
+        end = p + strcspn(p, "#");
+        view->query = p;
+        view->query_len = end - p;
+        p = end;
+    }
+
+    /* fragment */
+    if (*p == '#')
+    {
+        p++;
+        view->fragment = p;
+        view->fragment_len = strlen(p);
+    }
+    return 0;
+}
+
+/**
+ *  @brief Percent-decode a bounded string into a destination string
+ *
+ *  @param[out] dest Destination string
+ *  @param[in] src Source string
+ *  @param[in] src_len Length of the source string
+ *  @param[in] dest_len Total length of the destination string including space for the terminating '\0'
+ *
+ *  @returns Length of the destination string or error code
+ *  @retval >=0 Length of the destination string
+ *  @retval -1 Error
+ */
+static ssize_t uri_decode_view_str(char *dest, const char *src, size_t src_len, size_t dest_len)
+{
+    size_t num = 0;
+    size_t i = 0;
+    int c = 0;
+
+    while (i < src_len)
+    {
+        if (src[i] == '%')
+        {
+            if (i + 2 >= src_len)
+            {
+                return -1;
+            }
+            c = uri_2_hex_to_int(&src[i + 1]);
+            if (c == -1)
+            {
+                return -1;
+            }
+            i += 3;
+        }
+        else
+        {
+            c = src[i++];
+        }
+        if (num + 1 < dest_len)
+        {
+            dest[num] = c;
+        }
+        num++;
+    }
+    return num;
+}
+
+/**
+ *  @brief Allocate and percent-decode a URI component from a view
+ *
+ *  @param[out] dest Double pointer to hold the component
+ *  @param[in] src Source string
+ *  @param[in] src_len Length of the source string
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int uri_materialize_component(char **dest, const char *src, size_t src_len)
+{
+    ssize_t num = 0;
+
+    *dest = (char *)calloc(src_len + 1, 1);
+    if (*dest == NULL)
+    {
+        return -ENOMEM;
+    }
+    num = uri_decode_view_str(*dest, src, src_len, src_len + 1);
+    if ((num == -1) || (num > src_len))
+    {
+        free(*dest);
+        *dest = NULL;
+        return -EBADMSG;
+    }
+    return 0;
+}
+
+int uri_view_materialize(uri_t *uri, const uri_view_t *view)
+{
+    int ret = 0;
+
+    if ((uri == NULL) || (view == NULL))
+    {
+        return -EINVAL;
+    }
+
+    uri_destroy(uri);
+
+    if (view->scheme != NULL)
+    {
+        ret = uri_materialize_component(&uri->scheme, view->scheme, view->scheme_len);
+    }
+    if ((ret == 0) && (view->userinfo != NULL))
+    {
+        ret = uri_materialize_component(&uri->userinfo, view->userinfo, view->userinfo_len);
+    }
+    if ((ret == 0) && (view->host != NULL))
+    {
+        ret = uri_materialize_component(&uri->host, view->host, view->host_len);
+    }
+    if ((ret == 0) && (view->port != NULL))
+    {
+        ret = uri_materialize_component(&uri->port, view->port, view->port_len);
+    }
+    if ((ret == 0) && (view->path != NULL))
+    {
+        ret = uri_materialize_component(&uri->path, view->path, view->path_len);
+    }
+    if ((ret == 0) && (view->query != NULL))
+    {
+        ret = uri_materialize_component(&uri->query, view->query, view->query_len);
+    }
+    if ((ret == 0) && (view->fragment != NULL))
+    {
+        ret = uri_materialize_component(&uri->fragment, view->fragment, view->fragment_len);
+    }
+    if (ret < 0)
+    {
+        uri_destroy(uri);
+        return ret;
+    }
+    return 0;
+}
+
 int uri_copy(uri_t *dest, uri_t *src)
 {
     if ((dest == NULL) || (src == NULL))
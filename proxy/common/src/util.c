@@ -33,6 +33,12 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "util.h"
 
 /*  always writes a terminating null character if dst_len > 0
@@ -149,3 +155,137 @@ long util_load_txt_file(const char *file_name, char **buf)
     }
     return num;
 }
+
+/*  map a file into memory read-only, the pages are shared with the
+ *  page cache so repeated loads of the same file do not duplicate RSS
+ *  returns: {>=0, file size in bytes
+ *           {UTIL_FILE_ERROR, file not found or unreadable
+ */
+long util_load_file_mmap(const char *file_name, char **buf)
+{
+    struct stat stat_buf = {0};
+    void *addr = NULL;
+    int fd = -1;
+
+    *buf = NULL;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd == -1)
+    {
+        return UTIL_FILE_ERROR;
+    }
+    if (fstat(fd, &stat_buf) == -1)
+    {
+        close(fd);
+        return UTIL_FILE_ERROR;
+    }
+    if (stat_buf.st_size == 0)
+    {
+        /* a mapping of length zero is invalid */
+        close(fd);
+        return 0;
+    }
+    addr = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  /* the mapping remains valid after the descriptor is closed */
+    if (addr == MAP_FAILED)
+    {
+        return UTIL_FILE_ERROR;
+    }
+    *buf = (char *)addr;
+    return (long)stat_buf.st_size;
+}
+
+void util_unload_file_mmap(char *buf, long len)
+{
+    if ((buf != NULL) && (len > 0))
+    {
+        munmap(buf, len);
+    }
+}
+
+typedef struct util_cred  /**< entry in the credential file cache */
+{
+    char *file_name;
+    char *buf;
+    long len;
+    struct util_cred *next;
+}
+util_cred_t;
+
+static util_cred_t *util_cred_list = NULL;
+static pthread_mutex_t util_cred_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*  load a credential file into a process-wide cache of read-only
+ *  mappings, each file is mapped at most once and the same buffer
+ *  is returned to every caller, the cache holds the mappings until
+ *  util_unload_cred_files() is called
+ *  returns: {>0, file size in bytes
+ *           {UTIL_FILE_ERROR, file not found, unreadable or empty
+ *           {UTIL_NOMEM_ERROR, no memory
+ */
+long util_load_cred_file(const char *file_name, const char **buf)
+{
+    util_cred_t *cred = NULL;
+    long len = 0;
+
+    *buf = NULL;
+
+    pthread_mutex_lock(&util_cred_mutex);
+    for (cred = util_cred_list; cred != NULL; cred = cred->next)
+    {
+        if (strcmp(cred->file_name, file_name) == 0)
+        {
+            *buf = cred->buf;
+            len = cred->len;
+            pthread_mutex_unlock(&util_cred_mutex);
+            return len;
+        }
+    }
+    cred = (util_cred_t *)calloc(1, sizeof(util_cred_t));
+    if (cred == NULL)
+    {
+        pthread_mutex_unlock(&util_cred_mutex);
+        return UTIL_NOMEM_ERROR;
+    }
+    cred->file_name = strdup(file_name);
+    if (cred->file_name == NULL)
+    {
+        free(cred);
+        pthread_mutex_unlock(&util_cred_mutex);
+        return UTIL_NOMEM_ERROR;
+    }
+    len = util_load_file_mmap(file_name, &cred->buf);
+    if (len <= 0)
+    {
+        free(cred->file_name);
+        free(cred);
+        pthread_mutex_unlock(&util_cred_mutex);
+        return (len == 0) ? UTIL_FILE_ERROR : len;
+    }
+    cred->len = len;
+    cred->next = util_cred_list;
+    util_cred_list = cred;
+    *buf = cred->buf;
+    pthread_mutex_unlock(&util_cred_mutex);
+    return len;
+}
+
+/*  unmap and forget every cached credential file, buffers previously
+ *  returned by util_load_cred_file() become invalid
+ */
+void util_unload_cred_files(void)
+{
+    util_cred_t *cred = NULL;
+    util_cred_t *next = NULL;
+
+    pthread_mutex_lock(&util_cred_mutex);
+    for (cred = util_cred_list; cred != NULL; cred = next)
+    {
+        next = cred->next;
+        util_unload_file_mmap(cred->buf, cred->len);
+        free(cred->file_name);
+        free(cred);
+    }
+    util_cred_list = NULL;
+    pthread_mutex_unlock(&util_cred_mutex);
+}
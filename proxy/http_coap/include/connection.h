@@ -35,12 +35,12 @@
 #define CONNECTION_H
 
 #include <netinet/in.h>
-#include "coap_client.h"
+#include <time.h>
 #include "tls_sock.h"
 #include "data_buf.h"
 #include "param.h"
 
-typedef struct
+typedef struct connection_t
 {
     unsigned listener_index;
     unsigned con_index;
@@ -50,10 +50,10 @@ typedef struct
     data_buf_t recv_buf;
     data_buf_t send_buf;
     param_t *param;
-    int coap_client_active;
-    char *coap_client_host;
-    char *coap_client_port;
-    coap_client_t coap_client;
+    void *engine;                                                               /* engine that drives the connection, NULL in thread-per-connection mode */
+    time_t park_time;                                                           /* time at which the connection was parked in the engine */
+    struct connection_t *park_next;                                             /* next connection in the engine idle list */
+    struct connection_t *park_prev;                                             /* previous connection in the engine idle list */
 }
 connection_t;
 
@@ -62,4 +62,19 @@ void *connection_thread_func(void *data);
 connection_t *connection_new(tls_sock_t *sock, unsigned listener_index, unsigned con_index, param_t *param);
 void connection_delete(connection_t *con);
 
+/*  perform one request/response exchange with the HTTP client,
+ *  continuing until any pipelined requests already held in the
+ *  receive buffer have been processed and answered in order
+ *  return: { 0, success, the connection should be kept open
+ *          {>0, timeout or closed remotely, the connection should be closed
+ *          {<0, error, the connection should be closed
+ */
+int connection_handle(connection_t *con);
+
+/*  log the outcome of a connection and delete it
+ *  status: {>=0, connection successful
+ *          {< 0, connection failed
+ */
+void connection_close(connection_t *con, int status);
+
 #endif
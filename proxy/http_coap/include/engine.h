@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file engine.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy connection engine module
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <pthread.h>
+#include "connection.h"
+#include "thread.h"
+
+/**
+ *  @brief Connection engine structure
+ *
+ *  The engine multiplexes many HTTP client connections over
+ *  a single epoll instance so that an idle connection does
+ *  not occupy a thread. A connection that becomes readable
+ *  is dispatched to a worker thread for one request/response
+ *  exchange and then parked in the epoll instance again.
+ */
+typedef struct
+{
+    int epfd;                                                                   /**< epoll instance that monitors the parked connections */
+    int wakeup[2];                                                              /**< Pipe used to wake the event-loop thread */
+    pthread_mutex_t mutex;                                                      /**< Mutex that protects the list of parked connections */
+    connection_t *idle_first;                                                   /**< Least recently parked connection */
+    connection_t *idle_last;                                                    /**< Most recently parked connection */
+    thread_pool_t pool;                                                         /**< Pool of worker threads that process the exchanges */
+    thread_ctx_t ctx;                                                           /**< Thread context for the event-loop thread */
+    thread_t thread;                                                            /**< Event-loop thread */
+    int stop;                                                                   /**< Indicates to the event-loop thread to stop */
+}
+engine_t;
+
+int engine_create(engine_t *engine, unsigned num_worker, unsigned queue_size);
+void engine_destroy(engine_t *engine);
+int engine_add(engine_t *engine, connection_t *con);
+
+#endif
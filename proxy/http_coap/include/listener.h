@@ -37,6 +37,7 @@
 #include "tls_sock.h"
 #include "tls.h"
 #include "thread.h"
+#include "engine.h"
 #include "param.h"
 
 typedef struct
@@ -44,6 +45,9 @@ typedef struct
     unsigned index;
     param_t *param;
     thread_ctx_t ctx;
+    int engine_mode;
+    engine_t engine;
+    thread_pool_t pool;
     tls_ssock_t ssock;
 }
 listener_t;
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file metrics.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy metrics module
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#define METRICS_HIST_NUM_BUCKETS  24                                            /**< Number of histogram buckets, bucket i counts durations below 2^i usec */
+
+/**
+ *  @brief Latency histogram structure
+ *
+ *  Durations are recorded in microseconds into buckets
+ *  that double in width, bucket i counts durations of
+ *  less than 2^i microseconds.
+ */
+typedef struct
+{
+    unsigned long bucket[METRICS_HIST_NUM_BUCKETS];                             /**< Number of recorded durations per bucket */
+    unsigned long count;                                                        /**< Total number of recorded durations */
+}
+metrics_hist_t;
+
+/**
+ *  @brief Metrics structure
+ *
+ *  All fields are updated with relaxed atomic operations so
+ *  that recording a metric costs no more than an atomic
+ *  increment on the hot path.
+ */
+typedef struct
+{
+    unsigned long accepts;                                                      /**< Number of connections accepted */
+    unsigned long active_cons;                                                  /**< Number of connections currently open */
+    unsigned long requests;                                                     /**< Number of requests received from HTTP clients */
+    unsigned long upstream_exchanges;                                           /**< Number of exchanges with CoAP servers */
+    unsigned long cache_hits;                                                   /**< Number of responses served from the response cache */
+    unsigned long tls_resumptions;                                              /**< Number of resumed TLS sessions with HTTP clients */
+    unsigned long bytes_in;                                                     /**< Number of body and header bytes received from HTTP clients */
+    unsigned long bytes_out;                                                    /**< Number of body and header bytes sent to HTTP clients */
+    metrics_hist_t parse_hist;                                                  /**< Request parse latency */
+    metrics_hist_t translate_hist;                                              /**< HTTP/CoAP translation latency */
+    metrics_hist_t upstream_hist;                                               /**< Upstream exchange latency */
+}
+metrics_t;
+
+extern metrics_t metrics;
+
+#define metrics_inc(field)       __atomic_fetch_add(&metrics.field, 1, __ATOMIC_RELAXED)      /**< Increment a counter */
+#define metrics_dec(field)       __atomic_fetch_sub(&metrics.field, 1, __ATOMIC_RELAXED)      /**< Decrement a counter */
+#define metrics_add(field, num)  __atomic_fetch_add(&metrics.field, (unsigned long)(num), __ATOMIC_RELAXED)  /**< Add to a counter */
+
+/**
+ *  @brief Get the current time for use with metrics_hist_record
+ *
+ *  @returns Monotonic time in microseconds
+ */
+uint64_t metrics_now(void);
+
+/**
+ *  @brief Record a duration in a latency histogram
+ *
+ *  @param[in,out] hist Pointer to a latency histogram structure
+ *  @param[in] start Time at which the measured phase started, from metrics_now
+ */
+void metrics_hist_record(metrics_hist_t *hist, uint64_t start);
+
+/**
+ *  @brief Write all metrics to the log
+ *
+ *  Counters are logged along with the count and the
+ *  approximate 50th, 95th and 99th percentiles of each
+ *  latency histogram.
+ */
+void metrics_log(void);
+
+#endif
@@ -38,18 +38,28 @@
 
 #define PARAM_DEF_PORT                                "4430"
 #define PARAM_DEF_MAX_LOG_LEVEL                       "debug"
+#define PARAM_DEF_CONNECTION_MODE                     "engine"                  /**< Mode used to drive connections with HTTP clients */
+#define PARAM_DEF_COMPRESS_MIN_SIZE                   "256"                     /**< Minimum body size for response compression, 0 to disable */
+#define PARAM_DEF_NUM_LISTENERS                       "1"                       /**< Number of listeners sharing the port */
 #define PARAM_DEF_HTTP_SERVER_TRUST_FILE_NAME         "http_server_trust.pem"   /**< TLS trust file name */
 #define PARAM_DEF_HTTP_SERVER_CERT_FILE_NAME          "http_server_cert.pem"    /**< TLS certificate file name*/
 #define PARAM_DEF_HTTP_SERVER_KEY_FILE_NAME           "http_server_privkey.pem" /**< TLS key file name */
+#define PARAM_DEF_HTTP_SERVER_SESSION_CACHE_SIZE      "50"                      /**< TLS session cache size */
+#define PARAM_DEF_HTTP_SERVER_SESSION_LIFETIME        "3600"                    /**< TLS session lifetime in seconds */
 #define PARAM_DEF_COAP_CLIENT_TRUST_FILE_NAME         "coap_client_trust.pem"   /**< DTLS trust file name */
 #define PARAM_DEF_COAP_CLIENT_CERT_FILE_NAME          "coap_client_cert.pem"    /**< DTLS certificate file name */
 #define PARAM_DEF_COAP_CLIENT_KEY_FILE_NAME           "coap_client_privkey.pem" /**< DTLS key file name */
 
 #define param_get_port(param)                         ((param)->port)
 #define param_get_max_log_level(param)                ((param)->max_log_level)
+#define param_get_engine_mode(param)                  ((param)->engine_mode)
+#define param_get_compress_min_size(param)            ((param)->compress_min_size)
+#define param_get_num_listeners(param)                ((param)->num_listeners)
 #define param_get_http_server_key_file_name(param)    ((param)->http_server_key_file_name)
 #define param_get_http_server_cert_file_name(param)   ((param)->http_server_cert_file_name)
 #define param_get_http_server_trust_file_name(param)  ((param)->http_server_trust_file_name)
+#define param_get_http_server_session_cache_size(param)  ((param)->http_server_session_cache_size)
+#define param_get_http_server_session_lifetime(param)    ((param)->http_server_session_lifetime)
 #define param_get_coap_client_key_file_name(param)    ((param)->coap_client_key_file_name)
 #define param_get_coap_client_cert_file_name(param)   ((param)->coap_client_cert_file_name)
 #define param_get_coap_client_trust_file_name(param)  ((param)->coap_client_trust_file_name)
@@ -58,9 +68,14 @@ typedef struct
 {
     char *port;
     coap_log_level_t max_log_level;
+    int engine_mode;
+    unsigned compress_min_size;
+    unsigned num_listeners;
     char *http_server_key_file_name;
     char *http_server_cert_file_name;
     char *http_server_trust_file_name;
+    unsigned http_server_session_cache_size;
+    unsigned http_server_session_lifetime;
     char *coap_client_key_file_name;
     char *coap_client_cert_file_name;
     char *coap_client_trust_file_name;
@@ -68,6 +83,7 @@ typedef struct
 param_t;
 
 int param_create(param_t *param, const char *file_name);
+int param_preload_creds(param_t *param);                                        /**< Load every configured credential file into the shared read-only cache */
 void param_destroy(param_t *param);
 
 #endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file resp_cache.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy response cache module
+ */
+
+#ifndef RESP_CACHE_H
+#define RESP_CACHE_H
+
+#include "coap_msg.h"
+
+/**
+ *  @brief Look up a response in the cache
+ *
+ *  The cache key consists of the request method and the
+ *  request options that are not excluded from the cache
+ *  key. A fresh cached response is copied into the response
+ *  message passed by the caller.
+ *
+ *  @param[out] resp Pointer to an initialised CoAP response message structure
+ *  @param[in] req Pointer to a CoAP request message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOENT No fresh cached response was found
+ */
+int resp_cache_get(coap_msg_t *resp, coap_msg_t *req);
+
+/**
+ *  @brief Store a response in the cache
+ *
+ *  Only successful responses to GET requests that carry a
+ *  non-zero Max-Age are stored. The response expires when
+ *  its Max-Age elapses. The least recently used responses
+ *  are evicted when the cache exceeds its memory budget.
+ *
+ *  @param[in] req Pointer to a CoAP request message structure
+ *  @param[in] resp Pointer to a CoAP response message structure
+ */
+void resp_cache_put(coap_msg_t *req, coap_msg_t *resp);
+
+/**
+ *  @brief Destroy all cached responses
+ */
+void resp_cache_destroy_all(void);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file upstream.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy upstream client pool module
+ */
+
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <time.h>
+#include "coap_client.h"
+#include "uri.h"
+#include "param.h"
+
+#define upstream_client_get_client(uc)  (&(uc)->client)                         /**< Get the CoAP client from an upstream client */
+#define upstream_client_get_host(uc)    ((uc)->host)                            /**< Get the host from an upstream client */
+#define upstream_client_get_port(uc)    ((uc)->port)                            /**< Get the port from an upstream client */
+
+/**
+ *  @brief Upstream client structure
+ *
+ *  Holds a CoAP client with an established DTLS session to
+ *  one CoAP server, keyed by host and port. Idle upstream
+ *  clients are kept in a pool so that subsequent exchanges
+ *  with the same CoAP server skip the DTLS handshake.
+ */
+typedef struct upstream_client_t
+{
+    char *host;                                                                 /**< Host address of the CoAP server */
+    char *port;                                                                 /**< UDP port number of the CoAP server */
+    coap_client_t client;                                                       /**< CoAP client connected to the CoAP server */
+    time_t last_used;                                                           /**< Time at which the upstream client was last checked in */
+    int in_use;                                                                 /**< Indicates whether or not the upstream client is checked out */
+    int pooled;                                                                 /**< Indicates whether or not the upstream client belongs to the pool */
+    struct upstream_client_t *next;                                             /**< Next upstream client in the pool */
+}
+upstream_client_t;
+
+int upstream_checkout(upstream_client_t **uc, uri_view_t *uri_view, param_t *param);
+void upstream_checkin(upstream_client_t *uc, int keep);
+void upstream_destroy_all(void);
+
+#endif
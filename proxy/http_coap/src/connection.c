@@ -37,7 +37,11 @@
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <zlib.h>
 #include "connection.h"
+#include "upstream.h"
+#include "resp_cache.h"
+#include "metrics.h"
 #include "http_msg.h"
 #include "uri.h"
 #include "cross.h"
@@ -51,6 +55,10 @@
 #define CONNECTION_DATA_BUF_MIN_SPACE  128
 #define CONNECTION_INT_BUF_LEN         16
 
+#define CONNECTION_ENCODING_NONE       0                                        /* send the response body uncompressed */
+#define CONNECTION_ENCODING_DEFLATE    1                                        /* compress the response body with deflate */
+#define CONNECTION_ENCODING_GZIP       2                                        /* compress the response body with gzip */
+
 typedef enum
 {
     CON_RET_TIMEDOUT = 1,
@@ -120,67 +128,6 @@ int connection_init(void)
     return stats_init();
 }
 
-/*  return: { 0, success
- *          {<0, error
- */
-static int connection_coap_client_create(connection_t *con, uri_t *uri)
-{
-    int ret = 0;
-
-    coap_log_info("[%u] <%u> %s Connecting to CoAP server host %s and port %s",
-                  con->listener_index, con->con_index, con->addr,
-                  uri_get_host(uri), uri_get_port(uri));
-
-    ret = coap_client_create(&con->coap_client,
-                            uri_get_host(uri),
-                            uri_get_port(uri),
-                            param_get_coap_client_key_file_name(con->param),
-                            param_get_coap_client_cert_file_name(con->param),
-                            param_get_coap_client_trust_file_name(con->param),
-                            NULL);
-    if (ret < 0)
-    {
-        coap_log_error("[%u] <%u> %s Failed to connect to CoAP server host %s and port %s: %s",
-                       con->listener_index, con->con_index, con->addr,
-                       uri_get_host(uri), uri_get_port(uri),
-                       strerror(-ret));
-        return ret;
-    }
-    con->coap_client_host = strdup(uri->host);
-    if (con->coap_client_host == NULL)
-    {
-        coap_client_destroy(&con->coap_client);
-        coap_log_error("[%u] <%u> %s Out-of-memory",
-                       con->listener_index, con->con_index, con->addr);
-        return -ENOMEM;
-    }
-    con->coap_client_port = strdup(uri->port);
-    if (con->coap_client_port == NULL)
-    {
-        free(con->coap_client_host);
-        con->coap_client_host = NULL;
-        coap_client_destroy(&con->coap_client);
-        coap_log_error("[%u] <%u> %s Out-of-memory",
-                       con->listener_index, con->con_index, con->addr);
-        return -ENOMEM;
-    }
-    con->coap_client_active = 1;
-    return 0;
-}
-
-static void connection_coap_client_destroy(connection_t *con)
-{
-    coap_log_info("[%u] <%u> %s Disconnecting from CoAP server host %s and port %s",
-                  con->listener_index, con->con_index, con->addr,
-                  con->coap_client_host, con->coap_client_port);
-    con->coap_client_active = 0;
-    free(con->coap_client_port);
-    con->coap_client_port = NULL;
-    free(con->coap_client_host);
-    con->coap_client_host = NULL;
-    coap_client_destroy(&con->coap_client);
-}
-
 /*  return: { CON_RET_CLOSED,   socket closed remotely
  *          { CON_RET_TIMEDOUT, timeout
  *          { 0,                success
@@ -189,11 +136,39 @@ static void connection_coap_client_destroy(connection_t *con)
 static int connection_recv(connection_t *con, http_msg_t *msg)
 {
     struct timeval tv = {0};
+    uint64_t start = 0;
     ssize_t num = 0;
     fd_set readfds = {{0}};
     int ret = 0;
     int sd = 0;
 
+    /* a pipelined request may already be buffered in its */
+    /* entirety, parse before waiting for more data so that */
+    /* it is processed without a round trip to the client */
+    if (data_buf_get_count(&con->recv_buf) > 0)
+    {
+        start = metrics_now();
+        num = http_msg_parse(msg, data_buf_get_data(&con->recv_buf), data_buf_get_count(&con->recv_buf));
+        if (num > 0)
+        {
+            metrics_hist_record(&metrics.parse_hist, start);
+            metrics_inc(requests);
+            metrics_add(bytes_in, num);
+            data_buf_consume(&con->recv_buf, num);
+            coap_log_debug("[%u] <%u> %s Received from HTTP client: %s %s %s",
+                           con->listener_index, con->con_index, con->addr,
+                           http_msg_get_start(msg, 0),
+                           http_msg_get_start(msg, 1),
+                           http_msg_get_start(msg, 2));
+            return 0;  /* success */
+        }
+        else if (num != -EAGAIN)
+        {
+            coap_log_error("[%u] <%u> %s Failed to parse request message from HTTP client: %s",
+                           con->listener_index, con->con_index, con->addr, http_msg_strerror(num));
+            return num;
+        }
+    }
     tv.tv_sec = tls_sock_get_timeout(con->sock);
     tv.tv_usec = 0;
     sd = tls_sock_get_sd(con->sock);
@@ -229,9 +204,13 @@ static int connection_recv(connection_t *con, http_msg_t *msg)
             return CON_RET_CLOSED;
         }
         data_buf_add(&con->recv_buf, num);
+        start = metrics_now();
         num = http_msg_parse(msg, data_buf_get_data(&con->recv_buf), data_buf_get_count(&con->recv_buf));
         if (num > 0)
         {
+            metrics_hist_record(&metrics.parse_hist, start);
+            metrics_inc(requests);
+            metrics_add(bytes_in, num);
             data_buf_consume(&con->recv_buf, num);
             coap_log_debug("[%u] <%u> %s Received from HTTP client: %s %s %s",
                            con->listener_index, con->con_index, con->addr,
@@ -279,13 +258,17 @@ static int connection_recv(connection_t *con, http_msg_t *msg)
  */
 static int connection_send(connection_t *con, http_msg_t *msg)
 {
+    struct iovec iov[2] = {{0}};
     ssize_t num = 0;
     size_t len = 0;
     int ret = 0;
 
+    /* only the start line and headers pass through the send buffer, */
+    /* the body is transmitted from its own buffer in the same */
+    /* scatter-gather write so that it is never copied */
     while (1)
     {
-        len = http_msg_generate(msg, data_buf_get_data(&con->send_buf), data_buf_get_space(&con->send_buf));
+        len = http_msg_generate_headers(msg, data_buf_get_data(&con->send_buf), data_buf_get_space(&con->send_buf));
         if (len <= data_buf_get_space(&con->send_buf))
         {
             break;
@@ -306,7 +289,11 @@ static int connection_send(connection_t *con, http_msg_t *msg)
             return ret;
         }
     }
-    num = tls_sock_write_full(con->sock, data_buf_get_data(&con->send_buf), len);
+    iov[0].iov_base = data_buf_get_data(&con->send_buf);
+    iov[0].iov_len = len;
+    iov[1].iov_base = http_msg_get_body(msg);
+    iov[1].iov_len = http_msg_get_body_len(msg);
+    num = tls_sock_writev(con->sock, iov, (http_msg_get_body(msg) != NULL) ? 2 : 1);
     if (num < 0)
     {
         coap_log_error("[%u] <%u> %s Failed to write to socket conected to HTTP client: %s",
@@ -319,6 +306,7 @@ static int connection_send(connection_t *con, http_msg_t *msg)
                        con->listener_index, con->con_index, con->addr);
         return CON_RET_CLOSED;
     }
+    metrics_add(bytes_out, num);
     coap_log_debug("[%u] <%u> %s Sent to HTTP client: %s %s %s",
                    con->listener_index, con->con_index, con->addr,
                    http_msg_get_start(msg, 0),
@@ -348,19 +336,194 @@ static int connection_gen_error_resp(connection_t *con, http_msg_t *msg, unsigne
     return 0;
 }
 
+/*  determine the content coding to apply to a response from the
+ *  Accept-Encoding header in the request, each element in the
+ *  header value is a content coding optionally followed by a
+ *  quality value, a quality value of zero refuses the coding,
+ *  gzip is preferred when the client accepts more than one coding
+ *  return: { CONNECTION_ENCODING_GZIP,    compress with gzip
+ *          { CONNECTION_ENCODING_DEFLATE, compress with deflate
+ *          { CONNECTION_ENCODING_NONE,    do not compress
+ */
+static int connection_accept_encoding(http_msg_t *req_msg)
+{
+    http_msg_header_t *header = NULL;
+    const char *seg_end = NULL;
+    const char *tok_end = NULL;
+    const char *seg = NULL;
+    const char *val = NULL;
+    const char *q = NULL;
+    size_t len = 0;
+    int deflate_ok = 0;
+    int gzip_ok = 0;
+    int refused = 0;
+
+    header = http_msg_get_header(req_msg, "Accept-Encoding");
+    if (header == NULL)
+    {
+        return CONNECTION_ENCODING_NONE;
+    }
+    val = http_msg_header_get_value(header);
+    while (*val != '\0')
+    {
+        seg = val;
+        seg_end = strchr(seg, ',');
+        if (seg_end == NULL)
+        {
+            seg_end = seg + strlen(seg);
+        }
+        while ((seg < seg_end) && ((*seg == ' ') || (*seg == '\t')))
+        {
+            seg++;
+        }
+        tok_end = seg;
+        while ((tok_end < seg_end) && (*tok_end != ';') && (*tok_end != ' ') && (*tok_end != '\t'))
+        {
+            tok_end++;
+        }
+        len = tok_end - seg;
+        refused = 0;
+        q = memchr(tok_end, ';', seg_end - tok_end);
+        if (q != NULL)
+        {
+            q++;
+            while ((q < seg_end) && ((*q == ' ') || (*q == '\t')))
+            {
+                q++;
+            }
+            if ((q + 1 < seg_end) && ((q[0] == 'q') || (q[0] == 'Q')) && (q[1] == '='))
+            {
+                refused = (strtod(q + 2, NULL) <= 0.0);
+            }
+        }
+        if (!refused)
+        {
+            if ((len == 4) && (strncasecmp(seg, "gzip", 4) == 0))
+            {
+                gzip_ok = 1;
+            }
+            else if ((len == 7) && (strncasecmp(seg, "deflate", 7) == 0))
+            {
+                deflate_ok = 1;
+            }
+        }
+        val = (*seg_end == ',') ? seg_end + 1 : seg_end;
+    }
+    if (gzip_ok)
+    {
+        return CONNECTION_ENCODING_GZIP;
+    }
+    if (deflate_ok)
+    {
+        return CONNECTION_ENCODING_DEFLATE;
+    }
+    return CONNECTION_ENCODING_NONE;
+}
+
+/*  compress the body of a response when the client accepts a
+ *  content coding supported by the proxy and the body meets the
+ *  configured minimum size, the body is a CoAP payload that is
+ *  already held in memory in its entirety so it is compressed in
+ *  a single pass, failure to compress is not an error, the
+ *  response is simply sent uncompressed
+ */
+static void connection_compress_resp(connection_t *con, http_msg_t *req_msg, http_msg_t *resp_msg)
+{
+    http_msg_header_t *header = NULL;
+    z_stream strm = {0};
+    unsigned min_size = 0;
+    size_t body_len = 0;
+    size_t out_len = 0;
+    size_t bound = 0;
+    char int_buf[CONNECTION_INT_BUF_LEN] = {0};
+    char *body = NULL;
+    char *out = NULL;
+    int encoding = 0;
+    int ret = 0;
+
+    min_size = param_get_compress_min_size(con->param);
+    body = http_msg_get_body(resp_msg);
+    body_len = http_msg_get_body_len(resp_msg);
+    if ((min_size == 0) || (body == NULL) || (body_len < min_size))
+    {
+        return;
+    }
+    encoding = connection_accept_encoding(req_msg);
+    if (encoding == CONNECTION_ENCODING_NONE)
+    {
+        return;
+    }
+    header = http_msg_get_header(resp_msg, "Content-Length");
+    if (header == NULL)
+    {
+        return;
+    }
+    /* window bits above 15 select the gzip wrapper */
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                       (encoding == CONNECTION_ENCODING_GZIP) ? 15 + 16 : 15,
+                       8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK)
+    {
+        return;
+    }
+    bound = deflateBound(&strm, body_len);
+    out = (char *)malloc(bound);
+    if (out == NULL)
+    {
+        deflateEnd(&strm);
+        return;
+    }
+    strm.next_in = (unsigned char *)body;
+    strm.avail_in = body_len;
+    strm.next_out = (unsigned char *)out;
+    strm.avail_out = bound;
+    ret = deflate(&strm, Z_FINISH);
+    out_len = bound - strm.avail_out;
+    deflateEnd(&strm);
+    if ((ret != Z_STREAM_END) || (out_len >= body_len))
+    {
+        /* the body did not get smaller, send it as it is */
+        free(out);
+        return;
+    }
+    ret = http_msg_set_header(resp_msg, "Content-Encoding",
+                              (encoding == CONNECTION_ENCODING_GZIP) ? "gzip" : "deflate");
+    if (ret < 0)
+    {
+        free(out);
+        return;
+    }
+    snprintf(int_buf, sizeof(int_buf), "%zu", out_len);
+    ret = http_msg_header_set_value(resp_msg, header, int_buf);
+    if (ret < 0)
+    {
+        free(out);
+        return;
+    }
+    http_msg_adopt_body(resp_msg, out, out_len);
+    coap_log_debug("[%u] <%u> %s Compressed response body from %zu to %zu bytes",
+                   con->listener_index, con->con_index, con->addr, body_len, out_len);
+}
+
 /*  return: { 0, success
  *          {<0, error
  */
 static int connection_process_full(connection_t *con, http_msg_t *req_msg, http_msg_t *resp_msg)
 {
+    upstream_client_t *uc = NULL;
     coap_msg_t coap_resp_msg = {0};
     coap_msg_t coap_req_msg = {0};
+    uri_view_t uri_view = {0};
+    uint64_t start = 0;
     unsigned code = 0;
-    uri_t uri = {0};
     int ret = 0;
 
     coap_msg_create(&coap_req_msg);
-    ret = cross_req_http_to_coap(&coap_req_msg, req_msg, &code);
+    /* the CoAP request borrows the HTTP body, which stays valid */
+    /* until the request message is destroyed after the exchange */
+    start = metrics_now();
+    ret = cross_req_http_to_coap_nocopy(&coap_req_msg, req_msg, &code);
+    metrics_hist_record(&metrics.translate_hist, start);
     if (ret < 0)
     {
         coap_log_error("[%u] <%u> %s Failed to convert HTTP message to CoAP message: %s",
@@ -368,81 +531,89 @@ static int connection_process_full(connection_t *con, http_msg_t *req_msg, http_
         coap_msg_destroy(&coap_req_msg);
         return connection_gen_error_resp(con, resp_msg, code);
     }
-    uri_create(&uri);
-    ret = uri_parse(&uri, http_msg_get_start(req_msg, 1));
-    if (ret < 0)
+    coap_msg_create(&coap_resp_msg);
+    ret = resp_cache_get(&coap_resp_msg, &coap_req_msg);
+    if (ret == 0)
     {
-        coap_log_error("[%u] <%u> %s Failed to parse request URI in request message from HTTP client: %s",
-                       con->listener_index, con->con_index, con->addr, strerror(-ret));
-        uri_destroy(&uri);
+        /* a fresh cached response was found, the CoAP */
+        /* server is not contacted at all */
+        coap_log_debug("[%u] <%u> %s Serving response from cache",
+                       con->listener_index, con->con_index, con->addr);
+        metrics_inc(cache_hits);
         coap_msg_destroy(&coap_req_msg);
-        return ret;
     }
-    if (!con->coap_client_active)
+    else
     {
-        /* first exchange with a CoAP server */
-        ret = connection_coap_client_create(con, &uri);
+        /* routing only inspects the URI so a view of the request */
+        /* line is sufficient, the URI is only materialized when a */
+        /* connection to a new CoAP server has to be established */
+        ret = uri_parse_view(&uri_view, http_msg_get_start(req_msg, 1));
         if (ret < 0)
         {
-            uri_destroy(&uri);
+            coap_log_error("[%u] <%u> %s Failed to parse request URI in request message from HTTP client: %s",
+                           con->listener_index, con->con_index, con->addr, strerror(-ret));
+            coap_msg_destroy(&coap_resp_msg);
             coap_msg_destroy(&coap_req_msg);
             return ret;
         }
-    }
-    else if ((strcasecmp(uri_get_host(&uri), con->coap_client_host) != 0)
-          || (strcmp(uri_get_port(&uri), con->coap_client_port) != 0))
-    {
-        /* subsequent exchange with a different CoAP server */
-        connection_coap_client_destroy(con);
-        ret = connection_coap_client_create(con, &uri);
+        /* check a CoAP client out of the upstream pool so that */
+        /* an established DTLS session is reused if one exists */
+        ret = upstream_checkout(&uc, &uri_view, con->param);
         if (ret < 0)
         {
-            uri_destroy(&uri);
+            coap_log_error("[%u] <%u> %s Failed to obtain connection to CoAP server: %s",
+                           con->listener_index, con->con_index, con->addr, strerror(-ret));
+            coap_msg_destroy(&coap_resp_msg);
             coap_msg_destroy(&coap_req_msg);
             return ret;
         }
-    }
-    else
-    {
-        /* subsequent exchange with the same CoAP server */
-        coap_log_debug("[%u] <%u> %s Maintaining connection to CoAP server host %s and port %s",
-                       con->listener_index, con->con_index, con->addr,
-                       con->coap_client_host, con->coap_client_port);
-    }
-    uri_destroy(&uri);
-    coap_msg_create(&coap_resp_msg);
-    ret = coap_client_exchange(&con->coap_client, &coap_req_msg, &coap_resp_msg);
-    coap_msg_destroy(&coap_req_msg);
-    if (ret < 0)
-    {
-        coap_log_error("[%u] <%u> %s CoAP client exchange failed: %s",
-                       con->listener_index, con->con_index, con->addr, strerror(-ret));
-        switch (ret)
+        metrics_inc(upstream_exchanges);
+        start = metrics_now();
+        ret = coap_client_exchange(upstream_client_get_client(uc), &coap_req_msg, &coap_resp_msg);
+        metrics_hist_record(&metrics.upstream_hist, start);
+        /* a client that failed an exchange is not returned to the */
+        /* pool because its session may be broken */
+        upstream_checkin(uc, ret >= 0);
+        if (ret < 0)
         {
-        case -ETIMEDOUT:
-            /* If the proxy services the request by interacting with a third party
-             * (such as the CoAP origin server) and is unable to obtain a result within
-             * a reasonable time frame, a 504 (Gateway Timeout) response is returned.
-             */
-            ret = connection_gen_error_resp(con, resp_msg, 504);
-            break;
-        case -EBADMSG:
-            /* If a result can be obtained but is not understood, a 502 (Bad Gateway)
-             * response is returned.
-             */
-            ret = connection_gen_error_resp(con, resp_msg, 502);
-            break;
-        default:
-            /* If the proxy is unable or unwilling to service a request with a CoAP URI,
-             * a 501 (Not Implemented) response is returned to the client.
-             */
-            ret = connection_gen_error_resp(con, resp_msg, 501);
-            break;
+            coap_msg_destroy(&coap_req_msg);
+            coap_log_error("[%u] <%u> %s CoAP client exchange failed: %s",
+                           con->listener_index, con->con_index, con->addr, strerror(-ret));
+            switch (ret)
+            {
+            case -ETIMEDOUT:
+                /* If the proxy services the request by interacting with a third party
+                 * (such as the CoAP origin server) and is unable to obtain a result within
+                 * a reasonable time frame, a 504 (Gateway Timeout) response is returned.
+                 */
+                ret = connection_gen_error_resp(con, resp_msg, 504);
+                break;
+            case -EBADMSG:
+                /* If a result can be obtained but is not understood, a 502 (Bad Gateway)
+                 * response is returned.
+                 */
+                ret = connection_gen_error_resp(con, resp_msg, 502);
+                break;
+            default:
+                /* If the proxy is unable or unwilling to service a request with a CoAP URI,
+                 * a 501 (Not Implemented) response is returned to the client.
+                 */
+                ret = connection_gen_error_resp(con, resp_msg, 501);
+                break;
+            }
+            coap_msg_destroy(&coap_resp_msg);
+            return ret;
         }
-        coap_msg_destroy(&coap_resp_msg);
-        return ret;
+        /* store the response before its payload is handed */
+        /* over to the HTTP response */
+        resp_cache_put(&coap_req_msg, &coap_resp_msg);
+        coap_msg_destroy(&coap_req_msg);
     }
-    ret = cross_resp_coap_to_http(resp_msg, &coap_resp_msg, &code);
+    /* the HTTP response takes ownership of the CoAP payload so */
+    /* that it is not copied and the CoAP message can be destroyed */
+    start = metrics_now();
+    ret = cross_resp_coap_to_http_nocopy(resp_msg, &coap_resp_msg, &code);
+    metrics_hist_record(&metrics.translate_hist, start);
     coap_msg_destroy(&coap_resp_msg);
     if (ret < 0)
     {
@@ -450,6 +621,9 @@ static int connection_process_full(connection_t *con, http_msg_t *req_msg, http_
                        con->listener_index, con->con_index, con->addr, strerror(-ret));
         return connection_gen_error_resp(con, resp_msg, code);
     }
+    /* compress the body when the client accepts it so that */
+    /* egress bandwidth is reduced */
+    connection_compress_resp(con, req_msg, resp_msg);
     return 0;
 }
 
@@ -582,18 +756,24 @@ static int connection_exchange(connection_t *con)
     return status;
 }
 
-void *connection_thread_func(void *data)
+int connection_handle(connection_t *con)
 {
-    connection_t *con = (connection_t *)data;
     int status = 0;
 
-    thread_block_signals();
-    coap_log_notice("[%u] <%u> %s Connection with HTTP client started",
-                    con->listener_index, con->con_index, con->addr);
-    while (status == 0)
+    /* the HTTP client may pipeline requests, keep exchanging */
+    /* while received data remains in the receive buffer so */
+    /* that pipelined requests are processed back-to-back and */
+    /* their responses are sent in order */
+    do
     {
         status = connection_exchange(con);
     }
+    while ((status == 0) && (data_buf_get_count(&con->recv_buf) > 0));
+    return status;
+}
+
+void connection_close(connection_t *con, int status)
+{
     if (status < 0)
     {
         coap_log_notice("[%u] <%u> %s Connection with HTTP client failed",
@@ -608,6 +788,19 @@ void *connection_thread_func(void *data)
     }
     connection_delete(con);
     stats_log();
+}
+
+void *connection_thread_func(void *data)
+{
+    connection_t *con = (connection_t *)data;
+    int status = 0;
+
+    thread_block_signals();
+    while (status == 0)
+    {
+        status = connection_handle(con);
+    }
+    connection_close(con, status);
     return NULL;
 }
 
@@ -659,15 +852,15 @@ connection_t *connection_new(tls_sock_t *sock, unsigned listener_index, unsigned
         return NULL;
     }
     con->param = param;
+    metrics_inc(active_cons);
+    coap_log_notice("[%u] <%u> %s Connection with HTTP client started",
+                    listener_index, con_index, con->addr);
     return con;
 }
 
 void connection_delete(connection_t *con)
 {
-    if (con->coap_client_active)
-    {
-        connection_coap_client_destroy(con);
-    }
+    metrics_dec(active_cons);
     data_buf_destroy(&con->send_buf);
     data_buf_destroy(&con->recv_buf);
     tls_sock_close(con->sock);
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file engine.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy connection engine module
+ *
+ *  The engine multiplexes many HTTP client connections over
+ *  a single epoll instance. An idle connection is parked in
+ *  the epoll instance where it costs no thread, only its
+ *  buffers and an epoll registration. When a parked
+ *  connection becomes readable, the event-loop thread hands
+ *  it to a worker thread which performs one request/response
+ *  exchange and then parks the connection again. Parked
+ *  connections that remain idle for longer than the socket
+ *  timeout are closed by the event-loop thread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include "engine.h"
+#include "coap_log.h"
+
+#define ENGINE_MAX_EVENTS   64                                                  /**< Maximum number of events handled per call to epoll_wait */
+#define ENGINE_WAIT_PERIOD  1000                                                /**< Maximum time that the event-loop thread waits for events (msec) */
+
+/* unlink a connection from the engine idle list,
+ * the engine mutex must be held by the caller
+ */
+static void engine_unlink(engine_t *engine, connection_t *con)
+{
+    if (con->park_prev != NULL)
+    {
+        con->park_prev->park_next = con->park_next;
+    }
+    else
+    {
+        engine->idle_first = con->park_next;
+    }
+    if (con->park_next != NULL)
+    {
+        con->park_next->park_prev = con->park_prev;
+    }
+    else
+    {
+        engine->idle_last = con->park_prev;
+    }
+    con->park_next = NULL;
+    con->park_prev = NULL;
+}
+
+/*  park an idle connection in the epoll instance
+ *  return: { 0, success
+ *          {<0, error, the connection has been closed
+ */
+static int engine_park(engine_t *engine, connection_t *con)
+{
+    struct epoll_event event = {0};
+    int ret = 0;
+
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = con;
+    pthread_mutex_lock(&engine->mutex);
+    if (engine->stop)
+    {
+        pthread_mutex_unlock(&engine->mutex);
+        connection_close(con, 0);
+        return -1;
+    }
+    con->park_time = time(NULL);
+    con->park_prev = engine->idle_last;
+    con->park_next = NULL;
+    if (engine->idle_last != NULL)
+    {
+        engine->idle_last->park_next = con;
+    }
+    else
+    {
+        engine->idle_first = con;
+    }
+    engine->idle_last = con;
+    ret = epoll_ctl(engine->epfd, EPOLL_CTL_ADD, tls_sock_get_sd(con->sock), &event);
+    if (ret == -1)
+    {
+        engine_unlink(engine, con);
+        pthread_mutex_unlock(&engine->mutex);
+        coap_log_error("[%u] <%u> %s Failed to park connection: %s",
+                       con->listener_index, con->con_index, con->addr, strerror(errno));
+        connection_close(con, -errno);
+        return -1;
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    return 0;
+}
+
+/* main function for a worker thread, performs one
+ * request/response exchange and then parks the
+ * connection again or closes it
+ */
+static void *engine_worker_func(void *data)
+{
+    connection_t *con = (connection_t *)data;
+    engine_t *engine = (engine_t *)con->engine;
+    int status = 0;
+
+    status = connection_handle(con);
+    if (status != 0)
+    {
+        connection_close(con, status);
+        return NULL;
+    }
+    engine_park(engine, con);
+    return NULL;
+}
+
+/* close parked connections that have been idle for
+ * longer than the socket timeout, the idle list is
+ * ordered least recently parked first
+ */
+static void engine_sweep(engine_t *engine)
+{
+    connection_t *expired = NULL;
+    connection_t *con = NULL;
+    time_t now = 0;
+
+    now = time(NULL);
+    pthread_mutex_lock(&engine->mutex);
+    while ((engine->idle_first != NULL)
+        && (now - engine->idle_first->park_time >= tls_sock_get_timeout(engine->idle_first->sock)))
+    {
+        con = engine->idle_first;
+        epoll_ctl(engine->epfd, EPOLL_CTL_DEL, tls_sock_get_sd(con->sock), NULL);
+        engine_unlink(engine, con);
+        con->park_next = expired;
+        expired = con;
+    }
+    pthread_mutex_unlock(&engine->mutex);
+    while (expired != NULL)
+    {
+        con = expired;
+        expired = con->park_next;
+        con->park_next = NULL;
+        coap_log_info("[%u] <%u> %s Timed out waiting to read from socket connected to HTTP client",
+                      con->listener_index, con->con_index, con->addr);
+        connection_close(con, 0);
+    }
+}
+
+/* main function for the event-loop thread, waits for
+ * parked connections to become readable and dispatches
+ * them to the worker threads
+ */
+static void *engine_thread_func(void *data)
+{
+    struct epoll_event events[ENGINE_MAX_EVENTS] = {{0}};
+    engine_t *engine = (engine_t *)data;
+    connection_t *con = NULL;
+    char buf[16] = {0};
+    int num = 0;
+    int ret = 0;
+    int i = 0;
+
+    thread_block_signals();
+
+    while (1)
+    {
+        num = epoll_wait(engine->epfd, events, ENGINE_MAX_EVENTS, ENGINE_WAIT_PERIOD);
+        if ((num == -1) && (errno != EINTR))
+        {
+            coap_log_error("Call to epoll_wait returned: -1, errno: %d (%s)", errno, strerror(errno));
+            break;
+        }
+        pthread_mutex_lock(&engine->mutex);
+        if (engine->stop)
+        {
+            pthread_mutex_unlock(&engine->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&engine->mutex);
+        for (i = 0; i < num; i++)
+        {
+            con = (connection_t *)events[i].data.ptr;
+            if (con == NULL)  /* wakeup pipe */
+            {
+                while (read(engine->wakeup[0], buf, sizeof(buf)) > 0);
+                continue;
+            }
+            pthread_mutex_lock(&engine->mutex);
+            epoll_ctl(engine->epfd, EPOLL_CTL_DEL, tls_sock_get_sd(con->sock), NULL);
+            engine_unlink(engine, con);
+            pthread_mutex_unlock(&engine->mutex);
+            ret = thread_pool_dispatch(&engine->pool, con);
+            if (ret < 0)
+            {
+                connection_close(con, 0);
+            }
+        }
+        engine_sweep(engine);
+    }
+    return NULL;
+}
+
+int engine_create(engine_t *engine, unsigned num_worker, unsigned queue_size)
+{
+    struct epoll_event event = {0};
+    int flags = 0;
+    int ret = 0;
+
+    memset(engine, 0, sizeof(engine_t));
+    if (pthread_mutex_init(&engine->mutex, NULL) != 0)
+    {
+        return -1;
+    }
+    ret = pipe(engine->wakeup);
+    if (ret == -1)
+    {
+        pthread_mutex_destroy(&engine->mutex);
+        return -1;
+    }
+    flags = fcntl(engine->wakeup[0], F_GETFL, 0);
+    fcntl(engine->wakeup[0], F_SETFL, flags | O_NONBLOCK);
+    engine->epfd = epoll_create1(0);
+    if (engine->epfd == -1)
+    {
+        close(engine->wakeup[1]);
+        close(engine->wakeup[0]);
+        pthread_mutex_destroy(&engine->mutex);
+        return -1;
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;  /* identifies the wakeup pipe */
+    ret = epoll_ctl(engine->epfd, EPOLL_CTL_ADD, engine->wakeup[0], &event);
+    if (ret == -1)
+    {
+        close(engine->epfd);
+        close(engine->wakeup[1]);
+        close(engine->wakeup[0]);
+        pthread_mutex_destroy(&engine->mutex);
+        return -1;
+    }
+    ret = thread_pool_create(&engine->pool, num_worker, queue_size, engine_worker_func);
+    if (ret < 0)
+    {
+        close(engine->epfd);
+        close(engine->wakeup[1]);
+        close(engine->wakeup[0]);
+        pthread_mutex_destroy(&engine->mutex);
+        return -1;
+    }
+    ret = thread_joinable_ctx_create(&engine->ctx);
+    if (ret < 0)
+    {
+        thread_pool_destroy(&engine->pool);
+        close(engine->epfd);
+        close(engine->wakeup[1]);
+        close(engine->wakeup[0]);
+        pthread_mutex_destroy(&engine->mutex);
+        return -1;
+    }
+    ret = thread_init(&engine->thread, &engine->ctx, engine_thread_func, engine);
+    if (ret < 0)
+    {
+        thread_ctx_destroy(&engine->ctx);
+        thread_pool_destroy(&engine->pool);
+        close(engine->epfd);
+        close(engine->wakeup[1]);
+        close(engine->wakeup[0]);
+        pthread_mutex_destroy(&engine->mutex);
+        return -1;
+    }
+    return 0;
+}
+
+void engine_destroy(engine_t *engine)
+{
+    connection_t *con = NULL;
+    void *result = NULL;
+    ssize_t num = 0;
+
+    pthread_mutex_lock(&engine->mutex);
+    engine->stop = 1;
+    pthread_mutex_unlock(&engine->mutex);
+    num = write(engine->wakeup[1], "x", 1);
+    (void)num;
+    thread_join(&engine->thread, &result);
+    thread_ctx_destroy(&engine->ctx);
+    thread_pool_destroy(&engine->pool);
+    while (engine->idle_first != NULL)
+    {
+        con = engine->idle_first;
+        epoll_ctl(engine->epfd, EPOLL_CTL_DEL, tls_sock_get_sd(con->sock), NULL);
+        engine_unlink(engine, con);
+        connection_close(con, 0);
+    }
+    close(engine->epfd);
+    close(engine->wakeup[1]);
+    close(engine->wakeup[0]);
+    pthread_mutex_destroy(&engine->mutex);
+    memset(engine, 0, sizeof(engine_t));
+}
+
+int engine_add(engine_t *engine, connection_t *con)
+{
+    con->engine = engine;
+    return engine_park(engine, con);
+}
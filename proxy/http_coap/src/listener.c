@@ -34,9 +34,13 @@
 #include <stdlib.h>
 #include "listener.h"
 #include "connection.h"
+#include "metrics.h"
 #include "sock.h"
 #include "coap_log.h"
 
+#define LISTENER_NUM_WORKERS  8                                                 /**< Number of worker threads that process connections */
+#define LISTENER_QUEUE_SIZE   32                                                /**< Maximum number of connections queued for the worker threads */
+
 extern int go;
 
 static void *listener_thread_func(void *data)
@@ -45,7 +49,6 @@ static void *listener_thread_func(void *data)
     connection_t *con = NULL;
     tls_sock_t *sock = NULL;
     unsigned con_index = 0;
-    thread_t thread = {0};
     int ret = 0;
 
     thread_block_signals();
@@ -72,6 +75,12 @@ static void *listener_thread_func(void *data)
             continue;
         }
 
+        metrics_inc(accepts);
+        if (tls_sock_is_resumed(sock))
+        {
+            metrics_inc(tls_resumptions);
+        }
+
         con = connection_new(sock, listener->index, con_index++, listener->param);
         if (con == NULL)
         {
@@ -81,12 +90,32 @@ static void *listener_thread_func(void *data)
             break;
         }
 
-        ret = thread_init(&thread, &listener->ctx, connection_thread_func, con);
-        if (ret < 0)
+        if (listener->engine_mode)
         {
-            coap_log_error("Unable to create connection thread");
-            connection_delete(con);
-            break;
+            /* park the connection in the engine, it is dispatched
+             * to a worker thread when it becomes readable and is
+             * closed by the engine on failure
+             */
+            ret = engine_add(&listener->engine, con);
+            if (ret < 0)
+            {
+                coap_log_error("Unable to add connection to the engine");
+                break;
+            }
+        }
+        else
+        {
+            /* hand the connection over to a worker thread, blocks
+             * while the handoff queue is full so that a flood of
+             * connections cannot consume unbounded amounts of memory
+             */
+            ret = thread_pool_dispatch(&listener->pool, con);
+            if (ret < 0)
+            {
+                coap_log_error("Unable to dispatch connection to a worker thread");
+                connection_delete(con);
+                break;
+            }
         }
     }
     coap_log_notice("[%u] Stopped listening on port %s", listener->index, param_get_port(listener->param));
@@ -118,10 +147,52 @@ listener_t *listener_new(unsigned index, tls_server_t *server, param_t *param, i
         return NULL;
     }
 
-    ret = tls_ssock_open(&listener->ssock, server, param_get_port(param), timeout, backlog);
+    listener->engine_mode = param_get_engine_mode(param);
+    if (listener->engine_mode)
+    {
+        ret = engine_create(&listener->engine, LISTENER_NUM_WORKERS, LISTENER_QUEUE_SIZE);
+        if (ret < 0)
+        {
+            coap_log_error("Unable to initialise connection engine");
+            thread_ctx_destroy(&listener->ctx);
+            free(listener);
+            return NULL;
+        }
+    }
+    else
+    {
+        ret = thread_pool_create(&listener->pool, LISTENER_NUM_WORKERS, LISTENER_QUEUE_SIZE, connection_thread_func);
+        if (ret < 0)
+        {
+            coap_log_error("Unable to initialise worker thread pool");
+            thread_ctx_destroy(&listener->ctx);
+            free(listener);
+            return NULL;
+        }
+    }
+
+    /* when several listeners share the port the server socket is */
+    /* opened with SO_REUSEPORT so that the kernel distributes */
+    /* incoming connections between the listeners */
+    if (param_get_num_listeners(param) > 1)
+    {
+        ret = tls_ssock_open_shared(&listener->ssock, server, param_get_port(param), timeout, backlog);
+    }
+    else
+    {
+        ret = tls_ssock_open(&listener->ssock, server, param_get_port(param), timeout, backlog);
+    }
     if (ret != SOCK_OK)
     {
         coap_log_error(sock_strerror(ret));
+        if (listener->engine_mode)
+        {
+            engine_destroy(&listener->engine);
+        }
+        else
+        {
+            thread_pool_destroy(&listener->pool);
+        }
         thread_ctx_destroy(&listener->ctx);
         free(listener);
         return NULL;
@@ -133,6 +204,14 @@ listener_t *listener_new(unsigned index, tls_server_t *server, param_t *param, i
 void listener_delete(listener_t *listener)
 {
     tls_ssock_close(&listener->ssock);
+    if (listener->engine_mode)
+    {
+        engine_destroy(&listener->engine);
+    }
+    else
+    {
+        thread_pool_destroy(&listener->pool);
+    }
     thread_ctx_destroy(&listener->ctx);
     free(listener);
 }
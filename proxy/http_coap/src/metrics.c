@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file metrics.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy metrics module
+ */
+
+#include <time.h>
+#include "metrics.h"
+#include "coap_log.h"
+
+metrics_t metrics = {0};
+
+uint64_t metrics_now(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+}
+
+void metrics_hist_record(metrics_hist_t *hist, uint64_t start)
+{
+    uint64_t usec = 0;
+    unsigned i = 0;
+
+    usec = metrics_now() - start;
+    while ((i < METRICS_HIST_NUM_BUCKETS - 1) && (usec >= ((uint64_t)1 << i)))
+    {
+        i++;
+    }
+    __atomic_fetch_add(&hist->bucket[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+}
+
+/*  approximate a percentile as the upper bound of the bucket
+ *  that contains it
+ */
+static unsigned long metrics_hist_percentile(metrics_hist_t *hist, unsigned long count, unsigned percent)
+{
+    unsigned long rank = 0;
+    unsigned long seen = 0;
+    unsigned i = 0;
+
+    rank = ((count * percent) + 99) / 100;
+    for (i = 0; i < METRICS_HIST_NUM_BUCKETS; i++)
+    {
+        seen += __atomic_load_n(&hist->bucket[i], __ATOMIC_RELAXED);
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+    return (unsigned long)1 << i;
+}
+
+static void metrics_hist_log(const char *name, metrics_hist_t *hist)
+{
+    unsigned long count = 0;
+
+    count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    if (count == 0)
+    {
+        coap_log_info("%s latency: count: 0", name);
+        return;
+    }
+    coap_log_info("%s latency: count: %lu, p50: <%lu usec, p95: <%lu usec, p99: <%lu usec",
+                  name,
+                  count,
+                  metrics_hist_percentile(hist, count, 50),
+                  metrics_hist_percentile(hist, count, 95),
+                  metrics_hist_percentile(hist, count, 99));
+}
+
+void metrics_log(void)
+{
+    coap_log_info("Accepted connections: %lu", __atomic_load_n(&metrics.accepts, __ATOMIC_RELAXED));
+    coap_log_info("Active connections:   %lu", __atomic_load_n(&metrics.active_cons, __ATOMIC_RELAXED));
+    coap_log_info("Requests:             %lu", __atomic_load_n(&metrics.requests, __ATOMIC_RELAXED));
+    coap_log_info("Upstream exchanges:   %lu", __atomic_load_n(&metrics.upstream_exchanges, __ATOMIC_RELAXED));
+    coap_log_info("Cache hits:           %lu", __atomic_load_n(&metrics.cache_hits, __ATOMIC_RELAXED));
+    coap_log_info("TLS resumptions:      %lu", __atomic_load_n(&metrics.tls_resumptions, __ATOMIC_RELAXED));
+    coap_log_info("Bytes in:             %lu", __atomic_load_n(&metrics.bytes_in, __ATOMIC_RELAXED));
+    coap_log_info("Bytes out:            %lu", __atomic_load_n(&metrics.bytes_out, __ATOMIC_RELAXED));
+    metrics_hist_log("Parse", &metrics.parse_hist);
+    metrics_hist_log("Translate", &metrics.translate_hist);
+    metrics_hist_log("Upstream", &metrics.upstream_hist);
+}
@@ -67,6 +67,28 @@ static int param_parse_key_val(config_t *config, const char *section, const char
     return 0;
 }
 
+static int param_parse_key_uint(config_t *config, const char *section, const char *key, const char *def_val, unsigned *val)
+{
+    const char *str = NULL;
+    unsigned long num = 0;
+    char *end = NULL;
+
+    str = config_get(config, section, key);
+    if (str == NULL)
+    {
+        str = def_val;
+    }
+    num = strtoul(str, &end, 10);
+    if ((end == str) || (*end != '\0'))
+    {
+        param_report_unknown(key, str);
+        return -1;
+    }
+    *val = num;
+    param_report_success(key, str);
+    return 0;
+}
+
 static int param_parse_log_level(param_t *param, config_t *config)
 {
     const char *key = NULL;
@@ -107,6 +129,34 @@ static int param_parse_log_level(param_t *param, config_t *config)
     return 0;
 }
 
+static int param_parse_connection_mode(param_t *param, config_t *config)
+{
+    const char *key = NULL;
+    const char *val = NULL;
+
+    key = "connection_mode";
+    val = config_get(config, "", key);
+    if (val == NULL)
+    {
+        val = PARAM_DEF_CONNECTION_MODE;
+    }
+    if (strcmp(val, "engine") == 0)
+    {
+        param->engine_mode = 1;
+    }
+    else if (strcmp(val, "thread") == 0)
+    {
+        param->engine_mode = 0;
+    }
+    else
+    {
+        param_report_unknown(key, val);
+        return -1;
+    }
+    param_report_success(key, val);
+    return 0;
+}
+
 static int param_parse(param_t *param, const char *file_name, config_t *config, const char *buf)
 {
     unsigned line = 0;
@@ -136,6 +186,37 @@ static int param_parse(param_t *param, const char *file_name, config_t *config,
         return ret;
     }
 
+    ret = param_parse_connection_mode(param, config);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    ret = param_parse_key_uint(config,
+                               "",
+                               "compress_min_size",
+                               PARAM_DEF_COMPRESS_MIN_SIZE,
+                               &param->compress_min_size);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    ret = param_parse_key_uint(config,
+                               "",
+                               "num_listeners",
+                               PARAM_DEF_NUM_LISTENERS,
+                               &param->num_listeners);
+    if (ret != 0)
+    {
+        return ret;
+    }
+    if (param->num_listeners == 0)
+    {
+        param_report_unknown("num_listeners", "0");
+        return -1;
+    }
+
     ret = param_parse_key_val(config,
                               "http_server",
                               "key_file",
@@ -166,6 +247,26 @@ static int param_parse(param_t *param, const char *file_name, config_t *config,
         return ret;
     }
 
+    ret = param_parse_key_uint(config,
+                               "http_server",
+                               "session_cache_size",
+                               PARAM_DEF_HTTP_SERVER_SESSION_CACHE_SIZE,
+                               &param->http_server_session_cache_size);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    ret = param_parse_key_uint(config,
+                               "http_server",
+                               "session_lifetime",
+                               PARAM_DEF_HTTP_SERVER_SESSION_LIFETIME,
+                               &param->http_server_session_lifetime);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
     ret = param_parse_key_val(config,
                               "coap_client",
                               "key_file",
@@ -199,6 +300,40 @@ static int param_parse(param_t *param, const char *file_name, config_t *config,
     return ret;
 }
 
+int param_preload_creds(param_t *param)
+{
+    const char *file_name[] = {param->http_server_trust_file_name,
+                               param->http_server_cert_file_name,
+                               param->http_server_key_file_name,
+                               param->coap_client_trust_file_name,
+                               param->coap_client_cert_file_name,
+                               param->coap_client_key_file_name};
+    const char *buf = NULL;
+    unsigned i = 0;
+    long num = 0;
+
+    /* read every credential file referenced by the config once at */
+    /* startup so that the listeners and CoAP clients created later */
+    /* reuse the same read-only buffers instead of re-reading the */
+    /* files from disk */
+    for (i = 0; i < sizeof(file_name) / sizeof(file_name[0]); i++)
+    {
+        num = util_load_cred_file(file_name[i], &buf);
+        if (num == UTIL_NOMEM_ERROR)
+        {
+            param_report_mem_error();
+            return -1;
+        }
+        if (num <= 0)
+        {
+            coap_log_error("unable to load credential file: '%s'", file_name[i]);
+            return -1;
+        }
+        coap_log_notice("preloaded credential file: '%s', %ld bytes", file_name[i], num);
+    }
+    return 0;
+}
+
 int param_create(param_t *param, const char *file_name)
 {
     config_t config = {0};
@@ -38,8 +38,12 @@
 #include <unistd.h>
 #include "listener.h"
 #include "connection.h"
+#include "upstream.h"
+#include "resp_cache.h"
+#include "metrics.h"
 #include "param.h"
 #include "tls.h"
+#include "util.h"
 #include "coap_log.h"
 
 #define DEF_MAX_LOG_LEVEL  COAP_LOG_DEBUG                                       /**< Default maximum log level */
@@ -49,6 +53,8 @@
 
 int go = 1;                                                                     /**< Global variable used to indicate to the listener module to run or stop */
 
+static volatile sig_atomic_t dump_metrics = 0;                                  /**< Set by the metrics dump signal handler */
+
 /**
  *  @brief Signal handler for the interrupt signal
  *
@@ -59,6 +65,16 @@ static void signal_handler(int signo)
     go = 0;
 }
 
+/**
+ *  @brief Signal handler for the metrics dump signal
+ *
+ *  @param[in] signo Signal number
+ */
+static void metrics_signal_handler(int signo)
+{
+    dump_metrics = 1;
+}
+
 /**
  *  @brief Helper function to list command line options
  */
@@ -91,6 +107,7 @@ int main(int argc, char **argv)
     };
     struct sigaction sah = {{0}};
     struct sigaction sai = {{0}};
+    struct sigaction sam = {{0}};
     const char *config_file_name = CONFIG_FILE_NAME;
     const char *short_opts = ":hc:";
     tls_server_t server = {0};
@@ -106,7 +123,10 @@ int main(int argc, char **argv)
     sah.sa_flags = 0;
     sai.sa_handler = SIG_IGN;
     sai.sa_flags = 0;
+    sam.sa_handler = metrics_signal_handler;
+    sam.sa_flags = 0;
     if ((sigemptyset(&sai.sa_mask) == -1)
+     || (sigemptyset(&sam.sa_mask) == -1)
      || (sigfillset(&sah.sa_mask)  == -1)    /* block all signals while handling this one */
      || (sigaction(SIGHUP,  &sah, NULL) == -1)
      || (sigaction(SIGINT,  &sah, NULL) == -1)
@@ -114,6 +134,7 @@ int main(int argc, char **argv)
      || (sigaction(SIGABRT, &sah, NULL) == -1)
      || (sigaction(SIGPIPE, &sai, NULL) == -1)
      || (sigaction(SIGTERM, &sah, NULL) == -1)
+     || (sigaction(SIGUSR1, &sam, NULL) == -1)
         )
     {
         fprintf(stderr, "Error: unable to set singal handler\n");
@@ -172,15 +193,29 @@ int main(int argc, char **argv)
 
     coap_log_set_level(param_get_max_log_level(&param));
 
+    /* load all credential files referenced by the config once so */
+    /* that every TLS server and DTLS client created from now on */
+    /* reuses the same read-only buffers */
+    ret = param_preload_creds(&param);
+    if (ret < 0)
+    {
+        param_destroy(&param);
+        return EXIT_FAILURE;
+    }
+
     /* initialise SSL/TLS */
     ret = tls_init();
     if (ret != SOCK_OK)
     {
         coap_log_error("Unable to initialise TLS library");
+        util_unload_cred_files();
         param_destroy(&param);
         return EXIT_FAILURE;
     }
 
+    tls_server_set_cache_params(param_get_http_server_session_cache_size(&param),
+                                param_get_http_server_session_lifetime(&param));
+
     ret = tls_server_create(&server,
                             param_get_http_server_trust_file_name(&param),
                             param_get_http_server_cert_file_name(&param),
@@ -189,6 +224,7 @@ int main(int argc, char **argv)
     {
         coap_log_error("Unable to initialise TLS server");
         tls_deinit();
+        util_unload_cred_files();
         param_destroy(&param);
         return EXIT_FAILURE;
     }
@@ -199,34 +235,45 @@ int main(int argc, char **argv)
         coap_log_error("Unable to initialise connection module");
         tls_server_destroy(&server);
         tls_deinit();
+        util_unload_cred_files();
         param_destroy(&param);
         return EXIT_FAILURE;
     }
 
-    listener = listener_new(listener_index,
-                            &server,
-                            &param,
-                            SOCKET_TIMEOUT,
-                            SOCKET_BACKLOG);
-    if (listener == NULL)
+    /* each listener has its own server socket bound to the same */
+    /* port so that accepts and TLS handshakes are distributed */
+    /* over the listeners by the kernel */
+    for (listener_index = 0; listener_index < param_get_num_listeners(&param); listener_index++)
     {
-        tls_server_destroy(&server);
-        tls_deinit();
-        param_destroy(&param);
-        return EXIT_FAILURE;
-    }
+        listener = listener_new(listener_index,
+                                &server,
+                                &param,
+                                SOCKET_TIMEOUT,
+                                SOCKET_BACKLOG);
+        if (listener == NULL)
+        {
+            go = 0;
+            tls_server_destroy(&server);
+            tls_deinit();
+            util_unload_cred_files();
+            param_destroy(&param);
+            return EXIT_FAILURE;
+        }
 
-    ret = listener_run(listener);
-    if (ret < 0)
-    {
-        listener_delete(listener);
-        tls_server_destroy(&server);
-        tls_deinit();
-        param_destroy(&param);
-        return EXIT_FAILURE;
+        ret = listener_run(listener);
+        if (ret < 0)
+        {
+            go = 0;
+            listener_delete(listener);
+            tls_server_destroy(&server);
+            tls_deinit();
+            util_unload_cred_files();
+            param_destroy(&param);
+            return EXIT_FAILURE;
+        }
     }
 
-    /* the listener runs in its own thread,
+    /* each listener runs in its own thread,
      * waits for a signal and cleans up after itself
      * i.e. calls listener_delete()
      */
@@ -235,14 +282,24 @@ int main(int argc, char **argv)
 
     while (go)
     {
+        /* the sleep is interrupted when a signal is delivered */
         sleep(3600);
+        if (dump_metrics)
+        {
+            dump_metrics = 0;
+            metrics_log();
+        }
     }
     sleep(2);
 
     coap_log_notice("Proxy stopped");
 
+    metrics_log();
+    upstream_destroy_all();
+    resp_cache_destroy_all();
     tls_server_destroy(&server);
     tls_deinit();
+    util_unload_cred_files();
     param_destroy(&param);
 
     return EXIT_SUCCESS;
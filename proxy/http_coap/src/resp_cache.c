@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file resp_cache.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy response cache module
+ *
+ *  The cache stores successful CoAP responses to GET
+ *  requests, keyed by the request method and the request
+ *  options that are not excluded from the cache key. A
+ *  cached response expires when the Max-Age carried in the
+ *  response elapses. The memory consumed by the cache is
+ *  bounded and the least recently used responses are
+ *  evicted when the bound is exceeded, so hot resources are
+ *  served from memory without contacting the CoAP server.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "resp_cache.h"
+#include "coap_log.h"
+
+#define RESP_CACHE_MAX_BYTES  (128 * 1024)                                      /**< Memory budget for the cache */
+#define RESP_CACHE_DEF_MAX_AGE  60                                              /**< Expiry time used when a response carries no Max-Age option (sec) */
+
+/**
+ *  @brief Response cache entry structure
+ */
+typedef struct resp_cache_entry_t
+{
+    char *key;                                                                  /**< Cache key built from the request */
+    size_t key_len;                                                             /**< Length of the cache key */
+    unsigned hash;                                                              /**< Hash of the cache key */
+    coap_msg_t resp;                                                            /**< Copy of the response message */
+    size_t size;                                                                /**< Approximate memory consumed by the entry */
+    time_t expire;                                                              /**< Absolute time at which the entry expires */
+    time_t last_used;                                                           /**< Time at which the entry was last used */
+    struct resp_cache_entry_t *next;                                            /**< Next entry in the cache */
+}
+resp_cache_entry_t;
+
+static pthread_mutex_t resp_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static resp_cache_entry_t *resp_cache_first = NULL;
+static size_t resp_cache_bytes = 0;
+
+static unsigned resp_cache_hash(const char *str, size_t len)
+{
+    unsigned hash = 5381;
+    size_t i = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)str[i];
+    }
+    return hash;
+}
+
+/*  build the cache key for a request: the method followed
+ *  by the number, length and value of every option that is
+ *  not excluded from the cache key
+ *  return: { 0, success
+ *          {<0, error
+ */
+static int resp_cache_key(coap_msg_t *req, char **key, size_t *key_len)
+{
+    coap_msg_op_t *op = NULL;
+    unsigned num = 0;
+    unsigned len = 0;
+    size_t total = 0;
+    char *p = NULL;
+
+    total = 1;  /* method */
+    for (op = coap_msg_get_first_op(req); op != NULL; op = coap_msg_op_get_next(op))
+    {
+        if (!coap_msg_op_num_no_cache_key(coap_msg_op_get_num(op)))
+        {
+            total += sizeof(unsigned) + sizeof(unsigned) + coap_msg_op_get_len(op);
+        }
+    }
+    p = (char *)malloc(total);
+    if (p == NULL)
+    {
+        return -ENOMEM;
+    }
+    *key = p;
+    *key_len = total;
+    *p++ = coap_msg_get_code_detail(req);
+    for (op = coap_msg_get_first_op(req); op != NULL; op = coap_msg_op_get_next(op))
+    {
+        if (!coap_msg_op_num_no_cache_key(coap_msg_op_get_num(op)))
+        {
+            num = coap_msg_op_get_num(op);
+            len = coap_msg_op_get_len(op);
+            memcpy(p, &num, sizeof(unsigned));
+            p += sizeof(unsigned);
+            memcpy(p, &len, sizeof(unsigned));
+            p += sizeof(unsigned);
+            memcpy(p, coap_msg_op_get_val(op), len);
+            p += len;
+        }
+    }
+    return 0;
+}
+
+/* extract the Max-Age value from a response,
+ * the default applies when the option is absent
+ */
+static unsigned resp_cache_max_age(coap_msg_t *resp)
+{
+    coap_msg_op_t *op = NULL;
+    unsigned max_age = 0;
+    unsigned i = 0;
+    char *val = NULL;
+
+    for (op = coap_msg_get_first_op(resp); op != NULL; op = coap_msg_op_get_next(op))
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_MAX_AGE)
+        {
+            val = coap_msg_op_get_val(op);
+            for (i = 0; i < coap_msg_op_get_len(op); i++)
+            {
+                max_age = (max_age << 8) | (unsigned char)val[i];
+            }
+            return max_age;
+        }
+    }
+    return RESP_CACHE_DEF_MAX_AGE;
+}
+
+/* unlink an entry from the cache and update the memory
+ * accounting, the cache mutex must be held by the caller
+ */
+static void resp_cache_unlink(resp_cache_entry_t *entry)
+{
+    resp_cache_entry_t **p = NULL;
+
+    for (p = &resp_cache_first; *p != NULL; p = &(*p)->next)
+    {
+        if (*p == entry)
+        {
+            *p = entry->next;
+            entry->next = NULL;
+            resp_cache_bytes -= entry->size;
+            return;
+        }
+    }
+}
+
+static void resp_cache_entry_delete(resp_cache_entry_t *entry)
+{
+    coap_msg_destroy(&entry->resp);
+    free(entry->key);
+    free(entry);
+}
+
+int resp_cache_get(coap_msg_t *resp, coap_msg_t *req)
+{
+    resp_cache_entry_t *entry = NULL;
+    size_t key_len = 0;
+    unsigned hash = 0;
+    time_t now = 0;
+    char *key = NULL;
+    int ret = 0;
+
+    if ((coap_msg_get_code_class(req) != COAP_MSG_REQ)
+     || (coap_msg_get_code_detail(req) != COAP_MSG_GET))
+    {
+        return -ENOENT;
+    }
+    ret = resp_cache_key(req, &key, &key_len);
+    if (ret < 0)
+    {
+        return -ENOENT;
+    }
+    hash = resp_cache_hash(key, key_len);
+    now = time(NULL);
+    pthread_mutex_lock(&resp_cache_mutex);
+    for (entry = resp_cache_first; entry != NULL; entry = entry->next)
+    {
+        if ((entry->hash == hash)
+         && (entry->key_len == key_len)
+         && (memcmp(entry->key, key, key_len) == 0))
+        {
+            break;
+        }
+    }
+    if (entry == NULL)
+    {
+        pthread_mutex_unlock(&resp_cache_mutex);
+        free(key);
+        return -ENOENT;
+    }
+    if (now >= entry->expire)
+    {
+        resp_cache_unlink(entry);
+        pthread_mutex_unlock(&resp_cache_mutex);
+        resp_cache_entry_delete(entry);
+        free(key);
+        return -ENOENT;
+    }
+    ret = coap_msg_copy(resp, &entry->resp);
+    if (ret < 0)
+    {
+        pthread_mutex_unlock(&resp_cache_mutex);
+        free(key);
+        return -ENOENT;
+    }
+    entry->last_used = now;
+    pthread_mutex_unlock(&resp_cache_mutex);
+    free(key);
+    return 0;
+}
+
+void resp_cache_put(coap_msg_t *req, coap_msg_t *resp)
+{
+    resp_cache_entry_t *oldest = NULL;
+    resp_cache_entry_t *entry = NULL;
+    resp_cache_entry_t *p = NULL;
+    resp_cache_entry_t *q = NULL;
+    unsigned max_age = 0;
+    time_t now = 0;
+    int ret = 0;
+
+    if ((coap_msg_get_code_class(req) != COAP_MSG_REQ)
+     || (coap_msg_get_code_detail(req) != COAP_MSG_GET)
+     || (coap_msg_get_code_class(resp) != COAP_MSG_SUCCESS))
+    {
+        return;
+    }
+    max_age = resp_cache_max_age(resp);
+    if (max_age == 0)
+    {
+        return;
+    }
+    entry = (resp_cache_entry_t *)calloc(1, sizeof(resp_cache_entry_t));
+    if (entry == NULL)
+    {
+        return;
+    }
+    ret = resp_cache_key(req, &entry->key, &entry->key_len);
+    if (ret < 0)
+    {
+        free(entry);
+        return;
+    }
+    coap_msg_create(&entry->resp);
+    ret = coap_msg_copy(&entry->resp, resp);
+    if (ret < 0)
+    {
+        resp_cache_entry_delete(entry);
+        return;
+    }
+    entry->hash = resp_cache_hash(entry->key, entry->key_len);
+    entry->size = sizeof(resp_cache_entry_t) + entry->key_len + coap_msg_get_payload_len(resp);
+    now = time(NULL);
+    entry->expire = now + max_age;
+    entry->last_used = now;
+    if (entry->size > RESP_CACHE_MAX_BYTES)
+    {
+        resp_cache_entry_delete(entry);
+        return;
+    }
+    pthread_mutex_lock(&resp_cache_mutex);
+    /* replace an existing entry with the same key */
+    for (p = resp_cache_first; p != NULL; p = p->next)
+    {
+        if ((p->hash == entry->hash)
+         && (p->key_len == entry->key_len)
+         && (memcmp(p->key, entry->key, entry->key_len) == 0))
+        {
+            resp_cache_unlink(p);
+            break;
+        }
+    }
+    /* evict the least recently used entries until the new */
+    /* entry fits within the memory budget */
+    while ((resp_cache_bytes + entry->size > RESP_CACHE_MAX_BYTES)
+        && (resp_cache_first != NULL))
+    {
+        oldest = resp_cache_first;
+        for (q = resp_cache_first; q != NULL; q = q->next)
+        {
+            if (q->last_used < oldest->last_used)
+            {
+                oldest = q;
+            }
+        }
+        resp_cache_unlink(oldest);
+        resp_cache_entry_delete(oldest);
+    }
+    entry->next = resp_cache_first;
+    resp_cache_first = entry;
+    resp_cache_bytes += entry->size;
+    pthread_mutex_unlock(&resp_cache_mutex);
+    if (p != NULL)
+    {
+        resp_cache_entry_delete(p);
+    }
+}
+
+void resp_cache_destroy_all(void)
+{
+    resp_cache_entry_t *entry = NULL;
+
+    pthread_mutex_lock(&resp_cache_mutex);
+    while (resp_cache_first != NULL)
+    {
+        entry = resp_cache_first;
+        resp_cache_unlink(entry);
+        resp_cache_entry_delete(entry);
+    }
+    pthread_mutex_unlock(&resp_cache_mutex);
+}
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file upstream.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy upstream client pool module
+ *
+ *  The pool keeps CoAP clients with established DTLS
+ *  sessions keyed by CoAP server host and port. An exchange
+ *  checks a client out of the pool and checks it in again
+ *  afterwards, so steady-state proxied requests reuse an
+ *  established session and skip the DTLS handshake
+ *  entirely. The number of pooled clients is capped and
+ *  clients that remain unused for too long are destroyed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "upstream.h"
+#include "coap_log.h"
+
+#define UPSTREAM_MAX_CLIENTS   32                                               /**< Maximum number of CoAP clients kept in the pool */
+#define UPSTREAM_IDLE_TIMEOUT  60                                               /**< Time after which an unused CoAP client is destroyed (sec) */
+
+static pthread_mutex_t upstream_mutex = PTHREAD_MUTEX_INITIALIZER;
+static upstream_client_t *upstream_first = NULL;
+static unsigned upstream_num = 0;
+
+/* unlink an upstream client from the pool,
+ * the pool mutex must be held by the caller
+ */
+static void upstream_unlink(upstream_client_t *uc)
+{
+    upstream_client_t **p = NULL;
+
+    for (p = &upstream_first; *p != NULL; p = &(*p)->next)
+    {
+        if (*p == uc)
+        {
+            *p = uc->next;
+            uc->next = NULL;
+            upstream_num--;
+            return;
+        }
+    }
+}
+
+static void upstream_client_delete(upstream_client_t *uc)
+{
+    coap_log_info("Disconnecting from CoAP server host %s and port %s",
+                  uc->host, uc->port);
+    coap_client_destroy(&uc->client);
+    free(uc->port);
+    free(uc->host);
+    free(uc);
+}
+
+/* destroy pooled clients that have been unused for longer
+ * than the idle timeout, the pool mutex must be held by
+ * the caller, the expired clients are returned so that
+ * they can be destroyed after the mutex is released
+ */
+static upstream_client_t *upstream_reap(void)
+{
+    upstream_client_t *expired = NULL;
+    upstream_client_t *next = NULL;
+    upstream_client_t *uc = NULL;
+    time_t now = 0;
+
+    now = time(NULL);
+    for (uc = upstream_first; uc != NULL; uc = next)
+    {
+        next = uc->next;
+        if ((!uc->in_use) && (now - uc->last_used >= UPSTREAM_IDLE_TIMEOUT))
+        {
+            upstream_unlink(uc);
+            uc->next = expired;
+            expired = uc;
+        }
+    }
+    return expired;
+}
+
+/*  return: { 0, success
+ *          {<0, error
+ */
+int upstream_checkout(upstream_client_t **uc, uri_view_t *uri_view, param_t *param)
+{
+    upstream_client_t *expired = NULL;
+    upstream_client_t *oldest = NULL;
+    upstream_client_t *new = NULL;
+    upstream_client_t *p = NULL;
+    uri_t uri = {0};
+    int ret = 0;
+
+    *uc = NULL;
+
+    /* fast path: find an idle pooled client for the same host */
+    /* and port, the URI view is compared without materializing */
+    pthread_mutex_lock(&upstream_mutex);
+    expired = upstream_reap();
+    if ((uri_view_get_host(uri_view) != NULL)
+     && (uri_view_get_port(uri_view) != NULL))
+    {
+        for (p = upstream_first; p != NULL; p = p->next)
+        {
+            if ((!p->in_use)
+             && (strlen(p->host) == uri_view_get_host_len(uri_view))
+             && (strncasecmp(uri_view_get_host(uri_view), p->host, uri_view_get_host_len(uri_view)) == 0)
+             && (strlen(p->port) == uri_view_get_port_len(uri_view))
+             && (strncmp(uri_view_get_port(uri_view), p->port, uri_view_get_port_len(uri_view)) == 0))
+            {
+                p->in_use = 1;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&upstream_mutex);
+    while (expired != NULL)
+    {
+        new = expired;
+        expired = new->next;
+        new->next = NULL;
+        upstream_client_delete(new);
+    }
+    if (p != NULL)
+    {
+        coap_log_debug("Reusing connection to CoAP server host %s and port %s",
+                       p->host, p->port);
+        *uc = p;
+        return 0;
+    }
+
+    /* slow path: create a new client, the handshake is */
+    /* performed without holding the pool mutex */
+    ret = uri_view_materialize(&uri, uri_view);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    new = (upstream_client_t *)calloc(1, sizeof(upstream_client_t));
+    if (new == NULL)
+    {
+        uri_destroy(&uri);
+        return -ENOMEM;
+    }
+    new->host = strdup(uri_get_host(&uri));
+    if (new->host == NULL)
+    {
+        free(new);
+        uri_destroy(&uri);
+        return -ENOMEM;
+    }
+    new->port = strdup(uri_get_port(&uri));
+    if (new->port == NULL)
+    {
+        free(new->host);
+        free(new);
+        uri_destroy(&uri);
+        return -ENOMEM;
+    }
+    uri_destroy(&uri);
+    coap_log_info("Connecting to CoAP server host %s and port %s",
+                  new->host, new->port);
+    ret = coap_client_create(&new->client,
+                             new->host,
+                             new->port,
+                             param_get_coap_client_key_file_name(param),
+                             param_get_coap_client_cert_file_name(param),
+                             param_get_coap_client_trust_file_name(param),
+                             NULL);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to connect to CoAP server host %s and port %s: %s",
+                       new->host, new->port, strerror(-ret));
+        free(new->port);
+        free(new->host);
+        free(new);
+        return ret;
+    }
+    new->in_use = 1;
+
+    /* add the new client to the pool, evicting the least */
+    /* recently used idle client if the pool is full, the */
+    /* new client remains unpooled if every pooled client */
+    /* is checked out */
+    pthread_mutex_lock(&upstream_mutex);
+    if (upstream_num >= UPSTREAM_MAX_CLIENTS)
+    {
+        for (p = upstream_first; p != NULL; p = p->next)
+        {
+            if ((!p->in_use)
+             && ((oldest == NULL) || (p->last_used < oldest->last_used)))
+            {
+                oldest = p;
+            }
+        }
+        if (oldest != NULL)
+        {
+            upstream_unlink(oldest);
+        }
+    }
+    if (upstream_num < UPSTREAM_MAX_CLIENTS)
+    {
+        new->pooled = 1;
+        new->next = upstream_first;
+        upstream_first = new;
+        upstream_num++;
+    }
+    pthread_mutex_unlock(&upstream_mutex);
+    if (oldest != NULL)
+    {
+        upstream_client_delete(oldest);
+    }
+    *uc = new;
+    return 0;
+}
+
+/*  keep: {0, the session may be broken, destroy the client
+ *        {1, return the client to the pool
+ */
+void upstream_checkin(upstream_client_t *uc, int keep)
+{
+    if ((uc->pooled) && (keep))
+    {
+        pthread_mutex_lock(&upstream_mutex);
+        uc->in_use = 0;
+        uc->last_used = time(NULL);
+        pthread_mutex_unlock(&upstream_mutex);
+        return;
+    }
+    if (uc->pooled)
+    {
+        pthread_mutex_lock(&upstream_mutex);
+        upstream_unlink(uc);
+        pthread_mutex_unlock(&upstream_mutex);
+    }
+    upstream_client_delete(uc);
+}
+
+/* destroy all pooled clients, called at shutdown when no
+ * more exchanges are in progress
+ */
+void upstream_destroy_all(void)
+{
+    upstream_client_t *uc = NULL;
+
+    pthread_mutex_lock(&upstream_mutex);
+    while (upstream_first != NULL)
+    {
+        uc = upstream_first;
+        upstream_unlink(uc);
+        pthread_mutex_unlock(&upstream_mutex);
+        upstream_client_delete(uc);
+        pthread_mutex_lock(&upstream_mutex);
+    }
+    pthread_mutex_unlock(&upstream_mutex);
+}
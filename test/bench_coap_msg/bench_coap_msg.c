@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file bench_coap_msg.c
+ *
+ *  @brief Source file for the FreeCoAP message parser/formatter benchmark
+ *
+ *  Drives coap_msg_parse() and coap_msg_format() over representative
+ *  message corpora and reports ops/sec, ns/op and allocations/op.
+ *  Build with LDFLAGS += -Wl,--wrap=malloc,--wrap=free to enable the
+ *  allocation counters.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "coap_msg.h"
+
+#define BENCH_NUM_ITER      200000                                              /**< Number of iterations per benchmark */
+#define BENCH_NSEC_PER_SEC  1000000000ULL                                       /**< Nanoseconds per second */
+
+static unsigned long long bench_num_alloc = 0;                                  /**< Number of allocations observed */
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+/**
+ *  @brief Counting wrapper for malloc
+ *
+ *  @param[in] size Number of bytes to allocate
+ *
+ *  @returns Pointer to the allocated memory
+ */
+void *__wrap_malloc(size_t size)
+{
+    bench_num_alloc++;
+    return __real_malloc(size);
+}
+
+/**
+ *  @brief Pass-through wrapper for free
+ *
+ *  @param[in,out] ptr Pointer to the allocated memory
+ */
+void __wrap_free(void *ptr)
+{
+    __real_free(ptr);
+}
+
+/**
+ *  @brief Get the value of a monotonic clock in nanoseconds
+ *
+ *  @returns Clock value
+ */
+static unsigned long long bench_time(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * BENCH_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ *  @brief Report the result of a benchmark
+ *
+ *  @param[in] name Name of the benchmark
+ *  @param[in] num_iter Number of iterations performed
+ *  @param[in] nsec Elapsed time in nanoseconds
+ *  @param[in] num_alloc Number of allocations observed
+ */
+static void bench_report(const char *name, unsigned num_iter, unsigned long long nsec, unsigned long long num_alloc)
+{
+    printf("%-32s %12.0f ops/sec %8.1f ns/op %8.2f allocs/op\n",
+           name,
+           (double)num_iter * BENCH_NSEC_PER_SEC / nsec,
+           (double)nsec / num_iter,
+           (double)num_alloc / num_iter);
+}
+
+/**
+ *  @brief Build a tiny acknowledgement message
+ *
+ *  @param[out] buf Pointer to a buffer to contain the formatted message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Length of the formatted message
+ */
+static size_t bench_build_ack(char *buf, size_t len)
+{
+    coap_msg_t msg = {0};
+    ssize_t num = 0;
+
+    coap_msg_create(&msg);
+    coap_msg_set_type(&msg, COAP_MSG_ACK);
+    coap_msg_set_msg_id(&msg, 0x1234);
+    num = coap_msg_format(&msg, buf, len);
+    coap_msg_destroy(&msg);
+    return num > 0 ? num : 0;
+}
+
+/**
+ *  @brief Build an option-heavy request message
+ *
+ *  @param[out] buf Pointer to a buffer to contain the formatted message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Length of the formatted message
+ */
+static size_t bench_build_op_heavy(char *buf, size_t len)
+{
+    coap_msg_t msg = {0};
+    ssize_t num = 0;
+    char token[4] = {0x01, 0x02, 0x03, 0x04};
+    char port[2] = {0x16, 0x33};
+
+    coap_msg_create(&msg);
+    coap_msg_set_type(&msg, COAP_MSG_CON);
+    coap_msg_set_code(&msg, COAP_MSG_REQ, COAP_MSG_GET);
+    coap_msg_set_msg_id(&msg, 0x5678);
+    coap_msg_set_token(&msg, token, sizeof(token));
+    coap_msg_add_op(&msg, COAP_MSG_URI_HOST, 9, "benchhost");
+    coap_msg_add_op(&msg, COAP_MSG_URI_PORT, 2, port);
+    coap_msg_add_op(&msg, COAP_MSG_URI_PATH, 9, "telemetry");
+    coap_msg_add_op(&msg, COAP_MSG_URI_PATH, 7, "sensors");
+    coap_msg_add_op(&msg, COAP_MSG_URI_PATH, 11, "temperature");
+    coap_msg_add_op(&msg, COAP_MSG_URI_QUERY, 9, "page=1234");
+    coap_msg_add_op(&msg, COAP_MSG_URI_QUERY, 8, "count=64");
+    coap_msg_add_op(&msg, COAP_MSG_ACCEPT, 1, "\x32");
+    num = coap_msg_format(&msg, buf, len);
+    coap_msg_destroy(&msg);
+    return num > 0 ? num : 0;
+}
+
+/**
+ *  @brief Build a maximum-payload message
+ *
+ *  @param[out] buf Pointer to a buffer to contain the formatted message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Length of the formatted message
+ */
+static size_t bench_build_max_payload(char *buf, size_t len)
+{
+    coap_msg_t msg = {0};
+    ssize_t num = 0;
+    char token[8] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+    char payload[COAP_MSG_MAX_BUF_LEN - 13] = {0};
+    size_t i = 0;
+
+    for (i = 0; i < sizeof(payload); i++)
+    {
+        payload[i] = i & 0xff;
+    }
+    coap_msg_create(&msg);
+    coap_msg_set_type(&msg, COAP_MSG_CON);
+    coap_msg_set_code(&msg, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
+    coap_msg_set_msg_id(&msg, 0x9abc);
+    coap_msg_set_token(&msg, token, sizeof(token));
+    coap_msg_set_payload(&msg, payload, sizeof(payload));
+    num = coap_msg_format(&msg, buf, len);
+    coap_msg_destroy(&msg);
+    return num > 0 ? num : 0;
+}
+
+/**
+ *  @brief Benchmark the parse functions over a message
+ *
+ *  @param[in] name Name of the corpus entry
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int bench_parse(const char *name, char *buf, size_t len)
+{
+    unsigned long long num_alloc = 0;
+    unsigned long long start = 0;
+    coap_msg_t msg = {0};
+    unsigned i = 0;
+    ssize_t num = 0;
+    char label[64] = {0};
+
+    coap_msg_create(&msg);
+    num_alloc = bench_num_alloc;
+    start = bench_time();
+    for (i = 0; i < BENCH_NUM_ITER; i++)
+    {
+        num = coap_msg_parse(&msg, buf, len);
+        if (num < 0)
+        {
+            coap_msg_destroy(&msg);
+            return num;
+        }
+    }
+    snprintf(label, sizeof(label), "parse/%s", name);
+    bench_report(label, BENCH_NUM_ITER, bench_time() - start, bench_num_alloc - num_alloc);
+
+    num_alloc = bench_num_alloc;
+    start = bench_time();
+    for (i = 0; i < BENCH_NUM_ITER; i++)
+    {
+        num = coap_msg_parse_borrowed(&msg, buf, len);
+        if (num < 0)
+        {
+            coap_msg_destroy(&msg);
+            return num;
+        }
+    }
+    snprintf(label, sizeof(label), "parse_borrowed/%s", name);
+    bench_report(label, BENCH_NUM_ITER, bench_time() - start, bench_num_alloc - num_alloc);
+    coap_msg_destroy(&msg);
+    return 0;
+}
+
+/**
+ *  @brief Benchmark the format function over a message
+ *
+ *  @param[in] name Name of the corpus entry
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int bench_format(const char *name, char *buf, size_t len)
+{
+    unsigned long long num_alloc = 0;
+    unsigned long long start = 0;
+    coap_msg_t msg = {0};
+    unsigned i = 0;
+    ssize_t num = 0;
+    char tmp[COAP_MSG_MAX_BUF_LEN] = {0};
+    char label[64] = {0};
+
+    coap_msg_create(&msg);
+    num = coap_msg_parse(&msg, buf, len);
+    if (num < 0)
+    {
+        coap_msg_destroy(&msg);
+        return num;
+    }
+    num_alloc = bench_num_alloc;
+    start = bench_time();
+    for (i = 0; i < BENCH_NUM_ITER; i++)
+    {
+        num = coap_msg_format(&msg, tmp, sizeof(tmp));
+        if (num < 0)
+        {
+            coap_msg_destroy(&msg);
+            return num;
+        }
+    }
+    snprintf(label, sizeof(label), "format/%s", name);
+    bench_report(label, BENCH_NUM_ITER, bench_time() - start, bench_num_alloc - num_alloc);
+    coap_msg_destroy(&msg);
+    return 0;
+}
+
+/**
+ *  @brief Main function for the FreeCoAP message parser/formatter benchmark
+ *
+ *  @returns Operation status
+ *  @retval EXIT_SUCCESS Success
+ *  @retval EXIT_FAILURE Error
+ */
+int main(void)
+{
+    size_t len = 0;
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+
+    len = bench_build_ack(buf, sizeof(buf));
+    if ((len == 0)
+     || (bench_parse("tiny_ack", buf, len) < 0)
+     || (bench_format("tiny_ack", buf, len) < 0))
+    {
+        return EXIT_FAILURE;
+    }
+    len = bench_build_op_heavy(buf, sizeof(buf));
+    if ((len == 0)
+     || (bench_parse("op_heavy", buf, len) < 0)
+     || (bench_format("op_heavy", buf, len) < 0))
+    {
+        return EXIT_FAILURE;
+    }
+    len = bench_build_max_payload(buf, sizeof(buf));
+    if ((len == 0)
+     || (bench_parse("max_payload", buf, len) < 0)
+     || (bench_format("max_payload", buf, len) < 0))
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file coap_loadgen.c
+ *
+ *  @brief Source file for the FreeCoAP load generation tool
+ *
+ *  Sustain a configurable request rate against a CoAP server
+ *  across many simulated endpoints, each with its own client
+ *  and session, and report throughput, latency percentiles
+ *  and loss. The request rate can be ramped up over a number
+ *  of seconds to locate the knee point of a server build.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "coap_client.h"
+#include "coap_msg.h"
+#include "coap_log.h"
+
+#define HOST             "::1"                                                  /**< Default host address of the server */
+#define PORT             "12436"                                                /**< Default UDP port number of the server */
+#define KEY_FILE_NAME    "../../certs/client_privkey.pem"                       /**< DTLS key file name */
+#define CERT_FILE_NAME   "../../certs/client_cert.pem"                          /**< DTLS certificate file name */
+#define TRUST_FILE_NAME  "../../certs/root_server_cert.pem"                     /**< DTLS trust file name */
+#define CRL_FILE_NAME    ""                                                     /**< DTLS certificate revocation list file name */
+#define URI_PATH         "resource"                                             /**< Default URI path of the requests */
+
+#define DEF_NUM_ENDPOINTS  8                                                    /**< Default number of simulated endpoints */
+#define DEF_RATE           100                                                  /**< Default request rate (requests per second) */
+#define DEF_DURATION       10                                                   /**< Default test duration (sec) */
+#define DEF_CONCURRENCY    8                                                    /**< Default number of concurrent exchanges per endpoint */
+#define MAX_ENDPOINTS      1024                                                 /**< Maximum number of simulated endpoints */
+#define TICK_MSEC          10                                                   /**< Granularity of the request pacing timer */
+#define DRAIN_SEC          5                                                    /**< Maximum time to wait for outstanding exchanges after the test duration */
+#define NUM_LAT_BUCKETS    32                                                   /**< Number of buckets in the latency histogram */
+
+/**
+ *  @brief Endpoint structure
+ */
+typedef struct
+{
+    coap_client_t client;                                                       /**< Client used by the endpoint */
+    unsigned outstanding;                                                       /**< Number of exchanges in flight on the endpoint */
+}
+loadgen_endpoint_t;
+
+/**
+ *  @brief Per-request context structure
+ */
+typedef struct
+{
+    struct timespec start;                                                      /**< Time that the request was submitted */
+    loadgen_endpoint_t *ep;                                                     /**< Endpoint that submitted the request */
+}
+loadgen_req_t;
+
+/**
+ *  @brief Statistics structure
+ */
+typedef struct
+{
+    unsigned long long submitted;                                               /**< Number of requests submitted */
+    unsigned long long completed;                                               /**< Number of responses received */
+    unsigned long long timeouts;                                                /**< Number of requests that timed out */
+    unsigned long long errors;                                                  /**< Number of requests that failed for another reason */
+    unsigned long long busy;                                                    /**< Number of requests dropped because all endpoints were at capacity */
+    unsigned long long lat_hist[NUM_LAT_BUCKETS];                               /**< Histogram of response latencies with log2 usec buckets */
+    unsigned long long max_lat_usec;                                            /**< Largest observed response latency (usec) */
+}
+loadgen_stats_t;
+
+static loadgen_stats_t stats = {0};                                             /**< Statistics accumulated over the test */
+
+/**
+ *  @brief Calculate the time elapsed since a start time
+ *
+ *  @param[in] start Pointer to the start time
+ *
+ *  @returns Elapsed time (usec)
+ */
+static unsigned long long loadgen_elapsed_usec(struct timespec *start)
+{
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) * 1000000ULL)
+         + ((now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+/**
+ *  @brief Record a response latency in the histogram
+ *
+ *  @param[in] usec Response latency (usec)
+ */
+static void loadgen_record_lat(unsigned long long usec)
+{
+    unsigned bucket = 0;
+
+    while ((usec >> (bucket + 1)) && (bucket < NUM_LAT_BUCKETS - 1))
+    {
+        bucket++;
+    }
+    stats.lat_hist[bucket]++;
+    if (usec > stats.max_lat_usec)
+    {
+        stats.max_lat_usec = usec;
+    }
+}
+
+/**
+ *  @brief Look up a latency percentile in the histogram
+ *
+ *  @param[in] percent Percentile to look up
+ *
+ *  @returns Upper bound of the bucket containing the percentile (usec)
+ */
+static unsigned long long loadgen_lat_percentile(unsigned percent)
+{
+    unsigned long long total = 0;
+    unsigned long long count = 0;
+    unsigned i = 0;
+
+    for (i = 0; i < NUM_LAT_BUCKETS; i++)
+    {
+        total += stats.lat_hist[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    for (i = 0; i < NUM_LAT_BUCKETS; i++)
+    {
+        count += stats.lat_hist[i];
+        if (count * 100 >= total * percent)
+        {
+            return 2ULL << i;
+        }
+    }
+    return 2ULL << (NUM_LAT_BUCKETS - 1);
+}
+
+/**
+ *  @brief Callback function to handle the result of an exchange
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] resp Pointer to the response message
+ *  @param[in] status Result of the exchange
+ *  @param[in] data Pointer to a per-request context structure
+ */
+static void loadgen_done(coap_client_t *client, coap_msg_t *resp, int status, void *data)
+{
+    loadgen_req_t *req = (loadgen_req_t *)data;
+
+    req->ep->outstanding--;
+    if (status == 0)
+    {
+        stats.completed++;
+        loadgen_record_lat(loadgen_elapsed_usec(&req->start));
+    }
+    else if (status == -ETIMEDOUT)
+    {
+        stats.timeouts++;
+    }
+    else
+    {
+        stats.errors++;
+    }
+    free(req);
+}
+
+/**
+ *  @brief Submit one request on an endpoint
+ *
+ *  @param[in,out] ep Pointer to an endpoint structure
+ *  @param[in] uri_path String containing the URI path of the request
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int loadgen_submit(loadgen_endpoint_t *ep, const char *uri_path)
+{
+    loadgen_req_t *req = NULL;
+    coap_msg_t msg = {0};
+    int ret = 0;
+
+    req = (loadgen_req_t *)malloc(sizeof(loadgen_req_t));
+    if (req == NULL)
+    {
+        return -ENOMEM;
+    }
+    memset(req, 0, sizeof(loadgen_req_t));
+    req->ep = ep;
+    coap_msg_create(&msg);
+    ret = coap_msg_set_type(&msg, COAP_MSG_CON);
+    if (ret == 0)
+    {
+        ret = coap_msg_set_code(&msg, COAP_MSG_REQ, COAP_MSG_GET);
+    }
+    if (ret == 0)
+    {
+        ret = coap_msg_add_op(&msg, COAP_MSG_URI_PATH, strlen(uri_path), uri_path);
+    }
+    if (ret == 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &req->start);
+        ret = coap_client_submit(&ep->client, &msg, loadgen_done, req);
+    }
+    coap_msg_destroy(&msg);
+    if (ret < 0)
+    {
+        free(req);
+        return ret;
+    }
+    ep->outstanding++;
+    stats.submitted++;
+    return 0;
+}
+
+/**
+ *  @brief Print the final report
+ *
+ *  @param[in] elapsed_usec Total test time (usec)
+ */
+static void loadgen_report(unsigned long long elapsed_usec)
+{
+    unsigned long long lost = stats.timeouts + stats.errors;
+
+    printf("\n");
+    printf("duration:   %llu.%03llu sec\n", elapsed_usec / 1000000, (elapsed_usec % 1000000) / 1000);
+    printf("submitted:  %llu\n", stats.submitted);
+    printf("completed:  %llu\n", stats.completed);
+    printf("timeouts:   %llu\n", stats.timeouts);
+    printf("errors:     %llu\n", stats.errors);
+    printf("backpressure drops: %llu\n", stats.busy);
+    if (stats.submitted > 0)
+    {
+        printf("loss:       %llu.%02llu %%\n", lost * 100 / stats.submitted, (lost * 10000 / stats.submitted) % 100);
+    }
+    if (elapsed_usec > 0)
+    {
+        printf("throughput: %llu req/sec\n", stats.completed * 1000000 / elapsed_usec);
+    }
+    printf("latency p50:  <= %llu usec\n", loadgen_lat_percentile(50));
+    printf("latency p90:  <= %llu usec\n", loadgen_lat_percentile(90));
+    printf("latency p99:  <= %llu usec\n", loadgen_lat_percentile(99));
+    printf("latency max:  %llu usec\n", stats.max_lat_usec);
+}
+
+/**
+ *  @brief Helper function to list command line options
+ */
+static void usage(void)
+{
+    printf("Usage: coap_loadgen <options>\n");
+    printf("Options:\n");
+    printf("    -a addr - host address of the server (default: %s)\n", HOST);
+    printf("    -p port - UDP port number of the server (default: %s)\n", PORT);
+    printf("    -u path - URI path of the requests (default: %s)\n", URI_PATH);
+    printf("    -n num - number of simulated endpoints (default: %u)\n", DEF_NUM_ENDPOINTS);
+    printf("    -r rate - request rate in requests per second (default: %u)\n", DEF_RATE);
+    printf("    -t sec - test duration in seconds (default: %u)\n", DEF_DURATION);
+    printf("    -R sec - ramp the request rate up over this many seconds (default: 0)\n");
+    printf("    -c num - concurrent exchanges per endpoint (default: %u)\n", DEF_CONCURRENCY);
+    printf("    -l log-level - set the log level (0 to 4)\n");
+}
+
+/**
+ *  @brief Main function for the FreeCoAP load generation tool
+ *
+ *  @param[in] argc Number of command line arguments
+ *  @param[in] argv Array of pointers to command line arguments
+ *
+ *  @returns Operation status
+ *  @retval EXIT_SUCCESS Success
+ *  @retval EXIT_FAILURE Error
+ */
+int main(int argc, char **argv)
+{
+    loadgen_endpoint_t *eps = NULL;
+    struct epoll_event events[16] = {{0}};
+    struct itimerspec its = {{0}};
+    struct timespec test_start = {0};
+    unsigned long long elapsed_usec = 0;
+    unsigned long long tokens = 0;
+    const char *opts = ":ha:p:u:n:r:t:R:c:l:";
+    const char *host = HOST;
+    const char *port = PORT;
+    const char *uri_path = URI_PATH;
+    unsigned num_endpoints = DEF_NUM_ENDPOINTS;
+    unsigned rate = DEF_RATE;
+    unsigned duration = DEF_DURATION;
+    unsigned ramp = 0;
+    unsigned concurrency = DEF_CONCURRENCY;
+    unsigned eff_rate = 0;
+    unsigned outstanding = 0;
+    unsigned rr = 0;
+    unsigned i = 0;
+    unsigned j = 0;
+    uint64_t expiry = 0;
+    int log_level = COAP_LOG_ERROR;
+    int tick_fd = -1;
+    int epoll_fd = -1;
+    int draining = 0;
+    int num = 0;
+    int ret = 0;
+    int c = 0;
+
+    while ((c = getopt(argc, argv, opts)) != -1)
+    {
+        switch (c)
+        {
+        case 'h':
+            usage();
+            return EXIT_SUCCESS;
+        case 'a':
+            host = optarg;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        case 'u':
+            uri_path = optarg;
+            break;
+        case 'n':
+            num_endpoints = atoi(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 't':
+            duration = atoi(optarg);
+            break;
+        case 'R':
+            ramp = atoi(optarg);
+            break;
+        case 'c':
+            concurrency = atoi(optarg);
+            break;
+        case 'l':
+            log_level = atoi(optarg);
+            break;
+        case ':':
+            printf("Option '%c' requires an argument\n", optopt);
+            return EXIT_FAILURE;
+        case '?':
+            printf("Unknown option '%c'\n", optopt);
+            return EXIT_FAILURE;
+        default:
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if ((num_endpoints == 0) || (num_endpoints > MAX_ENDPOINTS)
+     || (rate == 0) || (duration == 0) || (concurrency == 0))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    coap_log_set_level(log_level);
+
+    /* create the endpoints */
+    eps = (loadgen_endpoint_t *)malloc(num_endpoints * sizeof(loadgen_endpoint_t));
+    if (eps == NULL)
+    {
+        coap_log_error("%s", strerror(ENOMEM));
+        return EXIT_FAILURE;
+    }
+    memset(eps, 0, num_endpoints * sizeof(loadgen_endpoint_t));
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+    {
+        coap_log_error("%s", strerror(errno));
+        free(eps);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < num_endpoints; i++)
+    {
+#ifdef COAP_DTLS_EN
+        ret = coap_client_create(&eps[i].client, host, port, KEY_FILE_NAME, CERT_FILE_NAME, TRUST_FILE_NAME, CRL_FILE_NAME);
+#else
+        ret = coap_client_create(&eps[i].client, host, port);
+#endif
+        if (ret == 0)
+        {
+            ret = coap_client_set_nstart(&eps[i].client, concurrency);
+        }
+        if (ret == 0)
+        {
+            struct epoll_event event = {0};
+            event.events = EPOLLIN;
+            event.data.u32 = i;
+            ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, eps[i].client.sd, &event);
+            if (ret == 0)
+            {
+                ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, eps[i].client.timer_fd, &event);
+            }
+            if (ret < 0)
+            {
+                ret = -errno;
+            }
+        }
+        if (ret < 0)
+        {
+            coap_log_error("Failed to create endpoint %u: %s", i, strerror(-ret));
+            while (i > 0)
+            {
+                coap_client_destroy(&eps[--i].client);
+            }
+            close(epoll_fd);
+            free(eps);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("Created %u endpoints connected to host %s and port %s\n", num_endpoints, host, port);
+
+    /* create the pacing timer */
+    tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (tick_fd < 0)
+    {
+        coap_log_error("%s", strerror(errno));
+        for (i = 0; i < num_endpoints; i++)
+        {
+            coap_client_destroy(&eps[i].client);
+        }
+        close(epoll_fd);
+        free(eps);
+        return EXIT_FAILURE;
+    }
+    its.it_value.tv_nsec = TICK_MSEC * 1000000;
+    its.it_interval.tv_nsec = TICK_MSEC * 1000000;
+    timerfd_settime(tick_fd, 0, &its, NULL);
+    {
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.u32 = num_endpoints;  /* out of range value identifies the pacing timer */
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tick_fd, &event);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &test_start);
+    printf("Running for %u sec at %u req/sec across %u endpoints\n", duration, rate, num_endpoints);
+
+    /* event loop */
+    while (1)
+    {
+        num = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), 1000);
+        if (num < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            coap_log_error("%s", strerror(errno));
+            break;
+        }
+        elapsed_usec = loadgen_elapsed_usec(&test_start);
+        for (i = 0; i < (unsigned)num; i++)
+        {
+            if (events[i].data.u32 < num_endpoints)
+            {
+                coap_client_process(&eps[events[i].data.u32].client);
+                continue;
+            }
+            /* pacing timer tick */
+            if (read(tick_fd, &expiry, sizeof(expiry)) != (ssize_t)sizeof(expiry))
+            {
+                continue;
+            }
+            if (draining)
+            {
+                continue;
+            }
+            /* ramp the request rate */
+            eff_rate = rate;
+            if ((ramp > 0) && (elapsed_usec < (unsigned long long)ramp * 1000000))
+            {
+                eff_rate = (unsigned)((unsigned long long)rate * elapsed_usec / ((unsigned long long)ramp * 1000000));
+                if (eff_rate == 0)
+                {
+                    eff_rate = 1;
+                }
+            }
+            /* accumulate request tokens, capped at one second worth */
+            tokens += (unsigned long long)eff_rate * expiry * TICK_MSEC * 1000;
+            if (tokens > (unsigned long long)eff_rate * 1000000)
+            {
+                tokens = (unsigned long long)eff_rate * 1000000;
+            }
+            while (tokens >= 1000000)
+            {
+                /* find an endpoint with spare capacity */
+                for (j = 0; j < num_endpoints; j++)
+                {
+                    if (eps[(rr + j) % num_endpoints].outstanding < concurrency)
+                    {
+                        break;
+                    }
+                }
+                if (j == num_endpoints)
+                {
+                    stats.busy++;
+                    tokens -= 1000000;
+                    continue;
+                }
+                rr = (rr + j) % num_endpoints;
+                ret = loadgen_submit(&eps[rr], uri_path);
+                rr = (rr + 1) % num_endpoints;
+                if (ret < 0)
+                {
+                    stats.errors++;
+                }
+                tokens -= 1000000;
+            }
+        }
+        /* stop submitting when the test duration has elapsed */
+        if ((!draining) && (elapsed_usec >= (unsigned long long)duration * 1000000))
+        {
+            draining = 1;
+        }
+        if (draining)
+        {
+            outstanding = 0;
+            for (i = 0; i < num_endpoints; i++)
+            {
+                outstanding += eps[i].outstanding;
+            }
+            if ((outstanding == 0)
+             || (elapsed_usec >= ((unsigned long long)duration + DRAIN_SEC) * 1000000))
+            {
+                break;
+            }
+        }
+    }
+
+    loadgen_report(loadgen_elapsed_usec(&test_start));
+
+    for (i = 0; i < num_endpoints; i++)
+    {
+        coap_client_destroy(&eps[i].client);
+    }
+    close(tick_fd);
+    close(epoll_fd);
+    free(eps);
+    return EXIT_SUCCESS;
+}
@@ -33,22 +33,45 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "test.h"
 
 #define START_STR   "\n----------------------------------------\n"              /**< String printed at the start of a test */
 #define PASS_STR    "-----------------<pass>-----------------\n"                /**< String printed at the end of a test that passed */
 #define FAIL_STR    "*****************[FAIL]*****************\n"                /**< String printed at the end of a test that failed */
 
-unsigned test_run(test_t *test, unsigned num_tests)
+static unsigned long test_elapsed_usec(struct timespec *start)
+{
+    struct timespec end = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000
+         + (end.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void test_print_total(unsigned num_tests, unsigned num_passed)
+{
+    if (num_passed < num_tests)
+        printf("\n[Total: %u, Pass: %u, Fail: %u]\n\n", num_tests, num_passed, num_tests - num_passed);
+    else
+        printf("\n[Total: %u, Pass: %u]\n\n", num_tests, num_passed);
+}
+
+static unsigned test_run_slice(test_t *test, unsigned num_tests)
 {
+    struct timespec start = {0};
     test_result_t result = 0;
-    unsigned num_passed = 0;  
+    unsigned num_passed = 0;
     unsigned i = 0;
 
     printf(START_STR);
     for (i = 0; i < num_tests; i++)
     {
+        clock_gettime(CLOCK_MONOTONIC, &start);
         result = (*test[i].func)(test[i].data);
+        printf("time: %lu usec\n", test_elapsed_usec(&start));
         if (result == PASS)
         {
             num_passed++;
@@ -59,10 +82,67 @@ unsigned test_run(test_t *test, unsigned num_tests)
             printf(FAIL_STR);
         }
     }
-    if (num_passed < num_tests)
-        printf("\n[Total: %u, Pass: %u, Fail: %u]\n\n", num_tests, num_passed, num_tests - num_passed);
-    else
-        printf("\n[Total: %u, Pass: %u]\n\n", num_tests, num_passed);
+    return num_passed;
+}
+
+unsigned test_run(test_t *test, unsigned num_tests)
+{
+    unsigned num_passed = 0;
+
+    num_passed = test_run_slice(test, num_tests);
+    test_print_total(num_tests, num_passed);
+
+    return num_passed;
+}
+
+unsigned test_run_groups(test_t *test, unsigned num_tests, unsigned num_groups)
+{
+    struct timespec start = {0};
+    unsigned num_passed = 0;
+    unsigned first = 0;
+    unsigned last = 0;
+    unsigned i = 0;
+    pid_t pid[TEST_MAX_NUM_GROUPS] = {0};
+    int stat_val = 0;
+
+    if ((num_groups < 2) || (num_groups > TEST_MAX_NUM_GROUPS))
+    {
+        return test_run(test, num_tests);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* each group of tests runs in its own child process so that */
+    /* the groups execute concurrently with isolated state, the */
+    /* child reports the number of tests that passed in its exit */
+    /* status */
+    for (i = 0; i < num_groups; i++)
+    {
+        first = (i * num_tests) / num_groups;
+        last = ((i + 1) * num_tests) / num_groups;
+        fflush(stdout);
+        pid[i] = fork();
+        if (pid[i] == 0)
+        {
+            _exit(test_run_slice(test + first, last - first));
+        }
+        if (pid[i] == -1)
+        {
+            /* run the group in this process instead */
+            num_passed += test_run_slice(test + first, last - first);
+        }
+    }
+    for (i = 0; i < num_groups; i++)
+    {
+        if ((pid[i] > 0)
+         && (waitpid(pid[i], &stat_val, 0) == pid[i])
+         && (WIFEXITED(stat_val)))
+        {
+            num_passed += WEXITSTATUS(stat_val);
+        }
+    }
+    printf("\ngroups: %u, time: %lu usec\n", num_groups, test_elapsed_usec(&start));
+    test_print_total(num_tests, num_passed);
 
     return num_passed;
 }
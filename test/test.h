@@ -36,6 +36,8 @@
 
 #define DEBUG_PRINT(fmt, ...) //printf(fmt, ## __VA_ARGS__)                     /**< Debug print */
 
+#define TEST_MAX_NUM_GROUPS  16                                                 /**< Maximum number of test groups that run concurrently */
+
 /**
  *  @brief Test result enumeration
  */
@@ -71,4 +73,20 @@ test_t;
  */
 unsigned test_run(test_t *test, unsigned num_tests);
 
+/**
+ *  @brief Run the tests split into groups of child processes that execute concurrently
+ *
+ *  Each group runs in its own forked child process with isolated state
+ *  so that the suite completes in the time of its slowest group, falls
+ *  back to test_run() when num_groups is less than 2 or greater than
+ *  TEST_MAX_NUM_GROUPS
+ *
+ *  @param[in] test Pointer to an array of test structures
+ *  @param[in] num_tests Number of test structures in the array
+ *  @param[in] num_groups Number of groups to run concurrently
+ *
+ *  @returns Number of tests that passed
+ */
+unsigned test_run_groups(test_t *test, unsigned num_tests, unsigned num_groups);
+
 #endif
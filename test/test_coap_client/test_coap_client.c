@@ -36,6 +36,7 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <sys/select.h>
 #include "coap_client.h"
 #include "coap_log.h"
 #include "test.h"
@@ -538,6 +539,321 @@ test_coap_client_data_t test7_data =
     .num_msg = TEST7_NUM_MSG
 };
 
+#define TEST8_NUM_MSG      1
+#define TEST8_REQ_OP1_LEN  7
+#define TEST8_NUM_OPS      1
+
+char test8_req_op1_val[TEST8_REQ_OP1_LEN + 1] = "observe";
+
+test_coap_client_msg_op_t test8_req_ops[TEST8_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST8_REQ_OP1_LEN,
+        .val = test8_req_op1_val
+    }
+};
+
+test_coap_client_msg_t test8_req[TEST8_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test8_req_ops,
+        .num_ops = TEST8_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0
+    }
+};
+
+test_coap_client_msg_t test8_resp[TEST8_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "Hello Client!",
+        .payload_len = 13
+    }
+};
+
+test_coap_client_data_t test8_data =
+{
+    .desc = "test 8: register as an observer and expect a response containing an observe option",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .test_req = test8_req,
+    .test_resp = test8_resp,
+    .num_msg = TEST8_NUM_MSG
+};
+
+#define TEST9_NUM_MSG      1
+#define TEST9_REQ_OP1_LEN  9
+#define TEST9_NUM_OPS      1
+#define TEST9_BODY_LEN     2500                                                 /**< Body length that requires multiple blocks */
+#define TEST9_BLOCK_SIZE   512                                                  /**< Block size used to transfer the body */
+
+char test9_req_op1_val[TEST9_REQ_OP1_LEN + 1] = "blockwise";
+
+test_coap_client_msg_op_t test9_req_ops[TEST9_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST9_REQ_OP1_LEN,
+        .val = test9_req_op1_val
+    }
+};
+
+test_coap_client_msg_t test9_req[TEST9_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test9_req_ops,
+        .num_ops = TEST9_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0
+    }
+};
+
+test_coap_client_msg_t test9_resp[TEST9_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0
+    }
+};
+
+test_coap_client_data_t test9_data =
+{
+    .desc = "test 9: send and receive a large body using blockwise transfers",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .test_req = test9_req,
+    .test_resp = test9_resp,
+    .num_msg = TEST9_NUM_MSG
+};
+
+#define TEST10_NUM_MSG      1
+#define TEST10_REQ_OP1_LEN  8
+#define TEST10_NUM_OPS      1
+
+char test10_req_op1_val[TEST10_REQ_OP1_LEN + 1] = "resource";
+
+test_coap_client_msg_op_t test10_req_ops[TEST10_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST10_REQ_OP1_LEN,
+        .val = test10_req_op1_val
+    }
+};
+
+test_coap_client_msg_t test10_req[TEST10_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test10_req_ops,
+        .num_ops = TEST10_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0
+    }
+};
+
+test_coap_client_msg_t test10_resp[TEST10_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "Hello Client!",
+        .payload_len = 13
+    }
+};
+
+test_coap_client_data_t test10_data =
+{
+    .desc = "test 10: submit a request and receive the response via an event loop",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .test_req = test10_req,
+    .test_resp = test10_resp,
+    .num_msg = TEST10_NUM_MSG
+};
+
+#define TEST11_NUM_MSG      3
+#define TEST11_REQ_OP1_LEN  8
+#define TEST11_NUM_OPS      1
+
+char test11_req_op1_val[TEST11_REQ_OP1_LEN + 1] = "resource";
+char test11_req_op2_val[TEST11_REQ_OP1_LEN + 1] = SEP_URI_PATH;
+
+test_coap_client_msg_op_t test11_req_ops1[TEST11_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST11_REQ_OP1_LEN,
+        .val = test11_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test11_req_ops2[TEST11_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST11_REQ_OP1_LEN,
+        .val = test11_req_op2_val
+    }
+};
+
+test_coap_client_msg_t test11_req[TEST11_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test11_req_ops1,
+        .num_ops = TEST11_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test11_req_ops2,
+        .num_ops = TEST11_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test11_req_ops1,
+        .num_ops = TEST11_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0
+    }
+};
+
+test_coap_client_msg_t test11_resp[TEST11_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "Hello Client!",
+        .payload_len = 13
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "Hello Client!",
+        .payload_len = 13
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "Hello Client!",
+        .payload_len = 13
+    }
+};
+
+#define TEST12_NUM_MSG  3
+
+test_coap_client_msg_t test12_req[TEST12_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test11_req_ops1,
+        .num_ops = TEST11_NUM_OPS,
+        .payload = "Hello Server!",
+        .payload_len = 13
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test11_req_ops1,
+        .num_ops = TEST11_NUM_OPS,
+        .payload = "Hello Server!",
+        .payload_len = 13
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test11_req_ops1,
+        .num_ops = TEST11_NUM_OPS,
+        .payload = "Hello Server!",
+        .payload_len = 13
+    }
+};
+
+test_coap_client_data_t test12_data =
+{
+    .desc = "test 12: send a batch of non-confirmable requests without waiting for responses",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .test_req = test12_req,
+    .test_resp = NULL,
+    .num_msg = TEST12_NUM_MSG
+};
+
+test_coap_client_data_t test11_data =
+{
+    .desc = "test 11: submit concurrent requests and receive the responses via an event loop",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .test_req = test11_req,
+    .test_resp = test11_resp,
+    .num_msg = TEST11_NUM_MSG
+};
+
 /**
  *  @brief Print a CoAP message
  *
@@ -818,41 +1134,596 @@ static test_result_t test_exchange_func(test_data_t data)
 }
 
 /**
- *  @brief Helper function to list command line options
+ *  @brief Callback function to handle the response to an observe registration
+ *
+ *  Check that the message contains an observe option and
+ *  return a positive value so that the client deregisters
+ *  after the initial representation of the resource.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 1 Stop observing
+ *  @retval <0 Error
  */
-static void usage(void)
+static int test_observe_notify(coap_client_t *client, coap_msg_t *msg)
 {
-    coap_log_error("Usage: test_coap_client <options> test-num");
-    coap_log_error("Options:");
-    coap_log_error("    -l log-level - set the log level (0 to 4)");
+    coap_msg_op_t *op = NULL;
+    int found = 0;
+
+    print_coap_msg("Received:", msg);
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_OBSERVE)
+        {
+            found = 1;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if (!found)
+    {
+        coap_log_error("Expected observe option not found");
+        return -EBADMSG;
+    }
+    return 1;
 }
 
 /**
- *  @brief Main function for the FreeCoAP client test application
+ *  @brief Test an observe registration and deregistration with the server
  *
- *  @param[in] argc Number of command line arguments
- *  @param[in] argv Array of pointers to command line arguments
+ *  @param[in] data Pointer to a client test data structure
  *
- *  @returns Operation status
- *  @retval EXIT_SUCCESS Success
- *  @retval EXIT_FAILURE Error
+ *  @returns Test result
  */
-int main(int argc, char **argv)
+static test_result_t test_observe_func(test_data_t data)
 {
-    const char *opts = ":hl:";
-    unsigned num_tests = 0;
-    unsigned num_pass = 0;
-    int log_level = COAP_LOG_DEBUG;
-    int test_num = 0;
-    int c = 0;
-    test_t tests[] = {{test_exchange_func, &test1_data},
-                      {test_exchange_func, &test2_data},
-                      {test_exchange_func, &test3_data},
-                      {test_exchange_func, &test4_data},
-                      {test_exchange_func, &test5_data},
-                      {test_exchange_func, &test6_data},
-                      {test_exchange_func, &test7_data}};
-
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret != 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return FAIL;
+    }
+
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+
+    result = populate_req(&test_data->test_req[0], &req);
+    if (result != PASS)
+    {
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
+        coap_client_destroy(&client);
+        return result;
+    }
+
+    ret = coap_client_observe(&client, &req, &resp, test_observe_notify);
+    if (ret != 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+
+    result = check_resp(&test_data->test_resp[0], &resp);
+
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    coap_client_destroy(&client);
+
+    return result;
+}
+
+/**
+ *  @brief Test a blockwise exchange with the server
+ *
+ *  Send a body that spans multiple blocks to the echo
+ *  resource on the server and check that the same body
+ *  is assembled from the blocks of the response.
+ *
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_blockwise_func(test_data_t data)
+{
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
+    ssize_t num = 0;
+    char body[2 * TEST9_BODY_LEN] = {0};
+    char check[TEST9_BODY_LEN] = {0};
+    int ret = 0;
+    int i = 0;
+
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret != 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return FAIL;
+    }
+
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+
+    result = populate_req(&test_data->test_req[0], &req);
+    if (result != PASS)
+    {
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
+        coap_client_destroy(&client);
+        return result;
+    }
+
+    for (i = 0; i < TEST9_BODY_LEN; i++)
+    {
+        body[i] = 'a' + (i % 26);
+        check[i] = 'a' + (i % 26);
+    }
+
+    num = coap_client_exchange_blockwise(&client, &req, &resp,
+                                         TEST9_BLOCK_SIZE, TEST9_BLOCK_SIZE,
+                                         body, sizeof(body), TEST9_BODY_LEN);
+    if (num < 0)
+    {
+        coap_log_error("%s", strerror(-num));
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+
+    print_coap_msg("Received:", &resp);
+
+    if (test_data->test_resp[0].type != coap_msg_get_type(&resp))
+    {
+        result = FAIL;
+    }
+    if (test_data->test_resp[0].code_class != coap_msg_get_code_class(&resp))
+    {
+        result = FAIL;
+    }
+    if (test_data->test_resp[0].code_detail != coap_msg_get_code_detail(&resp))
+    {
+        result = FAIL;
+    }
+    if (num != TEST9_BODY_LEN)
+    {
+        coap_log_error("Received response body with unexpected length %zd", num);
+        result = FAIL;
+    }
+    else if (memcmp(body, check, TEST9_BODY_LEN) != 0)
+    {
+        coap_log_error("Received response body with unexpected content");
+        result = FAIL;
+    }
+
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    coap_client_destroy(&client);
+
+    return result;
+}
+
+/**
+ *  @brief Asynchronous exchange result structure
+ */
+typedef struct
+{
+    test_coap_client_msg_t *test_resp;                                          /**< Expected response message */
+    int called;                                                                 /**< Flag to indicate that the call-back function was invoked */
+    int status;                                                                 /**< Status value passed to the call-back function */
+    test_result_t result;                                                       /**< Result of checking the response message */
+}
+test_submit_result_t;
+
+/**
+ *  @brief Callback function to handle the result of an asynchronous exchange
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] resp Pointer to the response message
+ *  @param[in] status Result of the exchange
+ *  @param[in] data Pointer to an asynchronous exchange result structure
+ */
+static void test_submit_done(coap_client_t *client, coap_msg_t *resp, int status, void *data)
+{
+    test_submit_result_t *submit_result = (test_submit_result_t *)data;
+
+    print_coap_msg("Received:", resp);
+    submit_result->called = 1;
+    submit_result->status = status;
+    if (status == 0)
+    {
+        submit_result->result = check_resp(submit_result->test_resp, resp);
+    }
+}
+
+/**
+ *  @brief Test an asynchronous exchange with the server
+ *
+ *  Submit a request, poll the socket and timer descriptors
+ *  in a select loop and drive the exchange to completion
+ *  with coap_client_process, as an event loop would.
+ *
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_submit_func(test_data_t data)
+{
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_submit_result_t submit_result = {0};
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t req = {0};
+    fd_set read_fds = {{0}};
+    int max_fd = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret != 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return FAIL;
+    }
+
+    coap_msg_create(&req);
+
+    result = populate_req(&test_data->test_req[0], &req);
+    if (result != PASS)
+    {
+        coap_msg_destroy(&req);
+        coap_client_destroy(&client);
+        return result;
+    }
+
+    submit_result.test_resp = &test_data->test_resp[0];
+    submit_result.result = FAIL;
+    ret = coap_client_submit(&client, &req, test_submit_done, &submit_result);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_msg_destroy(&req);
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+
+    while (!submit_result.called)
+    {
+        FD_ZERO(&read_fds);
+        FD_SET(client.sd, &read_fds);
+        FD_SET(client.timer_fd, &read_fds);
+        max_fd = client.sd;
+        if (client.timer_fd > max_fd)
+        {
+            max_fd = client.timer_fd;
+        }
+        ret = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(errno));
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        ret = coap_client_process(&client);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+    }
+
+    if (submit_result.status < 0)
+    {
+        coap_log_error("%s", strerror(-submit_result.status));
+        result = FAIL;
+    }
+    else
+    {
+        result = submit_result.result;
+    }
+
+    coap_msg_destroy(&req);
+    coap_client_destroy(&client);
+
+    return result;
+}
+
+/**
+ *  @brief Test concurrent asynchronous exchanges with the server
+ *
+ *  Submit all of the requests up front so that they are in
+ *  flight at the same time over one client, then poll the
+ *  socket and timer descriptors in a select loop and drive
+ *  the exchanges to completion with coap_client_process.
+ *  The client library matches the responses to the requests
+ *  by token.
+ *
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_concur_func(test_data_t data)
+{
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_submit_result_t submit_result[TEST11_NUM_MSG] = {{0}};
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t req[TEST11_NUM_MSG] = {{0}};
+    fd_set read_fds = {{0}};
+    unsigned num_called = 0;
+    unsigned i = 0;
+    int max_fd = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret != 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return FAIL;
+    }
+
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        coap_msg_create(&req[i]);
+    }
+
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        result = populate_req(&test_data->test_req[i], &req[i]);
+        if (result != PASS)
+        {
+            break;
+        }
+        submit_result[i].test_resp = &test_data->test_resp[i];
+        submit_result[i].result = FAIL;
+        ret = coap_client_submit(&client, &req[i], test_submit_done, &submit_result[i]);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            result = FAIL;
+            break;
+        }
+    }
+
+    while ((result == PASS) && (num_called < test_data->num_msg))
+    {
+        FD_ZERO(&read_fds);
+        FD_SET(client.sd, &read_fds);
+        FD_SET(client.timer_fd, &read_fds);
+        max_fd = client.sd;
+        if (client.timer_fd > max_fd)
+        {
+            max_fd = client.timer_fd;
+        }
+        ret = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(errno));
+            result = FAIL;
+            break;
+        }
+        ret = coap_client_process(&client);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            result = FAIL;
+            break;
+        }
+        num_called = 0;
+        for (i = 0; i < test_data->num_msg; i++)
+        {
+            if (submit_result[i].called)
+            {
+                num_called++;
+            }
+        }
+    }
+
+    for (i = 0; (result == PASS) && (i < test_data->num_msg); i++)
+    {
+        if (submit_result[i].status < 0)
+        {
+            coap_log_error("%s", strerror(-submit_result[i].status));
+            result = FAIL;
+        }
+        else if (submit_result[i].result != PASS)
+        {
+            result = submit_result[i].result;
+        }
+    }
+
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        coap_msg_destroy(&req[i]);
+    }
+    coap_client_destroy(&client);
+
+    return result;
+}
+
+/**
+ *  @brief Test a batched non-confirmable send to the server
+ *
+ *  Send a batch of non-confirmable requests with a single
+ *  call and check that all of the messages were accepted.
+ *  No responses are collected.
+ *
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_non_batch_func(test_data_t data)
+{
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t req[TEST12_NUM_MSG] = {{0}};
+    unsigned i = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret != 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return FAIL;
+    }
+
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        coap_msg_create(&req[i]);
+        result = populate_req(&test_data->test_req[i], &req[i]);
+        if (result != PASS)
+        {
+            break;
+        }
+    }
+
+    if (result == PASS)
+    {
+        ret = coap_client_send_non_batch(&client, req, test_data->num_msg);
+        if (ret != (int)test_data->num_msg)
+        {
+            coap_log_error("Expected %u messages to be sent, got %d", test_data->num_msg, ret);
+            result = FAIL;
+        }
+    }
+
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        coap_msg_destroy(&req[i]);
+    }
+    coap_client_destroy(&client);
+
+    return result;
+}
+
+/**
+ *  @brief Helper function to list command line options
+ */
+static void usage(void)
+{
+    coap_log_error("Usage: test_coap_client <options> test-num");
+    coap_log_error("Options:");
+    coap_log_error("    -l log-level - set the log level (0 to 4)");
+}
+
+/**
+ *  @brief Main function for the FreeCoAP client test application
+ *
+ *  @param[in] argc Number of command line arguments
+ *  @param[in] argv Array of pointers to command line arguments
+ *
+ *  @returns Operation status
+ *  @retval EXIT_SUCCESS Success
+ *  @retval EXIT_FAILURE Error
+ */
+int main(int argc, char **argv)
+{
+    const char *opts = ":hl:";
+    unsigned num_tests = 0;
+    unsigned num_pass = 0;
+    int log_level = COAP_LOG_DEBUG;
+    int test_num = 0;
+    int c = 0;
+    test_t tests[] = {{test_exchange_func, &test1_data},
+                      {test_exchange_func, &test2_data},
+                      {test_exchange_func, &test3_data},
+                      {test_exchange_func, &test4_data},
+                      {test_exchange_func, &test5_data},
+                      {test_exchange_func, &test6_data},
+                      {test_exchange_func, &test7_data},
+                      {test_observe_func, &test8_data},
+                      {test_blockwise_func, &test9_data},
+                      {test_submit_func, &test10_data},
+                      {test_concur_func, &test11_data},
+                      {test_non_batch_func, &test12_data}};
+
     opterr = 0;
     while ((c = getopt(argc, argv, opts)) != -1)
     {
@@ -912,8 +1783,28 @@ int main(int argc, char **argv)
         num_tests = 1;
         num_pass = test_run(&tests[6], num_tests);
         break;
+    case 8:
+        num_tests = 1;
+        num_pass = test_run(&tests[7], num_tests);
+        break;
+    case 9:
+        num_tests = 1;
+        num_pass = test_run(&tests[8], num_tests);
+        break;
+    case 10:
+        num_tests = 1;
+        num_pass = test_run(&tests[9], num_tests);
+        break;
+    case 11:
+        num_tests = 1;
+        num_pass = test_run(&tests[10], num_tests);
+        break;
+    case 12:
+        num_tests = 1;
+        num_pass = test_run(&tests[11], num_tests);
+        break;
     default:
-        num_tests = 7;
+        num_tests = 12;
         num_pass = test_run(tests, num_tests);
     }
 
@@ -3446,6 +3446,111 @@ static test_result_t test_parse_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Borrowed parse test function
+ *
+ *  @param[in] data Pointer to a message test structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_parse_borrowed_func(test_data_t data)
+{
+    test_coap_msg_data_t *test_data = (test_coap_msg_data_t *)data;
+    test_result_t result = PASS;
+    coap_msg_op_t *op = NULL;
+    coap_msg_t msg = {0};
+    unsigned i = 0;
+    ssize_t num = 0;
+    char *val = NULL;
+
+    printf("%s\n", test_data->parse_desc);
+
+    coap_msg_create(&msg);
+    num = coap_msg_parse_borrowed(&msg, test_data->buf, test_data->buf_len);
+    if (num != test_data->parse_ret)
+    {
+        result = FAIL;
+    }
+    if (test_data->parse_ret != 0)
+    {
+        coap_msg_destroy(&msg);
+        return result;
+    }
+    print_coap_msg("Parsed message:", &msg);
+    if (!coap_msg_is_borrowed(&msg))
+    {
+        result = FAIL;
+    }
+    op = coap_msg_get_first_op(&msg);
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        if (op == NULL)
+        {
+            result = FAIL;
+            break;
+        }
+        if (coap_msg_op_get_num(op) != test_data->ops[i].num)
+        {
+            result = FAIL;
+        }
+        if (coap_msg_op_get_len(op) != test_data->ops[i].len)
+        {
+            result = FAIL;
+        }
+        if (memcmp(coap_msg_op_get_val(op), test_data->ops[i].val, test_data->ops[i].len) != 0)
+        {
+            result = FAIL;
+        }
+        /* the value must point into the caller-owned buffer */
+        val = coap_msg_op_get_val(op);
+        if ((coap_msg_op_get_len(op) > 0)
+         && ((val < test_data->buf) || (val >= test_data->buf + test_data->buf_len)))
+        {
+            result = FAIL;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if (op != NULL)
+    {
+        result = FAIL;
+    }
+    if (test_data->payload != NULL)
+    {
+        if ((msg.payload == NULL)
+         || (memcmp(msg.payload, test_data->payload, test_data->payload_len) != 0))
+        {
+            result = FAIL;
+        }
+        /* the payload must point into the caller-owned buffer */
+        if ((msg.payload < test_data->buf) || (msg.payload >= test_data->buf + test_data->buf_len))
+        {
+            result = FAIL;
+        }
+    }
+    else
+    {
+        if (msg.payload != NULL)
+        {
+            result = FAIL;
+        }
+    }
+    if (msg.payload_len != test_data->payload_len)
+    {
+        result = FAIL;
+    }
+    /* a borrowed message must reject mutation */
+    if (coap_msg_add_op(&msg, COAP_MSG_URI_PATH, 3, "abc") != -EPERM)
+    {
+        result = FAIL;
+    }
+    if (coap_msg_set_payload(&msg, "abc", 3) != -EPERM)
+    {
+        result = FAIL;
+    }
+    coap_msg_destroy(&msg);
+    return result;
+}
+
 /**
  *  @brief Format test function
  *
@@ -3554,6 +3659,168 @@ static test_result_t test_format_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Streaming parse test function
+ *
+ *  Feeds the message to the resumable parser one byte at
+ *  a time and checks the result against the expected
+ *  message fields.
+ *
+ *  @param[in] data Pointer to a message test structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_parse_stream_func(test_data_t data)
+{
+    test_coap_msg_data_t *test_data = (test_coap_msg_data_t *)data;
+    coap_msg_parser_t parser = {0};
+    test_result_t result = PASS;
+    coap_msg_op_t *op = NULL;
+    coap_msg_t msg = {0};
+    unsigned i = 0;
+    ssize_t num = 0;
+
+    printf("%s\n", test_data->parse_desc);
+
+    coap_msg_create(&msg);
+    coap_msg_parser_create(&parser, &msg, test_data->buf_len);
+    for (i = 0; i < (unsigned)test_data->buf_len; i++)
+    {
+        num = coap_msg_parser_feed(&parser, test_data->buf + i, 1);
+        if (num < 0)
+        {
+            break;
+        }
+    }
+    if (test_data->parse_ret != 0)
+    {
+        /* malformed messages must be rejected */
+        if ((num >= 0) && (coap_msg_parser_is_done(&parser)))
+        {
+            result = FAIL;
+        }
+        coap_msg_destroy(&msg);
+        return result;
+    }
+    if ((num < 0) || (!coap_msg_parser_is_done(&parser)))
+    {
+        coap_msg_destroy(&msg);
+        return FAIL;
+    }
+    print_coap_msg("Parsed message:", &msg);
+    if ((msg.ver != test_data->ver)
+     || (msg.type != test_data->type)
+     || (msg.token_len != test_data->token_len)
+     || (msg.code_class != test_data->code_class)
+     || (msg.code_detail != test_data->code_detail)
+     || (msg.msg_id != test_data->msg_id)
+     || (memcmp(msg.token, test_data->token, test_data->token_len) != 0))
+    {
+        result = FAIL;
+    }
+    op = coap_msg_get_first_op(&msg);
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        if (op == NULL)
+        {
+            result = FAIL;
+            break;
+        }
+        if ((coap_msg_op_get_num(op) != test_data->ops[i].num)
+         || (coap_msg_op_get_len(op) != test_data->ops[i].len)
+         || (memcmp(coap_msg_op_get_val(op), test_data->ops[i].val, test_data->ops[i].len) != 0))
+        {
+            result = FAIL;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if (op != NULL)
+    {
+        result = FAIL;
+    }
+    if (msg.payload_len != test_data->payload_len)
+    {
+        result = FAIL;
+    }
+    if ((test_data->payload != NULL)
+     && ((msg.payload == NULL)
+      || (memcmp(msg.payload, test_data->payload, test_data->payload_len) != 0)))
+    {
+        result = FAIL;
+    }
+    coap_msg_destroy(&msg);
+    return result;
+}
+
+/**
+ *  @brief Vectored format test function
+ *
+ *  @param[in] data Pointer to a message test structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_format_iov_func(test_data_t data)
+{
+    test_coap_msg_data_t *test_data = (test_coap_msg_data_t *)data;
+    test_result_t result = PASS;
+    struct iovec iov[32] = {{0}};
+    coap_msg_t msg = {0};
+    unsigned i = 0;
+    ssize_t num = 0;
+    size_t len = 0;
+    char hdr[128] = {0};
+    char tmp[test_data->buf_len];
+    char *p = tmp;
+
+    printf("%s\n", test_data->format_desc);
+
+    coap_msg_create(&msg);
+    coap_msg_set_type(&msg, test_data->type);
+    coap_msg_set_code(&msg, test_data->code_class, test_data->code_detail);
+    coap_msg_set_msg_id(&msg, test_data->msg_id);
+    if (test_data->token_len > 0)
+    {
+        coap_msg_set_token(&msg, test_data->token, test_data->token_len);
+    }
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        coap_msg_add_op(&msg, test_data->ops[i].num, test_data->ops[i].len, test_data->ops[i].val);
+    }
+    if (test_data->payload_len > 0)
+    {
+        coap_msg_set_payload(&msg, test_data->payload, test_data->payload_len);
+    }
+    num = coap_msg_format_iov(&msg, iov, DIM(iov), hdr, sizeof(hdr));
+    if (num <= 0)
+    {
+        coap_msg_destroy(&msg);
+        return FAIL;
+    }
+    /* gather the iovec array and compare with the flat format */
+    for (i = 0; i < (unsigned)num; i++)
+    {
+        len += iov[i].iov_len;
+    }
+    if (len != (size_t)test_data->buf_len)
+    {
+        result = FAIL;
+    }
+    else
+    {
+        for (i = 0; i < (unsigned)num; i++)
+        {
+            memcpy(p, iov[i].iov_base, iov[i].iov_len);
+            p += iov[i].iov_len;
+        }
+        if (memcmp(tmp, test_data->buf, test_data->buf_len) != 0)
+        {
+            result = FAIL;
+        }
+    }
+    coap_msg_destroy(&msg);
+    return result;
+}
+
 /**
  *  @brief Parse type and message ID test function
  *
@@ -3809,6 +4076,53 @@ static test_result_t test_check_unsafe_ops_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Memory accounting test function
+ *
+ *  Charge a message's allocations to an accounting structure
+ *  and check that the byte counters are maintained and that
+ *  an allocation that would exceed the budget fails gracefully.
+ *
+ *  @param[in] data Unused
+ *
+ *  @returns Test result
+ */
+static test_result_t test_mem_acct_func(test_data_t data)
+{
+    coap_mem_acct_t acct = {0};
+    test_result_t result = PASS;
+    coap_msg_t msg = {0};
+    char val[2 * COAP_MSG_OP_INLINE_VAL_LEN] = {0};
+    int ret = 0;
+
+    printf("Charge message allocations to an accounting structure\n");
+
+    coap_msg_create(&msg);
+    coap_mem_acct_init(&acct, 1);
+    coap_msg_set_mem_acct(&msg, &acct);
+    ret = coap_msg_add_op(&msg, COAP_MSG_URI_PATH, sizeof(val), val);
+    if ((ret != -ENOMEM)
+     || (coap_mem_get_fails(&acct) != 1)
+     || (coap_mem_get_cur(&acct) != 0))
+    {
+        result = FAIL;
+    }
+    acct.budget = 0;
+    ret = coap_msg_add_op(&msg, COAP_MSG_URI_PATH, sizeof(val), val);
+    if ((ret != 0)
+     || (coap_mem_get_cur(&acct) == 0)
+     || (coap_mem_get_peak(&acct) < coap_mem_get_cur(&acct)))
+    {
+        result = FAIL;
+    }
+    coap_msg_destroy(&msg);
+    if (coap_mem_get_cur(&acct) != 0)
+    {
+        result = FAIL;
+    }
+    return result;
+}
+
 /**
  *  @brief Main function for the FreeCoAP message parser/formatter unit tests
  *
@@ -3905,12 +4219,28 @@ int main(void)
                       {test_check_unsafe_ops_func,   &test47_data},
                       {test_check_unsafe_ops_func,   &test48_data},
                       {test_check_unsafe_ops_func,   &test49_data},
-                      {test_format_func,             &test50_data}};
+                      {test_format_func,             &test50_data},
+                      {test_parse_borrowed_func,     &test1_data},
+                      {test_parse_borrowed_func,     &test2_data},
+                      {test_parse_borrowed_func,     &test3_data},
+                      {test_parse_borrowed_func,     &test4_data},
+                      {test_format_iov_func,         &test1_data},
+                      {test_format_iov_func,         &test2_data},
+                      {test_format_iov_func,         &test3_data},
+                      {test_format_iov_func,         &test4_data},
+                      {test_parse_stream_func,       &test1_data},
+                      {test_parse_stream_func,       &test2_data},
+                      {test_parse_stream_func,       &test3_data},
+                      {test_parse_stream_func,       &test4_data},
+                      {test_parse_stream_func,       &test9_data},
+                      {test_parse_stream_func,       &test11_data},
+                      {test_parse_stream_func,       &test12_data},
+                      {test_mem_acct_func,           NULL}};
     unsigned num_tests = DIM(tests);
     unsigned num_pass = 0;
 
     coap_log_set_level(COAP_LOG_ERROR);
-    num_pass = test_run(tests, num_tests);
+    num_pass = test_run_groups(tests, num_tests, 4);
 
     return num_pass == num_tests ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -44,7 +44,10 @@
 #define CERT_FILE_NAME       "../../certs/server_cert.pem"                      /**< DTLS certificate file name */
 #define TRUST_FILE_NAME      "../../certs/root_client_cert.pem"                 /**< DTLS trust file name */
 #define CRL_FILE_NAME        ""                                                 /**< DTLS certificate revocation list file name */
+#define DH_FILE_NAME         "../../certs/dh_params.pem"                        /**< DTLS Diffie-Hellman parameters file name */
 #define SEP_URI_PATH         "/separate"                                        /**< URI path that requires a separate response */
+#define OBS_URI_PATH         "/observe"                                         /**< URI path of a resource that can be observed */
+#define BLOCK_URI_PATH       "/blockwise"                                       /**< URI path of a resource accessed with blockwise transfers */
 #define UNSAFE_URI_PATH      "unsafe"                                           /**< URI path that causes the server to include an unsafe option in the response */
 #define UNSAFE_URI_PATH_LEN  6                                                  /**< Length of the URI path that causes the server to include an unsafe option in the response */
 
@@ -171,6 +174,7 @@ int server_handle_unsafe(coap_msg_t *req, coap_msg_t *resp)
  */
 int server_handle(coap_server_t *server, coap_msg_t *req, coap_msg_t *resp)
 {
+    coap_server_stats_t stats = {0};
     char *payload = "Hello Client!";
     int ret = 0;
 
@@ -192,11 +196,50 @@ int server_handle(coap_server_t *server, coap_msg_t *req, coap_msg_t *resp)
         coap_log_error("%s", strerror(-ret));
         return ret;
     }
+    coap_server_get_stats(server, &stats);
+    coap_log_debug("Served %llu requests from %llu received datagrams with %u of %u transactions active",
+                   stats.num_reqs, stats.rx_dgrams, stats.num_trans, stats.max_trans);
     print_coap_msg("Received:", req);
     print_coap_msg("Sent: (Note: the type, message ID and token fields have not been set by the server library yet)", resp);
     return 0;
 }
 
+/**
+ *  @brief Callback function to handle requests for the blockwise resource
+ *
+ *  Echo the body of the request message in the response
+ *  message so that the test client can verify a blockwise
+ *  round trip. The server library assembles the request
+ *  body and slices the response body as required.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int server_handle_blockwise(coap_server_t *server, coap_msg_t *req, coap_msg_t *resp)
+{
+    int ret = 0;
+
+    ret = coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CHANGED);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    ret = coap_msg_set_payload(resp, coap_msg_get_payload(req), coap_msg_get_payload_len(req));
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    coap_log_info("Echoing %zu byte request body", coap_msg_get_payload_len(req));
+    return 0;
+}
+
 /**
  *  @brief Main function for the CoAP server test application
  *
@@ -212,6 +255,12 @@ int main()
     coap_log_set_level(COAP_LOG_DEBUG);
 
 #ifdef COAP_DTLS_EN
+    ret = coap_server_load_dh_params(DH_FILE_NAME);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return EXIT_FAILURE;
+    }
     ret = coap_server_create(&server, server_handle, HOST, PORT, KEY_FILE_NAME, CERT_FILE_NAME, TRUST_FILE_NAME, CRL_FILE_NAME);
 #else
     ret = coap_server_create(&server, server_handle, HOST, PORT);
@@ -228,6 +277,27 @@ int main()
         coap_server_destroy(&server);
         return EXIT_FAILURE;
     }
+    ret = coap_server_add_resource(&server, SEP_URI_PATH, server_handle, COAP_SERVER_SEPARATE);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_server_destroy(&server);
+        return EXIT_FAILURE;
+    }
+    ret = coap_server_add_resource(&server, OBS_URI_PATH, server_handle, COAP_SERVER_PIGGYBACKED);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_server_destroy(&server);
+        return EXIT_FAILURE;
+    }
+    ret = coap_server_add_resource(&server, BLOCK_URI_PATH, server_handle_blockwise, COAP_SERVER_PIGGYBACKED);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_server_destroy(&server);
+        return EXIT_FAILURE;
+    }
     ret = coap_server_run(&server);
     if (ret < 0)
     {
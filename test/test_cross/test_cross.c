@@ -789,7 +789,7 @@ int main(void)
     unsigned num_pass = 0;
 
     coap_log_set_level(COAP_LOG_ERROR);
-    num_pass = test_run(tests, num_tests);
+    num_pass = test_run_groups(tests, num_tests, 4);
 
     return num_pass == num_tests ? EXIT_SUCCESS : EXIT_FAILURE;
 }
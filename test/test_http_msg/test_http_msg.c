@@ -1074,6 +1074,37 @@ test_http_msg_data_t test37_data =
     .exp_str_len = 1
 };
 
+#define TEST38_NUM_HEADERS  1
+
+const char *test38_name[TEST38_NUM_HEADERS] = {"Content-Length"};
+const char *test38_value[TEST38_NUM_HEADERS] = {"13"};
+const char *test38_exp_value[TEST38_NUM_HEADERS] = {"40"};
+
+test_http_msg_data_t test38_data =
+{
+    .desc = "test 38 : set header, replace header value, check header value",
+    .str = NULL,
+    .str_len = 0,
+    .parse_buf_len = 0,
+    .generate_buf_len = 0,
+    .num_headers = TEST38_NUM_HEADERS,
+    .set_start = NULL,
+    .set_name = test38_name,
+    .set_value = test38_value,
+    .set_body = NULL,
+    .exp_set_start_ret = 0,
+    .exp_set_header_ret = 0,
+    .exp_set_body_ret = 0,
+    .exp_parse_ret = 0,
+    .exp_generate_ret = 0,
+    .exp_start = NULL,
+    .exp_name = test38_name,
+    .exp_value = test38_exp_value,
+    .exp_body = NULL,
+    .exp_str = NULL,
+    .exp_str_len = 0
+};
+
 /**
  *  @brief Check the start fields in a HTTP message
  *
@@ -1654,6 +1685,60 @@ test_result_t test_gen_blank_line_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Set a header in a HTTP message, replace its value and check the result
+ *
+ *  @param[in] data Pointer to a HTTP message test data structure
+ *
+ *  @returns Test result
+ */
+test_result_t test_set_header_value_func(test_data_t data)
+{
+    test_http_msg_data_t *test_data = (test_http_msg_data_t *)data;
+    test_result_t result = PASS;
+    http_msg_header_t *header = NULL;
+    http_msg_t msg = {{0}};
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+    http_msg_create(&msg);
+
+    /* set header */
+    ret = http_msg_set_header(&msg, test_data->set_name[0], test_data->set_value[0]);
+    if (ret != test_data->exp_set_header_ret)
+    {
+        http_msg_destroy(&msg);
+        return FAIL;
+    }
+
+    /* replace header value */
+    header = http_msg_get_header(&msg, test_data->set_name[0]);
+    if (header == NULL)
+    {
+        http_msg_destroy(&msg);
+        return FAIL;
+    }
+    ret = http_msg_header_set_value(&msg, header, test_data->exp_value[0]);
+    if (ret != 0)
+    {
+        http_msg_destroy(&msg);
+        return FAIL;
+    }
+
+    /* check header value */
+    header = http_msg_get_header(&msg, test_data->exp_name[0]);
+    if ((header == NULL)
+     || (strcmp(http_msg_header_get_value(header), test_data->exp_value[0]) != 0))
+    {
+        result = FAIL;
+    }
+
+    http_msg_destroy(&msg);
+
+    return result;
+}
+
 /**
  *  @brief Main function for the FreeCoAP HTTP message parser/formatter unit tests
  *
@@ -1699,11 +1784,12 @@ int main()
                       {test_gen_trailer_func, &test34_data},
                       {test_gen_trailer_func, &test35_data},
                       {test_gen_blank_line_func, &test36_data},
-                      {test_gen_blank_line_func, &test37_data}};
+                      {test_gen_blank_line_func, &test37_data},
+                      {test_set_header_value_func, &test38_data}};
     unsigned num_tests = DIM(tests);
     unsigned num_pass = 0;
 
-    num_pass = test_run(tests, num_tests);
+    num_pass = test_run_groups(tests, num_tests, 4);
 
     return num_pass == num_tests ? EXIT_SUCCESS : EXIT_FAILURE;
 }
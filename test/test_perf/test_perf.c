@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file test_perf.c
+ *
+ *  @brief Source file for the FreeCoAP performance regression test application
+ *
+ *  Measures requests/sec, latency percentiles and peak RSS for a DTLS
+ *  exchange with the CoAP server and for a full HTTP/TLS exchange
+ *  through the proxy, both over loopback. The results are written to
+ *  a machine-readable file and compared against checked-in baselines;
+ *  a metric that regresses by more than the failure threshold fails
+ *  the run. The test CoAP server and the proxy must be running, see
+ *  test_coap_server and test_proxy_http_coap.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "coap_client.h"
+#include "coap_msg.h"
+#include "http_msg.h"
+#include "tls_sock.h"
+#include "tls.h"
+#include "sock.h"
+#include "coap_log.h"
+
+#define SERVER_COMMON_NAME     "dummy/server"                                   /**< Expected common name in the proxy's certificate */
+#define COAP_HOST              "::1"                                            /**< Host address of the CoAP server */
+#define COAP_PORT              "12436"                                          /**< UDP port number of the CoAP server */
+#ifdef SOCK_IP6
+#define PROXY_HOST             "::1"                                            /**< Host address of the proxy */
+#else
+#define PROXY_HOST             "127.0.0.1"                                      /**< Host address of the proxy */
+#endif
+#define PROXY_PORT             "12437"                                          /**< TCP port number of the proxy */
+#define TRUST_FILE_NAME        "../../certs/root_server_cert.pem"               /**< TLS trust file name */
+#define CERT_FILE_NAME         "../../certs/client_cert.pem"                    /**< TLS certificate file name */
+#define KEY_FILE_NAME          "../../certs/client_privkey.pem"                 /**< TLS key file name */
+#define CRL_FILE_NAME          ""                                               /**< TLS certificate revocation list file name */
+#define SOCKET_TIMEOUT         120                                              /**< Timeout for TLS/IPv6 socket operations */
+#define RESP_BUF_LEN           1024                                             /**< Size of the buffer used to store responses */
+#define RESULTS_FILE_NAME      "perf_results.txt"                               /**< File that the measured results are written to */
+#define BASELINE_FILE_NAME     "perf_baseline.txt"                              /**< File containing the checked-in baseline results */
+#define PERF_DEF_NUM_ITER      500                                              /**< Default number of timed iterations per scenario */
+#define PERF_MAX_NUM_ITER      100000                                           /**< Maximum number of timed iterations per scenario */
+#define PERF_NUM_WARMUP        8                                                /**< Number of untimed iterations per scenario */
+#define PERF_FAIL_THRESHOLD    0.5                                              /**< Maximum tolerated relative regression per metric */
+#define PERF_MAX_LINE_LEN      128                                              /**< Maximum length of a line in a results file */
+#define PERF_REQ_STR           "GET coaps://[::1]:12436/resource HTTP/1.1\r\nContent-Length: 13\r\n\r\nHello Server!"  /**< HTTP request sent to the proxy */
+
+/**
+ *  @brief Performance scenario result structure
+ */
+typedef struct
+{
+    const char *name;                                                           /**< Scenario name used as the metric key prefix */
+    double req_per_sec;                                                         /**< Completed requests per second */
+    unsigned long p50_usec;                                                     /**< Median request latency */
+    unsigned long p95_usec;                                                     /**< 95th percentile request latency */
+    unsigned long p99_usec;                                                     /**< 99th percentile request latency */
+}
+perf_result_t;
+
+static unsigned long *perf_sample = NULL;                                       /**< Array of per-request latency samples */
+static unsigned perf_num_iter = PERF_DEF_NUM_ITER;                              /**< Number of timed iterations per scenario */
+
+static unsigned long perf_elapsed_usec(struct timespec *start)
+{
+    struct timespec end = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000
+         + (end.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static int perf_compare_sample(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *)a;
+    unsigned long y = *(const unsigned long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*  reduce the recorded samples to requests/sec and latency
+ *  percentiles
+ */
+static void perf_reduce(perf_result_t *result, unsigned num_samples)
+{
+    unsigned long total = 0;
+    unsigned i = 0;
+
+    for (i = 0; i < num_samples; i++)
+    {
+        total += perf_sample[i];
+    }
+    qsort(perf_sample, num_samples, sizeof(perf_sample[0]), perf_compare_sample);
+    result->req_per_sec = (total > 0) ? (num_samples * 1000000.0) / total : 0.0;
+    result->p50_usec = perf_sample[(50 * (num_samples - 1)) / 100];
+    result->p95_usec = perf_sample[(95 * (num_samples - 1)) / 100];
+    result->p99_usec = perf_sample[(99 * (num_samples - 1)) / 100];
+}
+
+/**
+ *  @brief Measure DTLS exchanges directly with the CoAP server
+ *
+ *  @param[out] result Pointer to a performance scenario result structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Error
+ */
+static int perf_coap_dtls(perf_result_t *result)
+{
+    struct timespec start = {0};
+    coap_client_t client = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
+    unsigned i = 0;
+    int ret = 0;
+
+    result->name = "coap_dtls";
+
+    ret = coap_client_create(&client,
+                             COAP_HOST,
+                             COAP_PORT,
+                             KEY_FILE_NAME,
+                             CERT_FILE_NAME,
+                             TRUST_FILE_NAME,
+                             CRL_FILE_NAME);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return -1;
+    }
+    for (i = 0; i < PERF_NUM_WARMUP + perf_num_iter; i++)
+    {
+        coap_msg_create(&req);
+        coap_msg_create(&resp);
+        if ((coap_msg_set_type(&req, COAP_MSG_CON) < 0)
+         || (coap_msg_set_code(&req, COAP_MSG_REQ, COAP_MSG_GET) < 0)
+         || (coap_msg_add_op(&req, COAP_MSG_URI_PATH, 8, "resource") < 0))
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ret = coap_client_exchange(&client, &req, &resp);
+        if (i >= PERF_NUM_WARMUP)
+        {
+            perf_sample[i - PERF_NUM_WARMUP] = perf_elapsed_usec(&start);
+        }
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            coap_client_destroy(&client);
+            return -1;
+        }
+    }
+    coap_client_destroy(&client);
+    perf_reduce(result, perf_num_iter);
+    return 0;
+}
+
+/**
+ *  @brief Measure HTTP/TLS exchanges through the proxy to the CoAP server
+ *
+ *  @param[out] result Pointer to a performance scenario result structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Error
+ */
+static int perf_proxy_tls(perf_result_t *result)
+{
+    struct timespec start = {0};
+    tls_client_t client = {0};
+    tls_sock_t s = {0};
+    unsigned i = 0;
+    char resp_buf[RESP_BUF_LEN] = {0};
+    int ret = 0;
+
+    result->name = "proxy_tls";
+
+    ret = tls_client_create(&client, TRUST_FILE_NAME, CERT_FILE_NAME, KEY_FILE_NAME);
+    if (ret != SOCK_OK)
+    {
+        coap_log_error("%s", sock_strerror(ret));
+        return -1;
+    }
+    ret = tls_sock_open(&s, &client, PROXY_HOST, PROXY_PORT, SERVER_COMMON_NAME, SOCKET_TIMEOUT);
+    if (ret != SOCK_OK)
+    {
+        coap_log_error("%s", sock_strerror(ret));
+        tls_client_destroy(&client);
+        return -1;
+    }
+    /* all exchanges reuse one persistent connection so that the */
+    /* request/response path is measured, not the TLS handshake */
+    for (i = 0; i < PERF_NUM_WARMUP + perf_num_iter; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ret = tls_sock_write_full(&s, PERF_REQ_STR, strlen(PERF_REQ_STR));
+        if (ret <= 0)
+        {
+            tls_sock_close(&s);
+            tls_client_destroy(&client);
+            return -1;
+        }
+        memset(resp_buf, 0, sizeof(resp_buf));
+        ret = tls_sock_read(&s, resp_buf, sizeof(resp_buf));
+        if (ret <= 0)
+        {
+            tls_sock_close(&s);
+            tls_client_destroy(&client);
+            return -1;
+        }
+        if (i >= PERF_NUM_WARMUP)
+        {
+            perf_sample[i - PERF_NUM_WARMUP] = perf_elapsed_usec(&start);
+        }
+        if (strncmp(resp_buf, "HTTP/1.1 200", 12) != 0)
+        {
+            coap_log_error("Unexpected response: %s", resp_buf);
+            tls_sock_close(&s);
+            tls_client_destroy(&client);
+            return -1;
+        }
+    }
+    tls_sock_close(&s);
+    tls_client_destroy(&client);
+    perf_reduce(result, perf_num_iter);
+    return 0;
+}
+
+/*  peak resident set size of this process in kbyte */
+static unsigned long perf_peak_rss(void)
+{
+    struct rusage usage = {{0}};
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void perf_print_result(FILE *file, perf_result_t *result)
+{
+    fprintf(file, "%s.req_per_sec=%.1f\n", result->name, result->req_per_sec);
+    fprintf(file, "%s.p50_usec=%lu\n", result->name, result->p50_usec);
+    fprintf(file, "%s.p95_usec=%lu\n", result->name, result->p95_usec);
+    fprintf(file, "%s.p99_usec=%lu\n", result->name, result->p99_usec);
+}
+
+/**
+ *  @brief Write the measured results to a machine-readable file
+ *
+ *  @param[in] file_name String containing the file name
+ *  @param[in] result Array of performance scenario result structures
+ *  @param[in] num_results Number of performance scenario result structures in the array
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Error
+ */
+static int perf_write_results(const char *file_name, perf_result_t *result, unsigned num_results)
+{
+    unsigned i = 0;
+    FILE *file = NULL;
+
+    file = fopen(file_name, "w");
+    if (file == NULL)
+    {
+        coap_log_error("Unable to write results file: '%s'", file_name);
+        return -1;
+    }
+    for (i = 0; i < num_results; i++)
+    {
+        perf_print_result(file, &result[i]);
+    }
+    fprintf(file, "peak_rss_kbyte=%lu\n", perf_peak_rss());
+    fclose(file);
+    coap_log_notice("Wrote results file: '%s'", file_name);
+    return 0;
+}
+
+/*  look up a metric in a results file
+ *  returns: {0, metric found, *val updated
+ *           {-1, metric not found
+ */
+static int perf_lookup(const char *file_name, const char *key, double *val)
+{
+    size_t key_len = 0;
+    char line[PERF_MAX_LINE_LEN] = {0};
+    FILE *file = NULL;
+
+    file = fopen(file_name, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    key_len = strlen(key);
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if ((strncmp(line, key, key_len) == 0) && (line[key_len] == '='))
+        {
+            *val = strtod(line + key_len + 1, NULL);
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    return -1;
+}
+
+/*  compare a measured metric against its baseline
+ *  higher_is_better selects the direction in which a change is a
+ *  regression, a metric missing from the baseline file is reported
+ *  and skipped so that new metrics do not fail the run
+ *  returns: {0, within the failure threshold
+ *           {-1, regressed by more than the failure threshold
+ */
+static int perf_check_metric(const char *key, double measured, int higher_is_better)
+{
+    double baseline = 0.0;
+    double limit = 0.0;
+    int ret = 0;
+
+    ret = perf_lookup(BASELINE_FILE_NAME, key, &baseline);
+    if ((ret < 0) || (baseline <= 0.0))
+    {
+        coap_log_notice("%s=%.1f (no baseline)", key, measured);
+        return 0;
+    }
+    if (higher_is_better)
+    {
+        limit = baseline * (1.0 - PERF_FAIL_THRESHOLD);
+        if (measured < limit)
+        {
+            coap_log_error("%s=%.1f regressed below limit %.1f (baseline %.1f)", key, measured, limit, baseline);
+            return -1;
+        }
+    }
+    else
+    {
+        limit = baseline * (1.0 + PERF_FAIL_THRESHOLD);
+        if (measured > limit)
+        {
+            coap_log_error("%s=%.1f regressed above limit %.1f (baseline %.1f)", key, measured, limit, baseline);
+            return -1;
+        }
+    }
+    coap_log_notice("%s=%.1f within limit %.1f (baseline %.1f)", key, measured, limit, baseline);
+    return 0;
+}
+
+/**
+ *  @brief Compare the measured results against the checked-in baselines
+ *
+ *  @param[in] result Array of performance scenario result structures
+ *  @param[in] num_results Number of performance scenario result structures in the array
+ *
+ *  @returns Operation status
+ *  @retval 0 All metrics within the failure threshold
+ *  @retval -1 At least one metric regressed
+ */
+static int perf_check_results(perf_result_t *result, unsigned num_results)
+{
+    unsigned i = 0;
+    char key[PERF_MAX_LINE_LEN] = {0};
+    int status = 0;
+
+    for (i = 0; i < num_results; i++)
+    {
+        snprintf(key, sizeof(key), "%s.req_per_sec", result[i].name);
+        status |= perf_check_metric(key, result[i].req_per_sec, 1);
+        snprintf(key, sizeof(key), "%s.p50_usec", result[i].name);
+        status |= perf_check_metric(key, result[i].p50_usec, 0);
+        snprintf(key, sizeof(key), "%s.p95_usec", result[i].name);
+        status |= perf_check_metric(key, result[i].p95_usec, 0);
+        snprintf(key, sizeof(key), "%s.p99_usec", result[i].name);
+        status |= perf_check_metric(key, result[i].p99_usec, 0);
+    }
+    status |= perf_check_metric("peak_rss_kbyte", perf_peak_rss(), 0);
+    return status;
+}
+
+/**
+ *  @brief Helper function to list command line options
+ */
+static void usage(void)
+{
+    coap_log_error("Usage: test_perf <options>");
+    coap_log_error("Options:");
+    coap_log_error("    -l log-level - set the log level (0 to 4)");
+    coap_log_error("    -n num-iter - set the number of timed iterations per scenario");
+    coap_log_error("    -u - update the baseline file with the measured results");
+}
+
+/**
+ *  @brief Main function for the FreeCoAP performance regression test application
+ *
+ *  @param[in] argc Number of command line arguments
+ *  @param[in] argv Array of pointers to command line arguments
+ *
+ *  @returns Operation status
+ *  @retval EXIT_SUCCESS Success
+ *  @retval EXIT_FAILURE Error
+ */
+int main(int argc, char **argv)
+{
+    perf_result_t results[2] = {{0}};
+    const char *opts = ":hl:n:u";
+    unsigned num_iter = 0;
+    int update_baseline = 0;
+    int log_level = COAP_LOG_NOTICE;
+    int status = 0;
+    int ret = 0;
+    int c = 0;
+
+    opterr = 0;
+    while ((c = getopt(argc, argv, opts)) != -1)
+    {
+        switch (c)
+        {
+        case 'h':
+            usage();
+            return EXIT_SUCCESS;
+        case 'l':
+            log_level = atoi(optarg);
+            break;
+        case 'n':
+            num_iter = atoi(optarg);
+            if ((num_iter > 0) && (num_iter <= PERF_MAX_NUM_ITER))
+            {
+                perf_num_iter = num_iter;
+            }
+            break;
+        case 'u':
+            update_baseline = 1;
+            break;
+        case ':':
+            coap_log_error("Option '%c' requires an argument", optopt);
+            return EXIT_FAILURE;
+        case '?':
+            coap_log_error("Unknown option '%c'", optopt);
+            return EXIT_FAILURE;
+        default:
+            usage();
+        }
+    }
+
+    coap_log_set_level(log_level);
+
+    perf_sample = (unsigned long *)calloc(perf_num_iter, sizeof(unsigned long));
+    if (perf_sample == NULL)
+    {
+        coap_log_error("Out of memory");
+        return EXIT_FAILURE;
+    }
+
+    ret = tls_init();
+    if (ret != SOCK_OK)
+    {
+        coap_log_error("%s", sock_strerror(ret));
+        free(perf_sample);
+        return EXIT_FAILURE;
+    }
+
+    coap_log_notice("Running %u iterations per scenario", perf_num_iter);
+
+    if ((perf_coap_dtls(&results[0]) < 0)
+     || (perf_proxy_tls(&results[1]) < 0))
+    {
+        coap_log_error("Unable to complete the performance scenarios");
+        tls_deinit();
+        free(perf_sample);
+        return EXIT_FAILURE;
+    }
+
+    perf_print_result(stdout, &results[0]);
+    perf_print_result(stdout, &results[1]);
+    printf("peak_rss_kbyte=%lu\n", perf_peak_rss());
+
+    status = perf_write_results(RESULTS_FILE_NAME, results, 2);
+    if (status == 0)
+    {
+        if (update_baseline)
+        {
+            status = perf_write_results(BASELINE_FILE_NAME, results, 2);
+        }
+        else
+        {
+            status = perf_check_results(results, 2);
+        }
+    }
+
+    tls_deinit();
+    free(perf_sample);
+
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
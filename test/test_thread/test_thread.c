@@ -205,10 +205,65 @@ test_result_t test2_func(test_data_t data)
     return PASS;
 }
 
+test_thread_data_t test3_data =
+{
+    .desc = "test 3: thread pool",
+    .val = 100,
+    .thread1_result = 5050,  /* sum of 1..100 */
+    .thread2_result = 0
+};
+
+pthread_mutex_t test3_mutex = PTHREAD_MUTEX_INITIALIZER;
+unsigned long test3_sum = 0;
+
+void *test3_work_func(void *data)
+{
+    unsigned long x = (unsigned long)data;
+
+    pthread_mutex_lock(&test3_mutex);
+    test3_sum += x;
+    pthread_mutex_unlock(&test3_mutex);
+    return NULL;
+}
+
+test_result_t test3_func(test_data_t data)
+{
+    test_thread_data_t *test_data = (test_thread_data_t *)data;
+    thread_pool_t pool = {0};
+    unsigned long i = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+    test3_sum = 0;
+    ret = thread_pool_create(&pool, 4, 8, test3_work_func);
+    if (ret != 0)
+    {
+        return FAIL;
+    }
+    for (i = 1; i <= test_data->val; i++)
+    {
+        ret = thread_pool_dispatch(&pool, (void *)i);
+        if (ret != 0)
+        {
+            thread_pool_destroy(&pool);
+            return FAIL;
+        }
+    }
+    /* destroying the pool drains the queue and joins the workers */
+    thread_pool_destroy(&pool);
+    if (test3_sum != test_data->thread1_result)
+    {
+        return FAIL;
+    }
+    return PASS;
+}
+
 int main()
 {
     test_t tests[] = {{test1_func, &test1_data},
-                      {test2_func, &test2_data}};
+                      {test2_func, &test2_data},
+                      {test3_func, &test3_data}};
     unsigned num_tests = DIM(tests);
     unsigned num_pass = 0;
 
@@ -1721,6 +1721,42 @@ test_result_t test_parse_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Parse a URI into a view, materialize it and check the fields in the resulting URI structure
+ *
+ *  @param[in] test_data Pointer to a URI test data structure
+ *
+ *  @returns Test result
+ */
+test_result_t test_parse_view_func(test_data_t data)
+{
+    test_uri_data_t *test_data = (test_uri_data_t *)data;
+    test_result_t result = PASS;
+    uri_view_t view = {0};
+    uri_t uri = {0};
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+    DEBUG_PRINT("URI: '%s'\n", test_data->uri);
+
+    ret = uri_parse_view(&view, test_data->uri);
+    if (ret != 0)
+    {
+        result = FAIL;
+    }
+    uri_create(&uri);
+    ret = uri_view_materialize(&uri, &view);
+    if (ret != 0)
+    {
+        result = FAIL;
+    }
+    print_uri(&uri);
+    test_uri_struct(&result, &uri, test_data);
+    uri_destroy(&uri);
+    return result;
+}
+
 /**
  *  @brief Set the fields in a URI structure and generate the URI
  *
@@ -1851,11 +1887,16 @@ int main()
                       {test_parse_func, &test46_data},
                       {test_parse_func, &test47_data},
                       {test_set_gen_func, &test48_data},
-                      {test_set_gen_func, &test49_data}};
+                      {test_set_gen_func, &test49_data},
+                      {test_parse_view_func, &test1_data},
+                      {test_parse_view_func, &test2_data},
+                      {test_parse_view_func, &test3_data},
+                      {test_parse_view_func, &test46_data},
+                      {test_parse_view_func, &test47_data}};
     unsigned num_tests = DIM(tests);
     unsigned num_pass = 0;
 
-    num_pass = test_run(tests, num_tests);
+    num_pass = test_run_groups(tests, num_tests, 4);
 
     return num_pass == num_tests ? EXIT_SUCCESS : EXIT_FAILURE;
 }